@@ -0,0 +1,74 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2012 Kolja Glogowski
+#
+# Permission is hereby granted, free of charge, to any person
+# obtaining a copy of this software and associated documentation
+# files (the "Software"), to deal in the Software without
+# restriction, including without limitation the rights to use,
+# copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following
+# conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+# OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+# HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+# WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+# OTHER DEALINGS IN THE SOFTWARE.
+
+import sys, struct
+
+header_fmt = '<8sII'
+record_fmt = '<IIiIqqqq'
+record_fmt_v1 = '<IIiIqqq'
+magic = b'SJCFINFO'
+
+def read_frameinfo(f):
+    """Yields (id, count, status, timestamp, readoutTimestamp,
+    readoutTimeMs, exposureUtcUsecs) tuples from a binary frame info log
+    file. Version 1 files have no exposure time, it is returned as 0."""
+    header = f.read(struct.calcsize(header_fmt))
+    if len(header) != struct.calcsize(header_fmt):
+        raise ValueError('File too short')
+    fmagic, version, recsize = struct.unpack(header_fmt, header)
+    if fmagic != magic:
+        raise ValueError('Not a frame info log file')
+    fmt = {1: record_fmt_v1, 2: record_fmt}.get(version)
+    if fmt is None or recsize < struct.calcsize(fmt):
+        raise ValueError('Unsupported file version')
+    n = struct.calcsize(fmt)
+    while True:
+        rec = f.read(recsize)
+        if len(rec) < recsize:
+            break
+        values = struct.unpack(fmt, rec[:n])
+        fid, count, status, _, ts, rts, rtms = values[:7]
+        utc = values[7] if len(values) > 7 else 0
+        yield fid, count, status, ts, rts, rtms, utc
+
+if __name__ == '__main__':
+    from optparse import OptionParser
+
+    parser = OptionParser(
+        usage='usage: sjcam-frameinfo [options] <logfile> [<outfile>]')
+    opts, args = parser.parse_args()
+    if len(args) < 1 or len(args) > 2:
+        parser.error('Invalid arguments specified.')
+
+    out = open(args[1], 'w') if len(args) == 2 else sys.stdout
+    out.write('# id  count  status  timestamp  readoutTimestamp  '
+              'readoutTimeMs  exposureUtcUsecs\n')
+    try:
+        with open(args[0], 'rb') as f:
+            for rec in read_frameinfo(f):
+                out.write('%d  %d  %d  %d  %d  %d  %d\n' % rec)
+    except (IOError, ValueError) as e:
+        sys.stderr.write('Error: %s\n' % e)
+        sys.exit(1)
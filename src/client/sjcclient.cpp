@@ -303,6 +303,25 @@ void SjcClient::sendRequest(const QByteArray &identifier)
     m_requestMap[msg.snr()] = RequestItem(identifier);
 }
 
+void SjcClient::connectToStreamingHost(const QByteArray &address,
+                                       const QByteArray &port)
+{
+    // command line settings take precedence over the server's address
+    if (m_streamingServerName.isEmpty())
+        m_streamingServerName = address;
+    if (m_streamingServerPort == 0) {
+        bool ok;
+        ushort value = port.toUShort(&ok);
+        if (ok) m_streamingServerPort = value;
+    }
+    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
+        m_socket->disconnectFromHost();
+        if (m_socket->state() != QAbstractSocket::UnconnectedState)
+            m_socket->waitForDisconnected();
+    }
+    m_socket->connectToHost(m_streamingServerName, m_streamingServerPort);
+}
+
 void SjcClient::updateStatusBarImagePos(const QPoint &pos)
 {
     QString s;
@@ -393,10 +412,9 @@ void SjcClient::dcpConnected()
 {
     ui->actionConnect->setChecked(true);
 
-    // ask for camera state, streaming server address and enable notifications
-    sendRequest("camerastate");
-    sendRequest("streaminghost");
-    sendMessage("set notify true");
+    // ask for the server status and enable batched notifications
+    sendRequest("status");
+    sendMessage("set notify batch");
     m_requestTimer->start(m_requestTimeout);
 }
 
@@ -412,6 +430,119 @@ void SjcClient::dcpDisconnected()
     setWindowTitle(tr("Slit Jaw Camera"));
 }
 
+bool SjcClient::isNotification(const QByteArray &identifier)
+{
+    return identifier == "camerastate" || identifier == "exposure" ||
+           identifier == "framerate" || identifier == "triggermode" ||
+           identifier == "framewritten" || identifier == "marker";
+}
+
+bool SjcClient::applyNotification(const QByteArray &identifier,
+                                  const QList<QByteArray> &args)
+{
+    // set camerastate ( closed | opened | capturing )
+    if (identifier == "camerastate")
+    {
+        if (args.size() != 1)
+            return false;
+
+        CameraDock::CameraState state;
+        if (args[0] == "closed")
+            state = CameraDock::ClosedState;
+        else if (args[0] == "opened")
+            state = CameraDock::OpenedState;
+        else if (args[0] == "capturing")
+            state = CameraDock::CapturingState;
+        else
+            return false;
+
+        m_cameraDock->setCameraState(state);
+        updateStatusBarCamera(state);
+        if (state == CameraDock::OpenedState ||
+                state == CameraDock::CapturingState) {
+            sendRequest("status");
+        }
+        else {
+            setWindowTitle(tr("Slit Jaw Camera"));
+            m_recordingDock->setFramesWritten(0, 0);
+            m_image->clear();
+            m_imageWidget->setImage(m_image);
+            m_histogramDock->setImage(m_image);
+        }
+        return true;
+    }
+
+    // set exposure <usecs>
+    if (identifier == "exposure")
+    {
+        if (args.size() != 1)
+            return false;
+
+        bool ok;
+        uint value = args[0].toUInt(&ok);
+        if (ok)
+            m_cameraDock->setExposureTime(value / 1000.0);
+        return ok;
+    }
+
+    // set framerate <Hz>
+    if (identifier == "framerate")
+    {
+        if (args.size() != 1)
+            return false;
+
+        bool ok;
+        double value = args[0].toDouble(&ok);
+        if (ok)
+            m_cameraDock->setFrameRate(value);
+        return ok;
+    }
+
+    // set triggermode <mode>
+    if (identifier == "triggermode")
+    {
+        if (args.size() != 1)
+            return false;
+        m_cameraDock->setTriggerMode(args[0]);
+        return true;
+    }
+
+    // set framewritten <number> <total> [<file-id>]
+    if (identifier == "framewritten")
+    {
+        if (args.size() < 2 || args.size() > 3)
+            return false;
+
+        bool ok1, ok2;
+        int n = args[0].toInt(&ok1);
+        int total = args[1].toInt(&ok2);
+        if (!ok1 || !ok2)
+            return false;
+
+        QByteArray fileId = (args.size() == 3) ? args[2] : QByteArray();
+        m_recordingDock->setFramesWritten(n, total, fileId);
+        return true;
+    }
+
+    // set marker ( true | false ) <xpos> <ypos>
+    if (identifier == "marker")
+    {
+        if (args.size() != 3 || (args[0] != "true" && args[0] != "false"))
+            return false;
+
+        bool ok1, ok2;
+        QPointF pos(args[1].toDouble(&ok1), args[2].toDouble(&ok2));
+        if (!ok1 || !ok2)
+            return false;
+
+        m_imageWidget->setMarkerEnabled(args[0] == "true");
+        m_imageWidget->setMarkerPos(pos);
+        return true;
+    }
+
+    return false;
+}
+
 void SjcClient::dcpMessageReceived()
 {
     Dcp::Message msg = m_dcp->readMessage();
@@ -443,12 +574,17 @@ void SjcClient::dcpMessageReceived()
             // if notification is disabled, enable it and request settings
             if (args[0] != "false")
                 return;
-            sendMessage("set notify true");
-            sendRequest("camerastate");
-            sendRequest("streaminghost");
+            sendMessage("set notify batch");
+            sendRequest("status");
         }
-        else if (identifier == "camerastate")
+        else if (identifier == "status")
         {
+            // <camerastate> <address> <port> <camera name> <unique id>
+            // <width> <height> <bitdepth> <triggermode> <exposure> <exp_min>
+            // <exp_max> <framerate> <fr_min> <fr_max> <marker> <xpos> <ypos>
+            if (args.size() != 18)
+                return;
+
             CameraDock::CameraState state;
             if (args[0] == "closed")
                 state = CameraDock::ClosedState;
@@ -461,11 +597,18 @@ void SjcClient::dcpMessageReceived()
 
             if (state == CameraDock::OpenedState ||
                     state == CameraDock::CapturingState) {
-                sendRequest("camerainfo");
-                sendRequest("triggermode");
-                sendRequest("exposure");
-                sendRequest("framerate");
-                sendRequest("marker");
+                m_cameraDock->setCameraName(args[3]);
+                m_cameraDock->setCameraId(args[4]);
+                m_cameraDock->setCameraSensor(args[5] + "x" + args[6] + "@" +
+                                              args[7]);
+                setWindowTitle(args[3] + tr(" - Slit Jaw Camera"));
+                if (args[8] != "-")
+                    m_cameraDock->setTriggerMode(args[8]);
+                bool ok;
+                uint exposure = args[9].toUInt(&ok);
+                if (ok) m_cameraDock->setExposureTime(exposure / 1000.0);
+                double frameRate = args[12].toDouble(&ok);
+                if (ok) m_cameraDock->setFrameRate(frameRate);
             }
             else {
                 setWindowTitle(tr("Slit Jaw Camera"));
@@ -474,80 +617,20 @@ void SjcClient::dcpMessageReceived()
                 m_imageWidget->setImage(m_image);
                 m_histogramDock->setImage(m_image);
             }
-
             m_cameraDock->setCameraState(state);
             updateStatusBarCamera(state);
-        }
-        else if (identifier == "camerainfo")
-        {
-            if (args.size() != 5)
-                return;
-            m_cameraDock->setCameraName(args[0]);
-            m_cameraDock->setCameraId(args[1]);
-            m_cameraDock->setCameraSensor(args[2] + "x" + args[3] + "@" +
-                                          args[4]);
-            setWindowTitle(args[0] + tr(" - Slit Jaw Camera"));
-        }
-        else if (identifier == "triggermode")
-        {
-            m_cameraDock->setTriggerMode(args[0]);
-        }
-        else if (identifier == "exposure")
-        {
-            bool ok;
-            uint value = args[0].toUInt(&ok);
-            if (ok) m_cameraDock->setExposureTime(value / 1000.0);
-        }
-        else if (identifier == "framerate")
-        {
-            bool ok;
-            double value = args[0].toDouble(&ok);
-            if (ok) m_cameraDock->setFrameRate(value);
-        }
-        else if (identifier == "marker")
-        {
-            if (args.size() != 3)
-                return;
 
-            bool ok1, ok2, ok3;
-            bool enabled;
-            if (args[0] == "true") {
-                ok1 = true;
-                enabled = true;
-            } else if (args[0] == "false") {
-                ok1 = true;
-                enabled = false;
-            } else {
-                ok1 = false;
-            }
-            QPointF pos(args[1].toDouble(&ok2), args[2].toDouble(&ok3));
-
-            if (ok1 && ok2 && ok3) {
-                m_imageWidget->setMarkerEnabled(enabled);
+            bool ok1, ok2;
+            QPointF pos(args[16].toDouble(&ok1), args[17].toDouble(&ok2));
+            if ((args[15] == "true" || args[15] == "false") && ok1 && ok2) {
+                m_imageWidget->setMarkerEnabled(args[15] == "true");
                 m_imageWidget->setMarkerPos(pos);
             }
-        }
-        else if (identifier == "streaminghost")
-        {
-            if (args.size() != 2)
-                return;
-            if (m_streamingServerName.isEmpty() || m_streamingServerPort == 0)
-            {
-                if (m_streamingServerName.isEmpty())
-                    m_streamingServerName = args[0];
-
-                if (m_streamingServerPort == 0) {
-                    bool ok;
-                    ushort value = args[1].toUShort(&ok);
-                    if (ok) m_streamingServerPort = value;
-                }
-            }
-            if (m_socket->state() != QAbstractSocket::UnconnectedState) {
-                m_socket->disconnectFromHost();
-                if (m_socket->state() != QAbstractSocket::UnconnectedState)
-                    m_socket->waitForDisconnected();
-            }
-            m_socket->connectToHost(m_streamingServerName, m_streamingServerPort);
+
+            // status is also requested on camera state changes, keep an
+            // existing streaming connection in that case
+            if (m_socket->state() == QAbstractSocket::UnconnectedState)
+                connectToStreamingHost(args[1], args[2]);
         }
         return;
     }
@@ -575,167 +658,54 @@ void SjcClient::dcpMessageReceived()
             return;
         }
 
-        // set camerastate ( closed | opened | capturing )
+        // set batch <identifier> [<args>] ( ; <identifier> [<args>] )...
         //     returns: FIN
-        if (identifier == "camerastate")
+        //     errcodes: 1 -> at least one notification was invalid
+        //     note: notifications coalesced by the server; notifications
+        //           which are unknown to the client are skipped
+        if (identifier == "batch")
         {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-
-            const QByteArray arg = m_command.arguments()[0];
-            CameraDock::CameraState state;
-            if (arg == "closed")
-                state = CameraDock::ClosedState;
-            else if (arg == "opened")
-                state = CameraDock::OpenedState;
-            else if (arg == "capturing")
-                state = CameraDock::CapturingState;
-            else {
+            if (!m_command.hasArguments()) {
                 sendMessage(msg.ackMessage(Dcp::AckParameterError));
                 return;
             }
             sendMessage(msg.ackMessage());
-            m_cameraDock->setCameraState(state);
-            updateStatusBarCamera(state);
-            sendMessage(msg.replyMessage());
-            if (state == CameraDock::OpenedState ||
-                    state == CameraDock::CapturingState) {
-                sendRequest("camerainfo");
-                sendRequest("exposure");
-                sendRequest("framerate");
-            }
-            else {
-                setWindowTitle(tr("Slit Jaw Camera"));
-                m_recordingDock->setFramesWritten(0, 0);
-                m_image->clear();
-                m_imageWidget->setImage(m_image);
-                m_histogramDock->setImage(m_image);
-            }
-
-            return;
-        }
 
-        // set exposure <usecs>
-        //     returns: FIN
-        if (identifier == "exposure")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-
-            bool ok;
-            const QByteArray arg = m_command.arguments()[0];
-            uint value = arg.toUInt(&ok);
-            if (ok) {
-                sendMessage(msg.ackMessage());
-                m_cameraDock->setExposureTime(value / 1000.0);
-                sendMessage(msg.replyMessage());
-            } else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-            }
-            return;
-        }
-
-        // set framerate <Hz>
-        //     returns: FIN
-        if (identifier == "framerate")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-
-            bool ok;
-            const QByteArray arg = m_command.arguments()[0];
-            double value = arg.toDouble(&ok);
-            if (ok) {
-                sendMessage(msg.ackMessage());
-                m_cameraDock->setFrameRate(value);
-                sendMessage(msg.replyMessage());
-            } else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
+            bool ok = true;
+            QList<QByteArray> args = m_command.arguments();
+            args << ";";
+            QList<QByteArray> notification;
+            foreach (const QByteArray &arg, args) {
+                if (arg != ";") {
+                    notification << arg;
+                    continue;
+                }
+                if (notification.isEmpty())
+                    continue;
+                QByteArray name = notification.takeFirst();
+                if (isNotification(name) &&
+                        !applyNotification(name, notification))
+                    ok = false;
+                notification.clear();
             }
+            sendMessage(msg.replyMessage(QByteArray(), ok ? 0 : 1));
             return;
         }
 
-        // set triggermode <mode>
+        // set ( camerastate | exposure | framerate | triggermode |
+        //       framewritten | marker ) <args>
         //     returns: FIN
-        if (identifier == "triggermode")
+        //     note: see applyNotification()
+        if (isNotification(identifier))
         {
-            if (m_command.numArguments() != 1) {
+            if (!applyNotification(identifier, m_command.arguments())) {
                 sendMessage(msg.ackMessage(Dcp::AckParameterError));
                 return;
             }
-            QByteArray value = m_command.arguments()[0];
             sendMessage(msg.ackMessage());
-            m_cameraDock->setTriggerMode(value);
             sendMessage(msg.replyMessage());
             return;
         }
-
-        // set framewritten <number> <total> [<file-id>]
-        //     returns: FIN
-        if (identifier == "framewritten")
-        {
-            int numArgs = m_command.numArguments();
-            if (numArgs < 2 || numArgs > 3) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-
-            bool ok1, ok2;
-            QList<QByteArray> args = m_command.arguments();
-            int n = args[0].toInt(&ok1);
-            int total = args[1].toInt(&ok2);
-
-            if (ok1 && ok2) {
-                sendMessage(msg.ackMessage());
-                QByteArray fileId = (numArgs == 3) ? args[2] : QByteArray();
-                m_recordingDock->setFramesWritten(n, total, fileId);
-                sendMessage(msg.replyMessage());
-            } else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-            }
-            return;
-        }
-
-        // set marker ( true | false ) <xpos> <ypos>
-        //     returns: FIN
-        if (identifier == "marker")
-        {
-            if (m_command.numArguments() != 3) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-
-            bool ok1, ok2, ok3;
-            QList<QByteArray> args = m_command.arguments();
-
-            bool enabled;
-            if (args[0] == "true") {
-                ok1 = true;
-                enabled = true;
-            } else if (args[0] == "false") {
-                ok1 = true;
-                enabled = false;
-            } else {
-                ok1 = false;
-            }
-            QPointF pos(args[1].toDouble(&ok2), args[2].toDouble(&ok3));
-
-            if (ok1 && ok2 && ok3) {
-                sendMessage(msg.ackMessage());
-                m_imageWidget->setMarkerEnabled(enabled);
-                m_imageWidget->setMarkerPos(pos);
-                sendMessage(msg.replyMessage());
-            } else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-            }
-            return;
-        }
     }
     else if (cmdType == Dcp::CommandParser::GetCmd)
     {
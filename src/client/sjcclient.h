@@ -34,6 +34,7 @@
 #include <QtCore/QTextStream>
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QMap>
+#include <QtCore/QList>
 #include <QtNetwork/QTcpSocket>
 
 class QTimer;
@@ -81,6 +82,11 @@ protected:
     void sendMessage(const Dcp::Message &msg);
     Dcp::Message sendMessage(const QByteArray &data);
     void sendRequest(const QByteArray &data);
+    void connectToStreamingHost(const QByteArray &address,
+                                const QByteArray &port);
+    static bool isNotification(const QByteArray &identifier);
+    bool applyNotification(const QByteArray &identifier,
+                           const QList<QByteArray> &args);
     void updateStatusBarImagePos(const QPoint &pos);
     void updateStatusBarDcp(Dcp::Client::State state);
     void updateStatusBarStream(QAbstractSocket::SocketState state);
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "autoexposure.h"
+#include "frameops.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+#include <cmath>
+
+namespace {
+
+// approximate number of pixels used for the histogram of a frame
+const int MaxSamples = 1 << 17;
+
+// number of frames skipped after a change, if the frames do not contain
+// the exposure value in their ancillary data
+const int SettleFrames = 3;
+
+// relative exposure changes below this value are ignored
+const double Deadband = 0.05;
+
+} // namespace
+
+AutoExposure::AutoExposure()
+    : m_percentile(0.99),
+      m_level(0.8),
+      m_maxSaturation(0.001),
+      m_damping(0.5),
+      m_minExposure(1),
+      m_maxExposure(1000000)
+{
+    reset();
+}
+
+void AutoExposure::setTarget(double percentile, double level)
+{
+    m_percentile = qBound(0.0, percentile, 1.0);
+    m_level = qBound(1.0 / 256, level, 1.0);
+}
+
+void AutoExposure::setMaxSaturation(double fraction)
+{
+    m_maxSaturation = qBound(0.0, fraction, 1.0);
+}
+
+void AutoExposure::setDamping(double damping)
+{
+    m_damping = qBound(0.0, damping, 0.99);
+}
+
+void AutoExposure::setLimits(quint32 minExposure, quint32 maxExposure)
+{
+    m_minExposure = qMax(minExposure, quint32(1));
+    m_maxExposure = qMax(maxExposure, m_minExposure);
+}
+
+void AutoExposure::reset()
+{
+    m_settleFrames = 0;
+    m_lastLevel = 0;
+    m_lastSaturation = 0;
+}
+
+bool AutoExposure::processFrame(const tPvFrame *frame,
+                                quint32 currentExposure, quint32 *exposure)
+{
+    // skip frames which were exposed before the last change took effect
+    const quint32 frameExposure = PvFrameExposure(frame);
+    if (frameExposure != 0) {
+        if (frameExposure != currentExposure)
+            return false;
+    }
+    else if (m_settleFrames > 0) {
+        --m_settleFrames;
+        return false;
+    }
+
+    quint32 bins[256];
+    qMemSet(bins, 0, sizeof(bins));
+    if (!computeHistogram(frame, bins))
+        return false;
+
+    quint64 total = 0;
+    for (int i = 0; i < 256; ++i)
+        total += bins[i];
+    if (total == 0)
+        return false;
+
+    const quint64 rank = quint64(m_percentile * (total - 1));
+    quint64 sum = 0;
+    int bin = 0;
+    for (; bin < 255; ++bin) {
+        sum += bins[bin];
+        if (sum > rank)
+            break;
+    }
+    m_lastLevel = (bin + 0.5) / 256;
+    m_lastSaturation = double(bins[255]) / total;
+
+    // the pixel values are assumed to be proportional to the exposure
+    double ratio = m_level / m_lastLevel;
+    if (m_lastSaturation > m_maxSaturation)
+        ratio = qMin(ratio, 0.5);
+    const double factor = std::pow(ratio, 1 - m_damping);
+    if (qAbs(factor - 1) < Deadband)
+        return false;
+
+    const double value = qBound(double(m_minExposure),
+                                currentExposure * factor,
+                                double(m_maxExposure));
+    const quint32 newExposure = quint32(value + 0.5);
+    if (newExposure == currentExposure)
+        return false;
+
+    *exposure = newExposure;
+    m_settleFrames = SettleFrames;
+    return true;
+}
+
+// Only every n-th row is used, so that the histogram is computed from about
+// MaxSamples pixels.
+bool AutoExposure::computeHistogram(const tPvFrame *frame, quint32 *bins)
+{
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+    if (width <= 0 || height <= 0)
+        return false;
+    const int rowStep = qMax(height / qMax(MaxSamples / width, 1), 1);
+
+    if (frame->Format == ePvFmtMono8) {
+        histogram(reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                  width, height, rowStep, 0, bins);
+    }
+    else if (frame->Format == ePvFmtMono16) {
+        const int shift = qMax(int(frame->BitDepth) - 8, 0);
+        histogram(reinterpret_cast<const quint16 *>(frame->ImageBuffer),
+                  width, height, rowStep, shift, bins);
+    }
+    else if (frame->Format == ePvFmtMono12Packed) {
+        // the sampled rows are unpacked one by one, starting at an even
+        // pixel index, which is aligned to a byte boundary
+        const uchar *src = reinterpret_cast<const uchar *>(
+                    frame->ImageBuffer);
+        m_unpackBuffer.resize(width + 1);
+        for (int y = 0; y < height; y += rowStep) {
+            const qint64 first = qint64(y) * width;
+            const qint64 begin = first & ~qint64(1);
+            unpackMono12Packed(m_unpackBuffer.data(), src + 3 * begin / 2,
+                               int(first - begin) + width);
+            histogram(m_unpackBuffer.constData() + (first - begin),
+                      width, 1, 1, 0, bins);
+        }
+    }
+    else
+        return false;
+
+    return true;
+}
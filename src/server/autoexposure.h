@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_AUTOEXPOSURE_H
+#define SJCAM_AUTOEXPOSURE_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QVector>
+#include <PvApi.h>
+
+// Computes new exposure values from the histograms of the captured frames.
+// The exposure is scaled, so that the given percentile of the pixel values
+// reaches the target level. The exposure is reduced at least by a factor of
+// two as long as more pixels than allowed are saturated. Levels and
+// fractions are relative to the full scale of the pixel format.
+class AutoExposure
+{
+public:
+    AutoExposure();
+
+    void setTarget(double percentile, double level);
+    double percentile() const { return m_percentile; }
+    double level() const { return m_level; }
+    void setMaxSaturation(double fraction);
+    double maxSaturation() const { return m_maxSaturation; }
+    void setDamping(double damping);
+    double damping() const { return m_damping; }
+    void setLimits(quint32 minExposure, quint32 maxExposure);
+    quint32 minExposure() const { return m_minExposure; }
+    quint32 maxExposure() const { return m_maxExposure; }
+
+    void reset();
+
+    // Evaluates a frame captured with the current exposure value. Returns
+    // true and stores the new exposure value if it should be changed.
+    bool processFrame(const tPvFrame *frame, quint32 currentExposure,
+                      quint32 *exposure);
+
+    double lastLevel() const { return m_lastLevel; }
+    double lastSaturation() const { return m_lastSaturation; }
+
+private:
+    bool computeHistogram(const tPvFrame *frame, quint32 *bins);
+
+    double m_percentile;
+    double m_level;
+    double m_maxSaturation;
+    double m_damping;
+    quint32 m_minExposure;
+    quint32 m_maxExposure;
+    int m_settleFrames;
+    double m_lastLevel;
+    double m_lastSaturation;
+    QVector<uchar> m_unpackBuffer;
+};
+
+#endif // SJCAM_AUTOEXPOSURE_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "benchclient.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+#include <QtNetwork/QTcpSocket>
+
+BenchClient::BenchClient(QObject *parent)
+    : QObject(parent),
+      m_socket(new QTcpSocket(this)),
+      m_requestUsecs(0),
+      m_connected(false)
+{
+    connect(m_socket, SIGNAL(connected()), SLOT(socketConnected()));
+    connect(m_socket, SIGNAL(readyRead()), SLOT(socketReadyRead()));
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            SLOT(socketError()));
+}
+
+BenchClient::~BenchClient()
+{
+    delete m_socket;
+}
+
+BenchClient::Stats BenchClient::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+bool BenchClient::isConnected() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_connected;
+}
+
+void BenchClient::connectToServer(quint16 port)
+{
+    m_socket->connectToHost(QHostAddress::LocalHost, port);
+}
+
+void BenchClient::disconnectFromServer()
+{
+    m_socket->abort();
+    QMutexLocker locker(&m_mutex);
+    m_connected = false;
+}
+
+void BenchClient::resetStats()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats = Stats();
+}
+
+void BenchClient::socketConnected()
+{
+    m_mutex.lock();
+    m_connected = true;
+    m_mutex.unlock();
+    requestImage();
+}
+
+void BenchClient::socketReadyRead()
+{
+    QByteArray buf = m_socket->peek(4);
+    if (buf.size() < 4)
+        return;
+
+    quint32 size;
+    QDataStream is(&buf, QIODevice::ReadOnly);
+    is.setVersion(QDataStream::Qt_4_7);
+    is >> size;
+
+    // the size is followed by the QByteArray (4 + 4 + size)
+    if (m_socket->bytesAvailable() < qint64(size) + 8)
+        return;
+
+    QByteArray jpeg;
+    is.setDevice(m_socket);
+    is >> size >> jpeg;
+    const qint64 latency = monotonicUsecs() - m_requestUsecs;
+
+    // a JPEG file starts with the SOI marker
+    const bool valid = (quint32(jpeg.size()) == size && jpeg.size() > 2 &&
+                        uchar(jpeg[0]) == 0xff && uchar(jpeg[1]) == 0xd8);
+    m_mutex.lock();
+    if (valid) {
+        ++m_stats.images;
+        m_stats.bytes += 8 + jpeg.size();
+        m_stats.latency.add(latency);
+    } else {
+        ++m_stats.invalid;
+    }
+    m_mutex.unlock();
+
+    requestImage();
+}
+
+void BenchClient::socketError()
+{
+    m_mutex.lock();
+    m_connected = false;
+    m_mutex.unlock();
+    emit error("Benchmark client: " + m_socket->errorString() + ".");
+}
+
+void BenchClient::requestImage()
+{
+    m_requestUsecs = monotonicUsecs();
+    m_socket->write("moreplease");
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_BENCHCLIENT_H
+#define SJCAM_BENCHCLIENT_H
+
+#include "pipelinestats.h"
+#include <QtCore/QObject>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+class QTcpSocket;
+
+// Headless streaming client for the benchmark. It speaks the protocol of
+// the ImageStreamer like sjcclient: each sent byte sequence requests the
+// next image, which arrives as quint32 size followed by the JPEG data as
+// QByteArray (QDataStream, Qt_4_7). A new image is requested as soon as
+// the previous one was received; the images are checked but not decoded.
+class BenchClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        Stats() : images(0), bytes(0), invalid(0) {}
+
+        int images;
+        qint64 bytes;
+        int invalid;
+        LatencyHistogram latency;  // from the request to the received image
+    };
+
+    explicit BenchClient(QObject *parent = 0);
+    ~BenchClient();
+
+    // thread-safe
+    Stats stats() const;
+    bool isConnected() const;
+
+public slots:
+    void connectToServer(quint16 port);
+    void disconnectFromServer();
+    void resetStats();
+
+signals:
+    void error(const QString &errorString) const;
+
+protected slots:
+    void socketConnected();
+    void socketReadyRead();
+    void socketError();
+
+protected:
+    void requestImage();
+
+private:
+    Q_DISABLE_COPY(BenchClient)
+    QTcpSocket * const m_socket;
+    qint64 m_requestUsecs;
+    mutable QMutex m_mutex;
+    Stats m_stats;
+    bool m_connected;
+};
+
+#endif // SJCAM_BENCHCLIENT_H
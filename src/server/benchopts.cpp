@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "benchopts.h"
+#include "motiontracker.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QDir>
+
+BenchOpts::BenchOpts()
+    : width(1024),
+      height(1024),
+      bitDepth(12),
+      pixelFormat("Mono16"),
+      frameRate(30),
+      numBuffers(10),
+      numClients(1),
+      writeFrames(false),
+      stepping(1),
+      outputDirectory(QDir::tempPath()),
+      keepFiles(false),
+      trackingMode("off"),
+      warmupSeconds(2),
+      durationSeconds(10),
+      jsonFileName(QString()),
+      verbose(false),
+      help(false)
+{
+}
+
+bool BenchOpts::parse()
+{
+    QString appName = qApp->applicationName();
+    QStringList arguments = qApp->arguments();
+
+    // handle --help first and return if help is requested
+    if (arguments.contains("-h") || arguments.contains("--help") ||
+            arguments.contains("-help"))
+    {
+        help = true;
+        printHelp();
+        return true;
+    }
+
+    const QStringList argOptions = QStringList()
+            << "--size" << "--bits" << "--format" << "--fps" << "--buffers"
+            << "--clients" << "--write" << "--output" << "--tracking"
+            << "--warmup" << "--duration" << "--json";
+
+    QListIterator<QString> iter(arguments);
+    iter.next(); // skip executable name
+
+    while (iter.hasNext())
+    {
+        QString arg = iter.next();
+        if (argOptions.contains(arg) && !iter.hasNext()) {
+            printReqArg(arg);
+            return false;
+        }
+
+        bool ok = true;
+        if (arg == "--size") {
+            QStringList parts = iter.next().split('x');
+            bool ok1 = false, ok2 = false;
+            if (parts.size() == 2) {
+                width = parts[0].toUInt(&ok1);
+                height = parts[1].toUInt(&ok2);
+            }
+            if (!ok1 || !ok2 || width == 0 || height == 0) {
+                printInvalidArg(arg, "of the form <width>x<height>");
+                return false;
+            }
+        }
+        else if (arg == "--bits") {
+            bitDepth = iter.next().toUInt(&ok);
+            if (!ok || bitDepth < 8 || bitDepth > 16) {
+                printInvalidArg(arg, "an integer between 8 and 16");
+                return false;
+            }
+        }
+        else if (arg == "--format") {
+            pixelFormat = iter.next().toAscii();
+            if (pixelFormat != "Mono8" && pixelFormat != "Mono16" &&
+                    pixelFormat != "Mono12Packed") {
+                printInvalidArg(arg, "Mono8, Mono16 or Mono12Packed");
+                return false;
+            }
+        }
+        else if (arg == "--fps") {
+            frameRate = iter.next().toDouble(&ok);
+            if (!ok || frameRate < 0) {
+                printInvalidArg(arg, "a non-negative number");
+                return false;
+            }
+        }
+        else if (arg == "--buffers") {
+            numBuffers = iter.next().toInt(&ok);
+            if (!ok || numBuffers < 1) {
+                printInvalidArg(arg, "a positive integer");
+                return false;
+            }
+        }
+        else if (arg == "--clients") {
+            numClients = iter.next().toInt(&ok);
+            if (!ok || numClients < 0) {
+                printInvalidArg(arg, "a non-negative integer");
+                return false;
+            }
+        }
+        else if (arg == "--write") {
+            stepping = iter.next().toInt(&ok);
+            if (!ok || stepping < 1) {
+                printInvalidArg(arg, "a positive integer");
+                return false;
+            }
+            writeFrames = true;
+        }
+        else if (arg == "--output") {
+            outputDirectory = iter.next();
+        }
+        else if (arg == "--keep") {
+            keepFiles = true;
+        }
+        else if (arg == "--tracking") {
+            int mode;
+            trackingMode = iter.next().toAscii();
+            if (!MotionTracker::modeFromName(trackingMode, &mode)) {
+                printInvalidArg(arg, "off, centroid or correlation");
+                return false;
+            }
+        }
+        else if (arg == "--warmup") {
+            warmupSeconds = iter.next().toDouble(&ok);
+            if (!ok || warmupSeconds < 0) {
+                printInvalidArg(arg, "a non-negative number");
+                return false;
+            }
+        }
+        else if (arg == "--duration") {
+            durationSeconds = iter.next().toDouble(&ok);
+            if (!ok || durationSeconds <= 0) {
+                printInvalidArg(arg, "a positive number");
+                return false;
+            }
+        }
+        else if (arg == "--json") {
+            jsonFileName = iter.next();
+        }
+        else if (arg == "-v") {
+            verbose = true;
+        }
+        else {
+            QTextStream cerr(stderr, QIODevice::WriteOnly);
+            if (arg.startsWith('-'))
+                cerr << appName << ": unknown option `" << arg << "'.\n";
+            else
+                cerr << appName << ": invalid command line argument.\n";
+            cerr << moreInfo() << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BenchOpts::printHelp()
+{
+    QTextStream cout(stdout, QIODevice::WriteOnly);
+    cout << "Usage: " << qApp->applicationName() << " [options]\n"
+         << "\nRuns the capture pipeline of the server with synthetic frames"
+         << "\nand prints the results as JSON.\n"
+         << "\nOptions:"
+         << "\n  --size WxH       Frame size [1024x1024]"
+         << "\n  --bits n         Bit depth of the sensor [12]"
+         << "\n  --format name    Mono8, Mono16 or Mono12Packed [Mono16]"
+         << "\n  --fps f          Frame rate, 0 for as fast as possible [30]"
+         << "\n  --buffers n      Number of frame buffers [10]"
+         << "\n  --clients n      Number of streaming clients [1]"
+         << "\n  --write n        Write every n-th frame to FITS files"
+         << "\n  --output dir     Directory for the written files ["
+                                 << QDir::tempPath() << "]"
+         << "\n  --keep           Keep the written files"
+         << "\n  --tracking mode  Motion tracking mode [off]"
+         << "\n  --warmup s       Seconds before the measurement [2]"
+         << "\n  --duration s     Seconds of the measurement [10]"
+         << "\n  --json file      Write the results to file [stdout]"
+         << "\n  -v               Print server messages to stderr"
+         << "\n  -h, --help       Show this help message and quit"
+         << "\n" << endl;
+}
+
+void BenchOpts::printReqArg(const QString &optionName)
+{
+    QTextStream cerr(stderr, QIODevice::WriteOnly);
+    cerr << qApp->applicationName() << ": option `" << optionName
+         << "' requires an argument.\n" << moreInfo() << endl;
+}
+
+void BenchOpts::printInvalidArg(const QString &optionName,
+                                const QString &expected)
+{
+    QTextStream cerr(stderr, QIODevice::WriteOnly);
+    cerr << qApp->applicationName() << ": argument of option `"
+         << optionName << "' must be " << expected << ".\n"
+         << moreInfo() << endl;
+}
+
+QString BenchOpts::moreInfo()
+{
+    return QString("Try `%1 --help' for more information.")
+            .arg(qApp->applicationName());
+}
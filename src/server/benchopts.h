@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCBENCH_BENCHOPTS_H
+#define SJCBENCH_BENCHOPTS_H
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+
+// Command line options of sjcbench, which describe the benchmark scenario.
+class BenchOpts
+{
+public:
+    BenchOpts();
+    bool parse();
+    void printHelp();
+
+protected:
+    void printReqArg(const QString &optionName);
+    void printInvalidArg(const QString &optionName, const QString &expected);
+    QString moreInfo();
+
+public:
+    uint width;
+    uint height;
+    uint bitDepth;
+    QByteArray pixelFormat;
+    double frameRate;
+    int numBuffers;
+    int numClients;
+    bool writeFrames;
+    int stepping;
+    QString outputDirectory;
+    bool keepFiles;
+    QByteArray trackingMode;
+    double warmupSeconds;
+    double durationSeconds;
+    QString jsonFileName;
+    bool verbose;
+    bool help;
+};
+
+#endif // SJCBENCH_BENCHOPTS_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "buffertuner.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+// number of intervals the pool must be too large before it is shrunk
+const int ShrinkDelay = 10;
+
+} // namespace
+
+BufferTuner::BufferTuner()
+    : m_minBuffers(4),
+      m_maxBuffers(200),
+      m_maxMemory(0)
+{
+    reset();
+}
+
+void BufferTuner::setLimits(int minBuffers, int maxBuffers, qint64 maxMemory)
+{
+    m_minBuffers = qMax(minBuffers, 1);
+    m_maxBuffers = qMax(maxBuffers, m_minBuffers);
+    m_maxMemory = qMax(maxMemory, qint64(0));
+}
+
+void BufferTuner::reset()
+{
+    m_timer.start();
+    m_numFrames = 0;
+    m_highWater = 0;
+    m_maxLatency = 0;
+    m_dropped = 0;
+    m_shrinkCount = 0;
+    m_shrinkTarget = 0;
+    m_lastHighWater = 0;
+    m_lastMaxLatency = 0;
+    m_lastDropped = 0;
+}
+
+void BufferTuner::frameDispatched(int inFlight)
+{
+    ++m_numFrames;
+    if (inFlight > m_highWater)
+        m_highWater = inFlight;
+}
+
+void BufferTuner::frameReturned(qint64 consumerUsecs)
+{
+    if (consumerUsecs > m_maxLatency)
+        m_maxLatency = consumerUsecs;
+}
+
+void BufferTuner::framesDropped(int count)
+{
+    m_dropped += count;
+}
+
+int BufferTuner::evaluate(int numBuffers, ulong bufferSize)
+{
+    const qint64 msecs = qMax(m_timer.restart(), qint64(1));
+    const double frameRate = 1000.0 * m_numFrames / msecs;
+
+    // buffers needed to cover the slowest consumer at the current frame
+    // rate, plus 50% headroom and the buffers queued in the camera
+    int required = qMax(m_highWater,
+                        qCeil(frameRate * m_maxLatency * 1e-6));
+    int target = required + required / 2 + 2;
+    if (m_dropped > 0)
+        target = qMax(target, numBuffers + qMax(numBuffers / 2, 2));
+
+    int limit = m_maxBuffers;
+    if (m_maxMemory > 0 && bufferSize > 0)
+        limit = qMin(limit, int(m_maxMemory / qint64(bufferSize)));
+    target = qBound(m_minBuffers, target, qMax(limit, m_minBuffers));
+
+    m_lastHighWater = m_highWater;
+    m_lastMaxLatency = m_maxLatency;
+    m_lastDropped = m_dropped;
+    m_numFrames = 0;
+    m_highWater = 0;
+    m_maxLatency = 0;
+    m_dropped = 0;
+
+    if (target >= numBuffers) {
+        m_shrinkCount = 0;
+        m_shrinkTarget = 0;
+        return target;
+    }
+
+    // shrink to the largest target of the delay intervals
+    m_shrinkTarget = qMax(m_shrinkTarget, target);
+    if (++m_shrinkCount < ShrinkDelay)
+        return numBuffers;
+    target = m_shrinkTarget;
+    m_shrinkCount = 0;
+    m_shrinkTarget = 0;
+    return target;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_BUFFERTUNER_H
+#define SJCAM_BUFFERTUNER_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QElapsedTimer>
+
+// Computes the number of frame buffers needed by the capture pipeline from
+// the observed number of buffers in use, the time the buffers spend in the
+// consumers and dropped frames. The pool grows as soon as more buffers are
+// needed and shrinks only after it was too large for several intervals.
+class BufferTuner
+{
+public:
+    BufferTuner();
+
+    void setLimits(int minBuffers, int maxBuffers, qint64 maxMemory);
+    int minBuffers() const { return m_minBuffers; }
+    int maxBuffers() const { return m_maxBuffers; }
+    qint64 maxMemory() const { return m_maxMemory; }
+
+    void reset();
+    void frameDispatched(int inFlight);
+    void frameReturned(qint64 consumerUsecs);
+    void framesDropped(int count);
+
+    // Returns the number of buffers for the current interval and starts a
+    // new interval.
+    int evaluate(int numBuffers, ulong bufferSize);
+
+    int lastHighWater() const { return m_lastHighWater; }
+    qint64 lastMaxLatency() const { return m_lastMaxLatency; }
+    int lastDropped() const { return m_lastDropped; }
+
+private:
+    int m_minBuffers;
+    int m_maxBuffers;
+    qint64 m_maxMemory;
+    QElapsedTimer m_timer;
+    int m_numFrames;
+    int m_highWater;
+    qint64 m_maxLatency;
+    int m_dropped;
+    int m_shrinkCount;
+    int m_shrinkTarget;
+    int m_lastHighWater;
+    qint64 m_lastMaxLatency;
+    int m_lastDropped;
+};
+
+#endif // SJCAM_BUFFERTUNER_H
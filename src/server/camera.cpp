@@ -29,10 +29,10 @@
 #include <QtCore/QtCore>
 
 Camera::Camera()
-    : m_device(0),
-      m_sensorWidth(0),
+    : m_sensorWidth(0),
       m_sensorHeight(0),
-      m_sensorBits(0)
+      m_sensorBits(0),
+      m_device(0)
 {
     qMemSet(&m_cameraInfo, 0, sizeof(m_cameraInfo));
 }
@@ -91,6 +91,11 @@ bool Camera::open(ulong cameraId)
         return false;
     }
 
+    if (!loadAttributeInfo()) {
+        close();
+        return false;
+    }
+
     QByteArray sensorType;
     if (!getAttrEnum("SensorType", &sensorType)) {
         close();
@@ -127,6 +132,7 @@ void Camera::close()
 bool Camera::resetConfig()
 {
     tPvErr err;
+    invalidateAttributeCache();
 
     err = PvAttrEnumSet(m_device, "ConfigFileIndex", "Factory");
     if (err != ePvErrSuccess) {
@@ -231,6 +237,7 @@ bool Camera::waitForFrameDone(tPvFrame *frame, ulong timeout, bool *timedOut)
 
 bool Camera::runCommand(const QByteArray &name)
 {
+    invalidateAttributeCache();
     tPvErr err = PvCommandRun(m_device, name);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot run command %1.").arg(QString(name)), err);
@@ -254,6 +261,7 @@ bool Camera::getAttrString(const QByteArray &name, QByteArray *value) const
 
 bool Camera::setAttrString(const QByteArray &name, const QByteArray &value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrStringSet(m_device, name, value);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -277,6 +285,7 @@ bool Camera::getAttrEnum(const QByteArray &name, QByteArray *value) const
 
 bool Camera::setAttrEnum(const QByteArray &name, const QByteArray &value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrEnumSet(m_device, name, value);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -300,6 +309,7 @@ bool Camera::getAttrUint32(const QByteArray &name, quint32 *value) const
 
 bool Camera::setAttrUint32(const QByteArray &name, quint32 value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrUint32Set(m_device, name, value);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -323,6 +333,7 @@ bool Camera::getAttrFloat32(const QByteArray &name, float *value) const
 
 bool Camera::setAttrFloat32(const QByteArray &name, float value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrFloat32Set(m_device, name, value);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -346,6 +357,7 @@ bool Camera::getAttrInt64(const QByteArray &name, qint64 *value) const
 
 bool Camera::setAttrInt64(const QByteArray &name, qint64 value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrInt64Set(m_device, name, value);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -369,6 +381,7 @@ bool Camera::getAttrBoolean(const QByteArray &name, bool *value) const
 
 bool Camera::setAttrBoolean(const QByteArray &name, bool value)
 {
+    invalidateAttributeCache();
     tPvErr err = PvAttrBooleanSet(m_device, name, value ? 1 : 0);
     if (err != ePvErrSuccess) {
         setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
@@ -379,71 +392,85 @@ bool Camera::setAttrBoolean(const QByteArray &name, bool value)
 
 bool Camera::getAttribute(const QByteArray &name, QVariant *value) const
 {
-    tPvAttributeInfo info;
-    tPvErr err = PvAttrInfo(m_device, name, &info);
+    QHash<QByteArray, QVariant>::const_iterator cached =
+            m_valueCache.find(name);
+    if (cached != m_valueCache.constEnd()) {
+        *value = cached.value();
+        return true;
+    }
 
-    if (err == ePvErrSuccess)
+    AttributeInfo info;
+    if (attributeInfo(name, &info))
     {
-        switch(info.Datatype)
+        bool ok = false;
+        switch(info.datatype)
         {
         case ePvDatatypeString: {
             QByteArray v;
-            bool ok = getAttrString(name, &v);
+            ok = getAttrString(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         case ePvDatatypeEnum: {
             QByteArray v;
-            bool ok = getAttrEnum(name, &v);
+            ok = getAttrEnum(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         case ePvDatatypeUint32: {
             quint32 v;
-            bool ok = getAttrUint32(name, &v);
+            ok = getAttrUint32(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         case ePvDatatypeFloat32: {
             float v;
-            bool ok = getAttrFloat32(name, &v);
+            ok = getAttrFloat32(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         case ePvDatatypeInt64: {
             qint64 v;
-            bool ok = getAttrInt64(name, &v);
+            ok = getAttrInt64(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         case ePvDatatypeBoolean: {
             bool v;
-            bool ok = getAttrBoolean(name, &v);
+            ok = getAttrBoolean(name, &v);
             *value = ok ? v : QVariant();
-            return ok;
+            break;
         }
         default:
-            break;
+            *value = QVariant();
+            setError(QString("Cannot get attribute %1.").arg(QString(name)));
+            return false;
         }
+        if (ok && (info.flags & ePvFlagVolatile) == 0)
+            m_valueCache.insert(name, *value);
+        return ok;
     }
 
     *value = QVariant();
-    setError(QString("Cannot get attribute %1.").arg(QString(name)), err);
     return false;
 }
 
 bool Camera::setAttribute(const QByteArray &name, const QVariant &value)
 {
-    tPvAttributeInfo info;
-    tPvErr err = PvAttrInfo(m_device, name, &info);
-
-    if (err == ePvErrSuccess)
+    AttributeInfo info;
+    if (attributeInfo(name, &info))
     {
-        switch(info.Datatype)
+        switch(info.datatype)
         {
         case ePvDatatypeString:
             return setAttrString(name, value.toByteArray());
         case ePvDatatypeEnum:
+            if (!info.enumValues.isEmpty() &&
+                    !info.enumValues.contains(value.toByteArray())) {
+                setError(QString("Invalid value for attribute %1.")
+                         .arg(QString(name)));
+                return false;
+            }
             return setAttrString(name, value.toByteArray());
         case ePvDatatypeUint32: {
             bool ok;
@@ -470,12 +497,76 @@ bool Camera::setAttribute(const QByteArray &name, const QVariant &value)
         default:
             break;
         }
+        setError(QString("Cannot set attribute %1.").arg(QString(name)));
     }
-
-    setError(QString("Cannot set attribute %1.").arg(QString(name)), err);
     return false;
 }
 
+bool Camera::getAttributeRange(const QByteArray &name, QVariant *min,
+                               QVariant *max) const
+{
+    QHash<QByteArray, QPair<QVariant, QVariant> >::const_iterator cached =
+            m_rangeCache.find(name);
+    if (cached != m_rangeCache.constEnd()) {
+        *min = cached.value().first;
+        *max = cached.value().second;
+        return true;
+    }
+
+    *min = QVariant();
+    *max = QVariant();
+    AttributeInfo info;
+    if (!attributeInfo(name, &info))
+        return false;
+
+    tPvErr err = ePvErrWrongType;
+    if (info.datatype == ePvDatatypeUint32) {
+        tPvUint32 vmin, vmax;
+        err = PvAttrRangeUint32(m_device, name, &vmin, &vmax);
+        if (err == ePvErrSuccess) {
+            *min = quint32(vmin);
+            *max = quint32(vmax);
+        }
+    }
+    else if (info.datatype == ePvDatatypeFloat32) {
+        tPvFloat32 vmin, vmax;
+        err = PvAttrRangeFloat32(m_device, name, &vmin, &vmax);
+        if (err == ePvErrSuccess) {
+            *min = float(vmin);
+            *max = float(vmax);
+        }
+    }
+    else if (info.datatype == ePvDatatypeInt64) {
+        tPvInt64 vmin, vmax;
+        err = PvAttrRangeInt64(m_device, name, &vmin, &vmax);
+        if (err == ePvErrSuccess) {
+            *min = qint64(vmin);
+            *max = qint64(vmax);
+        }
+    }
+
+    if (err != ePvErrSuccess) {
+        setError(QString("Cannot get range of attribute %1.")
+                 .arg(QString(name)), err);
+        return false;
+    }
+    m_rangeCache.insert(name, qMakePair(*min, *max));
+    return true;
+}
+
+bool Camera::attributeInfo(const QByteArray &name, AttributeInfo *info) const
+{
+    QHash<QByteArray, AttributeInfo>::const_iterator it = m_attrInfo.find(name);
+    if (it == m_attrInfo.constEnd()) {
+        *info = AttributeInfo();
+        setError(QString("Unknown attribute %1.").arg(QString(name)),
+                 ePvErrNotFound);
+        return false;
+    }
+    *info = it.value();
+    return true;
+}
+
 bool Camera::getFrameStats(float &fps, uint &completed, uint &dropped)
 {
     float fpsValue;
@@ -494,6 +585,35 @@ bool Camera::getFrameStats(float &fps, uint &completed, uint &dropped)
     return true;
 }
 
+bool Camera::getNetworkStats(NetworkStats &stats)
+{
+    stats.clear();
+    if (!getAttrUint32("PacketSize", &stats.packetSize)
+            || !getAttrUint32("StreamBytesPerSecond", &stats.bytesPerSecond)
+            || !getAttrUint32("StatPacketsReceived", &stats.packetsReceived)
+            || !getAttrUint32("StatPacketsMissed", &stats.packetsMissed)
+            || !getAttrUint32("StatPacketsErroneous", &stats.packetsErroneous)
+            || !getAttrUint32("StatPacketsRequested", &stats.packetsRequested)
+            || !getAttrUint32("StatPacketsResent", &stats.packetsResent)) {
+        stats.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Camera::adjustPacketSize(quint32 maxPacketSize, quint32 *packetSize)
+{
+    // PvCaptureAdjustPacketSize() sends test packets of decreasing size
+    // to the host and sets PacketSize to the largest one which arrived
+    invalidateAttributeCache();
+    tPvErr err = PvCaptureAdjustPacketSize(m_device, maxPacketSize);
+    if (err != ePvErrSuccess) {
+        setError("Cannot adjust packet size.", err);
+        return false;
+    }
+    return getAttrUint32("PacketSize", packetSize);
+}
+
 QString Camera::infoString() const
 {
     QString result;
@@ -520,6 +640,49 @@ void Camera::clearInfo()
     m_sensorWidth = 0;
     m_sensorHeight = 0;
     m_sensorBits = 0;
+    m_attrInfo.clear();
+    invalidateAttributeCache();
+}
+
+// Reads the type, flags and enum values of all attributes of the camera.
+bool Camera::loadAttributeInfo()
+{
+    m_attrInfo.clear();
+    invalidateAttributeCache();
+
+    tPvAttrListPtr attrList;
+    unsigned long numAttrs;
+    tPvErr err = PvAttrList(m_device, &attrList, &numAttrs);
+    if (err != ePvErrSuccess) {
+        setError("Cannot get attribute list.", err);
+        return false;
+    }
+
+    for (unsigned long i = 0; i < numAttrs; ++i) {
+        QByteArray name(attrList[i]);
+        tPvAttributeInfo pvInfo;
+        if (PvAttrInfo(m_device, name, &pvInfo) != ePvErrSuccess)
+            continue;
+
+        AttributeInfo info;
+        info.datatype = pvInfo.Datatype;
+        info.flags = pvInfo.Flags;
+        if (info.datatype == ePvDatatypeEnum) {
+            char buf[512];
+            unsigned long size;
+            if (PvAttrRangeEnum(m_device, name, buf, sizeof(buf), &size)
+                    == ePvErrSuccess && buf[0] != '\0')
+                info.enumValues = QByteArray(buf).split(',');
+        }
+        m_attrInfo.insert(name, info);
+    }
+    return true;
+}
+
+void Camera::invalidateAttributeCache() const
+{
+    m_valueCache.clear();
+    m_rangeCache.clear();
 }
 
 void Camera::setError(const QString &errorString, tPvErr errorCode) const
@@ -29,36 +29,74 @@
 
 #include <QtCore/QByteArray>
 #include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QVariant>
 #include <PvApi.h>
 
-class QVariant;
+// Static description of a camera attribute, read once when the camera is
+// opened.
+struct AttributeInfo
+{
+    AttributeInfo() : datatype(ePvDatatypeUnknown), flags(0) {}
+
+    tPvDatatype datatype;
+    tPvUint32 flags;
+    QList<QByteArray> enumValues;
+};
+
+struct NetworkStats
+{
+    NetworkStats() { clear(); }
+    void clear() {
+        packetSize = 0;
+        bytesPerSecond = 0;
+        packetsReceived = 0;
+        packetsMissed = 0;
+        packetsErroneous = 0;
+        packetsRequested = 0;
+        packetsResent = 0;
+    }
 
+    quint32 packetSize;
+    quint32 bytesPerSecond;
+    quint32 packetsReceived;
+    quint32 packetsMissed;
+    quint32 packetsErroneous;
+    quint32 packetsRequested;
+    quint32 packetsResent;
+};
+
+// Wrapper for a PvApi camera. The methods used by the Recorder are virtual,
+// so that they can be replaced by other frame sources, see ReplayCamera.
 class Camera
 {
 public:
     Camera();
-    ~Camera();
-
-    bool open(ulong cameraId = 0);
-    bool isOpen() const { return m_device != 0; }
-    void close();
-    bool resetConfig();
-
-    bool startCapturing();
-    bool stopCapturing();
-    bool isCapturing() const;
-    bool enqueueFrame(tPvFrame *frame);
-    bool clearFrameQueue();
-    bool startAcqusition();
-    bool stopAcquisition();
-    bool waitForFrameDone(tPvFrame *frame, ulong timeout, bool *timedOut);
+    virtual ~Camera();
+
+    virtual bool open(ulong cameraId = 0);
+    virtual bool isOpen() const { return m_device != 0; }
+    virtual void close();
+    virtual bool resetConfig();
+
+    virtual bool startCapturing();
+    virtual bool stopCapturing();
+    virtual bool isCapturing() const;
+    virtual bool enqueueFrame(tPvFrame *frame);
+    virtual bool clearFrameQueue();
+    virtual bool startAcqusition();
+    virtual bool stopAcquisition();
+    virtual bool waitForFrameDone(tPvFrame *frame, ulong timeout,
+                                  bool *timedOut);
 
     bool runCommand(const QByteArray &name);
     bool getAttrString(const QByteArray &name, QByteArray *value) const;
     bool setAttrString(const QByteArray &name, const QByteArray &value);
     bool getAttrEnum(const QByteArray &name, QByteArray *value)  const;
     bool setAttrEnum(const QByteArray &name, const QByteArray &value);
-    bool getAttrUint32(const QByteArray &name, quint32 *value) const;
+    virtual bool getAttrUint32(const QByteArray &name, quint32 *value) const;
     bool setAttrUint32(const QByteArray &name, quint32 value);
     bool getAttrFloat32(const QByteArray &name, float *value) const;
     bool setAttrFloat32(const QByteArray &name, float value);
@@ -66,10 +104,16 @@ public:
     bool setAttrInt64(const QByteArray &name, qint64 value);
     bool getAttrBoolean(const QByteArray &name, bool *value) const;
     bool setAttrBoolean(const QByteArray &name, bool value);
-    bool getAttribute(const QByteArray &name, QVariant *value) const;
-    bool setAttribute(const QByteArray &name, const QVariant &value);
+    virtual bool getAttribute(const QByteArray &name, QVariant *value) const;
+    virtual bool setAttribute(const QByteArray &name, const QVariant &value);
+    virtual bool getAttributeRange(const QByteArray &name, QVariant *min,
+                                   QVariant *max) const;
+    bool attributeInfo(const QByteArray &name, AttributeInfo *info) const;
 
-    bool getFrameStats(float &fps, uint &completed, uint &dropped);
+    virtual bool getFrameStats(float &fps, uint &completed, uint &dropped);
+    virtual bool getNetworkStats(NetworkStats &stats);
+    virtual bool adjustPacketSize(quint32 maxPacketSize,
+                                  quint32 *packetSize);
 
     tPvHandle device() const { return m_device; }
     tPvCameraInfoEx cameraInfo() const { return m_cameraInfo; }
@@ -79,25 +123,35 @@ public:
     uint sensorHeight() const { return m_sensorHeight; }
     uint sensorBits() const { return m_sensorBits; }
 
-    QString infoString() const;
+    virtual QString infoString() const;
     QString errorString() const { return m_errorString; }
 
 protected:
     void clearInfo();
+    bool loadAttributeInfo();
+    void invalidateAttributeCache() const;
     void setError(const QString &errorString,
                   tPvErr errorCode = ePvErrSuccess) const;
     void clearError() const;
 
-private:
-    Q_DISABLE_COPY(Camera)
-    mutable QString m_errorString;
-    tPvHandle m_device;
     tPvCameraInfoEx m_cameraInfo;
     QByteArray m_hwAddress;
     QByteArray m_ipAddress;
     quint32 m_sensorWidth;
     quint32 m_sensorHeight;
     quint32 m_sensorBits;
+
+private:
+    Q_DISABLE_COPY(Camera)
+    mutable QString m_errorString;
+    tPvHandle m_device;
+
+    // the attribute infos are valid while the camera is opened; values of
+    // non-volatile attributes and ranges are cached until any attribute is
+    // set, because attributes may depend on each other
+    QHash<QByteArray, AttributeInfo> m_attrInfo;
+    mutable QHash<QByteArray, QVariant> m_valueCache;
+    mutable QHash<QByteArray, QPair<QVariant, QVariant> > m_rangeCache;
 };
 
 #endif // SJCAM_CAMERA_H
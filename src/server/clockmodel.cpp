@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "clockmodel.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+// decay of the sample weights, the fit effectively covers the last 512
+// frames
+const double Decay = 1.0 - 1.0 / 512;
+
+// gain of the moving average of the absolute residuals
+const double ResidualGain = 1.0 / 64;
+
+// samples are accepted unconditionally until the fit has settled
+const int MinSamples = 16;
+
+// samples with a residual larger than RejectFactor times the mean absolute
+// residual (but at least MinRejectUsecs) are rejected
+const double RejectFactor = 5.0;
+const double MinRejectUsecs = 100.0;
+
+// the fit is restarted after this many consecutive outliers, e.g. if the
+// time stamp counter of the camera was reset
+const int MaxConsecutiveRejected = 50;
+
+// crystal oscillators stay well within this limit; it keeps the slope sane
+// while only a few closely spaced samples are available
+const double MaxDriftPpm = 200.0;
+
+// the tick origin follows the samples to keep the fit variables small
+const double RebaseSeconds = 600.0;
+
+} // namespace
+
+ClockModel::ClockModel()
+    : m_tickFrequency(0),
+      m_utcOffset(0)
+{
+    reset(0);
+}
+
+void ClockModel::reset(uint tickFrequency)
+{
+    // bracket the wall clock with two monotonic readings
+    const qint64 before = monotonicUsecs();
+    const qint64 utc = ::utcUsecs();
+    const qint64 after = monotonicUsecs();
+
+    QMutexLocker locker(&m_mutex);
+    m_tickFrequency = tickFrequency;
+    m_utcOffset = utc - (before + after) / 2;
+    m_numRejected = 0;
+    restart(0, 0);
+    m_numSamples = 0;
+}
+
+// Adds a pair of camera ticks and host time and returns false if the sample
+// was rejected as outlier.
+bool ClockModel::addSample(quint64 ticks, qint64 hostUsecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_tickFrequency == 0)
+        return false;
+
+    // the first sample or a counter which went backwards starts a new fit
+    if (m_numSamples == 0 || ticks < m_tickOrigin) {
+        restart(ticks, hostUsecs);
+        return true;
+    }
+
+    // y is the deviation of the host time from the nominal tick rate
+    const double x = double(ticks - m_tickOrigin) / m_tickFrequency;
+    const double y = double(hostUsecs) - m_hostOrigin - 1e6 * x;
+
+    const double residual = y - m_meanY - m_slope * (x - m_meanX);
+    const double limit = qMax(RejectFactor * m_residual, MinRejectUsecs);
+    if (m_numSamples >= MinSamples && qAbs(residual) > limit) {
+        ++m_numRejected;
+        // let the tolerance grow if the fit is systematically off
+        m_residual += (limit - m_residual) * ResidualGain;
+        if (++m_numConsecutiveRejected >= MaxConsecutiveRejected)
+            restart(ticks, hostUsecs);
+        return false;
+    }
+    m_numConsecutiveRejected = 0;
+    m_residual += (qAbs(residual) - m_residual) * ResidualGain;
+
+    // exponentially weighted incremental mean and covariance update
+    m_weight = Decay * m_weight + 1.0;
+    const double dx = x - m_meanX;
+    const double dy = y - m_meanY;
+    m_meanX += dx / m_weight;
+    m_meanY += dy / m_weight;
+    m_covXX = Decay * m_covXX + dx * (x - m_meanX);
+    m_covXY = Decay * m_covXY + dx * (y - m_meanY);
+    if (m_covXX > 0)
+        m_slope = qBound(-MaxDriftPpm, m_covXY / m_covXX, MaxDriftPpm);
+    ++m_numSamples;
+
+    // moving the origin shifts x but leaves y unchanged
+    if (x > RebaseSeconds) {
+        m_tickOrigin = ticks;
+        m_hostOrigin += 1e6 * x;
+        m_meanX -= x;
+    }
+    return true;
+}
+
+bool ClockModel::isValid() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_numSamples > 0;
+}
+
+int ClockModel::numSamples() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_numSamples;
+}
+
+int ClockModel::numRejected() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_numRejected;
+}
+
+// Returns the drift of the camera clock relative to the host clock in
+// parts per million.
+double ClockModel::driftPpm() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_slope;
+}
+
+double ClockModel::residualUsecs() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_residual;
+}
+
+// Returns the monotonic host time of the given camera ticks, or 0 if the
+// model has no samples yet.
+qint64 ClockModel::hostUsecs(quint64 ticks) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_numSamples == 0)
+        return 0;
+    return qRound64(predict(double(qint64(ticks - m_tickOrigin))
+                            / m_tickFrequency));
+}
+
+// Returns the UTC time of the given camera ticks in microseconds since
+// 1970-01-01, or 0 if the model has no samples yet.
+qint64 ClockModel::utcUsecs(quint64 ticks) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_numSamples == 0)
+        return 0;
+    return qRound64(predict(double(qint64(ticks - m_tickOrigin))
+                            / m_tickFrequency)) + m_utcOffset;
+}
+
+qint64 ClockModel::hostToUtcUsecs(qint64 hostUsecs) const
+{
+    QMutexLocker locker(&m_mutex);
+    return hostUsecs + m_utcOffset;
+}
+
+// Returns the UTC time of the given camera ticks, or the current system
+// time if the model has no samples yet.
+QDateTime ClockModel::utcTime(quint64 ticks) const
+{
+    const qint64 usecs = utcUsecs(ticks);
+    if (usecs == 0)
+        return QDateTime::currentDateTimeUtc();
+    return QDateTime::fromMSecsSinceEpoch(usecs / 1000).toUTC();
+}
+
+QByteArray ClockModel::isoString(qint64 utcUsecs)
+{
+    QDateTime time = QDateTime::fromTime_t(uint(utcUsecs / 1000000)).toUTC();
+    return time.toString("yyyy-MM-ddThh:mm:ss").toAscii() + "."
+            + QByteArray::number(utcUsecs % 1000000).rightJustified(6, '0');
+}
+
+double ClockModel::predict(double x) const
+{
+    return m_hostOrigin + 1e6 * x + m_meanY + m_slope * (x - m_meanX);
+}
+
+void ClockModel::restart(quint64 ticks, qint64 hostUsecs)
+{
+    m_tickOrigin = ticks;
+    m_hostOrigin = double(hostUsecs);
+    m_weight = 1.0;
+    m_meanX = 0.0;
+    m_meanY = 0.0;
+    m_covXX = 0.0;
+    m_covXY = 0.0;
+    m_slope = 0.0;
+    m_residual = 0.0;
+    m_numSamples = 1;
+    m_numConsecutiveRejected = 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_CLOCKMODEL_H
+#define SJCAM_CLOCKMODEL_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QMutex>
+
+// Maps the time stamp counter of the camera to the monotonic host clock and
+// to UTC. The mapping is a linear fit of host time against camera ticks,
+// updated in O(1) per frame using exponentially weighted moving sums, so it
+// follows slow drifts of the camera oscillator. Samples which deviate by
+// more than a multiple of the typical residual (e.g. frames delayed by the
+// scheduler) are rejected. The offset between the monotonic clock and UTC
+// is measured once by reset(), so no wall clock is read per frame.
+//
+// addSample() is called by the capture thread, all methods are thread-safe.
+class ClockModel
+{
+public:
+    ClockModel();
+
+    void reset(uint tickFrequency);
+    bool addSample(quint64 ticks, qint64 hostUsecs);
+
+    bool isValid() const;
+    int numSamples() const;
+    int numRejected() const;
+    double driftPpm() const;
+    double residualUsecs() const;
+
+    qint64 hostUsecs(quint64 ticks) const;
+    qint64 utcUsecs(quint64 ticks) const;
+    qint64 hostToUtcUsecs(qint64 hostUsecs) const;
+    QDateTime utcTime(quint64 ticks) const;
+
+    // Formats a UTC time as ISO 8601 string with microseconds, as used for
+    // the DATE-OBS keyword.
+    static QByteArray isoString(qint64 utcUsecs);
+
+private:
+    Q_DISABLE_COPY(ClockModel)
+    double predict(double x) const;
+    void restart(quint64 ticks, qint64 hostUsecs);
+
+    mutable QMutex m_mutex;
+    uint m_tickFrequency;
+    qint64 m_utcOffset;
+    quint64 m_tickOrigin;
+    double m_hostOrigin;
+    double m_weight;
+    double m_meanX;
+    double m_meanY;
+    double m_covXX;
+    double m_covXY;
+    double m_slope;
+    double m_residual;
+    int m_numSamples;
+    int m_numRejected;
+    int m_numConsecutiveRejected;
+};
+
+#endif // SJCAM_CLOCKMODEL_H
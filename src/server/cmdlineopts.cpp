@@ -33,7 +33,7 @@ CmdLineOpts::CmdLineOpts()
       serverPort(0),
       deviceName(QByteArray()),
       cameraId(0),
-      configFileName(QString()),
+      configFileNames(QStringList()),
       verbose(-1),
       list(false),
       info(false),
@@ -114,10 +114,11 @@ bool CmdLineOpts::parse()
                 printReqArg("-c");
                 return false;
             }
-            configFileName = iter.next();
+            configFileNames.append(iter.next());
         }
-        else if (arg == "-v") {
-            verbose = 1;
+        else if (arg == "-v" || arg == "-vv") {
+            // -v enables status output, -vv or -v -v also debug output
+            verbose = qMax(verbose, 0) + arg.size() - 1;
         }
         else if (arg == "--list") {
             list = true;
@@ -141,6 +142,14 @@ bool CmdLineOpts::parse()
         }
     }
 
+    // each config file describes one camera
+    if (configFileNames.size() > 1 && (cameraId != 0 || !deviceName.isEmpty()))
+    {
+        cout << appName << ": options `-u' and `-n' cannot be used with "
+             << "multiple config files.\n" << moreInfo() << endl;
+        return false;
+    }
+
     return true;
 }
 
@@ -153,8 +162,9 @@ void CmdLineOpts::printHelp()
          << "\n  -p port     DCP server port [2001]"
          << "\n  -n device   DCP device name [sjcam]"
          << "\n  -u id       Select camera by its unique ID"
-         << "\n  -c file     Load configuration from config file"
-         << "\n  -v          Verbose text output"
+         << "\n  -c file     Load configuration from config file, use"
+         << "\n              multiple times to run several cameras"
+         << "\n  -v          Verbose text output, -vv for debug output"
          << "\n  --list      List available cameras and quit"
          << "\n  --info      Show camera informations and quit"
          << "\n  --version   Show program version and quit"
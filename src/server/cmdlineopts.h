@@ -28,6 +28,7 @@
 #define SJCSERVER_CMDLINEOPTS_H
 
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QByteArray>
 #include <QtCore/QTextStream>
 
@@ -47,7 +48,7 @@ public:
     quint16 serverPort;
     QByteArray deviceName;
     ulong cameraId;
-    QString configFileName;
+    QStringList configFileNames;
     int verbose;
     bool list;
     bool info;
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "defectmap.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// maximum fraction of pixels which are accepted as defects by detect()
+const double MaxDefectFraction = 0.01;
+
+// lower limit of the noise estimate used by detect(), in counts
+const double MinSigma = 0.5;
+
+const char FileHeader[] = "# sjcam defect map";
+
+// offsets of the neighbours of a pixel, in the order of the bits of the
+// neighbour masks
+const int NumNeighbours = 8;
+const int NeighbourDx[NumNeighbours] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+const int NeighbourDy[NumNeighbours] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+bool isDefect(const QVector<quint32> &indices, quint32 index)
+{
+    return std::binary_search(indices.constBegin(), indices.constEnd(),
+                              index);
+}
+
+// Defective neighbours are not part of the masks, so the result does not
+// depend on the order in which the pixels are replaced.
+template <typename T>
+void correctT(T *data, int stride, int width,
+              const QVector<quint32> &indices,
+              const QVector<quint8> &neighbours)
+{
+    for (int k = 0; k < indices.size(); ++k) {
+        const uint mask = neighbours[k];
+        if (mask == 0)
+            continue;
+        const int x = int(indices[k] % uint(width));
+        const int y = int(indices[k] / uint(width));
+        T * const pixel = data + qint64(y) * stride + x;
+        T values[NumNeighbours];
+        int n = 0;
+        for (int j = 0; j < NumNeighbours; ++j) {
+            if (!(mask & (1u << j)))
+                continue;
+            // insertion sort, there are at most 8 neighbours
+            const T value = pixel[qint64(NeighbourDy[j]) * stride +
+                                  NeighbourDx[j]];
+            int i = n++;
+            for (; i > 0 && values[i-1] > value; --i)
+                values[i] = values[i-1];
+            values[i] = value;
+        }
+        *pixel = (n % 2 == 1) ? values[n/2] :
+                T((int(values[n/2-1]) + int(values[n/2]) + 1) / 2);
+    }
+}
+
+} // namespace
+
+DefectMap::DefectMap()
+    : m_width(0),
+      m_height(0)
+{
+}
+
+bool DefectMap::matches(int width, int height) const
+{
+    return !m_indices.isEmpty() && width == m_width && height == m_height;
+}
+
+void DefectMap::clear()
+{
+    m_width = 0;
+    m_height = 0;
+    m_indices.clear();
+    m_neighbours.clear();
+}
+
+bool DefectMap::detect(const float *image, int width, int height,
+                       double threshold)
+{
+    const int numPixels = width * height;
+    if (numPixels <= 0) {
+        m_errorString = "Empty image.";
+        return false;
+    }
+
+    // median and median absolute deviation of the image
+    QVector<float> values(numPixels);
+    qCopy(image, image + numPixels, values.begin());
+    float *mid = values.begin() + numPixels / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    const float median = *mid;
+    for (int i = 0; i < numPixels; ++i)
+        values[i] = qAbs(image[i] - median);
+    std::nth_element(values.begin(), mid, values.end());
+    const double sigma = qMax(1.4826 * *mid, MinSigma);
+
+    const float limit = float(threshold * sigma);
+    QVector<quint32> indices;
+    for (int i = 0; i < numPixels; ++i)
+        if (qAbs(image[i] - median) > limit)
+            indices.append(quint32(i));
+    if (indices.size() > MaxDefectFraction * numPixels) {
+        m_errorString = QString("Too many defective pixels (%1), the "
+                                "threshold is too low.").arg(indices.size());
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_indices = indices;
+    findNeighbours();
+    return true;
+}
+
+// The file contains the header line, the image size and one pixel index
+// per line. Lines starting with '#' are ignored.
+bool DefectMap::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        m_errorString = "Cannot open the file '" + fileName + "'.";
+        return false;
+    }
+
+    int width = 0, height = 0;
+    QVector<quint32> indices;
+    bool sizeRead = false;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        bool ok1 = true, ok2 = true;
+        if (!sizeRead) {
+            const QList<QByteArray> size = line.simplified().split(' ');
+            if (size.size() == 2) {
+                width = size[0].toInt(&ok1);
+                height = size[1].toInt(&ok2);
+            }
+            else
+                ok1 = false;
+            sizeRead = true;
+        }
+        else
+            indices.append(line.toUInt(&ok1));
+        if (!ok1 || !ok2 || width <= 0 || height <= 0 ||
+                (!indices.isEmpty() &&
+                 indices.last() >= quint32(width) * quint32(height))) {
+            m_errorString = "Invalid defect map '" + fileName + "'.";
+            return false;
+        }
+    }
+    if (!sizeRead) {
+        m_errorString = "Invalid defect map '" + fileName + "'.";
+        return false;
+    }
+
+    qSort(indices);
+    indices.erase(std::unique(indices.begin(), indices.end()),
+                  indices.end());
+    m_width = width;
+    m_height = height;
+    m_indices = indices;
+    findNeighbours();
+    return true;
+}
+
+bool DefectMap::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        m_errorString = "Cannot create the file '" + fileName + "'.";
+        return false;
+    }
+
+    QTextStream os(&file);
+    os << FileHeader << "\n" << m_width << " " << m_height << "\n";
+    foreach (quint32 index, m_indices)
+        os << index << "\n";
+    os.flush();
+    if (file.error() != QFile::NoError) {
+        m_errorString = "Cannot write the file '" + fileName + "'.";
+        return false;
+    }
+    return true;
+}
+
+void DefectMap::correct(uchar *data, int stride) const
+{
+    correctT(data, stride, m_width, m_indices, m_neighbours);
+}
+
+void DefectMap::correct(quint16 *data, int stride) const
+{
+    correctT(data, stride, m_width, m_indices, m_neighbours);
+}
+
+// Marks the neighbours of each defect which are inside the image and not
+// defective themselves.
+void DefectMap::findNeighbours()
+{
+    m_neighbours.resize(m_indices.size());
+    for (int k = 0; k < m_indices.size(); ++k) {
+        const int x = int(m_indices[k] % uint(m_width));
+        const int y = int(m_indices[k] / uint(m_width));
+        quint8 mask = 0;
+        for (int j = 0; j < NumNeighbours; ++j) {
+            const int nx = x + NeighbourDx[j];
+            const int ny = y + NeighbourDy[j];
+            if (nx >= 0 && nx < m_width && ny >= 0 && ny < m_height &&
+                    !isDefect(m_indices, quint32(ny * m_width + nx)))
+                mask |= quint8(1 << j);
+        }
+        m_neighbours[k] = mask;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_DEFECTMAP_H
+#define SJCAM_DEFECTMAP_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QMetaType>
+
+// Sorted list of the indices (y * width + x) of defective pixels, e.g. hot
+// pixels found in dark frames. Defective pixels are replaced by the median
+// of their neighbours which are not defective themselves. These neighbours
+// are determined when the map is created, so a correction takes
+// O(number of defects) per frame.
+class DefectMap
+{
+public:
+    DefectMap();
+
+    bool isEmpty() const { return m_indices.isEmpty(); }
+    int size() const { return m_indices.size(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    const QVector<quint32> &indices() const { return m_indices; }
+    bool matches(int width, int height) const;
+    void clear();
+
+    // Marks the pixels of an averaged dark frame which deviate more than
+    // threshold times the robust standard deviation from the median.
+    // Returns false if more than 1% of the pixels would be marked.
+    bool detect(const float *image, int width, int height, double threshold);
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+    QString errorString() const { return m_errorString; }
+
+    // Replaces the defective pixels of an image with the size of the map,
+    // stride is the number of pixels per row.
+    void correct(uchar *data, int stride) const;
+    void correct(quint16 *data, int stride) const;
+
+private:
+    void findNeighbours();
+
+    int m_width;
+    int m_height;
+    QVector<quint32> m_indices;
+    QVector<quint8> m_neighbours;  // bit masks of the usable neighbours
+    mutable QString m_errorString;
+};
+
+Q_DECLARE_METATYPE(DefectMap)
+
+#endif // SJCAM_DEFECTMAP_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "emulatedcamera.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+// frequency of the emulated time stamp counter
+const quint32 TimeStampFrequency = 1000000;
+
+} // namespace
+
+EmulatedCamera::EmulatedCamera(float minFrameRate, float maxFrameRate)
+    : m_open(false),
+      m_minFrameRate(minFrameRate),
+      m_maxFrameRate(maxFrameRate)
+{
+}
+
+// Sets the default values of the attributes; subclasses reset their output
+// format in addition.
+bool EmulatedCamera::resetConfig()
+{
+    m_attributes.clear();
+    m_attributes.insert("PixelFormat", QByteArray("Mono16"));
+    m_attributes.insert("ExposureValue", quint32(10000));
+    m_attributes.insert("FrameRate", 30.0f);
+    m_attributes.insert("FrameStartTriggerMode", QByteArray("FixedRate"));
+    m_attributes.insert("Width", m_sensorWidth);
+    m_attributes.insert("Height", m_sensorHeight);
+    m_attributes.insert("RegionX", quint32(0));
+    m_attributes.insert("RegionY", quint32(0));
+    m_attributes.insert("BinningX", quint32(1));
+    m_attributes.insert("BinningY", quint32(1));
+    m_attributes.insert("SensorWidth", m_sensorWidth);
+    m_attributes.insert("SensorHeight", m_sensorHeight);
+    m_attributes.insert("SensorBits", m_sensorBits);
+    m_attributes.insert("TimeStampFrequency", TimeStampFrequency);
+    m_attributes.insert("PacketSize", quint32(8228));
+    m_attributes.insert("StreamBytesPerSecond", quint32(115000000));
+    return true;
+}
+
+bool EmulatedCamera::getAttrUint32(const QByteArray &name,
+                                   quint32 *value) const
+{
+    QVariant v;
+    bool ok = false;
+    if (getAttribute(name, &v))
+        *value = v.toUInt(&ok);
+    if (!ok) {
+        *value = 0;
+        setError(QString("Cannot get attribute %1.").arg(QString(name)));
+    }
+    return ok;
+}
+
+bool EmulatedCamera::getAttribute(const QByteArray &name,
+                                  QVariant *value) const
+{
+    QHash<QByteArray, QVariant>::const_iterator it = m_attributes.find(name);
+    if (!m_open || it == m_attributes.constEnd()) {
+        *value = QVariant();
+        setError(QString("Unknown attribute %1.").arg(QString(name)));
+        return false;
+    }
+    *value = it.value();
+    return true;
+}
+
+// Unknown attributes are accepted and stored, so that the attributes of the
+// configuration can be applied unchanged.
+bool EmulatedCamera::setAttribute(const QByteArray &name,
+                                  const QVariant &value)
+{
+    if (!m_open) {
+        setError(QString("Cannot set attribute %1.").arg(QString(name)));
+        return false;
+    }
+    if (value.isNull())
+        return true;  // commands are ignored
+
+    QVariant v = value;
+    QHash<QByteArray, QVariant>::const_iterator it = m_attributes.find(name);
+    if (it != m_attributes.constEnd() && !v.convert(it.value().type())) {
+        setError(QString("Invalid value for attribute %1.")
+                 .arg(QString(name)));
+        return false;
+    }
+    if (!applyAttribute(name, v))
+        return false;
+    m_attributes.insert(name, v);
+    return true;
+}
+
+bool EmulatedCamera::getAttributeRange(const QByteArray &name,
+                                       QVariant *min, QVariant *max) const
+{
+    if (name == "ExposureValue") {
+        *min = quint32(1);
+        *max = quint32(60000000);
+    }
+    else if (name == "FrameRate") {
+        *min = m_minFrameRate;
+        *max = m_maxFrameRate;
+    }
+    else if (name == "Width" || name == "Height") {
+        *min = quint32(1);
+        *max = (name == "Width") ? m_sensorWidth : m_sensorHeight;
+    }
+    else {
+        *min = QVariant();
+        *max = QVariant();
+        setError(QString("Cannot get range of attribute %1.")
+                 .arg(QString(name)));
+        return false;
+    }
+    return true;
+}
+
+bool EmulatedCamera::getNetworkStats(NetworkStats &stats)
+{
+    stats.clear();
+    stats.packetSize = m_attributes.value("PacketSize").toUInt();
+    return true;
+}
+
+bool EmulatedCamera::adjustPacketSize(quint32 maxPacketSize,
+                                      quint32 *packetSize)
+{
+    m_attributes.insert("PacketSize", maxPacketSize);
+    *packetSize = maxPacketSize;
+    return true;
+}
+
+// Called by setAttribute() with the converted value before it is stored;
+// returns false to reject the value.
+bool EmulatedCamera::applyAttribute(const QByteArray &name,
+                                    const QVariant &value)
+{
+    Q_UNUSED(name);
+    Q_UNUSED(value);
+    return true;
+}
+
+void EmulatedCamera::setInfo(const QByteArray &cameraName,
+                             const QByteArray &modelName,
+                             uint width, uint height, uint bitDepth)
+{
+    qMemSet(&m_cameraInfo, 0, sizeof(m_cameraInfo));
+    qstrncpy(m_cameraInfo.CameraName, cameraName.constData(),
+             sizeof(m_cameraInfo.CameraName));
+    qstrncpy(m_cameraInfo.ModelName, modelName.constData(),
+             sizeof(m_cameraInfo.ModelName));
+    qstrncpy(m_cameraInfo.SerialNumber, "0",
+             sizeof(m_cameraInfo.SerialNumber));
+    qstrncpy(m_cameraInfo.FirmwareVersion, "-",
+             sizeof(m_cameraInfo.FirmwareVersion));
+    m_hwAddress = "00-00-00-00-00-00";
+    m_ipAddress = "0.0.0.0";
+    m_sensorWidth = width;
+    m_sensorHeight = height;
+    m_sensorBits = bitDepth;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_EMULATEDCAMERA_H
+#define SJCAM_EMULATEDCAMERA_H
+
+#include "camera.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QVariant>
+
+// Base class of the frame sources which replace a PvApi camera, see
+// ReplayCamera and SyntheticCamera. The attributes are emulated by a hash
+// of values; subclasses handle the attributes which change their output in
+// applyAttribute().
+class EmulatedCamera : public Camera
+{
+public:
+    EmulatedCamera(float minFrameRate, float maxFrameRate);
+
+    bool isOpen() const { return m_open; }
+    bool resetConfig();
+
+    bool getAttrUint32(const QByteArray &name, quint32 *value) const;
+    bool getAttribute(const QByteArray &name, QVariant *value) const;
+    bool setAttribute(const QByteArray &name, const QVariant &value);
+    bool getAttributeRange(const QByteArray &name, QVariant *min,
+                           QVariant *max) const;
+
+    bool getNetworkStats(NetworkStats &stats);
+    bool adjustPacketSize(quint32 maxPacketSize, quint32 *packetSize);
+
+protected:
+    virtual bool applyAttribute(const QByteArray &name, const QVariant &value);
+    void setInfo(const QByteArray &cameraName, const QByteArray &modelName,
+                 uint width, uint height, uint bitDepth);
+
+    bool m_open;
+    QHash<QByteArray, QVariant> m_attributes;
+
+private:
+    Q_DISABLE_COPY(EmulatedCamera)
+    const float m_minFrameRate;
+    const float m_maxFrameRate;
+};
+
+#endif // SJCAM_EMULATEDCAMERA_H
@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "framecalibrator.h"
+#include "frameops.h"
+#include "pipelinestats.h"
+#include "version.h"
+#include <QtCore/QtCore>
+#include <QtCore/QtConcurrentMap>
+#include <fitsio.h>
+
+namespace {
+
+struct CalibrationChunk
+{
+    void *data;
+    ulong format;
+    const float *offset;
+    const float *gain;
+    int begin;
+    int count;
+};
+
+void calibrateChunk(CalibrationChunk &chunk)
+{
+    const float *offset = chunk.offset + chunk.begin;
+    const float *gain = chunk.gain + chunk.begin;
+    if (chunk.format == ePvFmtMono8)
+        calibrate(reinterpret_cast<uchar *>(chunk.data) + chunk.begin,
+                  offset, gain, chunk.count);
+    else
+        calibrate(reinterpret_cast<quint16 *>(chunk.data) + chunk.begin,
+                  offset, gain, chunk.count);
+}
+
+QString fitsioErrorString(int errcode)
+{
+    char fitsioMsg[31];  // message has max 30 chars
+    fits_get_errstatus(errcode, fitsioMsg);
+    return QString(fitsioMsg);
+}
+
+} // namespace
+
+FrameCalibrator::FrameCalibrator(QObject *parent)
+    : QObject(parent),
+      m_enabled(false),
+      m_sizeErrorSent(false),
+      m_width(0),
+      m_height(0),
+      m_defectMode(DefectsOff),
+      m_defectErrorSent(false),
+      m_defectThreshold(10.0),
+      m_buildType(Dark),
+      m_buildCount(0),
+      m_buildNumFrames(0),
+      m_buildWidth(0),
+      m_buildHeight(0)
+{
+}
+
+FrameCalibrator::~FrameCalibrator()
+{
+}
+
+QByteArray FrameCalibrator::defectModeName(int mode)
+{
+    switch (mode) {
+    case DefectsPreview:
+        return "preview";
+    case DefectsOn:
+        return "on";
+    default:
+        return "off";
+    }
+}
+
+bool FrameCalibrator::defectModeFromName(const QByteArray &name, int *mode)
+{
+    for (int i = DefectsOff; i <= DefectsOn; ++i) {
+        if (name == defectModeName(i)) {
+            *mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameCalibrator::setDirectory(const QString &directory)
+{
+    m_directory = QDir(directory);
+}
+
+void FrameCalibrator::setFileNamePrefix(const QString &prefix)
+{
+    m_fileNamePrefix = prefix;
+}
+
+void FrameCalibrator::setDefectThreshold(double threshold)
+{
+    m_defectThreshold = threshold;
+}
+
+void FrameCalibrator::processFrame(tPvFrame *frame)
+{
+    if (frame && (frame->Status == ePvErrSuccess)) {
+        // master frames are built from uncalibrated frames
+        if (m_buildCount > 0)
+            addBuildFrame(frame);
+        if (m_enabled && !m_offset.isEmpty())
+            calibrateFrame(frame);
+        if (m_defectMode == DefectsOn && !m_defectMap.isEmpty())
+            correctDefects(frame);
+    }
+    stampFrame(frame, FrameTrace::Calibrated);
+    emit frameFinished(frame);
+}
+
+void FrameCalibrator::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    m_sizeErrorSent = false;
+    emit calibrationChanged(m_enabled, m_darkFileName, m_flatFileName);
+}
+
+bool FrameCalibrator::loadMaster(int type, const QString &fileName)
+{
+    QVector<float> image;
+    int width = 0, height = 0;
+    if (!fileName.isEmpty()) {
+        if (!readImage(fileName, &image, &width, &height))
+            return false;
+
+        // dark and flat must have the same size
+        const QVector<float> &other = (type == Dark) ? m_flat : m_dark;
+        if (!other.isEmpty() && (width != m_width || height != m_height)) {
+            emit error("Size of '" + fileName + "' doesn't match the other "
+                       "calibration frame.");
+            return false;
+        }
+        m_width = width;
+        m_height = height;
+    }
+
+    if (type == Dark) {
+        m_dark = image;
+        m_darkFileName = fileName;
+    } else {
+        m_flat = image;
+        m_flatFileName = fileName;
+    }
+    updateCoefficients();
+    emit calibrationChanged(m_enabled, m_darkFileName, m_flatFileName);
+    return true;
+}
+
+void FrameCalibrator::buildMaster(int type, int numFrames)
+{
+    m_buildType = type;
+    m_buildCount = qMax(numFrames, 0);
+    m_buildNumFrames = 0;
+    m_buildSum.clear();
+    if (m_buildCount > 0 && type == Defects)
+        emit info(QString("Building defect map from %1 frames...")
+                  .arg(m_buildCount));
+    else if (m_buildCount > 0)
+        emit info(QString("Building master %1 from %2 frames...")
+                  .arg(type == Dark ? "dark" : "flat").arg(m_buildCount));
+}
+
+// An empty file name unloads the defect map.
+bool FrameCalibrator::loadDefectMap(const QString &fileName)
+{
+    DefectMap map;
+    if (!fileName.isEmpty() && !map.load(fileName)) {
+        emit error(map.errorString());
+        return false;
+    }
+    m_defectMap = map;
+    m_defectFileName = fileName;
+    m_defectErrorSent = false;
+    emitDefectModeChanged();
+    return true;
+}
+
+void FrameCalibrator::setDefectMode(int mode)
+{
+    m_defectMode = mode;
+    m_defectErrorSent = false;
+    emitDefectModeChanged();
+}
+
+// The streamer corrects the rendered preview images in both the preview and
+// the on mode, because packed frames cannot be corrected in place.
+void FrameCalibrator::emitDefectModeChanged()
+{
+    emit defectModeChanged(m_defectMode, m_defectFileName,
+                           m_defectMap.size());
+    emit previewDefectMapChanged(m_defectMode == DefectsOff ? DefectMap()
+                                                            : m_defectMap);
+}
+
+void FrameCalibrator::calibrateFrame(tPvFrame *frame)
+{
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+    if (frame->Format != ePvFmtMono8 && frame->Format != ePvFmtMono16) {
+        // packed frames cannot be calibrated in place
+        if (!m_sizeErrorSent) {
+            emit error("Cannot calibrate frame, unsupported pixel format.");
+            m_sizeErrorSent = true;
+        }
+        return;
+    }
+    if (width != m_width || height != m_height) {
+        if (!m_sizeErrorSent) {
+            emit error("Cannot calibrate frame, the frame doesn't match the "
+                       "calibration frames.");
+            m_sizeErrorSent = true;
+        }
+        return;
+    }
+
+    // calibrate blocks of rows in parallel
+    const int numChunks = qMax(QThread::idealThreadCount(), 1);
+    const int rowsPerChunk = (height + numChunks - 1) / numChunks;
+    QList<CalibrationChunk> chunks;
+    for (int row = 0; row < height; row += rowsPerChunk) {
+        CalibrationChunk chunk;
+        chunk.data = frame->ImageBuffer;
+        chunk.format = frame->Format;
+        chunk.offset = m_offset.constData();
+        chunk.gain = m_gain.constData();
+        chunk.begin = row * width;
+        chunk.count = qMin(rowsPerChunk, height - row) * width;
+        chunks.append(chunk);
+    }
+    QtConcurrent::blockingMap(chunks, calibrateChunk);
+    flagFrame(frame, FrameTrace::DarkFlatApplied);
+}
+
+void FrameCalibrator::correctDefects(tPvFrame *frame)
+{
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+    if (frame->Format != ePvFmtMono8 && frame->Format != ePvFmtMono16) {
+        if (!m_defectErrorSent) {
+            emit error("Cannot correct defects, unsupported pixel format.");
+            m_defectErrorSent = true;
+        }
+        return;
+    }
+    if (!m_defectMap.matches(width, height)) {
+        if (!m_defectErrorSent) {
+            emit error("Cannot correct defects, the frame doesn't match the "
+                       "defect map.");
+            m_defectErrorSent = true;
+        }
+        return;
+    }
+
+    if (frame->Format == ePvFmtMono8)
+        m_defectMap.correct(reinterpret_cast<uchar *>(frame->ImageBuffer),
+                            width);
+    else
+        m_defectMap.correct(reinterpret_cast<quint16 *>(frame->ImageBuffer),
+                            width);
+    flagFrame(frame, FrameTrace::DefectsCorrected);
+}
+
+void FrameCalibrator::addBuildFrame(tPvFrame *frame)
+{
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+    const int numPixels = width * height;
+
+    if (m_buildNumFrames == 0) {
+        // a flat field is dark subtracted, so it cannot be built with a
+        // master dark of another size
+        if (m_buildType == Flat && !m_dark.isEmpty() &&
+                (width != m_width || height != m_height)) {
+            emit error("Cannot build master flat, the frame doesn't match "
+                       "the master dark.");
+            m_buildCount = 0;
+            return;
+        }
+        m_buildWidth = width;
+        m_buildHeight = height;
+        m_buildSum.fill(0, numPixels);
+    }
+    else if (width != m_buildWidth || height != m_buildHeight) {
+        emit error("Frame size changed while building a master frame.");
+        m_buildCount = 0;
+        m_buildSum.clear();
+        return;
+    }
+
+    if (frame->Format == ePvFmtMono8)
+        accumulate(m_buildSum.data(),
+                   reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                   numPixels);
+    else if (frame->Format == ePvFmtMono12Packed) {
+        m_unpackBuffer.resize(numPixels);
+        unpackMono12Packed(m_unpackBuffer.data(),
+                           reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                           numPixels);
+        accumulate(m_buildSum.data(), m_unpackBuffer.constData(), numPixels);
+    }
+    else
+        accumulate(m_buildSum.data(),
+                   reinterpret_cast<const quint16 *>(frame->ImageBuffer),
+                   numPixels);
+
+    if (++m_buildNumFrames < m_buildCount)
+        return;
+
+    QVector<float> master(numPixels);
+    scale(master.data(), m_buildSum.constData(), numPixels,
+          1.0f / m_buildNumFrames);
+    if (m_buildType == Defects) {
+        finishDefectMap(master, width, height);
+        return;
+    }
+    if (m_buildType == Flat && !m_dark.isEmpty()) {
+        // the master dark may have been replaced during the build
+        if (m_width != width || m_height != height) {
+            emit error("Cannot build master flat, the frame doesn't match "
+                       "the master dark.");
+            m_buildCount = 0;
+            m_buildNumFrames = 0;
+            m_buildSum.clear();
+            return;
+        }
+        for (int i = 0; i < numPixels; ++i)
+            master[i] -= m_dark[i];
+    }
+
+    const QString typeName = (m_buildType == Dark) ? "dark" : "flat";
+    const QString fileName = m_directory.absoluteFilePath(
+                QString("%1_%2_%3.fits").arg(m_fileNamePrefix).arg(typeName)
+                .arg(QDateTime::currentDateTimeUtc().toString(
+                         "yyyyMMdd-hhmmss")));
+    const int type = m_buildType;
+    const int numFrames = m_buildNumFrames;
+    m_buildCount = 0;
+    m_buildNumFrames = 0;
+    m_buildSum.clear();
+
+    if (!writeImage(fileName, master, width, height, type, numFrames))
+        return;
+    emit info("Master " + typeName + " written [" + fileName + "].");
+    loadMaster(type, fileName);
+}
+
+// The defect map is detected from the average of the build frames, which
+// should be dark frames.
+void FrameCalibrator::finishDefectMap(const QVector<float> &average,
+                                      int width, int height)
+{
+    m_buildCount = 0;
+    m_buildNumFrames = 0;
+    m_buildSum.clear();
+
+    DefectMap map;
+    if (!map.detect(average.constData(), width, height, m_defectThreshold)) {
+        emit error("Cannot build defect map. " + map.errorString());
+        return;
+    }
+    const QString fileName = m_directory.absoluteFilePath(
+                QString("%1_defects_%2.txt").arg(m_fileNamePrefix)
+                .arg(QDateTime::currentDateTimeUtc().toString(
+                         "yyyyMMdd-hhmmss")));
+    if (!map.save(fileName)) {
+        emit error(map.errorString());
+        return;
+    }
+    emit info(QString("Defect map with %1 pixels written [%2].")
+              .arg(map.size()).arg(fileName));
+    m_defectMap = map;
+    m_defectFileName = fileName;
+    m_defectErrorSent = false;
+    emitDefectModeChanged();
+}
+
+void FrameCalibrator::updateCoefficients()
+{
+    const int numPixels = m_width * m_height;
+    m_sizeErrorSent = false;
+    if (m_dark.isEmpty() && m_flat.isEmpty()) {
+        m_offset.clear();
+        m_gain.clear();
+        return;
+    }
+
+    if (m_dark.isEmpty())
+        m_offset.fill(0.0f, numPixels);
+    else
+        m_offset = m_dark;
+
+    m_gain.fill(1.0f, numPixels);
+    if (!m_flat.isEmpty()) {
+        // normalize the flat field to a mean of 1; pixels without signal
+        // in the flat field are set to zero
+        double sum = 0;
+        int numValid = 0;
+        for (int i = 0; i < numPixels; ++i) {
+            if (m_flat[i] > 0) {
+                sum += m_flat[i];
+                ++numValid;
+            }
+        }
+        const float mean = numValid > 0 ? float(sum / numValid) : 1.0f;
+        for (int i = 0; i < numPixels; ++i)
+            m_gain[i] = (m_flat[i] > 0) ? mean / m_flat[i] : 0.0f;
+    }
+}
+
+bool FrameCalibrator::readImage(const QString &fileName,
+                                QVector<float> *image, int *width,
+                                int *height)
+{
+    int errcode = 0;
+    fitsfile *ff = 0;
+    fits_open_image(&ff, fileName.toAscii(), READONLY, &errcode);
+    if (errcode) {
+        sendError("Cannot open the file '" + fileName + "'.", errcode);
+        return false;
+    }
+
+    int naxis = 0;
+    long naxes[2] = { 0, 0 };
+    fits_get_img_dim(ff, &naxis, &errcode);
+    if (!errcode && naxis != 2) {
+        emit error("The file '" + fileName + "' doesn't contain an image.");
+        fits_close_file(ff, &errcode);
+        return false;
+    }
+    fits_get_img_size(ff, 2, naxes, &errcode);
+    if (errcode) {
+        sendError("Cannot read the image size.", errcode);
+        fits_close_file(ff, &errcode);
+        return false;
+    }
+
+    image->resize(int(naxes[0] * naxes[1]));
+    float nulval = 0;
+    int anynul = 0;
+    fits_read_img(ff, TFLOAT, 1, naxes[0] * naxes[1], &nulval, image->data(),
+                  &anynul, &errcode);
+    if (errcode) {
+        sendError("Cannot read the image from '" + fileName + "'.", errcode);
+        fits_close_file(ff, &errcode);
+        return false;
+    }
+
+    fits_close_file(ff, &errcode);
+    *width = int(naxes[0]);
+    *height = int(naxes[1]);
+    return true;
+}
+
+bool FrameCalibrator::writeImage(const QString &fileName,
+                                 const QVector<float> &image, int width,
+                                 int height, int type, int numFrames)
+{
+    // the master is written to a temporary file which is renamed when it
+    // is complete, so that a failed write never leaves a partial master
+    const QString tempFileName = fileName + ".tmp";
+    QFile::remove(tempFileName);
+
+    int errcode = 0;
+    fitsfile *ff = 0;
+    fits_create_diskfile(&ff, tempFileName.toAscii(), &errcode);
+    if (errcode) {
+        sendError("Cannot create the file '" + tempFileName + "'.", errcode);
+        if (ff) fits_close_file(ff, &errcode);
+        return false;
+    }
+
+    long naxes[2] = { width, height };
+    fits_create_img(ff, FLOAT_IMG, 2, naxes, &errcode);
+
+    QByteArray creator = QByteArray("SjcServer v") + SJCAM_VERSION_STRING;
+    QByteArray date = QDateTime::currentDateTimeUtc().toString(
+                "yyyy-MM-ddThh:mm:ss.zzz").toAscii();
+    QByteArray imageType = (type == Dark) ? "dark" : "flat";
+    fits_write_key(ff, TSTRING, "CREATOR", creator.data(),
+                   "program that created this file", &errcode);
+    fits_write_key(ff, TSTRING, "DATE", date.data(),
+                   "[utc] file creation time", &errcode);
+    fits_write_key(ff, TSTRING, "IMAGETYP", imageType.data(),
+                   "master calibration frame type", &errcode);
+    fits_write_key(ff, TINT, "NCOMBINE", &numFrames,
+                   "number of averaged frames", &errcode);
+
+    long fpixel[2] = { 1, 1 };
+    fits_write_pix(ff, TFLOAT, fpixel, LONGLONG(width) * height,
+                   const_cast<float *>(image.constData()), &errcode);
+    if (errcode) {
+        sendError("Cannot write the file '" + tempFileName + "'.", errcode);
+        fits_close_file(ff, &errcode);
+        QFile::remove(tempFileName);
+        return false;
+    }
+
+    fits_close_file(ff, &errcode);
+    if (errcode) {
+        sendError("Cannot close file.", errcode);
+        QFile::remove(tempFileName);
+        return false;
+    }
+    if (!QFile::rename(tempFileName, fileName)) {
+        sendError("Cannot rename temporary file.");
+        QFile::remove(tempFileName);
+        return false;
+    }
+    return true;
+}
+
+void FrameCalibrator::sendError(const QString &msg, int errcode) const
+{
+    QString fullMsg = msg;
+    if (errcode != 0)
+        fullMsg += " FITSIO: " + fitsioErrorString(errcode) + ".";
+    emit error(fullMsg);
+}
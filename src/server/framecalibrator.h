@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_FRAMECALIBRATOR_H
+#define SJCAM_FRAMECALIBRATOR_H
+
+#include "defectmap.h"
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <PvApi.h>
+
+class FrameCalibrator : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum MasterType { Dark, Flat, Defects };
+    enum DefectMode { DefectsOff, DefectsPreview, DefectsOn };
+
+    explicit FrameCalibrator(QObject *parent = 0);
+    ~FrameCalibrator();
+
+    static QByteArray defectModeName(int mode);
+    static bool defectModeFromName(const QByteArray &name, int *mode);
+
+    // these methods are NOT thread-safe, use QMetaObject::invokeMethod()
+    // after the calibrator was moved to its thread!
+    Q_INVOKABLE void setDirectory(const QString &directory);
+    Q_INVOKABLE void setFileNamePrefix(const QString &prefix);
+    Q_INVOKABLE void setDefectThreshold(double threshold);
+
+public slots:
+    void processFrame(tPvFrame *frame);
+    void setEnabled(bool enabled);
+    bool loadMaster(int type, const QString &fileName);
+    void buildMaster(int type, int numFrames);
+    bool loadDefectMap(const QString &fileName);
+    void setDefectMode(int mode);
+
+signals:
+    void frameFinished(tPvFrame *frame);
+    void calibrationChanged(bool enabled, const QString &darkFileName,
+                            const QString &flatFileName);
+    void defectModeChanged(int mode, const QString &fileName,
+                           int numDefects);
+    void previewDefectMapChanged(const DefectMap &map);
+    void info(const QString &infoString) const;
+    void error(const QString &errorString) const;
+
+protected:
+    void calibrateFrame(tPvFrame *frame);
+    void correctDefects(tPvFrame *frame);
+    void emitDefectModeChanged();
+    void addBuildFrame(tPvFrame *frame);
+    void finishDefectMap(const QVector<float> &average, int width,
+                         int height);
+    void updateCoefficients();
+    bool readImage(const QString &fileName, QVector<float> *image,
+                   int *width, int *height);
+    bool writeImage(const QString &fileName, const QVector<float> &image,
+                    int width, int height, int type, int numFrames);
+    void sendError(const QString &msg, int errcode = 0) const;
+
+private:
+    Q_DISABLE_COPY(FrameCalibrator)
+    QDir m_directory;
+    QString m_fileNamePrefix;
+    bool m_enabled;
+    bool m_sizeErrorSent;
+    int m_width;
+    int m_height;
+    QVector<float> m_dark;
+    QVector<float> m_flat;
+    QString m_darkFileName;
+    QString m_flatFileName;
+    QVector<float> m_offset;
+    QVector<float> m_gain;
+    int m_defectMode;
+    bool m_defectErrorSent;
+    double m_defectThreshold;
+    DefectMap m_defectMap;
+    QString m_defectFileName;
+    int m_buildType;
+    int m_buildCount;
+    int m_buildNumFrames;
+    int m_buildWidth;
+    int m_buildHeight;
+    QVector<quint32> m_buildSum;
+    QVector<quint16> m_unpackBuffer;
+};
+
+#endif // SJCAM_FRAMECALIBRATOR_H
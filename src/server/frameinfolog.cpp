@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "frameinfolog.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+void encodeRecord(const FrameInfo &info, uchar *dest)
+{
+    qToLittleEndian(quint32(info.id), dest);
+    qToLittleEndian(quint32(info.count), dest + 4);
+    qToLittleEndian(qint32(info.status), dest + 8);
+    qToLittleEndian(quint32(0), dest + 12);
+    qToLittleEndian(qint64(info.timestamp), dest + 16);
+    qToLittleEndian(qint64(info.readoutTimestamp), dest + 24);
+    qToLittleEndian(qint64(info.readoutTimeMs), dest + 32);
+    qToLittleEndian(qint64(info.exposureUtcUsecs), dest + 40);
+}
+
+} // namespace
+
+FrameInfoLog::FrameInfoLog(QObject *parent)
+    : QObject(parent),
+      m_ring(1000),
+      m_ringFirst(0),
+      m_ringCount(0),
+      m_logging(false),
+      m_file(0),
+      m_flushTimer(new QTimer(this))
+{
+    m_flushTimer->setInterval(1000);
+    connect(m_flushTimer, SIGNAL(timeout()), SLOT(flush()));
+}
+
+FrameInfoLog::~FrameInfoLog()
+{
+    stopLogging();
+}
+
+void FrameInfoLog::setRingSize(int size)
+{
+    m_ring = QVector<FrameInfo>(qMax(size, 1));
+    m_ringFirst = 0;
+    m_ringCount = 0;
+}
+
+void FrameInfoLog::setFlushInterval(int msecs)
+{
+    m_flushTimer->setInterval(msecs);
+}
+
+void FrameInfoLog::append(const FrameInfo &info)
+{
+    QMutexLocker locker(&m_mutex);
+    const int ringSize = m_ring.size();
+    if (m_ringCount < ringSize) {
+        m_ring[(m_ringFirst + m_ringCount) % ringSize] = info;
+        ++m_ringCount;
+    } else {
+        m_ring[m_ringFirst] = info;
+        m_ringFirst = (m_ringFirst + 1) % ringSize;
+    }
+    if (m_logging)
+        m_pending.append(info);
+}
+
+QList<FrameInfo> FrameInfoLog::records(qint64 sinceId, int maxCount) const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<FrameInfo> result;
+    const int ringSize = m_ring.size();
+    for (int i = 0; i < m_ringCount && result.size() < maxCount; ++i) {
+        const FrameInfo &info = m_ring[(m_ringFirst + i) % ringSize];
+        if (qint64(info.id) > sinceId)
+            result.append(info);
+    }
+    return result;
+}
+
+void FrameInfoLog::clearRecords()
+{
+    QMutexLocker locker(&m_mutex);
+    m_ringFirst = 0;
+    m_ringCount = 0;
+}
+
+bool FrameInfoLog::isLogging() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_logging;
+}
+
+bool FrameInfoLog::startLogging(const QString &fileName)
+{
+    if (m_file)
+        return false;
+
+    m_file = new QFile(fileName);
+    if (!m_file->open(QIODevice::WriteOnly)) {
+        emit error("Cannot create frame info log file '" + fileName + "'.");
+        delete m_file;
+        m_file = 0;
+        return false;
+    }
+
+    uchar header[HeaderSize];
+    qMemCopy(header, "SJCFINFO", 8);
+    qToLittleEndian(quint32(FormatVersion), header + 8);
+    qToLittleEndian(quint32(RecordSize), header + 12);
+    m_file->write(reinterpret_cast<const char *>(header), HeaderSize);
+
+    m_mutex.lock();
+    m_pending.clear();
+    m_logging = true;
+    m_mutex.unlock();
+
+    m_flushTimer->start();
+    return true;
+}
+
+void FrameInfoLog::stopLogging()
+{
+    if (!m_file)
+        return;
+
+    m_flushTimer->stop();
+    flush();
+
+    m_mutex.lock();
+    m_logging = false;
+    m_pending.clear();
+    m_mutex.unlock();
+
+    delete m_file;
+    m_file = 0;
+}
+
+void FrameInfoLog::flush()
+{
+    if (!m_file)
+        return;
+
+    // take the pending records, so that the mutex is not held while
+    // encoding and writing
+    m_mutex.lock();
+    QVector<FrameInfo> pending = m_pending;
+    m_pending.clear();
+    m_mutex.unlock();
+    if (pending.isEmpty())
+        return;
+
+    QByteArray data;
+    data.resize(pending.size() * RecordSize);
+    uchar *dest = reinterpret_cast<uchar *>(data.data());
+    for (int i = 0; i < pending.size(); ++i, dest += RecordSize)
+        encodeRecord(pending[i], dest);
+
+    if (m_file->write(data) != data.size())
+        emit error("Cannot write frame info log file.");
+    m_file->flush();
+}
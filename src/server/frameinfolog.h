@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_FRAMEINFOLOG_H
+#define SJCAM_FRAMEINFOLOG_H
+
+#include "recorder.h"
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtCore/QMutex>
+
+class QFile;
+class QTimer;
+
+// Keeps the most recent FrameInfo records in memory and optionally logs all
+// records to a binary file. Records are collected by append(), which may be
+// called from any thread, and are written to the file in batches by the
+// thread the FrameInfoLog object lives in.
+//
+// File format (little endian): a 16 byte header, consisting of the magic
+// "SJCFINFO", the format version (quint32) and the record size (quint32),
+// followed by fixed size records of the form
+//     quint32 id, quint32 count, qint32 status, quint32 reserved,
+//     qint64 timestamp, qint64 readoutTimestamp, qint64 readoutTimeMs,
+//     qint64 exposureUtcUsecs
+class FrameInfoLog : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { FormatVersion = 2, HeaderSize = 16, RecordSize = 48 };
+
+    explicit FrameInfoLog(QObject *parent = 0);
+    ~FrameInfoLog();
+
+    // these methods are NOT thread-safe!
+    void setRingSize(int size);
+    void setFlushInterval(int msecs);
+
+    // these methods are thread-safe
+    void append(const FrameInfo &info);
+    QList<FrameInfo> records(qint64 sinceId, int maxCount) const;
+    void clearRecords();
+    bool isLogging() const;
+
+public slots:
+    bool startLogging(const QString &fileName);
+    void stopLogging();
+    void flush();
+
+signals:
+    void error(const QString &errorString) const;
+
+private:
+    Q_DISABLE_COPY(FrameInfoLog)
+    mutable QMutex m_mutex;
+    QVector<FrameInfo> m_ring;
+    int m_ringFirst;
+    int m_ringCount;
+    QVector<FrameInfo> m_pending;
+    bool m_logging;
+    QFile *m_file;
+    QTimer *m_flushTimer;
+};
+
+#endif // SJCAM_FRAMEINFOLOG_H
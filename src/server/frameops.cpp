@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "frameops.h"
+#include <cmath>
+
+template <typename T>
+static double gradientEnergyT(const T *data, int width, int height)
+{
+    if (width < 2 || height < 2)
+        return 0;
+
+    qint64 energy = 0;
+    qint64 sum = 0;
+    for (int y = 0; y < height - 1; ++y)
+    {
+        const T * const line = data + qint64(y) * width;
+        const T * const nextLine = line + width;
+        for (int x = 0; x < width - 1; ++x)
+        {
+            const qint64 dx = qint64(line[x + 1]) - line[x];
+            const qint64 dy = qint64(nextLine[x]) - line[x];
+            energy += dx * dx + dy * dy;
+            sum += line[x];
+        }
+    }
+
+    const double n = double(width - 1) * (height - 1);
+    const double mean = sum / n;
+    if (mean <= 0)
+        return 0;
+    return energy / (n * mean * mean);
+}
+
+template <typename T>
+static double rmsContrastT(const T *data, int count)
+{
+    if (count < 1)
+        return 0;
+
+    qint64 sum = 0;
+    qint64 sumSq = 0;
+    for (int i = 0; i < count; ++i) {
+        const qint64 value = data[i];
+        sum += value;
+        sumSq += value * value;
+    }
+
+    const double mean = double(sum) / count;
+    if (mean <= 0)
+        return 0;
+    const double variance = double(sumSq) / count - mean * mean;
+    return variance > 0 ? std::sqrt(variance) / mean : 0;
+}
+
+template <typename T>
+static void accumulateT(quint32 *sum, const T *data, int count)
+{
+    for (int i = 0; i < count; ++i)
+        sum[i] += data[i];
+}
+
+template <typename T>
+static void calibrateT(T *data, const float *offset, const float *gain,
+                       int count, float maxValue)
+{
+    for (int i = 0; i < count; ++i) {
+        float value = (float(data[i]) - offset[i]) * gain[i];
+        value = value < 0.0f ? 0.0f : value;
+        value = value > maxValue ? maxValue : value;
+        data[i] = T(value + 0.5f);
+    }
+}
+
+template <typename T>
+static void minMaxT(const T *data, int stride, int width, int height,
+                    int *min, int *max)
+{
+    T lo = data[0];
+    T hi = data[0];
+    for (int y = 0; y < height; ++y)
+    {
+        const T * const line = data + qint64(y) * stride;
+        for (int x = 0; x < width; ++x)
+        {
+            lo = line[x] < lo ? line[x] : lo;
+            hi = line[x] > hi ? line[x] : hi;
+        }
+    }
+    *min = lo;
+    *max = hi;
+}
+
+template <typename T>
+static void thresholdMomentsT(const T *data, int stride, int width,
+                              int height, int threshold, qint64 *m0,
+                              qint64 *mx, qint64 *my)
+{
+    qint64 sum = 0;
+    qint64 sumX = 0;
+    qint64 sumY = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const T * const line = data + qint64(y) * stride;
+        qint64 lineSum = 0;
+        qint64 lineSumX = 0;
+        for (int x = 0; x < width; ++x)
+        {
+            int value = int(line[x]) - threshold;
+            value = value < 0 ? 0 : value;
+            lineSum += value;
+            lineSumX += qint64(value) * x;
+        }
+        sum += lineSum;
+        sumX += lineSumX;
+        sumY += lineSum * y;
+    }
+    *m0 = sum;
+    *mx = sumX;
+    *my = sumY;
+}
+
+template <typename T>
+static void projectT(const T *data, int stride, int width, int height,
+                     quint32 *xProfile, quint32 *yProfile)
+{
+    for (int x = 0; x < width; ++x)
+        xProfile[x] = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const T * const line = data + qint64(y) * stride;
+        quint32 lineSum = 0;
+        for (int x = 0; x < width; ++x)
+        {
+            xProfile[x] += line[x];
+            lineSum += line[x];
+        }
+        yProfile[y] = lineSum;
+    }
+}
+
+// Four partial histograms are used, so that runs of equal pixel values do
+// not stall on incrementing the same counter.
+template <typename T>
+static void histogramT(const T *data, int width, int height, int rowStep,
+                       int shift, quint32 *bins)
+{
+    quint32 partial[4][256];
+    qMemSet(partial, 0, sizeof(partial));
+    for (int y = 0; y < height; y += rowStep)
+    {
+        const T * const line = data + qint64(y) * width;
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                int value = line[x + k] >> shift;
+                value = value > 255 ? 255 : value;
+                ++partial[k][value];
+            }
+        }
+        for (; x < width; ++x)
+        {
+            int value = line[x] >> shift;
+            value = value > 255 ? 255 : value;
+            ++partial[0][value];
+        }
+    }
+    for (int i = 0; i < 256; ++i)
+        bins[i] += partial[0][i] + partial[1][i] + partial[2][i]
+                + partial[3][i];
+}
+
+double gradientEnergy(const uchar *data, int width, int height)
+{
+    return gradientEnergyT(data, width, height);
+}
+
+double gradientEnergy(const quint16 *data, int width, int height)
+{
+    return gradientEnergyT(data, width, height);
+}
+
+double rmsContrast(const uchar *data, int count)
+{
+    return rmsContrastT(data, count);
+}
+
+double rmsContrast(const quint16 *data, int count)
+{
+    return rmsContrastT(data, count);
+}
+
+void accumulate(quint32 *sum, const uchar *data, int count)
+{
+    accumulateT(sum, data, count);
+}
+
+void accumulate(quint32 *sum, const quint16 *data, int count)
+{
+    accumulateT(sum, data, count);
+}
+
+void scale(float *dest, const quint32 *src, int count, float factor)
+{
+    for (int i = 0; i < count; ++i)
+        dest[i] = factor * float(src[i]);
+}
+
+void minMax(const uchar *data, int stride, int width, int height,
+            int *min, int *max)
+{
+    minMaxT(data, stride, width, height, min, max);
+}
+
+void minMax(const quint16 *data, int stride, int width, int height,
+            int *min, int *max)
+{
+    minMaxT(data, stride, width, height, min, max);
+}
+
+void thresholdMoments(const uchar *data, int stride, int width, int height,
+                      int threshold, qint64 *m0, qint64 *mx, qint64 *my)
+{
+    thresholdMomentsT(data, stride, width, height, threshold, m0, mx, my);
+}
+
+void thresholdMoments(const quint16 *data, int stride, int width, int height,
+                      int threshold, qint64 *m0, qint64 *mx, qint64 *my)
+{
+    thresholdMomentsT(data, stride, width, height, threshold, m0, mx, my);
+}
+
+void project(const uchar *data, int stride, int width, int height,
+             quint32 *xProfile, quint32 *yProfile)
+{
+    projectT(data, stride, width, height, xProfile, yProfile);
+}
+
+void project(const quint16 *data, int stride, int width, int height,
+             quint32 *xProfile, quint32 *yProfile)
+{
+    projectT(data, stride, width, height, xProfile, yProfile);
+}
+
+void histogram(const uchar *data, int width, int height, int rowStep,
+               int shift, quint32 *bins)
+{
+    histogramT(data, width, height, rowStep, shift, bins);
+}
+
+void histogram(const quint16 *data, int width, int height, int rowStep,
+               int shift, quint32 *bins)
+{
+    histogramT(data, width, height, rowStep, shift, bins);
+}
+
+void unpackMono12Packed(quint16 *dest, const uchar *src, int count)
+{
+    const int numPairs = count / 2;
+    for (int i = 0; i < numPairs; ++i) {
+        const quint16 b0 = src[3 * i];
+        const quint16 b1 = src[3 * i + 1];
+        const quint16 b2 = src[3 * i + 2];
+        dest[2 * i] = quint16((b0 << 4) | (b1 & 0x0f));
+        dest[2 * i + 1] = quint16((b2 << 4) | (b1 >> 4));
+    }
+    if (count % 2 != 0) {
+        const uchar *last = src + 3 * numPairs;
+        dest[count - 1] = quint16((last[0] << 4) | (last[1] & 0x0f));
+    }
+}
+
+void unpackMono12Packed(uchar *dest, const uchar *src, int count)
+{
+    const int numPairs = count / 2;
+    for (int i = 0; i < numPairs; ++i) {
+        dest[2 * i] = src[3 * i];
+        dest[2 * i + 1] = src[3 * i + 2];
+    }
+    if (count % 2 != 0)
+        dest[count - 1] = src[3 * numPairs];
+}
+
+void calibrate(uchar *data, const float *offset, const float *gain, int count)
+{
+    calibrateT(data, offset, gain, count, 255.0f);
+}
+
+void calibrate(quint16 *data, const float *offset, const float *gain,
+               int count)
+{
+    calibrateT(data, offset, gain, count, 65535.0f);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_FRAMEOPS_H
+#define SJCAM_FRAMEOPS_H
+
+#include <QtCore/QtGlobal>
+
+// Pixel kernels used by the frame processing stages of the server. Except for
+// histogram(), the inner loops are written without data dependent branches
+// and with integer accumulators, so that they can be vectorized by the
+// compiler. The histogram is a scatter into partial tables, which only avoids
+// stalls on repeated pixel values.
+
+// Mean squared difference of neighbouring pixels in x and y, normalized by
+// the squared mean intensity.
+double gradientEnergy(const uchar *data, int width, int height);
+double gradientEnergy(const quint16 *data, int width, int height);
+
+// Standard deviation of the pixel values divided by their mean.
+double rmsContrast(const uchar *data, int count);
+double rmsContrast(const quint16 *data, int count);
+
+// Adds the pixel values to a 32-bit accumulator.
+void accumulate(quint32 *sum, const uchar *data, int count);
+void accumulate(quint32 *sum, const quint16 *data, int count);
+
+// Converts accumulated values to float and multiplies them by factor.
+void scale(float *dest, const quint32 *src, int count, float factor);
+
+// Replaces each pixel value by (value - offset) * gain, rounded and clamped
+// to the range of the pixel type.
+void calibrate(uchar *data, const float *offset, const float *gain, int count);
+void calibrate(quint16 *data, const float *offset, const float *gain,
+               int count);
+
+// The region kernels work on a width x height block of an image with
+// stride pixels per row, data points to the first pixel of the block.
+
+// Minimum and maximum pixel value of a region.
+void minMax(const uchar *data, int stride, int width, int height,
+            int *min, int *max);
+void minMax(const quint16 *data, int stride, int width, int height,
+            int *min, int *max);
+
+// Zeroth and first moments of the pixel values above threshold, i.e. the
+// sums of (value - threshold), (value - threshold) * x and
+// (value - threshold) * y with x and y relative to the first pixel.
+void thresholdMoments(const uchar *data, int stride, int width, int height,
+                      int threshold, qint64 *m0, qint64 *mx, qint64 *my);
+void thresholdMoments(const quint16 *data, int stride, int width, int height,
+                      int threshold, qint64 *m0, qint64 *mx, qint64 *my);
+
+// Column sums (xProfile, width values) and row sums (yProfile, height
+// values) of a region.
+void project(const uchar *data, int stride, int width, int height,
+             quint32 *xProfile, quint32 *yProfile);
+void project(const quint16 *data, int stride, int width, int height,
+             quint32 *xProfile, quint32 *yProfile);
+
+// Adds every rowStep-th row of an image to a histogram with 256 bins. The
+// pixel values are shifted right by shift bits, larger values are counted
+// in the last bin.
+void histogram(const uchar *data, int width, int height, int rowStep,
+               int shift, quint32 *bins);
+void histogram(const quint16 *data, int width, int height, int rowStep,
+               int shift, quint32 *bins);
+
+// Unpacks Mono12Packed data, where two pixels are stored in three bytes:
+//     byte 0: pixel 0, bits 11..4
+//     byte 1: pixel 0, bits 3..0 (low nibble); pixel 1, bits 3..0 (high
+//             nibble)
+//     byte 2: pixel 1, bits 11..4
+// The pixels are packed continuously, i.e. rows with an odd number of pixels
+// do not start at a byte boundary. The first version returns the 12-bit
+// values, the second one only the 8 most significant bits.
+void unpackMono12Packed(quint16 *dest, const uchar *src, int count);
+void unpackMono12Packed(uchar *dest, const uchar *src, int count);
+
+// Number of bytes used by count pixels in the Mono12Packed format.
+inline int mono12PackedSize(int count) { return (3 * count + 1) / 2; }
+
+#endif // SJCAM_FRAMEOPS_H
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "frameselector.h"
+#include "frameops.h"
+#include <QtCore/QtCore>
+
+FrameSelector::FrameSelector()
+    : m_numKeep(0),
+      m_windowSize(0),
+      m_numFrames(0),
+      m_metric(GradientEnergy)
+{
+}
+
+void FrameSelector::setup(int numKeep, int windowSize, Metric metric)
+{
+    m_numKeep = qMax(numKeep, 0);
+    m_windowSize = qMax(windowSize, m_numKeep);
+    m_metric = metric;
+    m_candidates.clear();
+    m_candidates.resize(m_numKeep);
+    m_numFrames = 0;
+}
+
+QByteArray FrameSelector::metricName() const
+{
+    return (m_metric == RmsContrast) ? "contrast" : "gradient";
+}
+
+bool FrameSelector::metricFromName(const QByteArray &name, Metric *metric)
+{
+    if (name == "gradient")
+        *metric = GradientEnergy;
+    else if (name == "contrast")
+        *metric = RmsContrast;
+    else
+        return false;
+    return true;
+}
+
+double FrameSelector::sharpness(const tPvFrame *frame) const
+{
+    Q_ASSERT(frame);
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+
+    if (frame->Format == ePvFmtMono8) {
+        const uchar *data = reinterpret_cast<const uchar *>(
+                    frame->ImageBuffer);
+        return (m_metric == RmsContrast) ? rmsContrast(data, width * height)
+                                         : gradientEnergy(data, width, height);
+    }
+    else if (frame->Format == ePvFmtMono16) {
+        const quint16 *data = reinterpret_cast<const quint16 *>(
+                    frame->ImageBuffer);
+        return (m_metric == RmsContrast) ? rmsContrast(data, width * height)
+                                         : gradientEnergy(data, width, height);
+    }
+    else if (frame->Format == ePvFmtMono12Packed) {
+        m_unpackBuffer.resize(width * height);
+        unpackMono12Packed(m_unpackBuffer.data(),
+                           reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                           width * height);
+        const quint16 *data = m_unpackBuffer.constData();
+        return (m_metric == RmsContrast) ? rmsContrast(data, width * height)
+                                         : gradientEnergy(data, width, height);
+    }
+    return 0;
+}
+
+void FrameSelector::addFrame(const tPvFrame *frame, const QDateTime &time)
+{
+    const double value = sharpness(frame);
+    const int index = m_numFrames++;
+
+    // use a free slot, or replace the least sharp candidate
+    int slot = -1;
+    for (int i = 0; i < m_candidates.size(); ++i) {
+        const Candidate &candidate = m_candidates[i];
+        if (!candidate.used) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || candidate.sharpness < m_candidates[slot].sharpness)
+            slot = i;
+    }
+    if (slot < 0)
+        return;
+
+    Candidate &candidate = m_candidates[slot];
+    if (candidate.used && candidate.sharpness >= value)
+        return;
+    candidate.storedFrame.assign(frame, time);
+    candidate.sharpness = value;
+    candidate.index = index;
+    candidate.used = true;
+}
+
+QList<SelectedFrame> FrameSelector::takeSelected()
+{
+    // sort the selected frames by their position within the window
+    QList<QPair<int, int> > order;
+    for (int i = 0; i < m_candidates.size(); ++i)
+        if (m_candidates[i].used)
+            order.append(qMakePair(m_candidates[i].index, i));
+    qSort(order);
+
+    QList<SelectedFrame> result;
+    for (int i = 0; i < order.size(); ++i) {
+        const Candidate &candidate = m_candidates[order[i].second];
+        SelectedFrame selected;
+        selected.storedFrame = candidate.storedFrame;
+        selected.sharpness = candidate.sharpness;
+        selected.rank = 1;
+        for (int j = 0; j < order.size(); ++j)
+            if (m_candidates[order[j].second].sharpness > candidate.sharpness)
+                ++selected.rank;
+        result.append(selected);
+    }
+
+    for (int i = 0; i < m_candidates.size(); ++i)
+        m_candidates[i].used = false;
+    m_numFrames = 0;
+    return result;
+}
+
+void FrameSelector::clear()
+{
+    for (int i = 0; i < m_candidates.size(); ++i)
+        m_candidates[i].used = false;
+    m_numFrames = 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_FRAMESELECTOR_H
+#define SJCAM_FRAMESELECTOR_H
+
+#include "framestore.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <PvApi.h>
+
+struct SelectedFrame
+{
+    StoredFrame storedFrame;
+    double sharpness;
+    int rank;
+};
+
+// Keeps copies of the numKeep() sharpest frames of each window of
+// windowSize() frames. Only the selected frames are copied, frames which
+// are not among the sharpest frames seen so far are just measured.
+class FrameSelector
+{
+public:
+    enum Metric { GradientEnergy, RmsContrast };
+
+    FrameSelector();
+
+    void setup(int numKeep, int windowSize, Metric metric);
+    bool isEnabled() const { return m_numKeep > 0; }
+    int numKeep() const { return m_numKeep; }
+    int windowSize() const { return m_windowSize; }
+    Metric metric() const { return m_metric; }
+    QByteArray metricName() const;
+    static bool metricFromName(const QByteArray &name, Metric *metric);
+
+    double sharpness(const tPvFrame *frame) const;
+    void addFrame(const tPvFrame *frame, const QDateTime &time);
+    bool isWindowComplete() const { return m_numFrames >= m_windowSize; }
+    QList<SelectedFrame> takeSelected();
+    void clear();
+
+private:
+    struct Candidate {
+        Candidate() : sharpness(0), index(0), used(false) {}
+        StoredFrame storedFrame;
+        double sharpness;
+        int index;
+        bool used;
+    };
+
+    QVector<Candidate> m_candidates;
+    mutable QVector<quint16> m_unpackBuffer;
+    int m_numKeep;
+    int m_windowSize;
+    int m_numFrames;
+    Metric m_metric;
+};
+
+#endif // SJCAM_FRAMESELECTOR_H
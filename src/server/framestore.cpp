@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "framestore.h"
+#include <QtCore/QtCore>
+
+StoredFrame::StoredFrame()
+    : m_compressed(false)
+{
+    qMemSet(&m_frame, 0, sizeof(m_frame));
+    m_trace.clear();
+}
+
+StoredFrame::StoredFrame(const tPvFrame *frame, const QDateTime &time,
+                         bool compressed)
+    : m_compressed(false)
+{
+    assign(frame, time, compressed);
+}
+
+void StoredFrame::assign(const tPvFrame *frame, const QDateTime &time,
+                         bool compressed)
+{
+    Q_ASSERT(frame);
+    m_frame = *frame;
+    m_frame.ImageBuffer = 0;
+    m_frame.AncillaryBuffer = 0;
+    m_frame.Context[0] = 0;  // the frame trace belongs to the source frame
+    if (frame->Context[0])
+        m_trace = *static_cast<const FrameTrace *>(frame->Context[0]);
+    else
+        m_trace.clear();
+
+    const char *imageData = reinterpret_cast<const char *>(
+                frame->ImageBuffer);
+    if (compressed) {
+        // use the fastest compression level, this is called for every frame
+        m_image = qCompress(reinterpret_cast<const uchar *>(imageData),
+                            int(frame->ImageSize), 1);
+    } else {
+        // resize() keeps the allocated memory if the buffer is not shared,
+        // so a ring of stored frames doesn't reallocate for every frame
+        m_image.resize(int(frame->ImageSize));
+        qMemCopy(m_image.data(), imageData, frame->ImageSize);
+    }
+    m_uncompressedImage.clear();
+
+    if (frame->AncillaryBuffer && frame->AncillarySize > 0) {
+        m_ancillary.resize(int(frame->AncillarySize));
+        qMemCopy(m_ancillary.data(), frame->AncillaryBuffer,
+                 frame->AncillarySize);
+    } else {
+        m_ancillary.clear();
+    }
+
+    m_time = time;
+    m_compressed = compressed;
+}
+
+void StoredFrame::reserve(int imageSize, int ancillarySize)
+{
+    m_image.reserve(imageSize);
+    m_ancillary.reserve(ancillarySize);
+}
+
+qint64 StoredFrame::memoryUsage() const
+{
+    return qint64(m_image.capacity()) + m_uncompressedImage.capacity()
+            + m_ancillary.capacity();
+}
+
+tPvFrame * StoredFrame::frame()
+{
+    // the returned frame is only read from, so we use constData() to avoid
+    // detaching buffers which are shared with other copies of this frame
+    if (m_compressed) {
+        if (m_uncompressedImage.isEmpty())
+            m_uncompressedImage = qUncompress(m_image);
+        m_frame.ImageBuffer = const_cast<char *>(
+                    m_uncompressedImage.constData());
+    } else {
+        m_frame.ImageBuffer = const_cast<char *>(m_image.constData());
+    }
+    m_frame.ImageBufferSize = m_frame.ImageSize;
+
+    if (!m_ancillary.isEmpty()) {
+        m_frame.AncillaryBuffer = const_cast<char *>(m_ancillary.constData());
+        m_frame.AncillaryBufferSize = ulong(m_ancillary.size());
+    } else {
+        m_frame.AncillaryBuffer = 0;
+        m_frame.AncillaryBufferSize = 0;
+    }
+    m_frame.Context[0] = &m_trace;
+    return &m_frame;
+}
+
+FrameRing::FrameRing(int capacity)
+    : m_first(0),
+      m_size(0),
+      m_maxAge(0)
+{
+    setCapacity(capacity);
+}
+
+void FrameRing::setCapacity(int capacity)
+{
+    m_frames.clear();
+    m_frames.resize(qMax(capacity, 0));
+    m_first = 0;
+    m_size = 0;
+}
+
+qint64 FrameRing::memoryUsage() const
+{
+    qint64 result = 0;
+    foreach (const StoredFrame &storedFrame, m_frames)
+        result += storedFrame.memoryUsage();
+    return result;
+}
+
+void FrameRing::append(const tPvFrame *frame, const QDateTime &time,
+                       bool compressed)
+{
+    const int cap = capacity();
+    if (cap == 0)
+        return;
+
+    // drop expired frames; their buffers are reused by the next appends
+    if (m_maxAge > 0) {
+        while (m_size > 0 &&
+               m_frames[m_first].time().msecsTo(time) > m_maxAge) {
+            m_first = (m_first + 1) % cap;
+            --m_size;
+        }
+    }
+
+    int index = (m_first + m_size) % cap;
+    if (m_size == cap)
+        m_first = (m_first + 1) % cap;
+    else
+        ++m_size;
+    m_frames[index].assign(frame, time, compressed);
+}
+
+StoredFrameList FrameRing::takeAll()
+{
+    const int cap = capacity();
+    StoredFrameList result;
+    for (int i = 0; i < m_size; ++i)
+        result.append(m_frames[(m_first + i) % cap]);
+    m_first = 0;
+    m_size = 0;
+    return result;
+}
+
+void FrameRing::clear()
+{
+    setCapacity(capacity());
+}
+
+FramePool::FramePool()
+    : m_size(0)
+{
+}
+
+void FramePool::allocate(int capacity, int imageBufferSize)
+{
+    release();
+    m_frames.resize(qMax(capacity, 0));
+    for (int i = 0; i < m_frames.size(); ++i)
+        m_frames[i].reserve(imageBufferSize, 48);
+}
+
+void FramePool::release()
+{
+    m_frames.clear();
+    m_size = 0;
+}
+
+qint64 FramePool::memoryUsage() const
+{
+    qint64 result = 0;
+    foreach (const StoredFrame &storedFrame, m_frames)
+        result += storedFrame.memoryUsage();
+    return result;
+}
+
+bool FramePool::append(const tPvFrame *frame, const QDateTime &time)
+{
+    if (isFull())
+        return false;
+    m_frames[m_size++].assign(frame, time);
+    return true;
+}
+
+StoredFrameList FramePool::takeAll()
+{
+    StoredFrameList result;
+    for (int i = 0; i < m_size; ++i)
+        result.append(m_frames[i]);
+    m_size = 0;
+    return result;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_FRAMESTORE_H
+#define SJCAM_FRAMESTORE_H
+
+#include "pipelinestats.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QVector>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <PvApi.h>
+
+// Deep copy of a tPvFrame which owns its image and ancillary data. The image
+// data can optionally be kept zlib compressed to save memory; frame() always
+// returns a frame with uncompressed image data and a copy of the frame trace.
+class StoredFrame
+{
+public:
+    StoredFrame();
+    StoredFrame(const tPvFrame *frame, const QDateTime &time,
+                bool compressed = false);
+
+    void assign(const tPvFrame *frame, const QDateTime &time,
+                bool compressed = false);
+    void reserve(int imageSize, int ancillarySize);
+    bool isNull() const { return m_image.isEmpty(); }
+    bool isCompressed() const { return m_compressed; }
+    QDateTime time() const { return m_time; }
+    qint64 memoryUsage() const;
+
+    tPvFrame * frame();
+
+private:
+    tPvFrame m_frame;
+    FrameTrace m_trace;
+    QByteArray m_image;
+    QByteArray m_uncompressedImage;
+    QByteArray m_ancillary;
+    QDateTime m_time;
+    bool m_compressed;
+};
+
+typedef QList<StoredFrame> StoredFrameList;
+Q_DECLARE_METATYPE(StoredFrameList)
+
+// Fixed size ring of the most recently stored frames. The oldest frame is
+// overwritten when the ring is full, and frames older than maxAge() msecs
+// are dropped when new frames are appended (if maxAge() > 0).
+class FrameRing
+{
+public:
+    explicit FrameRing(int capacity = 0);
+
+    int capacity() const { return m_frames.size(); }
+    void setCapacity(int capacity);
+    int maxAge() const { return m_maxAge; }
+    void setMaxAge(int msecs) { m_maxAge = msecs; }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    qint64 memoryUsage() const;
+
+    void append(const tPvFrame *frame, const QDateTime &time,
+                bool compressed = false);
+    StoredFrameList takeAll();
+    void clear();
+
+private:
+    QVector<StoredFrame> m_frames;
+    int m_first;
+    int m_size;
+    int m_maxAge;
+};
+
+// Pool of preallocated frames which is filled up to its capacity. The frame
+// buffers are reused after the frames returned by takeAll() are released,
+// so no memory is allocated while frames are appended.
+class FramePool
+{
+public:
+    FramePool();
+
+    void allocate(int capacity, int imageBufferSize);
+    void release();
+    int capacity() const { return m_frames.size(); }
+    int size() const { return m_size; }
+    bool isFull() const { return m_size == m_frames.size(); }
+    qint64 memoryUsage() const;
+
+    bool append(const tPvFrame *frame, const QDateTime &time);
+    StoredFrameList takeAll();
+
+private:
+    QVector<StoredFrame> m_frames;
+    int m_size;
+};
+
+#endif // SJCAM_FRAMESTORE_H
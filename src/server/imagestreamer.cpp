@@ -25,13 +25,19 @@
  */
 
 #include "imagestreamer.h"
+#include "clockmodel.h"
+#include "pvutils.h"
+#include "pipelinestats.h"
+#include "frameops.h"
+#include "metrics.h"
 #include <QtCore/QtCore>
 #include <QtNetwork/QTcpServer>
 #include <QtNetwork/QTcpSocket>
 
 ImageStreamer::ImageStreamer(QObject *parent)
     : QObject(parent),
-      m_tcpServer(new QTcpServer(this))
+      m_tcpServer(new QTcpServer(this)),
+      m_clockModel(0)
 {
     connect(m_tcpServer, SIGNAL(newConnection()), SLOT(newConnection()));
 
@@ -46,8 +52,11 @@ ImageStreamer::~ImageStreamer()
     delete m_tcpServer;
 }
 
+// Connected clients are kept when the server is moved to another port.
 bool ImageStreamer::listen(quint16 port)
 {
+    if (m_tcpServer->isListening())
+        m_tcpServer->close();
     if (!m_tcpServer->listen(QHostAddress::Any, port)) {
         emit error("Streaming Server: " + m_tcpServer->errorString() + ".");
         return false;
@@ -60,6 +69,18 @@ quint16 ImageStreamer::serverPort() const
     return m_tcpServer->serverPort();
 }
 
+void ImageStreamer::setClockModel(const ClockModel *clockModel)
+{
+    m_clockModel = clockModel;
+}
+
+// Defective pixels are replaced in the rendered image, so that they do not
+// dominate the scaling of the preview in the clients.
+void ImageStreamer::setDefectMap(const DefectMap &map)
+{
+    m_defectMap = map;
+}
+
 void ImageStreamer::processFrame(tPvFrame *frame)
 {
     if (frame && (frame->Status == ePvErrSuccess))
@@ -73,16 +94,17 @@ void ImageStreamer::processFrame(tPvFrame *frame)
 void ImageStreamer::renderImage(tPvFrame *frame)
 {
     Q_ASSERT(frame);
+    ScopedLatencyTimer timer(&serverMetrics.jpegEncodeUsecs,
+                             &serverMetrics.jpegEncodeCount);
     const int width = int(frame->Width);
     const int height = int(frame->Height);
-    const int bitDepth = int(frame->BitDepth);  // 8 or 12
 
     if (m_image.width() != width || m_image.height() != height) {
         m_image = QImage(width, height, QImage::Format_Indexed8);
         m_image.setColorTable(m_colorTable);
     }
 
-    if (bitDepth == 8)
+    if (frame->Format == ePvFmtMono8)
     {
         const uchar * const buffer = reinterpret_cast<uchar *>(
                     frame->ImageBuffer);
@@ -92,27 +114,59 @@ void ImageStreamer::renderImage(tPvFrame *frame)
             qMemCopy(m_image.scanLine(i), bufferLine, width);
         }
     }
-    else if (bitDepth == 12)
+    else if (frame->Format == ePvFmtMono16)
     {
         const quint16 * const buffer = reinterpret_cast<quint16 *>(
                     frame->ImageBuffer);
+        const int shift = qMax(int(frame->BitDepth) - 8, 0);
         for (int i = 0; i < height; ++i)
         {
             const quint16 * const bufferLine = buffer + (i * width);
             uchar * const imageLine = m_image.scanLine(i);
             for (int j = 0; j < width; ++j)
-                imageLine[j] = uchar(bufferLine[j] >> 4);
+                imageLine[j] = uchar(bufferLine[j] >> shift);
+        }
+    }
+    else if (frame->Format == ePvFmtMono12Packed)
+    {
+        const uchar * const buffer = reinterpret_cast<uchar *>(
+                    frame->ImageBuffer);
+        if (width % 2 == 0) {
+            // rows start at byte boundaries, unpack directly into the image
+            const int lineSize = mono12PackedSize(width);
+            for (int i = 0; i < height; ++i)
+                unpackMono12Packed(m_image.scanLine(i), buffer + i * lineSize,
+                                   width);
+        }
+        else {
+            m_unpackBuffer.resize(width * height);
+            unpackMono12Packed(m_unpackBuffer.data(), buffer, width * height);
+            for (int i = 0; i < height; ++i)
+                qMemCopy(m_image.scanLine(i),
+                         m_unpackBuffer.constData() + i * width, width);
         }
     }
     else
     {
         m_image.fill(0);
-        emit error("Cannot render image, unsupported bit depth.");
+        emit error("Cannot render image, unsupported pixel format.");
+    }
+    if (m_defectMap.matches(width, height))
+        m_defectMap.correct(m_image.bits(), m_image.bytesPerLine());
+    stampFrame(frame, FrameTrace::StreamerRendered);
+
+    // the start of the exposure is sent as JPEG comment "DATE-OBS: <utc>"
+    if (m_clockModel) {
+        qint64 usecs = m_clockModel->utcUsecs(PvFrameTicks(frame));
+        if (usecs != 0)
+            m_image.setText("DATE-OBS",
+                            QString::fromAscii(ClockModel::isoString(usecs)));
     }
 
     m_jpeg.clear();
     QBuffer buffer(&m_jpeg);
     m_image.save(&buffer, "jpeg");
+    stampFrame(frame, FrameTrace::StreamerEncoded);
 
     QMutableMapIterator<QTcpSocket *, ClientInfo> iter(m_socketMap);
     while (iter.hasNext()) {
@@ -122,8 +176,11 @@ void ImageStreamer::renderImage(tPvFrame *frame)
             os.setVersion(QDataStream::Qt_4_7);
             os << quint32(m_jpeg.size()) << m_jpeg;
             iter.value().imageRequested = false;
+            serverMetrics.streamImagesSent.increment();
+            serverMetrics.streamBytesSent.add(8 + m_jpeg.size());
         }
     }
+    stampFrame(frame, FrameTrace::StreamerSent);
 }
 
 QStringList ImageStreamer::getConnectionList() const
@@ -146,6 +203,7 @@ void ImageStreamer::newConnection()
         socket->peerPort()
     };
     m_socketMap.insert(socket, clientInfo);
+    serverMetrics.streamClients.increment();
     emit info(QString("Streaming client connected [%1:%2].")
               .arg(clientInfo.name).arg(clientInfo.port));
     emit connectionListChanged(getConnectionList());
@@ -169,6 +227,7 @@ void ImageStreamer::socketDisconnected()
               .arg(clientInfo.name).arg(clientInfo.port));
 
     m_socketMap.remove(socket);
+    serverMetrics.streamClients.decrement();
     socket->deleteLater();
     emit connectionListChanged(getConnectionList());
 }
@@ -27,6 +27,7 @@
 #ifndef SJCAM_IMAGESTREAMER_H
 #define SJCAM_IMAGESTREAMER_H
 
+#include "defectmap.h"
 #include <QtCore/QObject>
 #include <QtCore/QMap>
 #include <QtCore/QVector>
@@ -38,6 +39,7 @@
 class QString;
 class QTcpServer;
 class QTcpSocket;
+class ClockModel;
 
 class ImageStreamer : public QObject
 {
@@ -47,12 +49,15 @@ public:
     explicit ImageStreamer(QObject *parent = 0);
     ~ImageStreamer();
 
-    // these methods are NOT thread-safe!
-    bool listen(quint16 port);
+    // these methods are NOT thread-safe, use QMetaObject::invokeMethod()
+    // after the streamer was moved to its thread!
+    Q_INVOKABLE bool listen(quint16 port);
     quint16 serverPort() const;
+    void setClockModel(const ClockModel *clockModel);
 
 public slots:
     void processFrame(tPvFrame *frame);
+    void setDefectMap(const DefectMap &map);
 
 signals:
     void frameFinished(tPvFrame *frame);
@@ -79,10 +84,13 @@ protected:
 private:
     Q_DISABLE_COPY(ImageStreamer)
     QTcpServer * const m_tcpServer;
+    const ClockModel *m_clockModel;
+    DefectMap m_defectMap;
     QMap<QTcpSocket *, ClientInfo> m_socketMap;
     QVector<QRgb> m_colorTable;
     QImage m_image;
     QByteArray m_jpeg;
+    QVector<uchar> m_unpackBuffer;
 };
 
 #endif // SJCAM_IMAGESTREAMER_H
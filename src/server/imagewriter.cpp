@@ -26,19 +26,42 @@
 
 #include "imagewriter.h"
 #include "pvutils.h"
+#include "frameops.h"
+#include "pipelinestats.h"
+#include "metrics.h"
 #include "version.h"
 #include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
 #include <QtCore/QtEndian>
 #include <QtCore/QDebug>
 
 ImageWriter::ImageWriter(QObject *parent)
     : QObject(parent),
+      m_clockModel(0),
       m_markerEnabled(false),
       m_markerPos(0, 0),
       m_count(0),
       m_stepping(1),
-      m_i(0)
+      m_i(0),
+      m_numWritten(0),
+      m_numTotal(0),
+      m_preTriggerCompressed(false),
+      m_writePendingScheduled(false),
+      m_storedPending(false),
+      m_maxPendingFrames(0),
+      m_dropErrorSent(false),
+      m_numSelected(0),
+      m_coaddCount(0),
+      m_coaddAverage(false),
+      m_coaddNumFrames(0),
+      m_numCoadded(0),
+      m_coaddStartTimestamp(0),
+      m_coaddEndTimestamp(0),
+      m_coaddExposure(0),
+      m_coaddFlags(0),
+      m_fileStartUsecs(0)
 {
+    qMemSet(&m_coaddFirstFrame, 0, sizeof(m_coaddFirstFrame));
 }
 
 ImageWriter::~ImageWriter()
@@ -58,11 +81,26 @@ void ImageWriter::setFileNamePrefix(const QString &prefix)
 void ImageWriter::processFrame(tPvFrame *frame)
 {
     if (frame && (frame->Status == ePvErrSuccess)) {
-        if (m_i < m_count * m_stepping) {
-            if (m_i % m_stepping == 0)
-                writeFrame(frame);
+        QDateTime now = frameTime(frame);
+        if (isWriting()) {
+            if (m_i % m_stepping == 0) {
+                // keep the frame order while stored frames are written
+                if (isCoadding())
+                    coaddFrame(frame, now);
+                else if (m_frameSelector.isEnabled())
+                    selectFrame(frame, now);
+                else if (m_pendingFrames.isEmpty())
+                    writeFrame(frame, now);
+                else if (m_pendingFrames.size() < m_maxPendingFrames)
+                    m_pendingFrames.enqueue(StoredFrame(frame, now));
+                else
+                    dropFrame();
+            }
             m_i++;
         }
+        else if (m_preTriggerRing.capacity() > 0) {
+            m_preTriggerRing.append(frame, now, m_preTriggerCompressed);
+        }
     }
     emit frameFinished(frame);
 }
@@ -77,11 +115,94 @@ void ImageWriter::setTelescopeName(const QByteArray &telescopeName)
     m_telescopeName = telescopeName;
 }
 
+// The clock model is owned by the recorder and maps the frame time stamps
+// to UTC; without a clock model the time of arrival is used.
+void ImageWriter::setClockModel(const ClockModel *clockModel)
+{
+    m_clockModel = clockModel;
+}
+
 void ImageWriter::writeNextFrames(int count, int stepping)
 {
     m_count = count > 0 ? count : 0;
     m_stepping = stepping > 1 ? stepping : 1;
     m_i = 0;
+    m_numWritten = 0;
+    m_numTotal = m_count;
+    m_numSelected = 0;
+    m_frameSelector.clear();
+    m_numCoadded = 0;
+    m_coaddNumFrames = 0;
+
+    // frames which are still pending are written as part of the new request
+    m_numTotal += m_pendingFrames.size();
+}
+
+// The ring frames are written unprocessed, pre-trigger flushes are rejected
+// by the server while the frame selection or co-adding is enabled.
+void ImageWriter::writePreTriggerFrames(int count, int stepping)
+{
+    writeNextFrames(count, stepping);
+
+    // only use every stepping-th frame of the ring, counted backwards from
+    // the first frame which is written after the trigger
+    m_maxPendingFrames = m_preTriggerRing.capacity();
+    StoredFrameList ringFrames = m_preTriggerRing.takeAll();
+    const int numRingFrames = ringFrames.size();
+    int numEnqueued = 0;
+    for (int i = 0; i < numRingFrames; ++i)
+        if ((numRingFrames - i) % m_stepping == 0) {
+            m_pendingFrames.enqueue(PendingFrame(ringFrames[i]));
+            ++numEnqueued;
+        }
+
+    m_numTotal += numEnqueued;
+    m_storedPending = true;
+    if (m_pendingFrames.isEmpty())
+        finishStoredFrames();
+    else
+        scheduleWritePending();
+}
+
+void ImageWriter::writeStoredFrames(const StoredFrameList &frames)
+{
+    // stored frames are appended to the frames of a running write request
+    if (!isWriting() && m_pendingFrames.isEmpty()) {
+        m_numWritten = 0;
+        m_numTotal = 0;
+    }
+    foreach (const StoredFrame &storedFrame, frames)
+        m_pendingFrames.enqueue(PendingFrame(storedFrame));
+    m_numTotal += frames.size();
+    m_maxPendingFrames = qMax(m_preTriggerRing.capacity(), frames.size());
+
+    m_storedPending = true;
+    if (m_pendingFrames.isEmpty())
+        finishStoredFrames();
+    else
+        scheduleWritePending();
+}
+
+void ImageWriter::setPreTrigger(int numFrames, int msecs, bool compressed)
+{
+    m_preTriggerRing.setCapacity(numFrames);
+    m_preTriggerRing.setMaxAge(msecs);
+    m_preTriggerCompressed = compressed;
+}
+
+void ImageWriter::setFrameSelection(int numKeep, int windowSize, int metric)
+{
+    m_frameSelector.setup(numKeep, windowSize,
+                          FrameSelector::Metric(metric));
+    m_numSelected = 0;
+}
+
+void ImageWriter::setCoadding(int numFrames, bool average)
+{
+    m_coaddCount = numFrames;
+    m_coaddAverage = average;
+    m_coaddNumFrames = 0;
+    m_numCoadded = 0;
 }
 
 void ImageWriter::setCameraInfo(const CameraInfo &cameraInfo)
@@ -99,36 +220,290 @@ void ImageWriter::setMarkerPos(const QVariant &markerPos)
     }
 }
 
-bool ImageWriter::writeFrame(tPvFrame *frame)
+// Whether a frame was calibrated is recorded in its frame trace, the file
+// names are only written to the headers of calibrated frames.
+void ImageWriter::setCalibration(const QString &darkFileName,
+                                 const QString &flatFileName)
+{
+    m_darkFileName = QFileInfo(darkFileName).fileName().toAscii();
+    m_flatFileName = QFileInfo(flatFileName).fileName().toAscii();
+}
+
+// The file name is only written to the headers of corrected frames.
+void ImageWriter::setDefectFile(const QString &fileName)
+{
+    m_defectFileName = QFileInfo(fileName).fileName().toAscii();
+}
+
+void ImageWriter::writePendingFrame()
+{
+    m_writePendingScheduled = false;
+    if (m_pendingFrames.isEmpty())
+        return;
+
+    // write only one frame per call, so that incoming frames are returned
+    // to the recorder between the writes of the pending frames
+    PendingFrame pending = m_pendingFrames.dequeue();
+    writeFrame(pending.storedFrame.frame(), pending.storedFrame.time(),
+               pending.keys);
+    if (m_pendingFrames.isEmpty()) {
+        m_dropErrorSent = false;
+        finishStoredFrames();
+    }
+    else
+        scheduleWritePending();
+}
+
+// Live frames which arrive while stored frames are written are queued behind
+// them. The queue may use as many frames as the pre-trigger ring or the burst
+// being written, further frames are dropped so that a slow disk cannot grow
+// the memory usage without limit.
+void ImageWriter::dropFrame()
+{
+    serverMetrics.writerDropped.increment();
+    --m_numTotal;
+    if (!m_dropErrorSent) {
+        emit error("Writer queue is full, frames are dropped.");
+        m_dropErrorSent = true;
+    }
+}
+
+// Only stored frames of a burst or pre-trigger flush are reported, pending
+// frames of a live write request are not.
+void ImageWriter::finishStoredFrames()
+{
+    if (!m_storedPending)
+        return;
+    m_storedPending = false;
+    emit storedFramesWritten();
+}
+
+void ImageWriter::scheduleWritePending()
+{
+    if (m_writePendingScheduled || m_pendingFrames.isEmpty())
+        return;
+    m_writePendingScheduled = true;
+    QMetaObject::invokeMethod(this, "writePendingFrame", Qt::QueuedConnection);
+}
+
+bool ImageWriter::isCoadding() const
+{
+    return m_coaddCount > 1;
+}
+
+bool ImageWriter::isWriting() const
+{
+    if (isCoadding())
+        return m_numCoadded < m_count;
+    if (m_frameSelector.isEnabled())
+        return m_numSelected < m_count;
+    return m_i < m_count * m_stepping;
+}
+
+void ImageWriter::selectFrame(tPvFrame *frame, const QDateTime &time)
+{
+    m_frameSelector.addFrame(frame, time);
+    if (!m_frameSelector.isWindowComplete())
+        return;
+
+    QByteArray metricComment = "frame sharpness ("
+            + m_frameSelector.metricName() + ")";
+    foreach (const SelectedFrame &selected, m_frameSelector.takeSelected()) {
+        if (m_numSelected >= m_count)
+            break;
+        ++m_numSelected;
+        QList<FitsKey> keys;
+        keys << FitsKey("SHARPNES", selected.sharpness, metricComment)
+             << FitsKey("SELRANK", selected.rank,
+                        "sharpness rank within the selection window")
+             << FitsKey("SELWINDW", m_frameSelector.windowSize(),
+                        "frames per selection window");
+        m_pendingFrames.enqueue(PendingFrame(selected.storedFrame, keys));
+    }
+    scheduleWritePending();
+}
+
+bool ImageWriter::writeFrame(tPvFrame *frame, const QDateTime &time,
+                             const QList<FitsKey> &extraKeys)
 {
     Q_ASSERT(frame);
 
+    long width = long(frame->Width);
+    long height = long(frame->Height);
+    int imageType = (frame->Format == ePvFmtMono8) ? BYTE_IMG : SHORT_IMG;
+    fitsfile *ff = createFile(time, frameFlags(frame), imageType, width,
+                              height);
+    if (!ff)
+        return false;
+    stampFrame(frame, FrameTrace::WriterOpened);
+
+    writeKey(ff, "FRAME-NO", frame->FrameCount, "frame number (rolls at 65535)");
+
+    uint tsFreq = m_cameraInfo.timeStampFrequency;
+    if (tsFreq == 0) tsFreq = 1;
+    writeKey(ff, "TIMESTAM", PvFrameTimestamp(frame, tsFreq, 1e6),
+             "[us] time stamp (time since camera power on)");
+    writeDateObsKey(ff, frame);
+
+    if (frame->AncillaryBuffer && frame->AncillarySize >= 12) {
+        quint32 *buf = reinterpret_cast<quint32 *>(frame->AncillaryBuffer);
+        writeKey(ff, "EXPTIME", qFromBigEndian(buf[2]), "[us] exposure time");
+    }
+    writeKey(ff, "BITDEPTH", frame->BitDepth, "significant bits per pixel");
+    writeMarkerKeys(ff);
+
+    foreach (const FitsKey &key, extraKeys)
+        writeKey(ff, key);
+
+    //! \todo Add more header entries.
+
+    // packed 12-bit frames are stored as 16-bit integers
+    void *data = frame->ImageBuffer;
+    if (frame->Format == ePvFmtMono12Packed) {
+        m_unpackBuffer.resize(int(width * height));
+        unpackMono12Packed(m_unpackBuffer.data(),
+                           reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                           m_unpackBuffer.size());
+        data = m_unpackBuffer.data();
+    }
+
+    int dataType = (frame->Format == ePvFmtMono8) ? TBYTE : TSHORT;
+    return finishFile(ff, time, dataType, width * height, data,
+                      frameTrace(frame));
+}
+
+bool ImageWriter::writeCoaddedFrame()
+{
+    Q_ASSERT(m_coaddNumFrames > 0);
+
+    const tPvFrame &first = m_coaddFirstFrame;
+    long width = long(first.Width);
+    long height = long(first.Height);
+    int imageType = m_coaddAverage ? FLOAT_IMG : ULONG_IMG;
+    fitsfile *ff = createFile(m_coaddStartTime, m_coaddFlags, imageType,
+                              width, height);
+    if (!ff)
+        return false;
+
+    writeKey(ff, "FRAME-NO", first.FrameCount,
+             "number of the first frame (rolls at 65535)");
+    writeKey(ff, "NCOMBINE", m_coaddNumFrames, "number of co-added frames");
+    writeKey(ff, "COMBMODE", m_coaddAverage ? QByteArray("average")
+                                            : QByteArray("sum"),
+             "how the frames were combined");
+    writeKey(ff, "DATE-BEG", m_coaddStartTime.toString(
+                 "yyyy-MM-ddThh:mm:ss.zzz").toAscii(),
+             "[utc] time of the first frame");
+    writeKey(ff, "DATE-END", m_coaddEndTime.toString(
+                 "yyyy-MM-ddThh:mm:ss.zzz").toAscii(),
+             "[utc] time of the last frame");
+    writeDateObsKey(ff, &first);
+    writeKey(ff, "TSTART", m_coaddStartTimestamp,
+             "[us] time stamp of the first frame");
+    writeKey(ff, "TEND", m_coaddEndTimestamp,
+             "[us] time stamp of the last frame");
+    if (m_coaddExposure > 0)
+        writeKey(ff, "EXPTIME", m_coaddExposure,
+                 "[us] exposure time of a single frame");
+    writeKey(ff, "BITDEPTH", first.BitDepth,
+             "significant bits per pixel of a single frame");
+    writeMarkerKeys(ff);
+
+    const int numPixels = m_coaddSum.size();
+    if (m_coaddAverage) {
+        m_coaddAverageImage.resize(numPixels);
+        scale(m_coaddAverageImage.data(), m_coaddSum.constData(), numPixels,
+              1.0f / m_coaddNumFrames);
+        return finishFile(ff, m_coaddStartTime, TFLOAT, numPixels,
+                          m_coaddAverageImage.data());
+    }
+    return finishFile(ff, m_coaddStartTime, TUINT, numPixels,
+                      m_coaddSum.data());
+}
+
+void ImageWriter::coaddFrame(tPvFrame *frame, const QDateTime &time)
+{
+    Q_ASSERT(frame);
+    const int numPixels = int(frame->Width * frame->Height);
+
+    // start a new sum for the first frame or if the geometry has changed
+    if (m_coaddNumFrames > 0 && (frame->Width != m_coaddFirstFrame.Width ||
+            frame->Height != m_coaddFirstFrame.Height ||
+            frame->Format != m_coaddFirstFrame.Format))
+        m_coaddNumFrames = 0;
+
+    uint tsFreq = m_cameraInfo.timeStampFrequency;
+    if (tsFreq == 0) tsFreq = 1;
+    qint64 timestamp = PvFrameTimestamp(frame, tsFreq, 1e6);
+
+    if (m_coaddNumFrames == 0) {
+        m_coaddSum.fill(0, numPixels);
+        m_coaddFirstFrame = *frame;
+        m_coaddStartTime = time;
+        m_coaddStartTimestamp = timestamp;
+        m_coaddExposure = 0;
+        m_coaddFlags = frameFlags(frame);
+        if (frame->AncillaryBuffer && frame->AncillarySize >= 12) {
+            quint32 *buf = reinterpret_cast<quint32 *>(frame->AncillaryBuffer);
+            m_coaddExposure = qFromBigEndian(buf[2]);
+        }
+    }
+
+    if (frame->Format == ePvFmtMono8)
+        accumulate(m_coaddSum.data(),
+                   reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                   numPixels);
+    else if (frame->Format == ePvFmtMono12Packed) {
+        m_unpackBuffer.resize(numPixels);
+        unpackMono12Packed(m_unpackBuffer.data(),
+                           reinterpret_cast<const uchar *>(frame->ImageBuffer),
+                           numPixels);
+        accumulate(m_coaddSum.data(), m_unpackBuffer.constData(), numPixels);
+    }
+    else
+        accumulate(m_coaddSum.data(),
+                   reinterpret_cast<const quint16 *>(frame->ImageBuffer),
+                   numPixels);
+
+    // the sum is only flagged if all co-added frames are
+    m_coaddFlags &= frameFlags(frame);
+    m_coaddEndTime = time;
+    m_coaddEndTimestamp = timestamp;
+    if (++m_coaddNumFrames < m_coaddCount)
+        return;
+
+    writeCoaddedFrame();
+    m_coaddNumFrames = 0;
+    ++m_numCoadded;
+}
+
+fitsfile * ImageWriter::createFile(const QDateTime &time, quint32 frameFlags,
+                                   int imageType, long width, long height)
+{
     QDateTime now = QDateTime::currentDateTimeUtc();
-    QString fileId = now.toString("yyyyMMdd-hhmmsszzz");
-    QString fileName = QString("%1_%2.fits")
-            .arg(m_fileNamePrefix)
-            .arg(fileId);
-    QString tempFileName = fileName + ".tmp";
-    QString fullTempFileName = m_directory.absoluteFilePath(tempFileName);
+    QString fileName = fitsFileName(time);
+    QString fullTempFileName = m_directory.absoluteFilePath(fileName + ".tmp");
+    m_fileStartUsecs = monotonicUsecs();
 
     int errcode = 0;
     fitsfile *ff = 0;
     fits_create_diskfile(&ff, fullTempFileName.toAscii(), &errcode);
     if (errcode) {
         sendError("Cannot create the file '" + fullTempFileName + "'.", errcode);
+        serverMetrics.writerErrors.increment();
         if (ff) fits_close_file(ff, &errcode);
-        return false;
+        return 0;
     }
 
     long naxes[2];
-    naxes[0] = long(frame->Width);
-    naxes[1] = long(frame->Height);
-    int imageType = (frame->BitDepth == 8) ? BYTE_IMG : SHORT_IMG;
+    naxes[0] = width;
+    naxes[1] = height;
     fits_create_img(ff, imageType, 2, naxes, &errcode);
     if (errcode) {
         sendError("Cannot allocate file space.", errcode);
+        serverMetrics.writerErrors.increment();
         fits_close_file(ff, &errcode);
-        return false;
+        return 0;
     }
 
     // try to remove the 2 default comments entries from the header
@@ -140,7 +515,11 @@ bool ImageWriter::writeFrame(tPvFrame *frame)
     writeKey(ff, "DATE", now.toString("yyyy-MM-ddThh:mm:ss.zzz").toAscii(),
              "[utc] file creation time");
     writeKey(ff, "FILENAME", fileName.toAscii(), "original file name");
-    writeKey(ff, "STATUS", "raw", "file status");
+
+    // the status and the calibration keys describe what was applied to
+    // the frame
+    const bool calibrated = frameFlags & FrameTrace::DarkFlatApplied;
+    writeKey(ff, "STATUS", calibrated ? "calibrated" : "raw", "file status");
 
     writeKey(ff, "INSTRUME", m_deviceName, "instrument");
     if (!m_telescopeName.isEmpty())
@@ -155,53 +534,100 @@ bool ImageWriter::writeFrame(tPvFrame *frame)
     writeKey(ff, "CAMFWVER", m_cameraInfo.pvCameraInfo.FirmwareVersion,
              "camera firmware version");
 
-    writeKey(ff, "FRAME-NO", frame->FrameCount, "frame number (rolls at 65535)");
-
-    uint tsFreq = m_cameraInfo.timeStampFrequency;
-    if (tsFreq == 0) tsFreq = 1;
-    writeKey(ff, "TIMESTAM", PvFrameTimestamp(frame, tsFreq, 1e6),
-             "[us] time stamp (time since camera power on)");
-
-    if (frame->AncillaryBuffer && frame->AncillarySize >= 12) {
-        quint32 *buf = reinterpret_cast<quint32 *>(frame->AncillaryBuffer);
-        writeKey(ff, "EXPTIME", qFromBigEndian(buf[2]), "[us] exposure time");
+    writeKey(ff, FitsKey("CALIBRAT", calibrated,
+                         "dark/flat calibration applied"));
+    if (calibrated) {
+        if (!m_darkFileName.isEmpty())
+            writeKey(ff, "DARKFILE", m_darkFileName, "master dark frame");
+        if (!m_flatFileName.isEmpty())
+            writeKey(ff, "FLATFILE", m_flatFileName, "master flat field");
     }
-    writeKey(ff, "BITDEPTH", frame->BitDepth, "significant bits per pixel");
-
-    if (m_markerEnabled) {
-        writeKey(ff, "MARKER-X", m_markerPos.x(),
-                 "marker x-coordinate [0, width-1]");
-        writeKey(ff, "MARKER-Y", m_markerPos.y(),
-                 "marker y-coordinate [0, height-1]");
-    }
-
-    //! \todo Add more header entries.
+    const bool corrected = frameFlags & FrameTrace::DefectsCorrected;
+    writeKey(ff, FitsKey("DEFECTS", corrected, "defective pixels replaced"));
+    if (corrected && !m_defectFileName.isEmpty())
+        writeKey(ff, "DEFFILE", m_defectFileName, "defect map");
+    return ff;
+}
 
+bool ImageWriter::finishFile(fitsfile *ff, const QDateTime &time,
+                             int dataType, LONGLONG numPixels, void *data,
+                             FrameTrace *trace)
+{
+    int errcode = 0;
     long fpixel[2] = { 1, 1 };
-    LONGLONG nelem = naxes[0] * naxes[1];
-    int dataType = (frame->BitDepth == 8) ? TBYTE : TSHORT;
-    fits_write_pix(ff, dataType, fpixel, nelem, frame->ImageBuffer, &errcode);
+    fits_write_pix(ff, dataType, fpixel, numPixels, data, &errcode);
     if (errcode) {
         sendError("Cannot write frame.", errcode);
+        serverMetrics.writerErrors.increment();
         fits_close_file(ff, &errcode);
         return false;
     }
+    if (trace)
+        trace->stamps[FrameTrace::WriterWritten] = monotonicUsecs();
 
     fits_close_file(ff, &errcode);
     if (errcode) {
         sendError("Cannot close file.", errcode);
+        serverMetrics.writerErrors.increment();
         return false;
     }
+    if (trace)
+        trace->stamps[FrameTrace::WriterClosed] = monotonicUsecs();
 
-    if (!m_directory.rename(tempFileName, fileName)) {
+    QString fileName = fitsFileName(time);
+    if (!m_directory.rename(fileName + ".tmp", fileName)) {
         sendError("Cannot rename temporary file.");
+        serverMetrics.writerErrors.increment();
         return false;
     }
+    if (trace)
+        trace->stamps[FrameTrace::WriterRenamed] = monotonicUsecs();
 
-    emit frameWritten(m_i / m_stepping + 1, m_count, fileId.toAscii());
+    int bytesPerPixel = (dataType == TBYTE) ? 1 : (dataType == TSHORT) ? 2 : 4;
+    serverMetrics.writerFiles.increment();
+    serverMetrics.writerBytes.add(numPixels * bytesPerPixel);
+    serverMetrics.writerUsecs.add(monotonicUsecs() - m_fileStartUsecs);
+    serverMetrics.writerCount.increment();
+
+    QString fileId = time.toString("yyyyMMdd-hhmmsszzz");
+    emit frameWritten(++m_numWritten, m_numTotal, fileId.toAscii());
     return true;
 }
 
+QString ImageWriter::fitsFileName(const QDateTime &time) const
+{
+    return QString("%1_%2.fits")
+            .arg(m_fileNamePrefix)
+            .arg(time.toString("yyyyMMdd-hhmmsszzz"));
+}
+
+QDateTime ImageWriter::frameTime(tPvFrame *frame) const
+{
+    if (m_clockModel)
+        return m_clockModel->utcTime(PvFrameTicks(frame));
+    return QDateTime::currentDateTimeUtc();
+}
+
+void ImageWriter::writeDateObsKey(fitsfile *ff, const tPvFrame *frame)
+{
+    if (!m_clockModel)
+        return;
+    qint64 usecs = m_clockModel->utcUsecs(PvFrameTicks(frame));
+    if (usecs != 0)
+        writeKey(ff, "DATE-OBS", ClockModel::isoString(usecs),
+                 "[utc] start of the exposure");
+}
+
+void ImageWriter::writeMarkerKeys(fitsfile *ff)
+{
+    if (m_markerEnabled) {
+        writeKey(ff, "MARKER-X", m_markerPos.x(),
+                 "marker x-coordinate [0, width-1]");
+        writeKey(ff, "MARKER-Y", m_markerPos.y(),
+                 "marker y-coordinate [0, height-1]");
+    }
+}
+
 bool ImageWriter::writeKey(fitsfile *ff, int datatype, const char *keyname,
                            void *value, const char *comment)
 {
@@ -215,6 +641,28 @@ bool ImageWriter::writeKey(fitsfile *ff, int datatype, const char *keyname,
     return true;
 }
 
+bool ImageWriter::writeKey(fitsfile *ff, const FitsKey &key)
+{
+    switch (key.value.type())
+    {
+    case QVariant::Bool: {
+        int value = key.value.toBool() ? 1 : 0;
+        return writeKey(ff, TLOGICAL, key.name, &value, key.comment);
+    }
+    case QVariant::Int:
+        return writeKey(ff, key.name, key.value.toInt(), key.comment);
+    case QVariant::UInt:
+        return writeKey(ff, key.name, key.value.toUInt(), key.comment);
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+        return writeKey(ff, key.name, key.value.toLongLong(), key.comment);
+    case QVariant::Double:
+        return writeKey(ff, key.name, key.value.toDouble(), key.comment);
+    default:
+        return writeKey(ff, key.name, key.value.toByteArray(), key.comment);
+    }
+}
+
 QString ImageWriter::fitsioErrorString(int errcode) const
 {
     char fitsioMsg[31];  // message has max 30 chars
@@ -28,14 +28,33 @@
 #define SJCAM_IMAGEWRITER_H
 
 #include "recorder.h"
+#include "framestore.h"
+#include "frameselector.h"
 #include <QtCore/QObject>
 #include <QtCore/QDir>
 #include <QtCore/QString>
 #include <QtCore/QByteArray>
 #include <QtCore/QVariant>
 #include <QtCore/QPointF>
+#include <QtCore/QQueue>
+#include <QtCore/QDateTime>
+#include <QtCore/QList>
+#include <QtCore/QVector>
 #include <fitsio.h>
 
+struct FrameTrace;
+
+struct FitsKey
+{
+    FitsKey() {}
+    FitsKey(const QByteArray &name_, const QVariant &value_,
+            const QByteArray &comment_ = QByteArray())
+        : name(name_), value(value_), comment(comment_) {}
+    QByteArray name;
+    QVariant value;
+    QByteArray comment;
+};
+
 class ImageWriter : public QObject
 {
     Q_OBJECT
@@ -44,26 +63,58 @@ public:
     explicit ImageWriter(QObject *parent = 0);
     ~ImageWriter();
 
-    // these methods are NOT thread-safe!
-    void setDirectory(const QString &directory);
-    void setFileNamePrefix(const QString &prefix);
-    void setDeviceName(const QByteArray &deviceName);
-    void setTelescopeName(const QByteArray &telescopeName);
+    // these methods are NOT thread-safe, use QMetaObject::invokeMethod()
+    // after the writer was moved to its thread!
+    Q_INVOKABLE void setDirectory(const QString &directory);
+    Q_INVOKABLE void setFileNamePrefix(const QString &prefix);
+    Q_INVOKABLE void setDeviceName(const QByteArray &deviceName);
+    Q_INVOKABLE void setTelescopeName(const QByteArray &telescopeName);
+    Q_INVOKABLE void setClockModel(const ClockModel *clockModel);
 
 public slots:
     void processFrame(tPvFrame *frame);
     void writeNextFrames(int count, int stepping);
+    void writePreTriggerFrames(int count, int stepping);
+    void writeStoredFrames(const StoredFrameList &frames);
+    void setPreTrigger(int numFrames, int msecs, bool compressed);
+    void setFrameSelection(int numKeep, int windowSize, int metric);
+    void setCoadding(int numFrames, bool average);
     void setCameraInfo(const CameraInfo &cameraInfo);
     void setMarkerPos(const QVariant &markerPos);
+    void setCalibration(const QString &darkFileName,
+                        const QString &flatFileName);
+    void setDefectFile(const QString &fileName);
 
 signals:
     void frameFinished(tPvFrame *frame);
     void frameWritten(int n, int total, const QByteArray &fileId);
+    void storedFramesWritten();
     void info(const QString &infoString) const;
     void error(const QString &errorString) const;
 
+protected slots:
+    void writePendingFrame();
+
 protected:
-    bool writeFrame(tPvFrame *frame);
+    void dropFrame();
+    void finishStoredFrames();
+    bool isCoadding() const;
+    bool isWriting() const;
+    void selectFrame(tPvFrame *frame, const QDateTime &time);
+    void coaddFrame(tPvFrame *frame, const QDateTime &time);
+    bool writeFrame(tPvFrame *frame, const QDateTime &time,
+                    const QList<FitsKey> &extraKeys = QList<FitsKey>());
+    bool writeCoaddedFrame();
+
+    fitsfile * createFile(const QDateTime &time, quint32 frameFlags,
+                          int imageType, long width, long height);
+    bool finishFile(fitsfile *ff, const QDateTime &time, int dataType,
+                    LONGLONG numPixels, void *data, FrameTrace *trace = 0);
+    QString fitsFileName(const QDateTime &time) const;
+    QDateTime frameTime(tPvFrame *frame) const;
+    void writeDateObsKey(fitsfile *ff, const tPvFrame *frame);
+    void writeMarkerKeys(fitsfile *ff);
+    void scheduleWritePending();
 
     bool writeKey(fitsfile *ff, const QByteArray &key, short value, const QByteArray &comment = QByteArray());
     bool writeKey(fitsfile *ff, const QByteArray &key, ushort value, const QByteArray &comment = QByteArray());
@@ -76,22 +127,62 @@ protected:
     bool writeKey(fitsfile *ff, const QByteArray &key, double value, const QByteArray &comment = QByteArray());
     bool writeKey(fitsfile *ff, const QByteArray &key, QByteArray value, const QByteArray &comment = QByteArray());
     bool writeKey(fitsfile *ff, int datatype, const char *keyname, void *value, const char *comment);
+    bool writeKey(fitsfile *ff, const FitsKey &key);
 
     QString fitsioErrorString(int errcode) const;
     void sendError(const QString &msg, int errcode = 0) const;
 
 private:
+    struct PendingFrame {
+        PendingFrame() {}
+        PendingFrame(const StoredFrame &storedFrame_,
+                     const QList<FitsKey> &keys_ = QList<FitsKey>())
+            : storedFrame(storedFrame_), keys(keys_) {}
+        StoredFrame storedFrame;
+        QList<FitsKey> keys;
+    };
+
     Q_DISABLE_COPY(ImageWriter)
     QDir m_directory;
     QString m_fileNamePrefix;
     QByteArray m_deviceName;
     QByteArray m_telescopeName;
     CameraInfo m_cameraInfo;
+    const ClockModel *m_clockModel;
     bool m_markerEnabled;
     QPointF m_markerPos;
+    QByteArray m_darkFileName;
+    QByteArray m_flatFileName;
+    QByteArray m_defectFileName;
     int m_count;
     int m_stepping;
     int m_i;
+    int m_numWritten;
+    int m_numTotal;
+    FrameRing m_preTriggerRing;
+    bool m_preTriggerCompressed;
+    QQueue<PendingFrame> m_pendingFrames;
+    bool m_writePendingScheduled;
+    bool m_storedPending;
+    int m_maxPendingFrames;
+    bool m_dropErrorSent;
+    FrameSelector m_frameSelector;
+    int m_numSelected;
+    int m_coaddCount;
+    bool m_coaddAverage;
+    int m_coaddNumFrames;
+    int m_numCoadded;
+    QVector<quint32> m_coaddSum;
+    QVector<float> m_coaddAverageImage;
+    QVector<quint16> m_unpackBuffer;
+    tPvFrame m_coaddFirstFrame;
+    QDateTime m_coaddStartTime;
+    QDateTime m_coaddEndTime;
+    qint64 m_coaddStartTimestamp;
+    qint64 m_coaddEndTimestamp;
+    quint32 m_coaddExposure;
+    quint32 m_coaddFlags;
+    qint64 m_fileStartUsecs;
 };
 
 inline bool ImageWriter::writeKey(fitsfile *ff, const QByteArray &key,
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "metrics.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+
+#ifdef _WIN32
+#include <windows.h>
+void AtomicCounter::add(qint64 n)
+{
+    InterlockedExchangeAdd64(&m_value, n);
+}
+
+void AtomicCounter::set(qint64 n)
+{
+    InterlockedExchange64(&m_value, n);
+}
+
+qint64 AtomicCounter::value() const
+{
+    return InterlockedCompareExchange64(&m_value, 0, 0);
+}
+#else
+void AtomicCounter::add(qint64 n)
+{
+    __sync_fetch_and_add(&m_value, n);
+}
+
+void AtomicCounter::set(qint64 n)
+{
+    qint64 old = m_value;
+    qint64 prev;
+    while ((prev = __sync_val_compare_and_swap(&m_value, old, n)) != old)
+        old = prev;
+}
+
+qint64 AtomicCounter::value() const
+{
+    return __sync_fetch_and_add(&m_value, 0);
+}
+#endif
+
+ScopedLatencyTimer::ScopedLatencyTimer(AtomicCounter *sum,
+                                       AtomicCounter *count)
+    : m_sum(sum),
+      m_count(count),
+      m_start(monotonicUsecs())
+{
+}
+
+ScopedLatencyTimer::~ScopedLatencyTimer()
+{
+    m_sum->add(monotonicUsecs() - m_start);
+    m_count->increment();
+}
+
+ServerMetrics serverMetrics;
+
+void ServerMetrics::countFrame(int status)
+{
+    if (status >= 0 && status < NumFrameStatus)
+        framesByStatus[status].increment();
+    else
+        framesOtherStatus.increment();
+}
+
+namespace {
+
+void appendHeader(QByteArray &out, const char *name, const char *type,
+                  const char *help)
+{
+    out += QByteArray("# HELP ") + name + " " + help + "\n";
+    out += QByteArray("# TYPE ") + name + " " + type + "\n";
+}
+
+void appendValue(QByteArray &out, const QByteArray &name, qint64 value,
+                 const QByteArray &labels = QByteArray())
+{
+    out += name;
+    if (!labels.isEmpty())
+        out += "{" + labels + "}";
+    out += " " + QByteArray::number(value) + "\n";
+}
+
+void appendSeconds(QByteArray &out, const QByteArray &name, qint64 usecs)
+{
+    out += name + " " + QByteArray::number(usecs * 1e-6, 'g', 12)
+            + "\n";
+}
+
+void appendSummary(QByteArray &out, const char *name, const char *help,
+                   const AtomicCounter &usecs, const AtomicCounter &count)
+{
+    appendHeader(out, name, "summary", help);
+    appendSeconds(out, QByteArray(name) + "_sum", usecs.value());
+    appendValue(out, QByteArray(name) + "_count", count.value());
+}
+
+} // namespace
+
+QByteArray ServerMetrics::exposition() const
+{
+    QByteArray out;
+
+    appendHeader(out, "sjcam_frames_total", "counter",
+                 "Frames returned by the camera, by PvApi status.");
+    for (int i = 0; i < NumFrameStatus; ++i) {
+        QByteArray status = PvErrorCodeString(tPvErr(i)).toAscii();
+        appendValue(out, "sjcam_frames_total", framesByStatus[i].value(),
+                    "status=\"" + status + "\"");
+    }
+    appendValue(out, "sjcam_frames_total", framesOtherStatus.value(),
+                "status=\"other\"");
+    appendHeader(out, "sjcam_frames_dropped_total", "counter",
+                 "Frames dropped by the camera, detected from gaps in the "
+                 "frame counter.");
+    appendValue(out, "sjcam_frames_dropped_total", framesDropped.value());
+
+    const qint64 inFlight = buffersInFlight.value();
+    appendHeader(out, "sjcam_buffers", "gauge",
+                 "Frame buffers owned by the recorder (free) or by the "
+                 "processing pipeline (in_flight).");
+    appendValue(out, "sjcam_buffers", buffers.value() - inFlight,
+                "state=\"free\"");
+    appendValue(out, "sjcam_buffers", inFlight, "state=\"in_flight\"");
+
+    appendHeader(out, "sjcam_stream_clients", "gauge",
+                 "Connected streaming clients.");
+    appendValue(out, "sjcam_stream_clients", streamClients.value());
+    appendHeader(out, "sjcam_stream_images_sent_total", "counter",
+                 "Images sent to streaming clients.");
+    appendValue(out, "sjcam_stream_images_sent_total",
+                streamImagesSent.value());
+    appendHeader(out, "sjcam_stream_bytes_sent_total", "counter",
+                 "Bytes sent to streaming clients.");
+    appendValue(out, "sjcam_stream_bytes_sent_total",
+                streamBytesSent.value());
+    appendSummary(out, "sjcam_jpeg_encode_seconds",
+                  "Time spent rendering and encoding preview images.",
+                  jpegEncodeUsecs, jpegEncodeCount);
+
+    appendHeader(out, "sjcam_writer_files_total", "counter",
+                 "FITS files written.");
+    appendValue(out, "sjcam_writer_files_total", writerFiles.value());
+    appendHeader(out, "sjcam_writer_bytes_total", "counter",
+                 "Image data bytes written to FITS files.");
+    appendValue(out, "sjcam_writer_bytes_total", writerBytes.value());
+    appendHeader(out, "sjcam_writer_errors_total", "counter",
+                 "FITS files which could not be written.");
+    appendValue(out, "sjcam_writer_errors_total", writerErrors.value());
+    appendHeader(out, "sjcam_writer_dropped_total", "counter",
+                 "Frames dropped because the writer queue was full.");
+    appendValue(out, "sjcam_writer_dropped_total", writerDropped.value());
+    appendSummary(out, "sjcam_writer_file_seconds",
+                  "Time from creating a FITS file until it was renamed.",
+                  writerUsecs, writerCount);
+
+    appendSummary(out, "sjcam_dcp_command_seconds",
+                  "Time spent handling DCP messages.",
+                  dcpCommandUsecs, dcpCommandCount);
+    return out;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_METRICS_H
+#define SJCAM_METRICS_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QByteArray>
+
+// 64-bit counter which can be updated from any thread without locking.
+class AtomicCounter
+{
+public:
+    AtomicCounter() : m_value(0) {}
+
+    void add(qint64 n);
+    void increment() { add(1); }
+    void decrement() { add(-1); }
+    void set(qint64 n);
+    qint64 value() const;
+
+private:
+    Q_DISABLE_COPY(AtomicCounter)
+    mutable volatile qint64 m_value;
+};
+
+// Adds the lifetime of the timer in microseconds to a sum counter and
+// increments a count counter.
+class ScopedLatencyTimer
+{
+public:
+    ScopedLatencyTimer(AtomicCounter *sum, AtomicCounter *count);
+    ~ScopedLatencyTimer();
+
+private:
+    Q_DISABLE_COPY(ScopedLatencyTimer)
+    AtomicCounter *m_sum;
+    AtomicCounter *m_count;
+    qint64 m_start;
+};
+
+// Counters and gauges of the server, exported by the MetricsServer. They
+// are updated directly on the hot paths of the capture pipeline.
+struct ServerMetrics
+{
+    enum { NumFrameStatus = 23 };
+
+    AtomicCounter framesByStatus[NumFrameStatus];
+    AtomicCounter framesOtherStatus;
+    AtomicCounter framesDropped;
+    AtomicCounter buffers;
+    AtomicCounter buffersInFlight;
+
+    AtomicCounter streamClients;
+    AtomicCounter streamImagesSent;
+    AtomicCounter streamBytesSent;
+    AtomicCounter jpegEncodeUsecs;
+    AtomicCounter jpegEncodeCount;
+
+    AtomicCounter writerFiles;
+    AtomicCounter writerBytes;
+    AtomicCounter writerErrors;
+    AtomicCounter writerDropped;
+    AtomicCounter writerUsecs;
+    AtomicCounter writerCount;
+
+    AtomicCounter dcpCommandUsecs;
+    AtomicCounter dcpCommandCount;
+
+    void countFrame(int status);
+    QByteArray exposition() const;
+};
+
+extern ServerMetrics serverMetrics;
+
+#endif // SJCAM_METRICS_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "metricsserver.h"
+#include "metrics.h"
+#include <QtCore/QtCore>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QObject(parent),
+      m_tcpServer(new QTcpServer(this))
+{
+    connect(m_tcpServer, SIGNAL(newConnection()), SLOT(newConnection()));
+}
+
+MetricsServer::~MetricsServer()
+{
+}
+
+bool MetricsServer::listen(const QHostAddress &address, quint16 port)
+{
+    return m_tcpServer->listen(address, port);
+}
+
+bool MetricsServer::isListening() const
+{
+    return m_tcpServer->isListening();
+}
+
+quint16 MetricsServer::serverPort() const
+{
+    return m_tcpServer->serverPort();
+}
+
+QString MetricsServer::errorString() const
+{
+    return m_tcpServer->errorString();
+}
+
+void MetricsServer::newConnection()
+{
+    while (m_tcpServer->hasPendingConnections()) {
+        QTcpSocket *socket = m_tcpServer->nextPendingConnection();
+        connect(socket, SIGNAL(disconnected()), SLOT(socketDisconnected()));
+        connect(socket, SIGNAL(readyRead()), SLOT(socketReadyRead()));
+        m_requests.insert(socket, QByteArray());
+    }
+}
+
+void MetricsServer::socketReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket || !m_requests.contains(socket))
+        return;
+
+    QByteArray &request = m_requests[socket];
+    request += socket->readAll();
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n")) {
+        // don't buffer arbitrary amounts of data
+        if (request.size() > 8192) {
+            m_requests.remove(socket);
+            socket->abort();
+            socket->deleteLater();
+        }
+        return;
+    }
+
+    // only the request line is evaluated, e.g. "GET /metrics HTTP/1.1"
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n'))
+            .trimmed().split(' ');
+    m_requests[socket].clear();
+
+    if (requestLine.size() < 2 || requestLine[0] != "GET")
+        sendResponse(socket, "405 Method Not Allowed", "");
+    else if (requestLine[1] == "/metrics")
+        sendResponse(socket, "200 OK", serverMetrics.exposition());
+    else
+        sendResponse(socket, "404 Not Found", "");
+}
+
+void MetricsServer::socketDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+    m_requests.remove(socket);
+    socket->deleteLater();
+}
+
+void MetricsServer::sendResponse(QTcpSocket *socket, const QByteArray &status,
+                                 const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.0 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n"
+            "\r\n" + body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
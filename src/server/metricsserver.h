@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_METRICSSERVER_H
+#define SJCAM_METRICSSERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QMap>
+#include <QtCore/QByteArray>
+#include <QtNetwork/QHostAddress>
+
+class QTcpServer;
+class QTcpSocket;
+
+// Minimal HTTP server which answers "GET /metrics" requests with the
+// server metrics in the Prometheus text exposition format.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(QObject *parent = 0);
+    ~MetricsServer();
+
+    bool listen(const QHostAddress &address, quint16 port);
+    bool isListening() const;
+    quint16 serverPort() const;
+    QString errorString() const;
+
+protected slots:
+    void newConnection();
+    void socketReadyRead();
+    void socketDisconnected();
+
+protected:
+    void sendResponse(QTcpSocket *socket, const QByteArray &status,
+                      const QByteArray &body);
+
+private:
+    Q_DISABLE_COPY(MetricsServer)
+    QTcpServer *m_tcpServer;
+    QMap<QTcpSocket *, QByteArray> m_requests;
+};
+
+#endif // SJCAM_METRICSSERVER_H
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "motiontracker.h"
+#include "clockmodel.h"
+#include "frameops.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+namespace {
+
+// records are dropped for clients which cannot keep up
+const qint64 MaxPendingBytes = 65536;
+
+quint32 floatBits(float value)
+{
+    quint32 bits;
+    qMemCopy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+void encodeRecord(const MotionInfo &info, uchar *dest)
+{
+    qToLittleEndian(quint32(info.count), dest);
+    qToLittleEndian(qint32(info.status), dest + 4);
+    qToLittleEndian(qint64(info.exposureUtcUsecs), dest + 8);
+    qToLittleEndian(floatBits(info.dx), dest + 16);
+    qToLittleEndian(floatBits(info.dy), dest + 20);
+}
+
+QByteArray streamHeader()
+{
+    uchar header[MotionTracker::HeaderSize];
+    qMemCopy(header, "SJCMOTIO", 8);
+    qToLittleEndian(quint32(MotionTracker::FormatVersion), header + 8);
+    qToLittleEndian(quint32(MotionTracker::RecordSize), header + 12);
+    return QByteArray(reinterpret_cast<const char *>(header),
+                      MotionTracker::HeaderSize);
+}
+
+// Removes the mean and the linear trend from a profile, so that the
+// correlation is not dominated by large scale intensity gradients.
+void detrend(const QVector<quint32> &src, QVector<float> *dest)
+{
+    const int n = src.size();
+    dest->resize(n);
+    const double meanX = 0.5 * (n - 1);
+    double sumY = 0;
+    for (int i = 0; i < n; ++i)
+        sumY += src[i];
+    const double meanY = sumY / n;
+    double sumXY = 0, sumXX = 0;
+    for (int i = 0; i < n; ++i) {
+        sumXY += (i - meanX) * (src[i] - meanY);
+        sumXX += (i - meanX) * (i - meanX);
+    }
+    const double slope = sumXX > 0 ? sumXY / sumXX : 0;
+    float *d = dest->data();
+    for (int i = 0; i < n; ++i)
+        d[i] = float(src[i] - meanY - slope * (i - meanX));
+}
+
+// Computes the shift of cur relative to ref from the maximum of their
+// cross-correlation within +-maxShift, refined by a parabola fit.
+int profileShift(const QVector<float> &ref, const QVector<float> &cur,
+                 int maxShift, float *shift)
+{
+    const int n = qMin(ref.size(), cur.size());
+    maxShift = qMin(maxShift, n / 2);
+    if (maxShift < 1)
+        return MotionTracker::NoSignal;
+
+    QVarLengthArray<double, 129> corr(2 * maxShift + 1);
+    const float *r = ref.constData();
+    const float *c = cur.constData();
+    int best = 0;
+    for (int s = -maxShift; s <= maxShift; ++s) {
+        const int begin = qMax(0, -s);
+        const int end = qMin(n, n - s);
+        double sum = 0;
+        for (int i = begin; i < end; ++i)
+            sum += r[i] * c[i + s];
+        corr[s + maxShift] = sum / (end - begin);
+        if (corr[s + maxShift] > corr[best])
+            best = s + maxShift;
+    }
+
+    if (corr[best] <= 0)
+        return MotionTracker::NoSignal;
+    if (best == 0 || best == 2 * maxShift)
+        return MotionTracker::OutOfRange;
+    const double c0 = corr[best - 1];
+    const double c1 = corr[best];
+    const double c2 = corr[best + 1];
+    const double denom = c0 - 2 * c1 + c2;
+    const double delta = denom < 0 ? 0.5 * (c0 - c2) / denom : 0;
+    *shift = float(best - maxShift + delta);
+    return MotionTracker::Valid;
+}
+
+} // namespace
+
+MotionTracker::MotionTracker(QObject *parent)
+    : QObject(parent),
+      m_tcpServer(new QTcpServer(this)),
+      m_file(0),
+      m_clockModel(0),
+      m_mode(Off),
+      m_threshold(0.5),
+      m_maxShift(16),
+      m_markerEnabled(false),
+      m_markerPos(0, 0)
+{
+    connect(m_tcpServer, SIGNAL(newConnection()), SLOT(newConnection()));
+}
+
+MotionTracker::~MotionTracker()
+{
+    stopLogging();
+    delete m_tcpServer;
+}
+
+QByteArray MotionTracker::modeName(int mode)
+{
+    switch (mode) {
+    case Centroid:
+        return "centroid";
+    case Correlation:
+        return "correlation";
+    default:
+        return "off";
+    }
+}
+
+bool MotionTracker::modeFromName(const QByteArray &name, int *mode)
+{
+    for (int i = Off; i <= Correlation; ++i) {
+        if (name == modeName(i)) {
+            *mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray MotionTracker::statusName(int status)
+{
+    switch (status) {
+    case Valid:
+        return "valid";
+    case NoSignal:
+        return "nosignal";
+    case OutOfRange:
+        return "outofrange";
+    default:
+        return "unsupported";
+    }
+}
+
+bool MotionTracker::listen(quint16 port)
+{
+    if (m_tcpServer->isListening())
+        m_tcpServer->close();
+    if (!m_tcpServer->listen(QHostAddress::Any, port)) {
+        emit error("Tracking Server: " + m_tcpServer->errorString() + ".");
+        return false;
+    }
+    return true;
+}
+
+quint16 MotionTracker::serverPort() const
+{
+    return m_tcpServer->serverPort();
+}
+
+void MotionTracker::setClockModel(const ClockModel *clockModel)
+{
+    m_clockModel = clockModel;
+}
+
+void MotionTracker::processFrame(tPvFrame *frame)
+{
+    // the frame must be measured before it is passed on, it may be reused
+    // by the recorder as soon as the writer has finished
+    if (frame && (frame->Status == ePvErrSuccess) && m_mode != Off) {
+        MotionInfo info;
+        measure(frame, &info);
+        publish(info);
+    }
+    emit frameFinished(frame);
+}
+
+void MotionTracker::setMode(int mode)
+{
+    m_mode = (mode >= Off && mode <= Correlation) ? mode : Off;
+    resetReference();
+}
+
+void MotionTracker::setRoi(const QRect &roi)
+{
+    m_roi = roi;
+    resetReference();
+}
+
+void MotionTracker::setThreshold(double threshold)
+{
+    m_threshold = qBound(0.0, threshold, 1.0);
+}
+
+void MotionTracker::setMaxShift(int maxShift)
+{
+    m_maxShift = qBound(1, maxShift, 256);
+}
+
+void MotionTracker::setMarkerPos(const QVariant &markerPos)
+{
+    m_markerEnabled = markerPos.isValid();
+    if (m_markerEnabled)
+        m_markerPos = markerPos.toPointF();
+}
+
+// The next frame becomes the reference frame of the correlation mode.
+void MotionTracker::resetReference()
+{
+    m_refX.clear();
+    m_refY.clear();
+}
+
+bool MotionTracker::startLogging(const QString &fileName)
+{
+    if (m_file)
+        return false;
+
+    m_file = new QFile(fileName);
+    if (!m_file->open(QIODevice::WriteOnly)) {
+        emit error("Cannot create motion log file '" + fileName + "'.");
+        delete m_file;
+        m_file = 0;
+        return false;
+    }
+    m_file->write(streamHeader());
+    return true;
+}
+
+void MotionTracker::stopLogging()
+{
+    delete m_file;
+    m_file = 0;
+}
+
+void MotionTracker::newConnection()
+{
+    QTcpSocket *socket = m_tcpServer->nextPendingConnection();
+    connect(socket, SIGNAL(disconnected()), SLOT(socketDisconnected()));
+    m_sockets.append(socket);
+    socket->write(streamHeader());
+    emit info(QString("Tracking client connected [%1:%2].")
+              .arg(socket->peerAddress().toString())
+              .arg(socket->peerPort()));
+}
+
+void MotionTracker::socketDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket || !m_sockets.removeOne(socket)) {
+        qWarning("MotionTracker::socketDisconnected(): Unknown socket.");
+        return;
+    }
+    emit info(QString("Tracking client disconnected [%1:%2].")
+              .arg(socket->peerAddress().toString())
+              .arg(socket->peerPort()));
+    socket->deleteLater();
+}
+
+void MotionTracker::measure(tPvFrame *frame, MotionInfo *info)
+{
+    info->count = frame->FrameCount;
+    info->exposureUtcUsecs = m_clockModel ?
+                m_clockModel->utcUsecs(PvFrameTicks(frame)) : 0;
+    info->dx = 0;
+    info->dy = 0;
+
+    const int width = int(frame->Width);
+    const int height = int(frame->Height);
+    const QRect frameRect(0, 0, width, height);
+    const QRect roi = m_roi.isEmpty() ? frameRect
+                                      : m_roi.intersected(frameRect);
+    if (roi.width() < 2 || roi.height() < 2) {
+        info->status = NoSignal;
+        return;
+    }
+
+    // data points to the first pixel of the region of interest
+    const qint64 first = qint64(roi.y()) * width + roi.x();
+    const void *data = 0;
+    bool wide = true;
+    if (frame->Format == ePvFmtMono8) {
+        data = reinterpret_cast<const uchar *>(frame->ImageBuffer) + first;
+        wide = false;
+    }
+    else if (frame->Format == ePvFmtMono16) {
+        data = reinterpret_cast<const quint16 *>(frame->ImageBuffer) + first;
+    }
+    else if (frame->Format == ePvFmtMono12Packed) {
+        // only the rows of the region are unpacked, starting at an even
+        // pixel index, which is aligned to a byte boundary
+        const qint64 begin = (qint64(roi.y()) * width) & ~qint64(1);
+        const qint64 end = qint64(roi.y() + roi.height()) * width;
+        m_unpackBuffer.resize(int(end - begin));
+        unpackMono12Packed(m_unpackBuffer.data(),
+                           reinterpret_cast<const uchar *>(frame->ImageBuffer)
+                           + 3 * begin / 2, m_unpackBuffer.size());
+        data = m_unpackBuffer.constData() + (first - begin);
+    }
+    else {
+        info->status = Unsupported;
+        return;
+    }
+
+    if (m_mode == Centroid)
+        info->status = measureCentroid(data, wide, width, roi,
+                                       &info->dx, &info->dy);
+    else
+        info->status = measureShift(data, wide, width, roi,
+                                    &info->dx, &info->dy);
+}
+
+int MotionTracker::measureCentroid(const void *data, bool wide, int stride,
+                                   const QRect &roi, float *dx, float *dy)
+{
+    const quint16 *data16 = static_cast<const quint16 *>(data);
+    const uchar *data8 = static_cast<const uchar *>(data);
+    const int width = roi.width();
+    const int height = roi.height();
+
+    // the threshold is relative to the range of values in the region
+    int min, max;
+    if (wide)
+        minMax(data16, stride, width, height, &min, &max);
+    else
+        minMax(data8, stride, width, height, &min, &max);
+    if (max <= min)
+        return NoSignal;
+    const int threshold = min + int(m_threshold * (max - min));
+
+    qint64 m0, mx, my;
+    if (wide)
+        thresholdMoments(data16, stride, width, height, threshold,
+                         &m0, &mx, &my);
+    else
+        thresholdMoments(data8, stride, width, height, threshold,
+                         &m0, &mx, &my);
+    if (m0 <= 0)
+        return NoSignal;
+
+    const QPointF center = m_markerEnabled ? m_markerPos :
+            QPointF(roi.x() + 0.5 * (width - 1), roi.y() + 0.5 * (height - 1));
+    *dx = float(roi.x() + double(mx) / m0 - center.x());
+    *dy = float(roi.y() + double(my) / m0 - center.y());
+    return Valid;
+}
+
+int MotionTracker::measureShift(const void *data, bool wide, int stride,
+                                const QRect &roi, float *dx, float *dy)
+{
+    const int width = roi.width();
+    const int height = roi.height();
+    m_xProfile.resize(width);
+    m_yProfile.resize(height);
+    if (wide)
+        project(static_cast<const quint16 *>(data), stride, width, height,
+                m_xProfile.data(), m_yProfile.data());
+    else
+        project(static_cast<const uchar *>(data), stride, width, height,
+                m_xProfile.data(), m_yProfile.data());
+    detrend(m_xProfile, &m_curX);
+    detrend(m_yProfile, &m_curY);
+
+    // the first frame after a reset becomes the reference
+    if (m_refX.isEmpty() || roi != m_refRoi) {
+        m_refRoi = roi;
+        m_refX = m_curX;
+        m_refY = m_curY;
+        return Valid;
+    }
+
+    int status = profileShift(m_refX, m_curX, m_maxShift, dx);
+    if (status == Valid)
+        status = profileShift(m_refY, m_curY, m_maxShift, dy);
+    return status;
+}
+
+void MotionTracker::publish(const MotionInfo &info)
+{
+    uchar record[RecordSize];
+    encodeRecord(info, record);
+    const char *data = reinterpret_cast<const char *>(record);
+
+    foreach (QTcpSocket *socket, m_sockets)
+        if (socket->bytesToWrite() < MaxPendingBytes)
+            socket->write(data, RecordSize);
+    if (m_file && m_file->write(data, RecordSize) != RecordSize) {
+        emit error("Cannot write motion log file.");
+        stopLogging();
+    }
+    emit motionMeasured(info);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_MOTIONTRACKER_H
+#define SJCAM_MOTIONTRACKER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QRect>
+#include <QtCore/QPointF>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <PvApi.h>
+
+class ClockModel;
+class QFile;
+class QTcpServer;
+class QTcpSocket;
+
+struct MotionInfo
+{
+    ulong count;
+    int status;
+    qint64 exposureUtcUsecs;
+    float dx;
+    float dy;
+};
+Q_DECLARE_METATYPE(MotionInfo)
+
+// Measures the image motion on every frame, for guiding at the full frame
+// rate. In centroid mode the position of the thresholded centroid relative
+// to the marker (or the center of the region, if the marker is disabled) is
+// measured, in correlation mode the shift against a reference frame, using
+// the cross-correlation of the row and column profiles. The measurement is
+// restricted to the region of interest, an empty region selects the whole
+// frame.
+//
+// The results are emitted by motionMeasured() and sent as fixed size binary
+// records to all clients connected to the tracking port, and are optionally
+// logged to a file.
+//
+// Stream and file format (little endian): a 16 byte header, consisting of
+// the magic "SJCMOTIO", the format version (quint32) and the record size
+// (quint32), followed by records of the form
+//     quint32 count, qint32 status, qint64 exposureUtcUsecs,
+//     float dx, float dy
+class MotionTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode { Off, Centroid, Correlation };
+    enum Status { Valid, NoSignal, OutOfRange, Unsupported };
+    enum { FormatVersion = 1, HeaderSize = 16, RecordSize = 24 };
+
+    explicit MotionTracker(QObject *parent = 0);
+    ~MotionTracker();
+
+    static QByteArray modeName(int mode);
+    static bool modeFromName(const QByteArray &name, int *mode);
+    static QByteArray statusName(int status);
+
+    // these methods are NOT thread-safe, use QMetaObject::invokeMethod()
+    // after the tracker was moved to its thread!
+    Q_INVOKABLE bool listen(quint16 port);
+    quint16 serverPort() const;
+    void setClockModel(const ClockModel *clockModel);
+
+public slots:
+    void processFrame(tPvFrame *frame);
+    void setMode(int mode);
+    void setRoi(const QRect &roi);
+    void setThreshold(double threshold);
+    void setMaxShift(int maxShift);
+    void setMarkerPos(const QVariant &markerPos);
+    void resetReference();
+    bool startLogging(const QString &fileName);
+    void stopLogging();
+
+signals:
+    void frameFinished(tPvFrame *frame);
+    void motionMeasured(const MotionInfo &info);
+    void info(const QString &infoString) const;
+    void error(const QString &errorString) const;
+
+protected slots:
+    void newConnection();
+    void socketDisconnected();
+
+protected:
+    void measure(tPvFrame *frame, MotionInfo *info);
+    int measureCentroid(const void *data, bool wide, int stride,
+                        const QRect &roi, float *dx, float *dy);
+    int measureShift(const void *data, bool wide, int stride,
+                     const QRect &roi, float *dx, float *dy);
+    void publish(const MotionInfo &info);
+
+private:
+    Q_DISABLE_COPY(MotionTracker)
+    QTcpServer * const m_tcpServer;
+    QList<QTcpSocket *> m_sockets;
+    QFile *m_file;
+    const ClockModel *m_clockModel;
+    int m_mode;
+    QRect m_roi;
+    double m_threshold;
+    int m_maxShift;
+    bool m_markerEnabled;
+    QPointF m_markerPos;
+    QRect m_refRoi;
+    QVector<float> m_refX;
+    QVector<float> m_refY;
+    QVector<quint32> m_xProfile;
+    QVector<quint32> m_yProfile;
+    QVector<float> m_curX;
+    QVector<float> m_curY;
+    QVector<quint16> m_unpackBuffer;
+};
+
+#endif // SJCAM_MOTIONTRACKER_H
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pipelinebench.h"
+#include "servercontext.h"
+#include "syntheticcamera.h"
+#include "cmdlineopts.h"
+#include "metrics.h"
+#include "pvutils.h"
+#include "version.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+// the writer writes until the end of the measurement
+const int WriteAllFrames = 0x7fffffff;
+
+// time to wait for the frames in flight after the capturing was stopped
+const int DrainTimeoutMs = 5000;
+
+// frames counted by the recorder since the start of the process
+qint64 framesCounted(bool successful)
+{
+    if (successful)
+        return serverMetrics.framesByStatus[ePvErrSuccess].value();
+    qint64 n = serverMetrics.framesOtherStatus.value();
+    for (int i = 0; i < ServerMetrics::NumFrameStatus; ++i)
+        if (i != ePvErrSuccess)
+            n += serverMetrics.framesByStatus[i].value();
+    return n;
+}
+
+QByteArray jsonString(const QString &str)
+{
+    QByteArray result = "\"";
+    foreach (char c, str.toUtf8()) {
+        if (c == '"' || c == '\\')
+            result += QByteArray("\\") + c;
+        else if (uchar(c) < 0x20)
+            result += "\\u" + QByteArray::number(uchar(c), 16)
+                    .rightJustified(4, '0');
+        else
+            result += c;
+    }
+    return result + "\"";
+}
+
+QByteArray jsonNumber(double value)
+{
+    return QByteArray::number(value, 'f', 3);
+}
+
+QByteArray jsonBool(bool value)
+{
+    return value ? "true" : "false";
+}
+
+// latencies in microseconds
+QByteArray latencyJson(const LatencyHistogram &h)
+{
+    return "{\"count\": " + QByteArray::number(h.count())
+            + ", \"p50\": " + QByteArray::number(h.percentile(50))
+            + ", \"p95\": " + QByteArray::number(h.percentile(95))
+            + ", \"p99\": " + QByteArray::number(h.percentile(99))
+            + ", \"max\": " + QByteArray::number(h.max()) + "}";
+}
+
+} // namespace
+
+PipelineBench::PipelineBench(const BenchOpts &opts, QObject *parent)
+    : QObject(parent),
+      m_opts(opts),
+      m_context(new ServerContext),
+      m_clientThread(new WorkerThread),
+      m_configFile(new QTemporaryFile(QDir::temp().absoluteFilePath(
+                                          "sjcbench-XXXXXX.ini"))),
+      m_server(0),
+      m_exitCode(0),
+      m_numErrors(0),
+      m_startUsecs(0),
+      m_elapsedUsecs(0),
+      m_startFramesCaptured(0),
+      m_startFramesFailed(0),
+      m_startFramesDropped(0),
+      m_framesCaptured(0),
+      m_framesDropped(0),
+      m_framesFailed(0),
+      m_startWriterFiles(0),
+      m_startWriterBytes(0),
+      m_writerFiles(0),
+      m_writerBytes(0)
+{
+    qMemSet(m_startCpuUsecs, 0, sizeof(m_startCpuUsecs));
+    qMemSet(m_cpuUsecs, 0, sizeof(m_cpuUsecs));
+}
+
+PipelineBench::~PipelineBench()
+{
+    if (m_server)
+        m_server->shutdown();
+    stopThreads();
+
+    qDeleteAll(m_clients);
+    delete m_server;
+    delete m_context;
+    delete m_clientThread;
+    delete m_configFile;
+}
+
+void PipelineBench::start()
+{
+    m_clientThread->start();
+    if (!prepareOutputDirectory() || !writeConfigFile())
+        return;
+
+    // the server is configured like from the command line of sjcserver,
+    // without connecting to a DCP server
+    CmdLineOpts serverOpts;
+    serverOpts.deviceName = "sjcbench";
+    serverOpts.verbose = m_opts.verbose ? 1 : 0;
+    m_server = new SjcServer(serverOpts, m_configFile->fileName(),
+                             m_context);
+    if (!m_server->setFrameSource(new SyntheticCamera(m_opts.width,
+                                                      m_opts.height,
+                                                      m_opts.bitDepth)) ||
+            !m_server->openCamera()) {
+        fail("Cannot open the synthetic camera.");
+        return;
+    }
+    if (m_server->streamingPort() == 0) {
+        fail("Cannot start the streaming server.");
+        return;
+    }
+
+    for (int i = 0; i < m_opts.numClients; ++i) {
+        BenchClient *client = new BenchClient;
+        connect(client, SIGNAL(error(QString)), SLOT(printError(QString)));
+        client->moveToThread(m_clientThread);
+        QMetaObject::invokeMethod(client, "connectToServer",
+                                  Q_ARG(quint16, m_server->streamingPort()));
+        m_clients.append(client);
+    }
+
+    if (m_opts.writeFrames)
+        m_server->writeFrames(WriteAllFrames, m_opts.stepping);
+    m_server->startCapturing();
+    QTimer::singleShot(qRound(1000 * m_opts.warmupSeconds), this,
+                       SLOT(startMeasurement()));
+}
+
+void PipelineBench::startMeasurement()
+{
+    foreach (BenchClient *client, m_clients) {
+        if (!client->isConnected())
+            printError("Streaming client is not connected.");
+        QMetaObject::invokeMethod(client, "resetStats",
+                                  Qt::BlockingQueuedConnection);
+    }
+    for (int i = 0; i < NumThreadTypes; ++i)
+        m_startCpuUsecs[i] = threadCpuUsecs(i);
+    m_startWriterFiles = serverMetrics.writerFiles.value();
+    m_startWriterBytes = serverMetrics.writerBytes.value();
+    m_startFramesCaptured = framesCounted(true);
+    m_startFramesFailed = framesCounted(false);
+    m_startFramesDropped = serverMetrics.framesDropped.value();
+    m_server->clearPipelineStats();
+    m_startUsecs = monotonicUsecs();
+
+    QTimer::singleShot(qRound(1000 * m_opts.durationSeconds), this,
+                       SLOT(stopMeasurement()));
+}
+
+void PipelineBench::stopMeasurement()
+{
+    m_elapsedUsecs = monotonicUsecs() - m_startUsecs;
+    for (int i = 0; i < NumThreadTypes; ++i)
+        m_cpuUsecs[i] = threadCpuUsecs(i) - m_startCpuUsecs[i];
+    m_writerFiles = serverMetrics.writerFiles.value() - m_startWriterFiles;
+    m_writerBytes = serverMetrics.writerBytes.value() - m_startWriterBytes;
+    m_framesCaptured = framesCounted(true) - m_startFramesCaptured;
+    m_framesFailed = framesCounted(false) - m_startFramesFailed;
+    m_framesDropped = serverMetrics.framesDropped.value()
+            - m_startFramesDropped;
+    for (int i = 0; i < FrameTrace::NumStages; ++i)
+        m_stageLatencies[i] = m_server->pipelineStats().histogram(i);
+    foreach (BenchClient *client, m_clients)
+        m_clientStats.append(client->stats());
+
+    // stop capturing and wait until all buffers were returned
+    m_server->stopCapturing();
+    if (m_opts.writeFrames)
+        m_server->writeFrames(0);
+    foreach (BenchClient *client, m_clients)
+        QMetaObject::invokeMethod(client, "disconnectFromServer");
+    m_drainTimer.start();
+    drainPipeline();
+}
+
+void PipelineBench::drainPipeline()
+{
+    const qint64 inFlight = serverMetrics.buffersInFlight.value();
+    if (inFlight > 0 && m_drainTimer.elapsed() < DrainTimeoutMs) {
+        QTimer::singleShot(10, this, SLOT(drainPipeline()));
+        return;
+    }
+    if (inFlight > 0)
+        printError(QString("%1 frames were not returned by the pipeline.")
+                   .arg(inFlight));
+    finish();
+}
+
+// Repeated errors, e.g. of a streaming client while the pipeline is
+// overloaded, are only printed once unless verbose output is enabled. The
+// messages of the server are printed by the server itself.
+void PipelineBench::printError(const QString &errorString)
+{
+    ++m_numErrors;
+    if (!m_opts.verbose && m_printedErrors.contains(errorString))
+        return;
+    m_printedErrors.insert(errorString);
+    QTextStream cerr(stderr, QIODevice::WriteOnly);
+    cerr << "Error: " << errorString << endl;
+}
+
+void PipelineBench::fail(const QString &errorString)
+{
+    printError(errorString);
+    m_exitCode = 1;
+    emit finished();
+}
+
+void PipelineBench::finish()
+{
+    m_server->shutdown();
+    stopThreads();
+    m_result = resultJson();
+    removeOutputFiles();
+    emit finished();
+}
+
+// The server must be shut down before the shared threads are stopped.
+void PipelineBench::stopThreads()
+{
+    m_context->stopThreads();
+    m_clientThread->quit();
+    m_clientThread->wait();
+}
+
+// The files are written to a new subdirectory of the output directory,
+// which is removed after the benchmark unless the files are kept.
+bool PipelineBench::prepareOutputDirectory()
+{
+    if (!m_opts.writeFrames)
+        return true;
+
+    QDir dir(m_opts.outputDirectory);
+    QString name = QString("sjcbench-%1")
+            .arg(QCoreApplication::applicationPid());
+    if (!dir.exists() || !dir.mkpath(name)) {
+        fail("Cannot create a directory in '" + m_opts.outputDirectory
+             + "'.");
+        return false;
+    }
+    m_outputDirectory = dir.absoluteFilePath(name);
+    return true;
+}
+
+// Writes the server configuration of the scenario. The streaming server
+// listens on a free port, the status reports and the adaptive buffer
+// management are disabled.
+bool PipelineBench::writeConfigFile()
+{
+    if (!m_configFile->open()) {
+        fail("Cannot create a temporary config file.");
+        return false;
+    }
+    m_configFile->close();
+
+    QSettings settings(m_configFile->fileName(), QSettings::IniFormat);
+    settings.setValue("Camera/NumBuffers", m_opts.numBuffers);
+    settings.setValue("Camera/AdaptiveBuffers", false);
+    settings.setValue("CamAttr/PixelFormat", QString(m_opts.pixelFormat));
+    settings.setValue("CamAttr/FrameRate", m_opts.frameRate);
+    settings.setValue("Streaming/ServerPort", 0);
+    settings.setValue("Recording/FileNamePrefix", "sjcbench");
+    settings.setValue("Recording/Directory", m_outputDirectory);
+    settings.setValue("Tracking/Mode", QString(m_opts.trackingMode));
+    settings.setValue("Misc/StatusInterval", 0);
+    settings.sync();
+    if (settings.status() != QSettings::NoError) {
+        fail("Cannot write the temporary config file.");
+        return false;
+    }
+    return true;
+}
+
+void PipelineBench::removeOutputFiles()
+{
+    if (m_outputDirectory.isEmpty() || m_opts.keepFiles)
+        return;
+
+    QDir dir(m_outputDirectory);
+    foreach (const QString &fileName, dir.entryList(QDir::Files))
+        dir.remove(fileName);
+    QDir().rmdir(m_outputDirectory);
+}
+
+qint64 PipelineBench::threadCpuUsecs(int type) const
+{
+    qint64 usecs = (type == ClientThread) ?
+                m_clientThread->handle().cpuUsecs() :
+                m_server->threadCpuUsecs(SjcServer::ThreadType(type));
+    return qMax(usecs, qint64(0));
+}
+
+// Latencies are given in microseconds, the frame rates refer to the
+// measurement interval.
+QByteArray PipelineBench::resultJson() const
+{
+    const double seconds = qMax(m_elapsedUsecs, qint64(1)) / 1e6;
+    const qint64 framesReturned = m_stageLatencies[0].count();
+
+    QByteArray json = "{\n  \"version\": "
+            + jsonString(SJCAM_VERSION_STRING) + ",\n";
+
+    json += "  \"scenario\": {"
+            "\"width\": " + QByteArray::number(m_opts.width)
+            + ", \"height\": " + QByteArray::number(m_opts.height)
+            + ", \"bitDepth\": " + QByteArray::number(m_opts.bitDepth)
+            + ", \"pixelFormat\": " + jsonString(m_opts.pixelFormat)
+            + ", \"fps\": " + jsonNumber(m_opts.frameRate)
+            + ", \"buffers\": " + QByteArray::number(m_opts.numBuffers)
+            + ", \"clients\": " + QByteArray::number(m_opts.numClients)
+            + ", \"writeFrames\": " + jsonBool(m_opts.writeFrames)
+            + ", \"stepping\": " + QByteArray::number(m_opts.stepping)
+            + ", \"outputDirectory\": " + jsonString(m_opts.outputDirectory)
+            + ", \"tracking\": " + jsonString(m_opts.trackingMode)
+            + ", \"warmupSeconds\": " + jsonNumber(m_opts.warmupSeconds)
+            + ", \"durationSeconds\": " + jsonNumber(m_opts.durationSeconds)
+            + "},\n";
+
+    json += "  \"seconds\": " + jsonNumber(seconds) + ",\n";
+
+    json += "  \"frames\": {"
+            "\"captured\": " + QByteArray::number(m_framesCaptured)
+            + ", \"dropped\": " + QByteArray::number(m_framesDropped)
+            + ", \"failed\": " + QByteArray::number(m_framesFailed)
+            + ", \"returned\": " + QByteArray::number(framesReturned)
+            + ", \"fps\": " + jsonNumber(framesReturned / seconds)
+            + "},\n";
+
+    json += "  \"stages\": {";
+    for (int i = 0; i < FrameTrace::NumStages; ++i) {
+        if (i > 0)
+            json += ",";
+        json += "\n    \"" + QByteArray(PipelineStats::stageName(i))
+                + "\": " + latencyJson(m_stageLatencies[i]);
+    }
+    json += "\n  },\n";
+
+    int images = 0, invalid = 0;
+    qint64 bytes = 0;
+    QByteArray clients;
+    foreach (const BenchClient::Stats &stats, m_clientStats) {
+        images += stats.images;
+        invalid += stats.invalid;
+        bytes += stats.bytes;
+        if (!clients.isEmpty())
+            clients += ",";
+        clients += "\n    {\"images\": " + QByteArray::number(stats.images)
+                + ", \"bytes\": " + QByteArray::number(stats.bytes)
+                + ", \"invalid\": " + QByteArray::number(stats.invalid)
+                + ", \"fps\": " + jsonNumber(stats.images / seconds)
+                + ", \"latency\": " + latencyJson(stats.latency) + "}";
+    }
+    json += "  \"streaming\": {"
+            "\"images\": " + QByteArray::number(images)
+            + ", \"bytes\": " + QByteArray::number(bytes)
+            + ", \"invalid\": " + QByteArray::number(invalid)
+            + ", \"clients\": [" + clients
+            + (clients.isEmpty() ? "]" : "\n  ]") + "},\n";
+
+    json += "  \"writer\": {"
+            "\"files\": " + QByteArray::number(m_writerFiles)
+            + ", \"bytes\": " + QByteArray::number(m_writerBytes)
+            + ", \"filesPerSecond\": " + jsonNumber(m_writerFiles / seconds)
+            + ", \"megabytesPerSecond\": "
+            + jsonNumber(m_writerBytes / seconds / 1e6) + "},\n";
+
+    json += "  \"threads\": {";
+    for (int i = 0; i < NumThreadTypes; ++i) {
+        QByteArray name = (i == ClientThread) ? QByteArray("client") :
+                SjcServer::threadTypeName(SjcServer::ThreadType(i))
+                .toLower().toAscii();
+        if (i > 0)
+            json += ",";
+        json += "\n    \"" + name + "\": {"
+                "\"cpuSeconds\": " + jsonNumber(m_cpuUsecs[i] / 1e6)
+                + ", \"cpuPercent\": "
+                + jsonNumber(100.0 * m_cpuUsecs[i] / 1e6 / seconds) + "}";
+    }
+    json += "\n  },\n";
+
+    json += "  \"errors\": " + QByteArray::number(m_numErrors) + "\n}\n";
+    return json;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_PIPELINEBENCH_H
+#define SJCAM_PIPELINEBENCH_H
+
+#include "benchopts.h"
+#include "benchclient.h"
+#include "sjcserver.h"
+#include "pipelinestats.h"
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+class ServerContext;
+class QTemporaryFile;
+
+// Runs an SjcServer with a SyntheticCamera and headless loopback streaming
+// clients. The server is configured by a temporary config file which is
+// generated from the benchmark scenario; it is not connected to a DCP
+// server. After the warm-up the counters are reset, at the end of the
+// measurement the sustained frame rate, the dropped frames, the stage
+// latencies of the PipelineStats, the streaming statistics of the clients
+// and the CPU time of each thread are reported as JSON.
+class PipelineBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PipelineBench(const BenchOpts &opts, QObject *parent = 0);
+    ~PipelineBench();
+
+    int exitCode() const { return m_exitCode; }
+    QByteArray result() const { return m_result; }
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+protected slots:
+    void startMeasurement();
+    void stopMeasurement();
+    void drainPipeline();
+    void printError(const QString &errorString);
+
+protected:
+    // the client thread follows the threads of the server
+    enum { ClientThread = SjcServer::NumThreadTypes, NumThreadTypes };
+
+    void fail(const QString &errorString);
+    void finish();
+    void stopThreads();
+    bool prepareOutputDirectory();
+    bool writeConfigFile();
+    void removeOutputFiles();
+    qint64 threadCpuUsecs(int type) const;
+    QByteArray resultJson() const;
+
+private:
+    Q_DISABLE_COPY(PipelineBench)
+    const BenchOpts m_opts;
+    ServerContext * const m_context;
+    WorkerThread * const m_clientThread;
+    QTemporaryFile * const m_configFile;
+    SjcServer *m_server;
+    QList<BenchClient *> m_clients;
+    QString m_outputDirectory;
+    int m_exitCode;
+    int m_numErrors;
+    QSet<QString> m_printedErrors;
+    QElapsedTimer m_drainTimer;
+    QByteArray m_result;
+
+    // counters of the measurement interval
+    qint64 m_startUsecs;
+    qint64 m_elapsedUsecs;
+    qint64 m_startFramesCaptured;
+    qint64 m_startFramesFailed;
+    qint64 m_startFramesDropped;
+    qint64 m_framesCaptured;
+    qint64 m_framesDropped;
+    qint64 m_framesFailed;
+    qint64 m_startCpuUsecs[NumThreadTypes];
+    qint64 m_cpuUsecs[NumThreadTypes];
+    qint64 m_startWriterFiles;
+    qint64 m_startWriterBytes;
+    qint64 m_writerFiles;
+    qint64 m_writerBytes;
+    LatencyHistogram m_stageLatencies[FrameTrace::NumStages];
+    QList<BenchClient::Stats> m_clientStats;
+};
+
+#endif // SJCAM_PIPELINEBENCH_H
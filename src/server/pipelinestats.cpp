@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pipelinestats.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+const int SubBucketBits = 3;
+const int SubBucketCount = 1 << SubBucketBits;
+const int LinearBucketCount = 2 * SubBucketCount;
+const int MaxExponent = 40;
+const int BucketCount = LinearBucketCount +
+        (MaxExponent - SubBucketBits) * SubBucketCount;
+
+// thread lane of each stage in the trace file
+const int StageLanes[FrameTrace::NumStages] = {
+    1, 1, 2, 3, 4, 4, 4, 5, 5, 5, 5, 2
+};
+
+const char * const LaneNames[] = {
+    "", "recorder", "main", "calibrator", "streamer", "writer"
+};
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : m_buckets(BucketCount, 0),
+      m_count(0),
+      m_max(0)
+{
+}
+
+void LatencyHistogram::add(qint64 usecs)
+{
+    if (usecs < 0)
+        usecs = 0;
+    ++m_buckets[bucketIndex(usecs)];
+    ++m_count;
+    if (usecs > m_max)
+        m_max = usecs;
+}
+
+void LatencyHistogram::clear()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+    m_max = 0;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0;
+    const qint64 rank = qMax(qint64(1), qint64(p * m_count / 100.0 + 0.5));
+    qint64 n = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        n += m_buckets[i];
+        if (n >= rank)
+            return qMin(bucketValue(i), m_max);
+    }
+    return m_max;
+}
+
+int LatencyHistogram::bucketIndex(qint64 usecs)
+{
+    if (usecs < LinearBucketCount)
+        return int(usecs);
+
+    int exponent = SubBucketBits + 1;
+    while (exponent < MaxExponent && (usecs >> (exponent + 1)) != 0)
+        ++exponent;
+    const int sub = int(usecs >> (exponent - SubBucketBits))
+            & (SubBucketCount - 1);
+    return qMin(LinearBucketCount +
+                (exponent - SubBucketBits - 1) * SubBucketCount + sub,
+                BucketCount - 1);
+}
+
+qint64 LatencyHistogram::bucketValue(int index)
+{
+    if (index < LinearBucketCount)
+        return index;
+
+    // return the center of the bucket
+    const int exponent = (index - LinearBucketCount) / SubBucketCount
+            + SubBucketBits + 1;
+    const int sub = (index - LinearBucketCount) % SubBucketCount;
+    const qint64 width = qint64(1) << (exponent - SubBucketBits);
+    return (SubBucketCount + sub) * width + width / 2;
+}
+
+PipelineStats::PipelineStats()
+    : m_traceFile(0),
+      m_traceRemaining(0)
+{
+}
+
+PipelineStats::~PipelineStats()
+{
+    delete m_traceFile;
+}
+
+void PipelineStats::addFrame(ulong frameId, const FrameTrace &trace)
+{
+    const qint64 *stamps = trace.stamps;
+    qint64 first = 0, previous = 0;
+    for (int i = 0; i < FrameTrace::NumStages; ++i) {
+        if (stamps[i] == 0)
+            continue;
+        if (previous != 0)
+            m_histograms[i].add(stamps[i] - previous);
+        else
+            first = stamps[i];
+        previous = stamps[i];
+    }
+    if (first != 0 && previous != first)
+        m_histograms[0].add(previous - first);
+
+    if (m_traceFile) {
+        addTraceEvents(frameId, trace);
+        if (--m_traceRemaining <= 0)
+            finishTrace();
+    }
+}
+
+void PipelineStats::clear()
+{
+    for (int i = 0; i < FrameTrace::NumStages; ++i)
+        m_histograms[i].clear();
+}
+
+QByteArray PipelineStats::summary() const
+{
+    QByteArray result;
+    for (int i = 0; i < FrameTrace::NumStages; ++i) {
+        const LatencyHistogram &h = m_histograms[i];
+        if (!result.isEmpty())
+            result += " ";
+        result += QByteArray(stageName(i))
+                + " " + QByteArray::number(h.count())
+                + " " + QByteArray::number(h.percentile(50))
+                + " " + QByteArray::number(h.percentile(95))
+                + " " + QByteArray::number(h.percentile(99))
+                + " " + QByteArray::number(h.max());
+    }
+    return result;
+}
+
+bool PipelineStats::startTrace(const QString &fileName, int numFrames)
+{
+    delete m_traceFile;
+    m_traceFile = new QFile(fileName);
+    if (numFrames < 1 || !m_traceFile->open(QIODevice::WriteOnly)) {
+        delete m_traceFile;
+        m_traceFile = 0;
+        return false;
+    }
+    m_traceRemaining = numFrames;
+    m_traceEvents.clear();
+
+    // name the thread lanes
+    for (int lane = 1; lane <= 5; ++lane) {
+        if (!m_traceEvents.isEmpty())
+            m_traceEvents += ",\n";
+        m_traceEvents += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":" + QByteArray::number(lane) + ","
+                "\"args\":{\"name\":\"" + LaneNames[lane] + "\"}}";
+    }
+    return true;
+}
+
+bool PipelineStats::finishTrace()
+{
+    if (!m_traceFile)
+        return false;
+
+    QByteArray data = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            + m_traceEvents + "\n]}\n";
+    bool ok = (m_traceFile->write(data) == data.size());
+    delete m_traceFile;
+    m_traceFile = 0;
+    m_traceRemaining = 0;
+    m_traceEvents.clear();
+    return ok;
+}
+
+QString PipelineStats::traceFileName() const
+{
+    return m_traceFile ? m_traceFile->fileName() : QString();
+}
+
+const char * PipelineStats::stageName(int stage)
+{
+    static const char * const names[FrameTrace::NumStages] = {
+        "total", "recorder", "dispatch", "calibrate", "render", "encode",
+        "send", "open", "write", "close", "rename", "return"
+    };
+    Q_ASSERT(stage >= 0 && stage < FrameTrace::NumStages);
+    return names[stage];
+}
+
+void PipelineStats::addTraceEvents(ulong frameId, const FrameTrace &trace)
+{
+    const qint64 *stamps = trace.stamps;
+    qint64 previous = 0;
+    for (int i = 0; i < FrameTrace::NumStages; ++i) {
+        if (stamps[i] == 0)
+            continue;
+        if (previous != 0) {
+            m_traceEvents += ",\n{\"name\":\"" + QByteArray(stageName(i))
+                    + "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    + QByteArray::number(StageLanes[i])
+                    + ",\"ts\":" + QByteArray::number(previous)
+                    + ",\"dur\":" + QByteArray::number(stamps[i] - previous)
+                    + ",\"args\":{\"frame\":"
+                    + QByteArray::number(quint64(frameId)) + "}}";
+        }
+        previous = stamps[i];
+    }
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_PIPELINESTATS_H
+#define SJCAM_PIPELINESTATS_H
+
+#include "pvutils.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <PvApi.h>
+
+class QFile;
+
+// Monotonic time stamps (in microseconds) of the hand-offs of a frame in the
+// capture pipeline. A FrameTrace is attached to each frame buffer by
+// allocPvFrame() using tPvFrame::Context[0]; stages which were not passed
+// have a zero time stamp. The flags record what was done to the image data.
+struct FrameTrace
+{
+    enum Stage {
+        CameraDone,
+        RecorderOutput,
+        Dispatched,
+        Calibrated,
+        StreamerRendered,
+        StreamerEncoded,
+        StreamerSent,
+        WriterOpened,
+        WriterWritten,
+        WriterClosed,
+        WriterRenamed,
+        BufferReturned,
+        NumStages
+    };
+
+    enum Flag {
+        DarkFlatApplied = 0x1,
+        DefectsCorrected = 0x2
+    };
+
+    void clear() { qMemSet(stamps, 0, sizeof(stamps)); flags = 0; }
+    qint64 stamps[NumStages];
+    quint32 flags;
+};
+
+inline FrameTrace * frameTrace(tPvFrame *frame)
+{
+    return frame ? static_cast<FrameTrace *>(frame->Context[0]) : 0;
+}
+
+inline void stampFrame(tPvFrame *frame, FrameTrace::Stage stage)
+{
+    FrameTrace *trace = frameTrace(frame);
+    if (trace)
+        trace->stamps[stage] = monotonicUsecs();
+}
+
+inline void flagFrame(tPvFrame *frame, FrameTrace::Flag flag)
+{
+    FrameTrace *trace = frameTrace(frame);
+    if (trace)
+        trace->flags |= flag;
+}
+
+inline quint32 frameFlags(tPvFrame *frame)
+{
+    FrameTrace *trace = frameTrace(frame);
+    return trace ? trace->flags : 0;
+}
+
+// Log-linear histogram of latencies in microseconds with a relative
+// resolution of 1/8.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(qint64 usecs);
+    void clear();
+    int count() const { return m_count; }
+    qint64 max() const { return m_max; }
+    qint64 percentile(double p) const;
+
+private:
+    static int bucketIndex(qint64 usecs);
+    static qint64 bucketValue(int index);
+
+    QVector<int> m_buckets;
+    int m_count;
+    qint64 m_max;
+};
+
+// Collects the frame traces of returned frames into one latency histogram
+// per stage. The latency of a stage is the time since the previous stage
+// the frame passed; the first histogram contains the total time from the
+// end of the exposure until the buffer was returned. Optionally the traces
+// of the next frames are written to a file in the Chrome trace event format.
+class PipelineStats
+{
+public:
+    PipelineStats();
+    ~PipelineStats();
+
+    void addFrame(ulong frameId, const FrameTrace &trace);
+    void clear();
+    QByteArray summary() const;
+    const LatencyHistogram & histogram(int stage) const;
+
+    bool startTrace(const QString &fileName, int numFrames);
+    bool finishTrace();
+    bool isTracing() const { return m_traceFile != 0; }
+    QString traceFileName() const;
+
+    static const char * stageName(int stage);
+
+private:
+    Q_DISABLE_COPY(PipelineStats)
+    void addTraceEvents(ulong frameId, const FrameTrace &trace);
+
+    LatencyHistogram m_histograms[FrameTrace::NumStages];
+    QFile *m_traceFile;
+    int m_traceRemaining;
+    QByteArray m_traceEvents;
+};
+
+inline const LatencyHistogram & PipelineStats::histogram(int stage) const
+{
+    Q_ASSERT(stage >= 0 && stage < FrameTrace::NumStages);
+    return m_histograms[stage];
+}
+
+#endif // SJCAM_PIPELINESTATS_H
@@ -25,6 +25,12 @@
  */
 
 #include "pvutils.h"
+#include "pipelinestats.h"
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QtEndian>
 
 #include <ctime>
 #include <cerrno>
@@ -36,6 +42,27 @@ int pvmsleep(unsigned int ms)
     Sleep(DWORD(ms));
     return 0;
 }
+
+qint64 monotonicUsecs()
+{
+    static LARGE_INTEGER frequency = { { 0, 0 } };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return qint64(counter.QuadPart / frequency.QuadPart) * 1000000
+            + qint64(counter.QuadPart % frequency.QuadPart) * 1000000
+            / frequency.QuadPart;
+}
+
+qint64 utcUsecs()
+{
+    // FILETIME counts 100 ns intervals since 1601-01-01
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    qint64 t = (qint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return t / 10 - Q_INT64_C(11644473600000000);
+}
 #else
 int pvmsleep(unsigned int ms)
 {
@@ -56,17 +83,50 @@ int pvmsleep(unsigned int ms)
 
     return 0;
 }
+
+qint64 monotonicUsecs()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return qint64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+
+qint64 utcUsecs()
+{
+    timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return qint64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
 #endif
 
+quint64 PvFrameTicks(const tPvFrame *frame)
+{
+    Q_ASSERT(frame);
+    return (quint64(frame->TimestampHi) << 32) | frame->TimestampLo;
+}
+
 qint64 PvFrameTimestamp(tPvFrame *frame, uint tsFreq, double timeScale)
 {
     Q_ASSERT(frame);
     Q_ASSERT(tsFreq > 0);
-    double timestamp = frame->TimestampHi * 4294967295.0 + frame->TimestampLo;
-    timestamp *= timeScale / tsFreq;
+    // split the counter into whole seconds and remaining ticks, so that
+    // the double multiply does not lose precision for large counts
+    const quint64 ticks = PvFrameTicks(frame);
+    double timestamp = double(ticks / tsFreq) * timeScale
+            + double(ticks % tsFreq) * timeScale / tsFreq;
     return qRound64(timestamp);
 }
 
+quint32 PvFrameExposure(const tPvFrame *frame)
+{
+    Q_ASSERT(frame);
+    if (!frame->AncillaryBuffer || frame->AncillarySize < 12)
+        return 0;
+    const quint32 *buf = reinterpret_cast<const quint32 *>(
+                frame->AncillaryBuffer);
+    return qFromBigEndian(buf[2]);
+}
+
 QString PvVersionString()
 {
     ulong major, minor;
@@ -152,16 +212,9 @@ QString formatErrorMessage(const QString &errorString, tPvErr errorCode)
             .arg(PvErrorCodeString(errorCode));
 }
 
-CameraInfoList availablePvCameras(uint timeout)
+static CameraInfoList listPvCameras()
 {
-    // try to find a camera for timeout milliseconds
-    uint numLoops = timeout / 100;
-    ulong camCount = 0;
-    for (uint i = 0; i < numLoops && camCount < 1; ++i) {
-        camCount = PvCameraCount();
-        pvmsleep(100);
-    }
-
+    ulong camCount = PvCameraCount();
     if (camCount < 1)
         return CameraInfoList();
 
@@ -176,6 +229,107 @@ CameraInfoList availablePvCameras(uint timeout)
     return result;
 }
 
+// State of the camera discovery; the link callback is called from a PvApi
+// thread, so it only marks the camera list as outdated and the list is
+// updated by the next call of availablePvCameras().
+struct CameraDiscovery
+{
+    CameraDiscovery() : active(false), outdated(true) {}
+
+    QMutex mutex;
+    QWaitCondition linkEvent;
+    bool active;
+    bool outdated;
+    CameraInfoList cameras;
+    QHash<ulong, quint32> generations;
+};
+
+static CameraDiscovery discovery;
+
+static void _STDCALL linkCallback(void *context, tPvInterface interfaceType,
+                                  tPvLinkEvent event, unsigned long uniqueId)
+{
+    Q_UNUSED(context);
+    Q_UNUSED(interfaceType);
+    QMutexLocker locker(&discovery.mutex);
+    if (event == ePvLinkAdd)
+        ++discovery.generations[uniqueId];
+    discovery.outdated = true;
+    discovery.linkEvent.wakeAll();
+}
+
+bool startCameraDiscovery()
+{
+    QMutexLocker locker(&discovery.mutex);
+    if (discovery.active)
+        return true;
+    if (PvLinkCallbackRegister(linkCallback, ePvLinkAdd, 0) != ePvErrSuccess)
+        return false;
+    if (PvLinkCallbackRegister(linkCallback, ePvLinkRemove, 0)
+            != ePvErrSuccess) {
+        PvLinkCallbackUnRegister(linkCallback, ePvLinkAdd);
+        return false;
+    }
+    discovery.active = true;
+    discovery.outdated = true;
+    return true;
+}
+
+void stopCameraDiscovery()
+{
+    QMutexLocker locker(&discovery.mutex);
+    if (!discovery.active)
+        return;
+    discovery.active = false;
+    locker.unlock();
+
+    PvLinkCallbackUnRegister(linkCallback, ePvLinkAdd);
+    PvLinkCallbackUnRegister(linkCallback, ePvLinkRemove);
+}
+
+// Returns the number of link events which announced the given camera, or
+// 0 if the camera discovery is not running. A changed value means that the
+// camera was disconnected or restarted in between.
+quint32 cameraLinkGeneration(ulong uniqueId)
+{
+    QMutexLocker locker(&discovery.mutex);
+    return discovery.active ? discovery.generations.value(uniqueId, 0) : 0;
+}
+
+CameraInfoList availablePvCameras(uint timeout)
+{
+    QMutexLocker locker(&discovery.mutex);
+    if (!discovery.active) {
+        locker.unlock();
+
+        // try to find a camera for timeout milliseconds
+        uint numLoops = timeout / 100;
+        for (uint i = 0; i < numLoops && PvCameraCount() < 1; ++i)
+            pvmsleep(100);
+        return listPvCameras();
+    }
+
+    // use the cached list and wait for link events if no camera is known
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        if (discovery.outdated) {
+            discovery.outdated = false;
+            locker.unlock();
+            CameraInfoList cameras = listPvCameras();
+            locker.relock();
+            discovery.cameras = cameras;
+            continue;
+        }
+        if (!discovery.cameras.isEmpty())
+            return discovery.cameras;
+        qint64 remaining = qint64(timeout) - timer.elapsed();
+        if (remaining <= 0)
+            return CameraInfoList();
+        discovery.linkEvent.wait(&discovery.mutex, ulong(remaining));
+    }
+}
+
 QString permittedAccessString(ulong permittedAccess)
 {
     if ((permittedAccess & ePvAccessMaster) != 0)
@@ -194,6 +348,21 @@ QString interfaceTypeString(tPvInterface interfaceType)
     return QString("Unknown");
 }
 
+// Returns the image buffer size needed for the given pixel format, or 0 if
+// the pixel format is not supported.
+ulong pvFrameBufferSize(const QByteArray &pixelFormat, uint width,
+                        uint height)
+{
+    ulong numPixels = ulong(width) * height;
+    if (pixelFormat == "Mono8")
+        return numPixels;
+    else if (pixelFormat == "Mono16")
+        return 2 * numPixels;
+    else if (pixelFormat == "Mono12Packed")
+        return (3 * numPixels + 1) / 2;
+    return 0;
+}
+
 tPvFrame * allocPvFrame(ulong bufferSize)
 {
     tPvFrame *frame = new tPvFrame;
@@ -202,6 +371,9 @@ tPvFrame * allocPvFrame(ulong bufferSize)
     frame->ImageBufferSize = bufferSize;
     frame->AncillaryBuffer = new uchar[48]; // Needs firmware 1.42; the buffer
     frame->AncillaryBufferSize = 48;        // size is 48 bytes (PvApi 1.26)
+    FrameTrace *trace = new FrameTrace;
+    trace->clear();
+    frame->Context[0] = trace;
     return frame;
 }
 
@@ -210,6 +382,7 @@ void freePvFrame(tPvFrame *frame)
     if (frame) {
         delete [] reinterpret_cast<uchar *>(frame->ImageBuffer);
         delete [] reinterpret_cast<uchar *>(frame->AncillaryBuffer);
+        delete frameTrace(frame);
         delete frame;
     }
 }
@@ -27,6 +27,7 @@
 #ifndef SJCAM_PVUTILS_H
 #define SJCAM_PVUTILS_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QList>
 #include <QtCore/QString>
 #include <PvApi.h>
@@ -35,8 +36,20 @@
 // spamming Prosilica API.
 int pvmsleep(unsigned int ms);
 
+// Returns the time of a monotonic clock in microseconds.
+qint64 monotonicUsecs();
+
+// Returns the system (UTC) time in microseconds since 1970-01-01.
+qint64 utcUsecs();
+
+// Returns the raw 64 bit time stamp counter of a frame.
+quint64 PvFrameTicks(const tPvFrame *frame);
 qint64 PvFrameTimestamp(tPvFrame *frame, uint tsFreq, double timeScale = 1e3);
 
+// Returns the exposure time in microseconds from the ancillary data of a
+// frame, or 0 if it is not available.
+quint32 PvFrameExposure(const tPvFrame *frame);
+
 QString PvVersionString();
 QString PvErrorCodeString(tPvErr errorCode);
 QString PvErrorMessage(tPvErr errorCode);
@@ -44,10 +57,15 @@ QString formatErrorMessage(const QString &errorString, tPvErr errorCode);
 
 typedef QList<tPvCameraInfoEx> CameraInfoList;
 CameraInfoList availablePvCameras(uint timeout = 3000);
+bool startCameraDiscovery();
+void stopCameraDiscovery();
+quint32 cameraLinkGeneration(ulong uniqueId);
 
 QString permittedAccessString(ulong permittedAccess);
 QString interfaceTypeString(tPvInterface interfaceType);
 
+ulong pvFrameBufferSize(const QByteArray &pixelFormat, uint width,
+                        uint height);
 tPvFrame * allocPvFrame(ulong bufferSize);
 void freePvFrame(tPvFrame *frame);
 
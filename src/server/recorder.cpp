@@ -26,14 +26,26 @@
 
 #include "recorder.h"
 #include "camera.h"
+#include "replaycamera.h"
 #include "pvutils.h"
+#include "pipelinestats.h"
+#include "metrics.h"
 #include <QtCore/QtCore>
 
 Recorder::Recorder(QObject *parent)
     : QThread(parent),
       m_camera(new Camera),
+      m_replay(false),
       m_stopRequested(false),
-      m_numBuffers(10)
+      m_numBuffers(10),
+      m_bufferSize(0),
+      m_pixelFormat("Mono16"),
+      m_threadCpuUsecs(0),
+      m_warmOpen(false),
+      m_snapshotCameraId(0),
+      m_snapshotGeneration(0),
+      m_exposureValue(0),
+      m_pendingExposure(0)
 {
 }
 
@@ -48,6 +60,48 @@ Recorder::~Recorder()
     delete m_camera;
 }
 
+// Replaces the camera by a ReplayCamera which plays back the FITS files in
+// path; an empty path selects the PvApi camera again.
+bool Recorder::setReplay(const QString &path, double speed, bool loop)
+{
+    if (path.isEmpty())
+        return setFrameSource(0);
+
+    ReplayCamera *replayCamera = new ReplayCamera(path);
+    replayCamera->setSpeed(speed);
+    replayCamera->setLoop(loop);
+    if (!setFrameSource(replayCamera)) {
+        delete replayCamera;
+        return false;
+    }
+    QMutexLocker locker(&m_cameraMutex);
+    m_replay = true;
+    return true;
+}
+
+// Replaces the camera by another frame source, e.g. a SyntheticCamera; the
+// recorder takes ownership of the camera if successful. A null pointer
+// selects the PvApi camera again.
+bool Recorder::setFrameSource(Camera *camera)
+{
+    QMutexLocker locker(&m_cameraMutex);
+    if (m_camera->isOpen()) {
+        emit error("Cannot change the frame source while camera is opened.");
+        return false;
+    }
+
+    delete m_camera;
+    m_camera = camera ? camera : new Camera;
+    m_replay = false;
+    return true;
+}
+
+bool Recorder::isReplay() const
+{
+    QMutexLocker locker(&m_cameraMutex);
+    return m_replay;
+}
+
 bool Recorder::openCamera(ulong cameraId)
 {
     if (isRunning()) {
@@ -63,11 +117,28 @@ bool Recorder::openCamera(ulong cameraId)
         m_cameraMutex.unlock();
         return false;
     }
-    if (!m_camera->resetConfig()) {
-        emit error(m_camera->errorString());
-        m_camera->close();
-        m_cameraMutex.unlock();
-        return false;
+
+    // skip loading the factory settings if the camera was opened before and
+    // has not been restarted since, the attributes which were set are known
+    // in that case
+    ulong openedId = m_camera->cameraInfo().UniqueId;
+    quint32 generation = cameraLinkGeneration(openedId);
+    m_warmOpen = (openedId == m_snapshotCameraId && generation != 0 &&
+                  generation == m_snapshotGeneration);
+    if (!m_warmOpen) {
+        m_attrSnapshot.clear();
+        m_exposureMutex.lock();
+        m_exposureValue = 0;
+        m_exposureMutex.unlock();
+        m_snapshotCameraId = openedId;
+        m_snapshotGeneration = generation;
+        if (!m_camera->resetConfig()) {
+            emit error(m_camera->errorString());
+            m_camera->close();
+            m_snapshotCameraId = 0;
+            m_cameraMutex.unlock();
+            return false;
+        }
     }
     m_cameraInfo.pvCameraInfo = m_camera->cameraInfo();
     m_cameraInfo.hwAddress = m_camera->hwAddress().toAscii();
@@ -84,10 +155,21 @@ bool Recorder::openCamera(ulong cameraId)
         return false;
     }
     m_cameraInfo.timeStampFrequency = timeStampFrequency;
+
+    // the pixel format determines the buffer size and is therefore fixed
+    // while the camera is opened
+    if (!setCachedAttribute("PixelFormat", m_pixelFormat, m_warmOpen)) {
+        emit error(m_camera->errorString());
+        m_camera->close();
+        m_cameraInfo.clear();
+        m_cameraMutex.unlock();
+        return false;
+    }
     ulong camId = m_cameraInfo.pvCameraInfo.UniqueId;
     m_cameraMutex.unlock();
 
-    emit info(QString("Camera opened [%1].").arg(camId));
+    emit info(QString("Camera opened [%1]%2.").arg(camId)
+              .arg(m_warmOpen ? " (warm)" : ""));
 
     allocateFrames();
     return true;
@@ -105,12 +187,19 @@ bool Recorder::closeCamera()
         emit info("Closing camera.");
     m_camera->close();
     m_cameraInfo.clear();
+    m_warmOpen = false;
     m_cameraMutex.unlock();
 
     clearFrameQueues();
     return true;
 }
 
+bool Recorder::isWarmOpen() const
+{
+    QMutexLocker locker(&m_cameraMutex);
+    return m_warmOpen;
+}
+
 bool Recorder::isCameraOpen() const
 {
     QMutexLocker locker(&m_cameraMutex);
@@ -127,16 +216,70 @@ bool Recorder::getAttribute(const QByteArray &name, QVariant *value) const
     return true;
 }
 
+bool Recorder::getAttributeRange(const QByteArray &name, QVariant *min,
+                                 QVariant *max) const
+{
+    QMutexLocker locker(&m_cameraMutex);
+    if (!m_camera->getAttributeRange(name, min, max)) {
+        emit error(m_camera->errorString());
+        return false;
+    }
+    return true;
+}
+
 bool Recorder::setAttribute(const QByteArray &name, const QVariant &value)
 {
     QMutexLocker locker(&m_cameraMutex);
-    if (!m_camera->setAttribute(name, value)) {
+    if (name == "PixelFormat" && value.toByteArray() != m_pixelFormat) {
+        emit error("Cannot change pixel format while camera is opened.");
+        return false;
+    }
+    if (!setCachedAttribute(name, value, false)) {
         emit error(m_camera->errorString());
         return false;
     }
     return true;
 }
 
+// Like setAttribute(), but skips attributes which already have the given
+// value after a warm re-open.
+bool Recorder::updateAttribute(const QByteArray &name, const QVariant &value)
+{
+    QMutexLocker locker(&m_cameraMutex);
+    if (name == "PixelFormat" && value.toByteArray() != m_pixelFormat) {
+        emit error("Cannot change pixel format while camera is opened.");
+        return false;
+    }
+    if (!setCachedAttribute(name, value, m_warmOpen)) {
+        emit error(m_camera->errorString());
+        return false;
+    }
+    return true;
+}
+
+// Sets an attribute and records its value in the snapshot used for warm
+// re-opens; m_cameraMutex must be locked.
+bool Recorder::setCachedAttribute(const QByteArray &name,
+                                  const QVariant &value, bool skipUnchanged)
+{
+    QString str = value.toString();
+    QMap<QByteArray, QString>::const_iterator it = m_attrSnapshot.find(name);
+    if (skipUnchanged && !value.isNull() && it != m_attrSnapshot.constEnd()
+            && it.value() == str)
+        return true;
+    if (!m_camera->setAttribute(name, value)) {
+        m_attrSnapshot.remove(name);
+        return false;
+    }
+    if (!value.isNull())
+        m_attrSnapshot.insert(name, str);
+    if (name == "ExposureValue") {
+        QMutexLocker locker(&m_exposureMutex);
+        m_exposureValue = value.toUInt();
+    }
+    return true;
+}
+
 bool Recorder::getFrameStats(float &fps, uint &completed, uint &dropped)
 {
     QMutexLocker locker(&m_cameraMutex);
@@ -147,9 +290,51 @@ bool Recorder::getFrameStats(float &fps, uint &completed, uint &dropped)
     return true;
 }
 
-int Recorder::numBuffers() const
+bool Recorder::getNetworkStats(NetworkStats &stats)
 {
     QMutexLocker locker(&m_cameraMutex);
+    if (!m_camera->getNetworkStats(stats)) {
+        emit error(m_camera->errorString());
+        return false;
+    }
+    return true;
+}
+
+bool Recorder::adjustPacketSize(quint32 maxPacketSize, quint32 *packetSize)
+{
+    QMutexLocker locker(&m_cameraMutex);
+    if (m_camera->isCapturing()) {
+        emit error("Cannot adjust packet size while capturing.");
+        return false;
+    }
+    if (!m_camera->adjustPacketSize(maxPacketSize, packetSize)) {
+        emit error(m_camera->errorString());
+        return false;
+    }
+    m_attrSnapshot.insert("PacketSize", QString::number(*packetSize));
+    return true;
+}
+
+// Returns the exposure value which was last set through the recorder, or 0
+// if it is unknown. Unlike getAttribute() this doesn't wait for the camera.
+quint32 Recorder::exposureValue() const
+{
+    QMutexLocker locker(&m_exposureMutex);
+    return m_exposureValue;
+}
+
+// Requests a new exposure value, which is set by the capture thread before
+// it waits for the next frame. Used by the auto exposure, so that the main
+// thread doesn't wait for the camera while capturing.
+void Recorder::setPendingExposure(quint32 exposure)
+{
+    QMutexLocker locker(&m_exposureMutex);
+    m_pendingExposure = exposure;
+}
+
+int Recorder::numBuffers() const
+{
+    QMutexLocker locker(&m_queueMutex);
     return m_numBuffers;
 }
 
@@ -160,10 +345,39 @@ bool Recorder::setNumBuffers(int numBuffers)
         emit error("Cannot set number of buffers while camera is opened.");
         return false;
     }
+    QMutexLocker queueLocker(&m_queueMutex);
     m_numBuffers = (numBuffers >= 1 ? numBuffers : 1);
     return true;
 }
 
+QByteArray Recorder::pixelFormat() const
+{
+    QMutexLocker locker(&m_cameraMutex);
+    return m_pixelFormat;
+}
+
+bool Recorder::setPixelFormat(const QByteArray &pixelFormat)
+{
+    QMutexLocker locker(&m_cameraMutex);
+    if (m_camera->isOpen()) {
+        emit error("Cannot set pixel format while camera is opened.");
+        return false;
+    }
+    if (pvFrameBufferSize(pixelFormat, 1, 1) == 0) {
+        emit error(QString("Unsupported pixel format '%1'.")
+                   .arg(QString(pixelFormat)));
+        return false;
+    }
+    m_pixelFormat = pixelFormat;
+    return true;
+}
+
+ulong Recorder::bufferSize() const
+{
+    QMutexLocker locker(&m_queueMutex);
+    return m_bufferSize;
+}
+
 CameraInfo Recorder::cameraInfo() const
 {
     QMutexLocker locker(&m_cameraMutex);
@@ -176,6 +390,13 @@ QString Recorder::cameraInfoString() const
     return m_camera->infoString();
 }
 
+// The clock model is updated by the capture thread and maps the frame time
+// stamps to UTC; it is thread-safe and may be used by the other stages.
+const ClockModel * Recorder::clockModel() const
+{
+    return &m_clockModel;
+}
+
 bool Recorder::hasFinishedFrame() const
 {
     QMutexLocker locker(&m_queueMutex);
@@ -195,6 +416,46 @@ void Recorder::enqueueFrame(tPvFrame *frame)
     return m_inputQueue.enqueue(frame);
 }
 
+// Allocates count additional frames; this can be used while capturing.
+void Recorder::addFrames(int count)
+{
+    QMutexLocker locker(&m_queueMutex);
+    if (m_bufferSize == 0)
+        return;
+    for (int i = 0; i < count; ++i)
+        m_inputQueue.enqueue(allocPvFrame(m_bufferSize));
+    m_numBuffers += count;
+    serverMetrics.buffers.add(count);
+}
+
+// Frees a frame which was read by readFinishedFrame() instead of enqueueing
+// it again; this can be used while capturing.
+void Recorder::releaseFrame(tPvFrame *frame)
+{
+    Q_ASSERT(frame);
+    QMutexLocker locker(&m_queueMutex);
+    freePvFrame(frame);
+    --m_numBuffers;
+    serverMetrics.buffers.decrement();
+}
+
+// The settings are applied when the capture thread is started.
+void Recorder::setThreadSettings(const ThreadSettings &settings)
+{
+    QMutexLocker locker(&m_threadMutex);
+    m_threadSettings = settings;
+}
+
+// Returns the CPU time used by all capture threads so far.
+qint64 Recorder::threadCpuUsecs() const
+{
+    QMutexLocker locker(&m_threadMutex);
+    qint64 usecs = m_threadCpuUsecs;
+    if (m_threadHandle.isValid())
+        usecs += qMax(m_threadHandle.cpuUsecs(), qint64(0));
+    return usecs;
+}
+
 void Recorder::start()
 {
     if (isRunning())
@@ -217,15 +478,17 @@ void Recorder::allocateFrames()
 {
     Q_ASSERT(!isRunning());
 
-    // create frames with the full sensor size and 2 bytes per pixel to make
-    // sure that all possible frames fit to the allocated buffers
+    // create frames with the full sensor size, so that all possible regions
+    // of interest fit to the allocated buffers
     uint width = m_camera->sensorWidth();
     uint height = m_camera->sensorHeight();
-    ulong bufferSize = 2L * width * height;
+    ulong bufferSize = pvFrameBufferSize(m_pixelFormat, width, height);
 
     m_queueMutex.lock();
+    m_bufferSize = bufferSize;
     for (int i = 0; i < m_numBuffers; ++i)
         m_inputQueue.enqueue(allocPvFrame(bufferSize));
+    serverMetrics.buffers.add(m_numBuffers);
     m_queueMutex.unlock();
 }
 
@@ -243,6 +506,9 @@ void Recorder::clearFrameQueues()
         freePvFrame(m_inputQueue.dequeue());
     while (!m_outputQueue.isEmpty())
         freePvFrame(m_outputQueue.dequeue());
+    if (m_bufferSize != 0)
+        serverMetrics.buffers.add(-m_numBuffers);
+    m_bufferSize = 0;
     m_queueMutex.unlock();
 }
 
@@ -265,10 +531,33 @@ void Recorder::clearFrameQueues()
      Stop capturing
 */
 void Recorder::run()
+{
+    // a missing permission for real-time scheduling is not fatal, the
+    // thread continues with the default settings
+    m_threadMutex.lock();
+    m_threadHandle = ThreadHandle::current();
+    QString threadError;
+    if (!m_threadSettings.isDefault() &&
+            !m_threadHandle.apply(m_threadSettings, &threadError))
+        emit error("Capture thread: " + threadError);
+    m_threadMutex.unlock();
+
+    runCapture();
+
+    m_threadMutex.lock();
+    m_threadCpuUsecs += qMax(m_threadHandle.cpuUsecs(), qint64(0));
+    m_threadHandle = ThreadHandle();
+    m_threadMutex.unlock();
+}
+
+void Recorder::runCapture()
 {
     // list of frames, used to move frames between queues
     QList<tPvFrame *> frameList;
 
+    // exposure requests of a previous run are outdated
+    setPendingExposure(0);
+
 // +++ queue
     // read all frames from the input queue
     m_queueMutex.lock();
@@ -311,6 +600,7 @@ void Recorder::run()
     m_cameraMutex.unlock();
 // --- camera
 
+    m_clockModel.reset(m_cameraInfo.timeStampFrequency);
     QElapsedTimer clock;
     clock.start();
 
@@ -350,6 +640,15 @@ void Recorder::run()
         }
         frameList.clear();
 
+        // apply a requested exposure value while the camera is locked
+        m_exposureMutex.lock();
+        const quint32 exposure = m_pendingExposure;
+        m_pendingExposure = 0;
+        m_exposureMutex.unlock();
+        if (exposure != 0 &&
+                !setCachedAttribute("ExposureValue", exposure, false))
+            emit error(m_camera->errorString());
+
         if (m_cameraQueue.isEmpty()) {
             emit error("Capture queue is empty.");
             m_cameraMutex.unlock();
@@ -373,20 +672,33 @@ void Recorder::run()
             }
         }
         m_cameraQueue.dequeue();
+        const qint64 doneUsecs = monotonicUsecs();
+        stampFrame(frame, FrameTrace::CameraDone);
         FrameInfo frameInfo;
         frameInfo.readoutTimestamp = clock.elapsed();
-        frameInfo.readoutTimeMs = QDateTime::currentDateTimeUtc()
-                .toMSecsSinceEpoch();
+        frameInfo.readoutTimeMs = m_clockModel.hostToUtcUsecs(doneUsecs)
+                / 1000;
         frameInfo.id = id;
         frameInfo.count = frame->FrameCount;
         frameInfo.status = frame->Status;
+        serverMetrics.countFrame(frame->Status);
         frameInfo.timestamp = PvFrameTimestamp(
                     frame, m_cameraInfo.timeStampFrequency, 1e3);
+        frameInfo.exposureUtcUsecs = 0;
+        if (frame->Status == ePvErrSuccess) {
+            // the camera latches the time stamp at the start of the
+            // exposure, which ended before the frame was read out
+            const quint64 ticks = PvFrameTicks(frame);
+            m_clockModel.addSample(ticks,
+                                   doneUsecs - PvFrameExposure(frame));
+            frameInfo.exposureUtcUsecs = m_clockModel.utcUsecs(ticks);
+        }
         m_cameraMutex.unlock();
 // --- camera
 
 // +++ queue
         // enqueue the finished frame to the output queue
+        stampFrame(frame, FrameTrace::RecorderOutput);
         m_queueMutex.lock();
         m_outputQueue.enqueue(frame);
         m_queueMutex.unlock();
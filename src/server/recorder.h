@@ -27,14 +27,18 @@
 #ifndef SJCAM_RECORDER_H
 #define SJCAM_RECORDER_H
 
+#include "threadcontrol.h"
+#include "clockmodel.h"
 #include <QtCore/QThread>
 #include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QQueue>
+#include <QtCore/QMap>
 #include <QtCore/QMetaType>
 #include <PvApi.h>
 
 class Camera;
+struct NetworkStats;
 
 struct CameraInfo
 {
@@ -81,6 +85,7 @@ struct FrameInfo
     qint64 timestamp;
     qint64 readoutTimestamp;
     qint64 readoutTimeMs;
+    qint64 exposureUtcUsecs;
 };
 Q_DECLARE_METATYPE(FrameInfo)
 
@@ -92,24 +97,44 @@ public:
     explicit Recorder(QObject *parent = 0);
     ~Recorder();
 
+    bool setReplay(const QString &path, double speed = 1.0,
+                   bool loop = true);
+    bool isReplay() const;
+    bool setFrameSource(Camera *camera);
     bool openCamera(ulong cameraId = 0);
     bool closeCamera();
     bool isCameraOpen() const;
+    bool isWarmOpen() const;
 
     bool getAttribute(const QByteArray &name, QVariant *value) const;
     bool setAttribute(const QByteArray &name, const QVariant &value);
+    bool updateAttribute(const QByteArray &name, const QVariant &value);
+    bool getAttributeRange(const QByteArray &name, QVariant *min,
+                           QVariant *max) const;
     bool getFrameStats(float &fps, uint &completed, uint &dropped);
+    bool getNetworkStats(NetworkStats &stats);
+    bool adjustPacketSize(quint32 maxPacketSize, quint32 *packetSize);
+    quint32 exposureValue() const;
+    void setPendingExposure(quint32 exposure);
 
     bool hasFinishedFrame() const;
     tPvFrame * readFinishedFrame();
     void enqueueFrame(tPvFrame *frame);
+    void addFrames(int count);
+    void releaseFrame(tPvFrame *frame);
 
     int numBuffers() const;
     bool setNumBuffers(int numBuffers);
+    ulong bufferSize() const;
+    QByteArray pixelFormat() const;
+    bool setPixelFormat(const QByteArray &pixelFormat);
     bool isStopRequested() const;
+    void setThreadSettings(const ThreadSettings &settings);
+    qint64 threadCpuUsecs() const;
 
     CameraInfo cameraInfo() const;
     QString cameraInfoString() const;
+    const ClockModel * clockModel() const;
 
 public slots:
     void start();
@@ -124,19 +149,37 @@ protected:
     void allocateFrames();
     void clearFrameQueues();
     void run();
+    void runCapture();
+    bool setCachedAttribute(const QByteArray &name, const QVariant &value,
+                            bool skipUnchanged);
 
 private:
     Q_DISABLE_COPY(Recorder)
     mutable QMutex m_cameraMutex;
     mutable QMutex m_queueMutex;
     mutable QReadWriteLock m_stopRequestLock;
-    Camera * const m_camera;
+    Camera *m_camera;
+    bool m_replay;
     CameraInfo m_cameraInfo;
     QQueue<tPvFrame *> m_cameraQueue;
     QQueue<tPvFrame *> m_inputQueue;
     QQueue<tPvFrame *> m_outputQueue;
     bool m_stopRequested;
     int m_numBuffers;
+    ulong m_bufferSize;
+    QByteArray m_pixelFormat;
+    mutable QMutex m_threadMutex;
+    ThreadSettings m_threadSettings;
+    ThreadHandle m_threadHandle;
+    qint64 m_threadCpuUsecs;
+    bool m_warmOpen;
+    ulong m_snapshotCameraId;
+    quint32 m_snapshotGeneration;
+    QMap<QByteArray, QString> m_attrSnapshot;
+    mutable QMutex m_exposureMutex;
+    quint32 m_exposureValue;
+    quint32 m_pendingExposure;
+    ClockModel m_clockModel;
 };
 
 inline bool Recorder::isStopRequested() const {
@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "replaycamera.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+
+namespace {
+
+// number of frames converted ahead of the capture loop
+const int PrefetchFrames = 8;
+
+// larger gaps between the time stamps of two files, e.g. between two
+// observing runs, are skipped
+const qint64 MaxGapUsecs = 10000000;
+
+const int FitsBlockSize = 2880;
+const int FitsCardSize = 80;
+
+// The keywords of the primary header which are needed to read the image
+// data and the frame times; see ImageWriter for the written keywords.
+struct FitsHeader
+{
+    int bitpix;
+    int naxis;
+    qint64 naxes[3];
+    double bzero;
+    double bscale;
+    qint64 timestamp;
+    quint32 exposure;
+    uint bitDepth;
+    qint64 dataOffset;
+
+    qint64 planeSize() const {
+        return naxes[0] * naxes[1] * (bitpix / 8);
+    }
+};
+
+bool parseFitsHeader(const uchar *data, qint64 size, FitsHeader *header)
+{
+    header->bitpix = 0;
+    header->naxis = 0;
+    header->naxes[0] = header->naxes[1] = 0;
+    header->naxes[2] = 1;
+    header->bzero = 0;
+    header->bscale = 1;
+    header->timestamp = -1;
+    header->exposure = 0;
+    header->bitDepth = 0;
+
+    for (qint64 pos = 0; pos + FitsCardSize <= size; pos += FitsCardSize) {
+        const QByteArray card(reinterpret_cast<const char *>(data) + pos,
+                              FitsCardSize);
+        const QByteArray key = card.left(8).trimmed();
+        if (key == "END") {
+            header->dataOffset = (pos / FitsBlockSize + 1) * FitsBlockSize;
+            if (header->bitDepth == 0)
+                header->bitDepth = uint(header->bitpix);
+            return (header->bitpix == 8 || header->bitpix == 16) &&
+                    (header->naxis == 2 || header->naxis == 3) &&
+                    header->naxes[0] > 0 && header->naxes[1] > 0 &&
+                    header->naxes[2] > 0 && header->bscale == 1 &&
+                    header->dataOffset + header->naxes[2] *
+                    header->planeSize() <= size;
+        }
+        if (card.mid(8, 2) != "= ")
+            continue;
+
+        // only numeric values are used, so the comment starts at '/'
+        QByteArray value = card.mid(10);
+        int slash = value.indexOf('/');
+        if (slash >= 0)
+            value.truncate(slash);
+        value = value.trimmed();
+        if (key == "BITPIX")
+            header->bitpix = value.toInt();
+        else if (key == "NAXIS")
+            header->naxis = value.toInt();
+        else if (key == "NAXIS1")
+            header->naxes[0] = value.toLongLong();
+        else if (key == "NAXIS2")
+            header->naxes[1] = value.toLongLong();
+        else if (key == "NAXIS3")
+            header->naxes[2] = value.toLongLong();
+        else if (key == "BZERO")
+            header->bzero = value.toDouble();
+        else if (key == "BSCALE")
+            header->bscale = value.toDouble();
+        else if (key == "TIMESTAM")
+            header->timestamp = value.toLongLong();
+        else if (key == "EXPTIME")
+            header->exposure = value.toUInt();
+        else if (key == "BITDEPTH")
+            header->bitDepth = value.toUInt();
+    }
+    return false;
+}
+
+// Converts big-endian FITS pixels to the output format; values are clipped
+// to the output range after shifting them right by shift bits.
+template <typename T>
+void convertPixels(T *dest, const uchar *src, int bitpix, int bzero,
+                   int shift, int maxValue, int count)
+{
+    if (bitpix == 8) {
+        for (int i = 0; i < count; ++i) {
+            int value = (int(src[i]) + bzero) >> shift;
+            dest[i] = T(qBound(0, value, maxValue));
+        }
+    }
+    else {
+        for (int i = 0; i < count; ++i) {
+            qint16 raw = qint16((src[2*i] << 8) | src[2*i + 1]);
+            int value = (int(raw) + bzero) >> shift;
+            dest[i] = T(qBound(0, value, maxValue));
+        }
+    }
+}
+
+bool isFitsFile(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "fits" || suffix == "fit" || suffix == "fts";
+}
+
+} // namespace
+
+// The reader thread only calls ReplayCamera::readFrames().
+class ReplayReader : public QThread
+{
+public:
+    explicit ReplayReader(ReplayCamera *camera) : m_camera(camera) {}
+
+protected:
+    void run() { m_camera->readFrames(); }
+
+private:
+    ReplayCamera * const m_camera;
+};
+
+ReplayCamera::ReplayCamera(const QString &path)
+    : EmulatedCamera(0.01f, 1000.0f),
+      m_path(path),
+      m_speed(1.0),
+      m_loop(true),
+      m_reader(0),
+      m_outputFormat(ePvFmtMono16),
+      m_frameCount(0),
+      m_skippedFiles(0),
+      m_acquisitionUsecs(0),
+      m_startUsecs(0),
+      m_firstTimestamp(-1),
+      m_lastTimestamp(-1),
+      m_lastDueUsecs(-1),
+      m_nextDueUsecs(-1),
+      m_completed(0),
+      m_stopReading(false),
+      m_endOfData(false)
+{
+}
+
+ReplayCamera::~ReplayCamera()
+{
+    close();
+}
+
+void ReplayCamera::setSpeed(double speed)
+{
+    m_speed = qMax(speed, 0.0);
+}
+
+void ReplayCamera::setLoop(bool loop)
+{
+    m_loop = loop;
+}
+
+// The sensor size is taken from the first readable file, files with other
+// image sizes are skipped while replaying.
+bool ReplayCamera::open(ulong cameraId)
+{
+    Q_UNUSED(cameraId);
+    clearError();
+    if (isOpen())
+        close();
+
+    m_fileNames = listFiles();
+    FitsHeader header;
+    bool found = false;
+    foreach (const QString &fileName, m_fileNames) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        uchar *data = file.map(0, file.size());
+        if (!data)
+            continue;
+        found = parseFitsHeader(data, file.size(), &header);
+        file.unmap(data);
+        if (found)
+            break;
+    }
+    if (!found) {
+        setError("No replayable FITS files found in '" + m_path + "'.");
+        m_fileNames.clear();
+        return false;
+    }
+
+    setInfo(QFileInfo(m_path).fileName().toAscii(), "Replay",
+            quint32(header.naxes[0]), quint32(header.naxes[1]),
+            header.bitDepth);
+    m_open = true;
+    resetConfig();
+    return true;
+}
+
+void ReplayCamera::close()
+{
+    if (!m_open)
+        return;
+    stopCapturing();
+    clearFrameQueue();
+    m_fileNames.clear();
+    m_attributes.clear();
+    clearInfo();
+    m_open = false;
+}
+
+bool ReplayCamera::resetConfig()
+{
+    EmulatedCamera::resetConfig();
+    m_outputFormat = ePvFmtMono16;
+    return true;
+}
+
+bool ReplayCamera::startCapturing()
+{
+    if (!m_open) {
+        setError("Cannot start capturing.");
+        return false;
+    }
+    if (m_reader)
+        return true;
+
+    m_mutex.lock();
+    m_readyFrames.clear();
+    m_stopReading = false;
+    m_endOfData = false;
+    m_mutex.unlock();
+
+    m_reader = new ReplayReader(this);
+    m_reader->start();
+    return true;
+}
+
+bool ReplayCamera::stopCapturing()
+{
+    if (!m_reader)
+        return true;
+
+    m_mutex.lock();
+    m_stopReading = true;
+    m_spaceAvailable.wakeAll();
+    m_mutex.unlock();
+
+    m_reader->wait();
+    delete m_reader;
+    m_reader = 0;
+
+    QMutexLocker locker(&m_mutex);
+    m_readyFrames.clear();
+    return true;
+}
+
+bool ReplayCamera::enqueueFrame(tPvFrame *frame)
+{
+    if (!m_reader) {
+        setError("Cannot enqueue frame.");
+        return false;
+    }
+    m_frameQueue.enqueue(frame);
+    return true;
+}
+
+bool ReplayCamera::clearFrameQueue()
+{
+    while (!m_frameQueue.isEmpty())
+        m_frameQueue.dequeue()->Status = ePvErrCancelled;
+    return true;
+}
+
+bool ReplayCamera::startAcqusition()
+{
+    m_acquisitionUsecs = monotonicUsecs();
+    m_startUsecs = m_acquisitionUsecs;
+    m_firstTimestamp = -1;
+    m_lastTimestamp = -1;
+    m_lastDueUsecs = -1;
+    m_nextDueUsecs = -1;
+    m_completed = 0;
+    return true;
+}
+
+bool ReplayCamera::stopAcquisition()
+{
+    return true;
+}
+
+bool ReplayCamera::waitForFrameDone(tPvFrame *frame, ulong timeout,
+                                    bool *timedOut)
+{
+    if (timedOut)
+        *timedOut = false;
+    if (m_frameQueue.isEmpty() || m_frameQueue.head() != frame) {
+        setError("Failed to wait for frame, the frame is not queued.");
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_readyFrames.isEmpty() && !m_endOfData)
+        m_frameReady.wait(&m_mutex, timeout);
+    if (m_readyFrames.isEmpty()) {
+        if (m_endOfData) {
+            setError("End of replay data.");
+        } else {
+            setError("Failed to wait for frame, timeout.");
+            if (timedOut)
+                *timedOut = true;
+        }
+        return false;
+    }
+
+    // wait until the frame is due, at most for the given timeout
+    qint64 now = monotonicUsecs();
+    if (m_nextDueUsecs < 0)
+        m_nextDueUsecs = dueUsecs(m_readyFrames.head(), now);
+    const qint64 waitUsecs = m_nextDueUsecs - now;
+    if (waitUsecs > 1000 * qint64(timeout)) {
+        locker.unlock();
+        pvmsleep(uint(timeout));
+        setError("Failed to wait for frame, timeout.");
+        if (timedOut)
+            *timedOut = true;
+        return false;
+    }
+    if (waitUsecs >= 1000) {
+        locker.unlock();
+        pvmsleep(uint(waitUsecs / 1000));
+        locker.relock();
+    }
+
+    const ReplayFrame replayFrame = m_readyFrames.dequeue();
+    m_spaceAvailable.wakeOne();
+    locker.unlock();
+    m_lastDueUsecs = m_nextDueUsecs;
+    m_nextDueUsecs = -1;
+    m_frameQueue.dequeue();
+
+    const ulong size = ulong(replayFrame.data.size());
+    if (size > frame->ImageBufferSize) {
+        frame->Status = ePvErrDataLost;
+        frame->ImageSize = 0;
+        return true;
+    }
+    qMemCopy(frame->ImageBuffer, replayFrame.data.constData(), size);
+    frame->ImageSize = size;
+    frame->Width = m_sensorWidth;
+    frame->Height = m_sensorHeight;
+    frame->RegionX = 0;
+    frame->RegionY = 0;
+    frame->Format = tPvImageFormat(m_outputFormat);
+    frame->BitDepth = replayFrame.bitDepth;
+    frame->FrameCount = (++m_frameCount) & 0xffff;
+
+    // the camera latches the time stamp at the start of the exposure
+    now = monotonicUsecs();
+    const quint64 ticks = quint64(qMax(now - replayFrame.exposure,
+                                       qint64(0)));
+    frame->TimestampLo = ulong(ticks & 0xffffffff);
+    frame->TimestampHi = ulong(ticks >> 32);
+    if (frame->AncillaryBuffer && frame->AncillaryBufferSize >= 12) {
+        qMemSet(frame->AncillaryBuffer, 0, frame->AncillaryBufferSize);
+        quint32 *buf = reinterpret_cast<quint32 *>(frame->AncillaryBuffer);
+        buf[2] = qToBigEndian(replayFrame.exposure);
+        frame->AncillarySize = frame->AncillaryBufferSize;
+    }
+    frame->Status = ePvErrSuccess;
+    ++m_completed;
+    return true;
+}
+
+// Frames with time stamps are replayed relative to the first frame of the
+// sequence, other frames with the emulated frame rate. The time base is
+// reset at the start of the sequence and if the time stamps jump, so the
+// due times never decrease.
+qint64 ReplayCamera::dueUsecs(const ReplayFrame &frame, qint64 now)
+{
+    if (m_speed <= 0)
+        return now;
+
+    qint64 due;
+    if (frame.timestamp >= 0 && !frame.restart && m_lastTimestamp >= 0 &&
+            frame.timestamp > m_lastTimestamp &&
+            frame.timestamp - m_lastTimestamp <= MaxGapUsecs) {
+        due = m_startUsecs + qint64((frame.timestamp - m_firstTimestamp)
+                                    / m_speed);
+        m_lastTimestamp = frame.timestamp;
+    }
+    else if (frame.timestamp >= 0) {
+        m_startUsecs = (m_lastDueUsecs < 0) ? now : qMax(now, m_lastDueUsecs);
+        m_firstTimestamp = frame.timestamp;
+        m_lastTimestamp = frame.timestamp;
+        due = m_startUsecs;
+    }
+    else {
+        const float frameRate = qMax(m_attributes.value("FrameRate")
+                                     .toFloat(), 0.01f);
+        due = (m_lastDueUsecs < 0) ? now : m_lastDueUsecs +
+                qint64(1e6 / (frameRate * m_speed));
+    }
+    return (m_lastDueUsecs < 0) ? due : qMax(due, m_lastDueUsecs);
+}
+
+bool ReplayCamera::applyAttribute(const QByteArray &name,
+                                  const QVariant &value)
+{
+    if (name == "PixelFormat") {
+        if (value.toByteArray() == "Mono8")
+            m_outputFormat = ePvFmtMono8;
+        else if (value.toByteArray() == "Mono16")
+            m_outputFormat = ePvFmtMono16;
+        else {
+            setError("Replay supports only the pixel formats Mono8 and "
+                     "Mono16.");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReplayCamera::getFrameStats(float &fps, uint &completed, uint &dropped)
+{
+    const qint64 elapsed = monotonicUsecs() - m_acquisitionUsecs;
+    fps = (m_reader && elapsed > 0) ? float(1e6 * m_completed / elapsed) : 0;
+    completed = m_completed;
+    dropped = 0;
+    return true;
+}
+
+QString ReplayCamera::infoString() const
+{
+    m_mutex.lock();
+    const uint skippedFiles = m_skippedFiles;
+    m_mutex.unlock();
+
+    QString result;
+    QTextStream ts(&result);
+    ts << "Replay infos:"
+       << "\n    Path .............. " << m_path
+       << "\n    Files ............. " << m_fileNames.size()
+       << "\n    Skipped files ..... " << skippedFiles
+       << "\n    Speed ............. " << m_speed
+       << "\n    Loop .............. " << (m_loop ? "true" : "false")
+       << "\n    Sensor ............ " << m_sensorWidth << "x"
+                                       << m_sensorHeight << "@"
+                                       << m_sensorBits;
+    return result;
+}
+
+QStringList ReplayCamera::listFiles() const
+{
+    QFileInfo info(m_path);
+    if (!info.isDir())
+        return QStringList() << m_path;
+
+    QDir dir(m_path);
+    QStringList fileNames;
+    foreach (const QString &name,
+             dir.entryList(QDir::Files | QDir::Readable, QDir::Name))
+        if (isFitsFile(name))
+            fileNames.append(dir.absoluteFilePath(name));
+    return fileNames;
+}
+
+// Runs in the reader thread and reads the files until the end of the
+// sequence or until the capturing is stopped.
+void ReplayCamera::readFrames()
+{
+    // the files and the settings do not change while capturing
+    const QStringList fileNames = m_fileNames;
+    const bool loop = m_loop;
+    const ulong format = m_outputFormat;
+
+    bool restart = true;
+    int numFrames = 0;
+    for (int i = 0; ; ++i) {
+        if (i == fileNames.size()) {
+            // stop if a complete pass didn't contain a single frame
+            if (!loop || numFrames == 0)
+                break;
+            i = 0;
+            numFrames = 0;
+            restart = true;
+        }
+        const int n = readFile(fileNames[i], format, restart);
+        if (n < 0)
+            return;  // stopped
+        if (n > 0)
+            restart = false;
+        numFrames += n;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_endOfData = true;
+    m_frameReady.wakeAll();
+}
+
+// Returns the number of frames read from the file, or -1 if the reader was
+// stopped.
+int ReplayCamera::readFile(const QString &fileName, ulong format,
+                           bool restart)
+{
+    QFile file(fileName);
+    uchar *data = 0;
+    FitsHeader header;
+    if (!file.open(QIODevice::ReadOnly) ||
+            !(data = file.map(0, file.size())) ||
+            !parseFitsHeader(data, file.size(), &header) ||
+            header.naxes[0] != m_sensorWidth ||
+            header.naxes[1] != m_sensorHeight) {
+        if (data)
+            file.unmap(data);
+        QMutexLocker locker(&m_mutex);
+        ++m_skippedFiles;
+        return 0;
+    }
+
+    const int count = int(header.naxes[0] * header.naxes[1]);
+    const bool mono8 = (format == ePvFmtMono8);
+    const int shift = mono8 ? qMax(int(header.bitDepth) - 8, 0) : 0;
+    const int bzero = qRound(header.bzero);
+    int numFrames = 0;
+    for (int plane = 0; plane < header.naxes[2]; ++plane) {
+        const uchar *src = data + header.dataOffset
+                + plane * header.planeSize();
+        ReplayFrame frame;
+        frame.bitDepth = mono8 ? qMin(header.bitDepth, 8u)
+                               : header.bitDepth;
+        frame.exposure = header.exposure;
+        frame.timestamp = (plane == 0) ? header.timestamp : -1;
+        frame.restart = restart && plane == 0;
+        if (mono8) {
+            frame.data.resize(count);
+            convertPixels(reinterpret_cast<uchar *>(frame.data.data()), src,
+                          header.bitpix, bzero, shift, 255, count);
+        } else {
+            frame.data.resize(2 * count);
+            convertPixels(reinterpret_cast<quint16 *>(frame.data.data()),
+                          src, header.bitpix, bzero, shift, 65535, count);
+        }
+        if (!pushFrame(frame)) {
+            file.unmap(data);
+            return -1;
+        }
+        ++numFrames;
+    }
+    file.unmap(data);
+    return numFrames;
+}
+
+// Blocks while the prefetch queue is full; returns false if the reader was
+// stopped.
+bool ReplayCamera::pushFrame(const ReplayFrame &frame)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_readyFrames.size() >= PrefetchFrames && !m_stopReading)
+        m_spaceAvailable.wait(&m_mutex);
+    if (m_stopReading)
+        return false;
+    m_readyFrames.enqueue(frame);
+    m_frameReady.wakeOne();
+    return true;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_REPLAYCAMERA_H
+#define SJCAM_REPLAYCAMERA_H
+
+#include "emulatedcamera.h"
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QQueue>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+class ReplayReader;
+
+// Plays back FITS files written by the server in place of a camera, to
+// reproduce problems with recorded data and to measure the throughput of
+// the pipeline without hardware. The path is either a single file or a
+// directory, whose FITS files are played in the order of their names; a
+// file may contain a single frame or a cube. A reader thread maps the files
+// into memory and converts the next frames ahead of time. The attributes
+// are only emulated, except for PixelFormat, which selects Mono8 or Mono16
+// output.
+class ReplayCamera : public EmulatedCamera
+{
+public:
+    explicit ReplayCamera(const QString &path);
+    ~ReplayCamera();
+
+    // speed 1 replays the frames at their original time stamps, 2 twice as
+    // fast, and 0 as fast as the pipeline accepts them
+    void setSpeed(double speed);
+    double speed() const { return m_speed; }
+    void setLoop(bool loop);
+    bool loop() const { return m_loop; }
+
+    bool open(ulong cameraId = 0);
+    void close();
+    bool resetConfig();
+
+    bool startCapturing();
+    bool stopCapturing();
+    bool isCapturing() const { return m_reader != 0; }
+    bool enqueueFrame(tPvFrame *frame);
+    bool clearFrameQueue();
+    bool startAcqusition();
+    bool stopAcquisition();
+    bool waitForFrameDone(tPvFrame *frame, ulong timeout, bool *timedOut);
+
+    bool getFrameStats(float &fps, uint &completed, uint &dropped);
+
+    QString infoString() const;
+
+protected:
+    friend class ReplayReader;
+
+    struct ReplayFrame
+    {
+        QByteArray data;
+        uint bitDepth;
+        quint32 exposure;
+        qint64 timestamp;   // [us] original time stamp, -1 if unknown
+        bool restart;       // first frame of the sequence
+    };
+
+    bool applyAttribute(const QByteArray &name, const QVariant &value);
+    QStringList listFiles() const;
+    void readFrames();
+    int readFile(const QString &fileName, ulong format, bool restart);
+    bool pushFrame(const ReplayFrame &frame);
+    qint64 dueUsecs(const ReplayFrame &frame, qint64 now);
+
+private:
+    Q_DISABLE_COPY(ReplayCamera)
+    QString m_path;
+    double m_speed;
+    bool m_loop;
+    QStringList m_fileNames;
+    ReplayReader *m_reader;
+    QQueue<tPvFrame *> m_frameQueue;
+    ulong m_outputFormat;
+    ulong m_frameCount;
+    uint m_skippedFiles;
+
+    // pacing of the current acquisition
+    qint64 m_acquisitionUsecs;
+    qint64 m_startUsecs;
+    qint64 m_firstTimestamp;
+    qint64 m_lastTimestamp;
+    qint64 m_lastDueUsecs;
+    qint64 m_nextDueUsecs;
+    uint m_completed;
+
+    // shared with the reader thread
+    mutable QMutex m_mutex;
+    QWaitCondition m_frameReady;
+    QWaitCondition m_spaceAvailable;
+    QQueue<ReplayFrame> m_readyFrames;
+    bool m_stopReading;
+    bool m_endOfData;
+};
+
+#endif // SJCAM_REPLAYCAMERA_H
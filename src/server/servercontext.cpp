@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "servercontext.h"
+#include "metricsserver.h"
+#include "pvutils.h"
+#include <QtCore/QSocketNotifier>
+#include <PvApi.h>
+#include <csignal>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+int ServerContext::s_signalFds[2] = { -1, -1 };
+
+ServerContext::ServerContext(int numCameras, QObject *parent)
+    : QObject(parent),
+      m_numCameras(qMax(numCameras, 1)),
+      m_mainThread(ThreadHandle::current()),
+      m_streamerThread(new WorkerThread),
+      m_calibratorThread(new WorkerThread),
+      m_writerThread(new WorkerThread),
+      m_frameInfoLogThread(new WorkerThread),
+      m_metricsServer(new MetricsServer),
+      m_signalNotifier(0)
+{
+    PvInitialize();
+
+#ifndef _WIN32
+    // Qt functions cannot be called from a signal handler, the handler
+    // writes to a socket pair which is watched by the event loop
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalFds) == 0) {
+        m_signalNotifier = new QSocketNotifier(s_signalFds[1],
+                                               QSocketNotifier::Read, this);
+        connect(m_signalNotifier, SIGNAL(activated(int)),
+                SLOT(readSignalSocket()));
+        std::signal(SIGHUP, hangupHandler);
+    }
+#endif
+
+    // keep the camera list up to date from the start, so that opening a
+    // camera doesn't need to wait for the discovery
+    startCameraDiscovery();
+
+    m_streamerThread->start();
+    m_calibratorThread->start();
+    m_writerThread->start();
+    m_frameInfoLogThread->start();
+}
+
+ServerContext::~ServerContext()
+{
+    stopThreads();
+
+    delete m_streamerThread;
+    delete m_calibratorThread;
+    delete m_writerThread;
+    delete m_frameInfoLogThread;
+    delete m_metricsServer;
+
+    stopCameraDiscovery();
+    PvUnInitialize();
+
+#ifndef _WIN32
+    if (m_signalNotifier) {
+        std::signal(SIGHUP, SIG_DFL);
+        delete m_signalNotifier;
+        ::close(s_signalFds[0]);
+        ::close(s_signalFds[1]);
+        s_signalFds[0] = s_signalFds[1] = -1;
+    }
+#endif
+}
+
+// Returns false if another server has already claimed different settings
+// for the shared thread.
+bool ServerContext::claimThreadSettings(const QString &threadName,
+                                        const ThreadSettings &settings)
+{
+    QMap<QString, ThreadSettings>::const_iterator it =
+            m_threadSettings.find(threadName);
+    if (it != m_threadSettings.constEnd())
+        return it.value() == settings;
+    m_threadSettings.insert(threadName, settings);
+    return true;
+}
+
+void ServerContext::stopThreads()
+{
+    // stop the threads in pipeline order
+    WorkerThread *threads[] = { m_calibratorThread, m_streamerThread,
+                           m_writerThread, m_frameInfoLogThread };
+    for (int i = 0; i < 4; ++i) {
+        threads[i]->quit();
+        threads[i]->wait();
+    }
+}
+
+void ServerContext::hangupHandler(int)
+{
+#ifndef _WIN32
+    char c = 1;
+    if (::write(s_signalFds[0], &c, sizeof(c)) < 0)
+        return;
+#endif
+}
+
+void ServerContext::readSignalSocket()
+{
+#ifndef _WIN32
+    m_signalNotifier->setEnabled(false);
+    char c;
+    if (::read(s_signalFds[1], &c, sizeof(c)) == sizeof(c))
+        emit reloadRequested();
+    m_signalNotifier->setEnabled(true);
+#endif
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_SERVERCONTEXT_H
+#define SJCAM_SERVERCONTEXT_H
+
+#include "threadcontrol.h"
+#include <QtCore/QMap>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+class MetricsServer;
+class QSocketNotifier;
+
+// Resources which are shared by all camera servers of the process: the
+// PvApi instance with the camera discovery, the worker threads of the processing stages and the
+// metrics server. The stage objects of each camera are moved to the shared
+// threads, so that the number of threads does not grow with the number of
+// cameras and file writes of all cameras are serialized. On POSIX systems
+// SIGHUP is forwarded to the servers as reloadRequested() signal.
+//
+// The servers must be deleted after stopThreads() was called, because
+// their stage objects live in the shared threads. The settings of a shared
+// thread are claimed by the first server which applies them, differing
+// settings of other servers are rejected by claimThreadSettings().
+class ServerContext : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ServerContext(int numCameras = 1, QObject *parent = 0);
+    ~ServerContext();
+
+    int numCameras() const { return m_numCameras; }
+    ThreadHandle mainThread() const { return m_mainThread; }
+    WorkerThread * streamerThread() const { return m_streamerThread; }
+    WorkerThread * calibratorThread() const { return m_calibratorThread; }
+    WorkerThread * writerThread() const { return m_writerThread; }
+    WorkerThread * frameInfoLogThread() const { return m_frameInfoLogThread; }
+    MetricsServer * metricsServer() const { return m_metricsServer; }
+
+    bool claimThreadSettings(const QString &threadName,
+                             const ThreadSettings &settings);
+
+    void stopThreads();
+
+signals:
+    void reloadRequested();
+
+private slots:
+    void readSignalSocket();
+
+private:
+    static void hangupHandler(int);
+    static int s_signalFds[2];
+
+    Q_DISABLE_COPY(ServerContext)
+    int m_numCameras;
+    ThreadHandle m_mainThread;
+    WorkerThread * const m_streamerThread;
+    WorkerThread * const m_calibratorThread;
+    WorkerThread * const m_writerThread;
+    WorkerThread * const m_frameInfoLogThread;
+    MetricsServer * const m_metricsServer;
+    QSocketNotifier *m_signalNotifier;
+    QMap<QString, ThreadSettings> m_threadSettings;
+};
+
+#endif // SJCAM_SERVERCONTEXT_H
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pipelinebench.h"
+#include "benchopts.h"
+#include "recorder.h"
+#include "motiontracker.h"
+#include "framestore.h"
+#include "defectmap.h"
+#include <QtCore/QtCore>
+#include <cstdio>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QFileInfo(app.arguments()[0]).fileName());
+
+    // register types which are used as slot arguments
+    qRegisterMetaType<tPvFrame *>("tPvFrame *");
+    qRegisterMetaType<CameraInfo>("CameraInfo");
+    qRegisterMetaType<FrameInfo>("FrameInfo");
+    qRegisterMetaType<MotionInfo>("MotionInfo");
+    qRegisterMetaType<StoredFrameList>("StoredFrameList");
+    qRegisterMetaType<DefectMap>("DefectMap");
+
+    BenchOpts opts;
+    if (!opts.parse() || opts.help)
+        return opts.help ? 0 : 1;
+
+    // the server prints its messages to stdout, which is reserved for the
+    // results; the messages are redirected to stderr
+    FILE *resultFile = stdout;
+#ifndef _WIN32
+    int resultFd = ::dup(STDOUT_FILENO);
+    if (resultFd >= 0 && ::dup2(STDERR_FILENO, STDOUT_FILENO) >= 0)
+        resultFile = ::fdopen(resultFd, "w");
+    if (!resultFile)
+        resultFile = stdout;
+#endif
+
+    PipelineBench bench(opts);
+    QObject::connect(&bench, SIGNAL(finished()), &app, SLOT(quit()));
+    QTimer::singleShot(0, &bench, SLOT(start()));
+    app.exec();
+    if (bench.exitCode() != 0)
+        return bench.exitCode();
+
+    // the results go to stdout, messages to stderr
+    QFile file(opts.jsonFileName);
+    bool ok = opts.jsonFileName.isEmpty() ?
+                file.open(resultFile, QIODevice::WriteOnly) :
+                file.open(QIODevice::WriteOnly);
+    if (!ok || file.write(bench.result()) != bench.result().size()) {
+        QTextStream cerr(stderr, QIODevice::WriteOnly);
+        cerr << "Error: Cannot write results to \"" << opts.jsonFileName
+             << "\"." << endl;
+        return 1;
+    }
+    return 0;
+}
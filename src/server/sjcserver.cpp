@@ -26,38 +26,132 @@
 
 #include "sjcserver.h"
 #include "recorder.h"
+#include "camera.h"
 #include "imagestreamer.h"
 #include "imagewriter.h"
+#include "framecalibrator.h"
+#include "frameinfolog.h"
+#include "motiontracker.h"
+#include "metricsserver.h"
+#include "servercontext.h"
+#include "metrics.h"
 #include "pvutils.h"
 #include "version.h"
 #include <QtCore/QtCore>
 #include <QtNetwork/QHostAddress>
 
-SjcServer::SjcServer(const CmdLineOpts &opts, QObject *parent)
+namespace {
+
+// Config values are compared as numbers if both are numeric, so that e.g.
+// 10.0 and 10 are the same value.
+bool sameConfigValue(const QVariant &a, const QVariant &b)
+{
+    bool ok1, ok2;
+    double x = a.toDouble(&ok1);
+    double y = b.toDouble(&ok2);
+    if (ok1 && ok2)
+        return x == y;
+    return a.toString() == b.toString();
+}
+
+// Event notifications report something that happened, e.g. a written file,
+// and are never replaced by a newer notification with the same identifier.
+bool isEventNotification(const QByteArray &identifier)
+{
+    return identifier == "framewritten" || identifier == "motion";
+}
+
+bool containsConfigValue(const QList<NamedValue> &list,
+                         const NamedValue &attr)
+{
+    foreach (const NamedValue &item, list)
+        if (item.name == attr.name)
+            return sameConfigValue(item.value, attr.value);
+    return false;
+}
+
+} // namespace
+
+SjcServer::SjcServer(const CmdLineOpts &opts, const QString &configFileName,
+                     ServerContext *context, QObject *parent)
     : QObject(parent),
       cout(stdout, QIODevice::WriteOnly),
+      m_context(context),
       m_recorder(new Recorder),
       m_imageStreamer(new ImageStreamer),
-      m_imageStreamerThread(new QThread),
+      m_imageStreamerThread(context->streamerThread()),
+      m_frameCalibrator(new FrameCalibrator),
+      m_frameCalibratorThread(context->calibratorThread()),
+      m_motionTracker(new MotionTracker),
       m_imageWriter(new ImageWriter),
-      m_imageWriterThread(new QThread),
+      m_imageWriterThread(context->writerThread()),
+      m_frameInfoLog(new FrameInfoLog),
+      m_frameInfoLogThread(context->frameInfoLogThread()),
       m_dcp(new Dcp::Client),
       m_clientTimeout(30000),
       m_updateClientMapTimer(new QTimer),
+      m_notifyTimer(new QTimer),
+      m_notifyDelay(20),
+      m_statusTimer(new QTimer),
+      m_statusInterval(10),
       m_serverName("localhost"),
       m_serverPort(2001),
       m_deviceName("sjcam"),
+      m_preTriggerFrames(0),
+      m_preTriggerSeconds(0),
+      m_preTriggerCompressed(false),
+      m_selectKeep(0),
+      m_selectWindow(0),
+      m_selectMetric("gradient"),
+      m_coaddFrames(0),
+      m_coaddAverage(false),
+      m_burstMemory(0),
+      m_burstRemaining(0),
+      m_burstWriting(false),
+      m_storedWriting(false),
+      m_calibrationEnabled(false),
+      m_defectMode(FrameCalibrator::DefectsOff),
+      m_defectThreshold(10.0),
+      m_numDefects(0),
+      m_trackingMode(MotionTracker::Off),
+      m_trackingThreshold(0.5),
+      m_trackingMaxShift(16),
+      m_trackingPort(0),
+      m_autoExposureEnabled(false),
+      m_autoExposureMin(1),
+      m_autoExposureMax(1000000),
+      m_exposureValue(0),
+      m_exposureMin(0),
+      m_exposureMax(0),
       m_cameraId(0),
+      m_replaySpeed(1.0),
+      m_replayLoop(true),
       m_numBuffers(10),
+      m_adaptiveBuffers(false),
+      m_bufferTuneTimer(new QTimer),
+      m_buffersToRelease(0),
+      m_buffersInFlight(0),
+      m_maxPacketSize(8228),
+      m_bandwidthBudget(0),
+      m_bandwidthShares(0),
+      m_lastFrameCount(-1),
       m_streamingPort(0),
-      m_configFileName(opts.configFileName),
-      m_verbose(false),
+      m_metricsPort(0),
+      m_configFileName(configFileName),
+      m_verbosity(0),
       m_markerEnabled(false),
       m_markerCentering(true),
       m_markerPos(0, 0),
-      m_frameInfoLogFile(0)
+      m_statusValid(false),
+      m_frameInfoLogEnabled(false),
+      m_shutdown(false)
 {
-    PvInitialize();
+    registerDcpCommands();
+    m_lastMotion.count = 0;
+    m_lastMotion.status = MotionTracker::NoSignal;
+    m_lastMotion.exposureUtcUsecs = 0;
+    m_lastMotion.dx = 0;
+    m_lastMotion.dy = 0;
 
     m_dcp->setAutoReconnect(true);
     connect(m_dcp, SIGNAL(error(Dcp::Client::Error)),
@@ -77,27 +171,52 @@ SjcServer::SjcServer(const CmdLineOpts &opts, QObject *parent)
     connect(m_imageStreamer, SIGNAL(error(QString)), SLOT(printError(QString)));
     connect(m_imageStreamer, SIGNAL(connectionListChanged(QStringList)),
                              SLOT(streamerConnectionListChanged(QStringList)));
-    connect(m_imageStreamerThread, SIGNAL(started()),
-                                   SLOT(streamerThreadStarted()));
     connect(m_imageStreamerThread, SIGNAL(finished()),
                                    SLOT(streamerThreadFinished()));
 
+    connect(m_frameCalibrator, SIGNAL(info(QString)), SLOT(printInfo(QString)));
+    connect(m_frameCalibrator, SIGNAL(error(QString)), SLOT(printError(QString)));
+    connect(m_frameCalibrator,
+            SIGNAL(calibrationChanged(bool,QString,QString)),
+            SLOT(calibratorCalibrationChanged(bool,QString,QString)));
+    connect(m_frameCalibrator,
+            SIGNAL(defectModeChanged(int,QString,int)),
+            SLOT(calibratorDefectModeChanged(int,QString,int)));
+
+    connect(m_motionTracker, SIGNAL(info(QString)), SLOT(printInfo(QString)));
+    connect(m_motionTracker, SIGNAL(error(QString)), SLOT(printError(QString)));
+    connect(m_motionTracker, SIGNAL(motionMeasured(MotionInfo)),
+                             SLOT(trackerMotionMeasured(MotionInfo)));
+
+    connect(m_frameInfoLog, SIGNAL(error(QString)), SLOT(printError(QString)));
+
     connect(m_imageWriter, SIGNAL(frameWritten(int,int,QByteArray)),
                            SLOT(writerFrameWritten(int,int,QByteArray)));
     connect(m_imageWriter, SIGNAL(frameFinished(tPvFrame*)),
                            SLOT(writerFrameFinished(tPvFrame*)));
+    connect(m_imageWriter, SIGNAL(storedFramesWritten()),
+                           SLOT(writerStoredFramesWritten()));
     connect(m_imageWriter, SIGNAL(info(QString)), SLOT(printInfo(QString)));
     connect(m_imageWriter, SIGNAL(error(QString)), SLOT(printError(QString)));
-    connect(m_imageWriterThread, SIGNAL(started()),
-                                 SLOT(writerThreadStarted()));
     connect(m_imageWriterThread, SIGNAL(finished()),
                                  SLOT(writerThreadFinished()));
 
+    connect(m_frameCalibrator, SIGNAL(frameFinished(tPvFrame*)),
+            m_motionTracker, SLOT(processFrame(tPvFrame*)));
+    connect(m_motionTracker, SIGNAL(frameFinished(tPvFrame*)),
+            m_imageStreamer, SLOT(processFrame(tPvFrame*)));
+    connect(m_frameCalibrator, SIGNAL(previewDefectMapChanged(DefectMap)),
+            m_imageStreamer, SLOT(setDefectMap(DefectMap)));
     connect(m_imageStreamer, SIGNAL(frameFinished(tPvFrame*)),
             m_imageWriter, SLOT(processFrame(tPvFrame*)));
 
     connect(m_updateClientMapTimer, SIGNAL(timeout()), SLOT(updateClientMap()));
     m_updateClientMapTimer->start(m_clientTimeout / 3);
+    m_notifyTimer->setSingleShot(true);
+    connect(m_notifyTimer, SIGNAL(timeout()), SLOT(flushNotifications()));
+    connect(m_statusTimer, SIGNAL(timeout()), SLOT(printStatus()));
+    connect(m_context, SIGNAL(reloadRequested()), SLOT(reloadConfig()));
+    connect(m_bufferTuneTimer, SIGNAL(timeout()), SLOT(tuneBuffers()));
 
     if (!m_configFileName.isEmpty())
         loadConfigFile();
@@ -110,26 +229,124 @@ SjcServer::SjcServer(const CmdLineOpts &opts, QObject *parent)
     if (opts.cameraId != 0)
         m_cameraId = opts.cameraId;
     if (opts.verbose != -1)
-        m_verbose = bool(opts.verbose);
+        m_verbosity = opts.verbose;
 
+    if (!m_replayPath.isEmpty() &&
+            m_recorder->setReplay(m_replayPath, m_replaySpeed, m_replayLoop)) {
+        if (verbose())
+            cout << "Replaying '" << m_replayPath << "'." << endl;
+    }
     m_recorder->setNumBuffers(m_numBuffers);
+    m_recorder->setThreadSettings(m_threadSettings[CaptureThread]);
+    applyThreadSettings();
+    if (m_statusInterval > 0)
+        m_statusTimer->start(1000 * m_statusInterval);
 
+    m_imageStreamer->setClockModel(m_recorder->clockModel());
     if (m_imageStreamer->listen(m_streamingPort)) {
-        m_imageStreamerThread->start();
         m_imageStreamer->moveToThread(m_imageStreamerThread);
+        if (verbose())
+            cout << "Streaming server started ["
+                 << m_imageStreamer->serverPort() << "]." << endl;
     }
     m_streamingPort = m_imageStreamer->serverPort();
 
+    // the metrics cover all cameras of the process, the first server with
+    // a configured port starts the metrics server
+    MetricsServer *metricsServer = m_context->metricsServer();
+    if (m_metricsPort != 0 && !metricsServer->isListening()) {
+        QHostAddress address = m_metricsAddress.isEmpty() ?
+                    QHostAddress(QHostAddress::Any) :
+                    QHostAddress(m_metricsAddress);
+        if (metricsServer->listen(address, m_metricsPort))
+            cout << "Metrics server started [" << m_metricsPort << "]."
+                 << endl;
+        else
+            printError("Cannot start metrics server: "
+                       + metricsServer->errorString());
+    }
+
     m_imageWriter->setFileNamePrefix(m_outputFileNamePrefix);
     m_imageWriter->setDirectory(m_outputDirectory);
     m_imageWriter->setDeviceName(m_deviceName);
     m_imageWriter->setTelescopeName(m_telescopeName);
-    m_imageWriterThread->start();
+    m_imageWriter->setClockModel(m_recorder->clockModel());
+    m_imageWriter->setPreTrigger(m_preTriggerFrames,
+                                 qRound(1000 * m_preTriggerSeconds),
+                                 m_preTriggerCompressed);
+    FrameSelector::Metric selectMetric = FrameSelector::GradientEnergy;
+    FrameSelector::metricFromName(m_selectMetric, &selectMetric);
+    m_imageWriter->setFrameSelection(m_selectKeep, m_selectWindow,
+                                     selectMetric);
+    m_imageWriter->setCoadding(m_coaddFrames, m_coaddAverage);
     m_imageWriter->moveToThread(m_imageWriterThread);
+
+    m_frameCalibrator->setFileNamePrefix(m_outputFileNamePrefix);
+    m_frameCalibrator->setDirectory(m_calibrationDirectory.isEmpty() ?
+                                    m_outputDirectory : m_calibrationDirectory);
+    m_frameCalibrator->setDefectThreshold(m_defectThreshold);
+    m_frameCalibrator->moveToThread(m_frameCalibratorThread);
+    if (!m_darkFileName.isEmpty())
+        QMetaObject::invokeMethod(m_frameCalibrator, "loadMaster",
+                                  Q_ARG(int, FrameCalibrator::Dark),
+                                  Q_ARG(QString, m_darkFileName));
+    if (!m_flatFileName.isEmpty())
+        QMetaObject::invokeMethod(m_frameCalibrator, "loadMaster",
+                                  Q_ARG(int, FrameCalibrator::Flat),
+                                  Q_ARG(QString, m_flatFileName));
+    QMetaObject::invokeMethod(m_frameCalibrator, "setEnabled",
+                              Q_ARG(bool, m_calibrationEnabled));
+    if (!m_defectFileName.isEmpty())
+        QMetaObject::invokeMethod(m_frameCalibrator, "loadDefectMap",
+                                  Q_ARG(QString, m_defectFileName));
+    QMetaObject::invokeMethod(m_frameCalibrator, "setDefectMode",
+                              Q_ARG(int, m_defectMode));
+
+    // the tracker runs in the calibrator thread, directly after calibration
+    m_motionTracker->setClockModel(m_recorder->clockModel());
+    m_motionTracker->setMode(m_trackingMode);
+    m_motionTracker->setRoi(m_trackingRoi);
+    m_motionTracker->setThreshold(m_trackingThreshold);
+    m_motionTracker->setMaxShift(m_trackingMaxShift);
+    if (m_trackingPort != 0 && m_motionTracker->listen(m_trackingPort)) {
+        if (verbose())
+            cout << "Tracking server started ["
+                 << m_motionTracker->serverPort() << "]." << endl;
+    }
+    m_motionTracker->moveToThread(m_frameCalibratorThread);
+
+    m_frameInfoLog->moveToThread(m_frameInfoLogThread);
+    if (m_frameInfoLogEnabled)
+        startFrameInfoLog();
 }
 
 SjcServer::~SjcServer()
 {
+    shutdown();
+
+    delete m_dcp;
+    delete m_recorder;
+    delete m_imageStreamer;
+    delete m_frameCalibrator;
+    delete m_motionTracker;
+    delete m_imageWriter;
+    delete m_updateClientMapTimer;
+    delete m_notifyTimer;
+    delete m_statusTimer;
+    delete m_bufferTuneTimer;
+    delete m_frameInfoLog;
+}
+
+// Disconnects from the DCP server, closes the camera and stops the frame
+// info log. This must be called before the shared threads are stopped.
+void SjcServer::shutdown()
+{
+    if (m_shutdown)
+        return;
+    m_shutdown = true;
+
+    m_notifyTimer->stop();
+    flushNotifications();
     m_dcp->disconnectFromServer();
     m_dcp->waitForDisconnected();
 
@@ -137,38 +354,158 @@ SjcServer::~SjcServer()
     m_recorder->wait();
     m_recorder->closeCamera();
 
-    m_imageStreamerThread->quit();
-    m_imageStreamerThread->wait();
+    QMetaObject::invokeMethod(m_frameInfoLog, "stopLogging",
+                              Qt::BlockingQueuedConnection);
+    QMetaObject::invokeMethod(m_motionTracker, "stopLogging",
+                              Qt::BlockingQueuedConnection);
+}
 
-    m_imageWriterThread->quit();
-    m_imageWriterThread->wait();
+QString SjcServer::threadTypeName(ThreadType type)
+{
+    static const char * const names[NumThreadTypes] = {
+        "Capture", "Main", "Calibrator", "Streamer", "Writer"
+    };
+    return QString(names[type]);
+}
 
-    delete m_dcp;
-    delete m_recorder;
-    delete m_imageStreamer;
-    delete m_imageStreamerThread;
-    delete m_imageWriter;
-    delete m_imageWriterThread;
-    delete m_updateClientMapTimer;
-    delete m_frameInfoLogFile;
+ThreadHandle SjcServer::threadHandle(ThreadType type) const
+{
+    switch (type) {
+    case MainThread: return m_context->mainThread();
+    case CalibratorThread: return m_context->calibratorThread()->handle();
+    case StreamerThread: return m_context->streamerThread()->handle();
+    case WriterThread: return m_context->writerThread()->handle();
+    default: return ThreadHandle();
+    }
+}
+
+// Returns the CPU time consumed by the thread, or -1 if it is unknown.
+qint64 SjcServer::threadCpuUsecs(ThreadType type) const
+{
+    return (type == CaptureThread) ? m_recorder->threadCpuUsecs()
+                                   : threadHandle(type).cpuUsecs();
+}
+
+// Applies the [Threads] settings to the main and the worker threads; the
+// capture thread is configured by the recorder whenever it is started. The
+// main and worker threads are shared by all cameras of the process, their
+// settings must be the same in the config files of all cameras.
+void SjcServer::applyThreadSettings()
+{
+    for (int i = MainThread; i < NumThreadTypes; ++i) {
+        const ThreadSettings &settings = m_threadSettings[i];
+        if (settings.isDefault())
+            continue;
+        if (!m_context->claimThreadSettings(threadTypeName(ThreadType(i)),
+                                            settings)) {
+            printError(threadTypeName(ThreadType(i)) + " thread: the "
+                       "settings differ from those of another camera and "
+                       "are ignored.");
+            continue;
+        }
+        QString errorString;
+        if (!threadHandle(ThreadType(i)).apply(settings, &errorString))
+            printError(threadTypeName(ThreadType(i)) + " thread: "
+                       + errorString);
+    }
+}
+
+void SjcServer::setStatusReportEnabled(bool enable)
+{
+    if (enable && m_statusInterval > 0)
+        m_statusTimer->start(1000 * m_statusInterval);
+    else
+        m_statusTimer->stop();
+}
 
-    PvUnInitialize();
+// Replaces the camera, e.g. by a SyntheticCamera for benchmarks; the server
+// takes ownership of the frame source if successful. The frame source can
+// only be replaced while the camera is closed.
+bool SjcServer::setFrameSource(Camera *camera)
+{
+    return m_recorder->setFrameSource(camera);
 }
 
 bool SjcServer::openCamera()
 {
+    // start with the configured number of buffers, the adaptive mode may
+    // have changed it while the camera was opened
+    if (!m_recorder->isCameraOpen()) {
+        m_recorder->setNumBuffers(m_numBuffers);
+
+        // the pixel format is set by the recorder when opening the camera,
+        // because it determines the size of the frame buffers
+        QByteArray pixelFormat = "Mono16";
+        foreach (const NamedValue &attr, m_camAttrList)
+            if (attr.name == "PixelFormat")
+                pixelFormat = attr.value.toByteArray();
+        if (!m_recorder->setPixelFormat(pixelFormat))
+            return false;
+    }
+    m_buffersToRelease = 0;
+    QElapsedTimer openTimer;
+    openTimer.start();
+    invalidateStatus();
     if (!m_recorder->openCamera(m_cameraId))
         return false;
+    const bool warmOpen = m_recorder->isWarmOpen();
+
+    // negotiate the largest packet size supported by the network path; the
+    // negotiated size is kept by the camera after a warm re-open
+    quint32 packetSize;
+    if (m_maxPacketSize > 0 && !warmOpen &&
+            m_recorder->adjustPacketSize(m_maxPacketSize, &packetSize)) {
+        if (verbose())
+            cout << "Packet size: " << packetSize << " bytes." << endl;
+    }
 
     // default attribute settings
-    m_recorder->setAttribute("FrameStartTriggerMode", "FixedRate");
-    m_recorder->setAttribute("FrameRate", 10);
-    m_recorder->setAttribute("ExposureValue", 10000);
-    m_recorder->setAttribute("PixelFormat", "Mono16");
+    QList<NamedValue> attrList;
+    attrList << NamedValue("FrameStartTriggerMode", "FixedRate")
+             << NamedValue("FrameRate", 10)
+             << NamedValue("ExposureValue", 10000);
+
+    // split the bandwidth budget between the cameras sharing the link
+    if (m_bandwidthBudget > 0) {
+        int shares = (m_bandwidthShares > 0) ? m_bandwidthShares
+                                             : m_context->numCameras();
+        qint64 bytesPerSecond = qMin(m_bandwidthBudget / shares,
+                                     qint64(0xffffffff));
+        attrList << NamedValue("StreamBytesPerSecond",
+                               quint32(bytesPerSecond));
+    }
 
-    // config file attribute settings
-    foreach (const NamedValue &attr, m_camAttrList)
-        m_recorder->setAttribute(attr.name, attr.value);
+    // config file attribute settings replace the defaults
+    foreach (const NamedValue &attr, m_camAttrList) {
+        if (attr.name == "PixelFormat")
+            continue;
+        int i = 0;
+        while (i < attrList.size() && attrList[i].name != attr.name)
+            ++i;
+        if (i < attrList.size())
+            attrList[i] = attr;
+        else
+            attrList << attr;
+    }
+
+    // after a warm re-open only changed attributes are written
+    foreach (const NamedValue &attr, attrList)
+        m_recorder->updateAttribute(attr.name, attr.value);
+
+    // the exposure range is used by the auto exposure, which must not wait
+    // for the camera while capturing
+    QVariant exposureMin, exposureMax;
+    if (m_recorder->getAttributeRange("ExposureValue", &exposureMin,
+                                      &exposureMax)) {
+        m_exposureMin = exposureMin.toUInt();
+        m_exposureMax = exposureMax.toUInt();
+    } else {
+        m_exposureMin = m_exposureMax = 0;
+    }
+
+    if (verbose())
+        cout << "Camera opened in " << openTimer.elapsed() << " ms"
+             << (warmOpen ? " (warm)." : ".") << endl;
 
     if (verbose())
         cout << "\n" << m_recorder->cameraInfoString() << "\n" << endl;
@@ -181,15 +518,26 @@ bool SjcServer::openCamera()
     }
     QMetaObject::invokeMethod(m_imageWriter, "setCameraInfo",
                               Q_ARG(CameraInfo, cameraInfo));
-    QVariant markerPos = m_markerEnabled ? m_markerPos : QVariant();
-    QMetaObject::invokeMethod(m_imageWriter, "setMarkerPos",
-            Q_ARG(QVariant, markerPos));
+    updateMarkerPos();
+
+    // allocate the burst buffer using the same frame size as the recorder
+    if (m_burstMemory > 0) {
+        int bufferSize = int(m_recorder->bufferSize());
+        int capacity = int(qint64(m_burstMemory) * 1024 * 1024 / bufferSize);
+        m_burstPool.allocate(capacity, bufferSize);
+        if (verbose())
+            cout << "Burst buffer allocated [" << capacity << " frames]."
+                 << endl;
+    }
     return true;
 }
 
 bool SjcServer::closeCamera()
 {
     stopCapturing();
+    invalidateStatus();
+    m_burstRemaining = 0;
+    m_burstPool.release();
     return m_recorder->closeCamera();
 }
 
@@ -207,25 +555,40 @@ void SjcServer::stopCapturing()
     }
 }
 
+// Writes the next <count> frames, every <stepping>th frame is written; a
+// count of 0 stops writing.
+void SjcServer::writeFrames(int count, int stepping)
+{
+    QMetaObject::invokeMethod(m_imageWriter, "writeNextFrames",
+            Q_ARG(int, count), Q_ARG(int, stepping));
+}
+
 void SjcServer::connectToDcpServer()
 {
     m_dcp->connectToServer(m_serverName, m_serverPort, m_deviceName);
 }
 
-void SjcServer::loadConfigFile()
+bool SjcServer::isConfigFileReadable()
 {
     QFileInfo fileInfo(m_configFileName);
     if (!fileInfo.isFile()) {
         cout << "Warning: Cannot find config file \"" << m_configFileName
              << "\"." << endl;
-        return;
+        return false;
     }
 
     if (!fileInfo.isReadable()) {
         cout << "Warning: Cannot read config file \"" << m_configFileName
              << "\"." << endl;
-        return;
+        return false;
     }
+    return true;
+}
+
+void SjcServer::loadConfigFile()
+{
+    if (!isConfigFileReadable())
+        return;
 
     bool ok;
     QSettings settings(m_configFileName, QSettings::IniFormat);
@@ -245,6 +608,10 @@ void SjcServer::loadConfigFile()
     if (!deviceName.isEmpty())
         m_deviceName = deviceName;
 
+    int notifyDelay = settings.value("NotifyDelay").toInt(&ok);
+    if (ok && notifyDelay >= 0)
+        m_notifyDelay = notifyDelay;
+
     settings.endGroup();
 
     // Camera Section
@@ -256,9 +623,128 @@ void SjcServer::loadConfigFile()
     int numBuffers = settings.value("NumBuffers").toInt(&ok);
     if (ok) m_numBuffers = numBuffers;
 
+    m_adaptiveBuffers = settings.value("AdaptiveBuffers", false).toBool();
+    int minBuffers = settings.value("MinBuffers").toInt(&ok);
+    if (!ok) minBuffers = m_bufferTuner.minBuffers();
+    int maxBuffers = settings.value("MaxBuffers").toInt(&ok);
+    if (!ok) maxBuffers = m_bufferTuner.maxBuffers();
+    int bufferMemory = settings.value("BufferMemory").toInt(&ok);
+    if (!ok || bufferMemory < 0) bufferMemory = 0;
+    m_bufferTuner.setLimits(minBuffers, maxBuffers,
+                            qint64(bufferMemory) * 1024 * 1024);
+
     settings.endGroup();
 
     // CamAttr Section
+    readCamAttrSection(settings);
+
+    // Network Section
+    settings.beginGroup("Network");
+
+    uint maxPacketSize = settings.value("MaxPacketSize").toUInt(&ok);
+    if (ok) m_maxPacketSize = maxPacketSize;
+
+    double bandwidth = settings.value("Bandwidth").toDouble(&ok);
+    if (ok && bandwidth >= 0) m_bandwidthBudget = qint64(bandwidth * 1e6);
+
+    int bandwidthShares = settings.value("SharedCameras").toInt(&ok);
+    if (ok && bandwidthShares >= 1) m_bandwidthShares = bandwidthShares;
+
+    settings.endGroup();
+
+    // Streaming Section
+    readStreamingSection(settings);
+
+    // Threads Section
+    settings.beginGroup("Threads");
+    for (int i = 0; i < NumThreadTypes; ++i) {
+        const QString name = threadTypeName(ThreadType(i));
+        ThreadSettings &threadSettings = m_threadSettings[i];
+        QString cpus = settings.value(name + "Cpus").toString();
+        if (!parseCpuList(cpus, &threadSettings.cpus))
+            printError("Invalid CPU list for " + name + " thread.");
+        QByteArray policy = settings.value(name + "Policy").toByteArray();
+        if (!schedPolicyFromName(policy, &threadSettings.policy))
+            printError("Invalid scheduling policy for " + name + " thread.");
+        int priority = settings.value(name + "Priority").toInt(&ok);
+        if (ok) threadSettings.priority = priority;
+    }
+    settings.endGroup();
+
+    // Metrics Section
+    settings.beginGroup("Metrics");
+    m_metricsAddress = settings.value("Address").toString();
+    uint metricsPort = settings.value("Port").toUInt(&ok);
+    if (ok && metricsPort <= 65535)
+        m_metricsPort = quint16(metricsPort);
+    settings.endGroup();
+
+    // Replay Section
+    settings.beginGroup("Replay");
+    m_replayPath = settings.value("Path").toString();
+    double replaySpeed = settings.value("Speed").toDouble(&ok);
+    if (ok && replaySpeed >= 0)
+        m_replaySpeed = replaySpeed;
+    m_replayLoop = settings.value("Loop", true).toBool();
+    settings.endGroup();
+
+    // Recording Section
+    readRecordingSection(settings);
+
+    // Calibration Section
+    settings.beginGroup("Calibration");
+    m_calibrationEnabled = settings.value("Enabled", false).toBool();
+    m_calibrationDirectory = settings.value("Directory").toString();
+    m_darkFileName = settings.value("DarkFile").toString();
+    m_flatFileName = settings.value("FlatFile").toString();
+    m_defectFileName = settings.value("DefectFile").toString();
+    QByteArray defectMode = settings.value("DefectCorrection").toByteArray()
+            .toLower();
+    if (!defectMode.isEmpty() &&
+            !FrameCalibrator::defectModeFromName(defectMode, &m_defectMode))
+        printError("Invalid defect correction mode.");
+    double defectThreshold = settings.value("DefectThreshold").toDouble(&ok);
+    if (ok && defectThreshold > 0)
+        m_defectThreshold = defectThreshold;
+    settings.endGroup();
+
+    // Tracking Section
+    readTrackingSection(settings);
+
+    // AutoExposure Section
+    readAutoExposureSection(settings);
+
+    // Misc Section
+    settings.beginGroup("Misc");
+    int statusInterval = settings.value("StatusInterval").toInt(&ok);
+    if (ok && statusInterval >= 0)
+        m_statusInterval = statusInterval;
+    m_markerEnabled = settings.value("Marker").toBool();
+    if (settings.contains("MarkerPosX") && settings.contains("MarkerPosY")) {
+        bool ok1, ok2;
+        double markerPosX = settings.value("MarkerPosX").toDouble(&ok1);
+        double markerPosY = settings.value("MarkerPosY").toDouble(&ok2);
+        if (ok1 && ok2) {
+            m_markerPos = QPointF(markerPosX, markerPosY);
+            m_markerCentering = false;
+        }
+    }
+    updateMarkerPos();
+
+    QString frameInfoLogDir = settings.value("FrameInfoLogDir").toString();
+    m_frameInfoDirPath = frameInfoLogDir.isEmpty() ?
+                qApp->applicationDirPath() : frameInfoLogDir;
+    m_frameInfoLogEnabled = settings.value("FrameInfoLog", false).toBool();
+    int frameInfoRingSize = settings.value("FrameInfoRingSize").toInt(&ok);
+    if (ok && frameInfoRingSize > 0)
+        m_frameInfoLog->setRingSize(frameInfoRingSize);
+    settings.endGroup();
+}
+
+// The sections which can be reloaded while the server is running, see
+// reloadConfig().
+void SjcServer::readCamAttrSection(QSettings &settings)
+{
     settings.beginGroup("CamAttr");
     m_camAttrList.clear();
     foreach (QString key, settings.allKeys()) {
@@ -267,66 +753,361 @@ void SjcServer::loadConfigFile()
             m_camAttrList.append(attr);
     }
     settings.endGroup();
+}
 
-    // Streaming Section
+void SjcServer::readStreamingSection(QSettings &settings)
+{
+    bool ok;
     settings.beginGroup("Streaming");
     uint streamingPort = settings.value("ServerPort").toUInt(&ok);
     if (ok && streamingPort <= 65535)
         m_streamingPort = quint16(streamingPort);
     settings.endGroup();
+}
 
-    // Recording Section
+void SjcServer::readRecordingSection(QSettings &settings)
+{
+    bool ok;
     settings.beginGroup("Recording");
     m_outputFileNamePrefix = settings.value("FileNamePrefix").toString();
     if (m_outputFileNamePrefix.isEmpty())
         m_outputFileNamePrefix = m_deviceName;
     m_outputDirectory = settings.value("Directory").toString();
     m_telescopeName = settings.value("TelescopeName").toByteArray();
+    int preTriggerFrames = settings.value("PreTriggerFrames").toInt(&ok);
+    if (ok && preTriggerFrames >= 0)
+        m_preTriggerFrames = preTriggerFrames;
+    double preTriggerSeconds = settings.value("PreTriggerSeconds")
+            .toDouble(&ok);
+    if (ok && preTriggerSeconds >= 0)
+        m_preTriggerSeconds = preTriggerSeconds;
+    m_preTriggerCompressed = settings.value("PreTriggerCompression",
+                                            false).toBool();
+    int selectKeep = settings.value("SelectKeep").toInt(&ok);
+    if (ok && selectKeep >= 0)
+        m_selectKeep = selectKeep;
+    int selectWindow = settings.value("SelectWindow").toInt(&ok);
+    if (ok && selectWindow >= 0)
+        m_selectWindow = selectWindow;
+    FrameSelector::Metric selectMetric = FrameSelector::GradientEnergy;
+    QByteArray selectMetricName = settings.value("SelectMetric")
+            .toByteArray().toLower();
+    if (FrameSelector::metricFromName(selectMetricName, &selectMetric))
+        m_selectMetric = selectMetricName;
+    int coaddFrames = settings.value("CoaddFrames").toInt(&ok);
+    if (ok && coaddFrames >= 0 && coaddFrames <= 65536)
+        m_coaddFrames = coaddFrames;
+    m_coaddAverage = (settings.value("CoaddMode").toString() == "average");
+    int burstMemory = settings.value("BurstMemory").toInt(&ok);
+    if (ok && burstMemory >= 0)
+        m_burstMemory = burstMemory;
     settings.endGroup();
+}
 
-    // Misc Section
-    settings.beginGroup("Misc");
-    m_markerEnabled = settings.value("Marker").toBool();
-    if (settings.contains("MarkerPosX") && settings.contains("MarkerPosY")) {
-        bool ok1, ok2;
-        double markerPosX = settings.value("MarkerPosX").toDouble(&ok1);
-        double markerPosY = settings.value("MarkerPosY").toDouble(&ok2);
-        if (ok1 && ok2) {
-            m_markerPos = QPointF(markerPosX, markerPosY);
-            m_markerCentering = false;
-        }
+void SjcServer::readTrackingSection(QSettings &settings)
+{
+    bool ok;
+    settings.beginGroup("Tracking");
+    QByteArray mode = settings.value("Mode").toByteArray().toLower();
+    if (!mode.isEmpty() && !MotionTracker::modeFromName(mode,
+                                                        &m_trackingMode))
+        printError("Invalid tracking mode.");
+    QStringList roi = settings.value("Roi").toStringList();
+    if (roi.size() == 4) {
+        int values[4];
+        bool roiOk = true;
+        for (int i = 0; i < 4 && roiOk; ++i)
+            values[i] = roi[i].trimmed().toInt(&roiOk);
+        if (roiOk)
+            m_trackingRoi = QRect(values[0], values[1], values[2], values[3]);
+        else
+            printError("Invalid tracking ROI.");
     }
-    QVariant markerPos = m_markerEnabled ? m_markerPos : QVariant();
-    QMetaObject::invokeMethod(m_imageWriter, "setMarkerPos",
-            Q_ARG(QVariant, markerPos));
+    double threshold = settings.value("Threshold").toDouble(&ok);
+    if (ok && threshold >= 0 && threshold <= 1)
+        m_trackingThreshold = threshold;
+    int maxShift = settings.value("MaxShift").toInt(&ok);
+    if (ok && maxShift >= 1)
+        m_trackingMaxShift = maxShift;
+    uint trackingPort = settings.value("ServerPort").toUInt(&ok);
+    if (ok && trackingPort <= 65535)
+        m_trackingPort = quint16(trackingPort);
+    settings.endGroup();
+}
 
-    QString frameInfoLogDir = settings.value("FrameInfoLogDir").toString();
-    m_frameInfoDirPath = frameInfoLogDir.isEmpty() ?
-                qApp->applicationDirPath() : frameInfoLogDir;
-    if (settings.value("FrameInfoLog", false).toBool())
-        createFrameInfoLogFile();
+void SjcServer::readAutoExposureSection(QSettings &settings)
+{
+    bool ok1, ok2;
+    settings.beginGroup("AutoExposure");
+    m_autoExposureEnabled = settings.value("Enabled", false).toBool();
+    double percentile = settings.value("Percentile").toDouble(&ok1);
+    if (!ok1) percentile = m_autoExposure.percentile();
+    double level = settings.value("Level").toDouble(&ok2);
+    if (!ok2) level = m_autoExposure.level();
+    m_autoExposure.setTarget(percentile, level);
+    double maxSaturation = settings.value("MaxSaturation").toDouble(&ok1);
+    if (ok1)
+        m_autoExposure.setMaxSaturation(maxSaturation);
+    double damping = settings.value("Damping").toDouble(&ok1);
+    if (ok1)
+        m_autoExposure.setDamping(damping);
+    uint minExposure = settings.value("MinExposure").toUInt(&ok1);
+    if (ok1)
+        m_autoExposureMin = minExposure;
+    uint maxExposure = settings.value("MaxExposure").toUInt(&ok2);
+    if (ok2)
+        m_autoExposureMax = maxExposure;
+    m_autoExposure.setLimits(m_autoExposureMin, m_autoExposureMax);
     settings.endGroup();
 }
 
+// Re-reads the [CamAttr], [Recording] and [Streaming] sections and applies
+// the settings which differ from the running state. The other sections are
+// only read at startup.
+bool SjcServer::reloadConfig()
+{
+    if (m_configFileName.isEmpty() || !isConfigFileReadable())
+        return false;
+
+    const QByteArray pixelFormat = m_recorder->pixelFormat();
+    const QList<NamedValue> camAttrList = m_camAttrList;
+    const QString prefix = m_outputFileNamePrefix;
+    const QString directory = m_outputDirectory;
+    const QByteArray telescopeName = m_telescopeName;
+    const int preTriggerFrames = m_preTriggerFrames;
+    const double preTriggerSeconds = m_preTriggerSeconds;
+    const bool preTriggerCompressed = m_preTriggerCompressed;
+    const int selectKeep = m_selectKeep;
+    const int selectWindow = m_selectWindow;
+    const QByteArray selectMetric = m_selectMetric;
+    const int coaddFrames = m_coaddFrames;
+    const bool coaddAverage = m_coaddAverage;
+    const int burstMemory = m_burstMemory;
+    const quint16 streamingPort = m_streamingPort;
+
+    QSettings settings(m_configFileName, QSettings::IniFormat);
+    settings.sync();
+    readCamAttrSection(settings);
+    readRecordingSection(settings);
+    readStreamingSection(settings);
+    QStringList changes;
+
+    // camera attributes; the frame buffers are only reallocated when the
+    // pixel format changes, which requires re-opening the camera. Only the
+    // entries which changed in the config file are applied, so that values
+    // set by DCP clients or the auto exposure are kept.
+    QByteArray newPixelFormat = "Mono16";
+    foreach (const NamedValue &attr, m_camAttrList)
+        if (attr.name == "PixelFormat")
+            newPixelFormat = attr.value.toByteArray();
+    if (m_recorder->isCameraOpen()) {
+        if (newPixelFormat != pixelFormat) {
+            bool capturing = m_recorder->isRunning();
+            closeCamera();
+            if (openCamera() && capturing)
+                startCapturing();
+            changes << "PixelFormat";
+        } else {
+            foreach (const NamedValue &attr, m_camAttrList) {
+                if (attr.name == "PixelFormat" ||
+                        containsConfigValue(camAttrList, attr))
+                    continue;
+                if (m_recorder->setAttribute(attr.name, attr.value))
+                    changes << QString(attr.name);
+            }
+        }
+        if (!changes.isEmpty()) {
+            m_exposureValue = 0;
+            sendCameraNotifications();
+        }
+    }
+
+    // recording settings
+    if (m_outputFileNamePrefix != prefix || m_outputDirectory != directory
+            || m_telescopeName != telescopeName) {
+        QString calibrationDirectory = m_calibrationDirectory.isEmpty() ?
+                    m_outputDirectory : m_calibrationDirectory;
+        QMetaObject::invokeMethod(m_imageWriter, "setFileNamePrefix",
+                Q_ARG(QString, m_outputFileNamePrefix));
+        QMetaObject::invokeMethod(m_imageWriter, "setDirectory",
+                Q_ARG(QString, m_outputDirectory));
+        QMetaObject::invokeMethod(m_imageWriter, "setTelescopeName",
+                Q_ARG(QByteArray, m_telescopeName));
+        QMetaObject::invokeMethod(m_frameCalibrator, "setFileNamePrefix",
+                Q_ARG(QString, m_outputFileNamePrefix));
+        QMetaObject::invokeMethod(m_frameCalibrator, "setDirectory",
+                Q_ARG(QString, calibrationDirectory));
+        changes << "output";
+    }
+    if (m_preTriggerFrames != preTriggerFrames ||
+            m_preTriggerSeconds != preTriggerSeconds ||
+            m_preTriggerCompressed != preTriggerCompressed) {
+        QMetaObject::invokeMethod(m_imageWriter, "setPreTrigger",
+                Q_ARG(int, m_preTriggerFrames),
+                Q_ARG(int, qRound(1000 * m_preTriggerSeconds)),
+                Q_ARG(bool, m_preTriggerCompressed));
+        changes << "pretrigger";
+    }
+    if (m_selectKeep != selectKeep || m_selectWindow != selectWindow ||
+            m_selectMetric != selectMetric) {
+        FrameSelector::Metric metric = FrameSelector::GradientEnergy;
+        FrameSelector::metricFromName(m_selectMetric, &metric);
+        QMetaObject::invokeMethod(m_imageWriter, "setFrameSelection",
+                Q_ARG(int, m_selectKeep), Q_ARG(int, m_selectWindow),
+                Q_ARG(int, int(metric)));
+        changes << "selectframes";
+    }
+    if (m_coaddFrames != coaddFrames || m_coaddAverage != coaddAverage) {
+        QMetaObject::invokeMethod(m_imageWriter, "setCoadding",
+                Q_ARG(int, m_coaddFrames), Q_ARG(bool, m_coaddAverage));
+        changes << "coadd";
+    }
+    if (m_burstMemory != burstMemory) {
+        if (m_burstRemaining > 0 || m_burstWriting) {
+            printError("Cannot resize the burst buffer during a burst.");
+            m_burstMemory = burstMemory;
+        } else {
+            m_burstPool.release();
+            if (m_burstMemory > 0 && m_recorder->isCameraOpen()) {
+                int bufferSize = int(m_recorder->bufferSize());
+                m_burstPool.allocate(int(qint64(m_burstMemory) * 1024 * 1024
+                                         / bufferSize), bufferSize);
+            }
+            changes << "burst";
+        }
+    }
+
+    // streaming server; connected clients are kept when the port changes
+    if (m_streamingPort != 0 && m_streamingPort != streamingPort) {
+        bool ok = false;
+        QMetaObject::invokeMethod(m_imageStreamer, "listen",
+                                  Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, ok),
+                                  Q_ARG(quint16, m_streamingPort));
+        if (ok)
+            changes << "streaming port";
+        else
+            m_streamingPort = streamingPort;
+    } else {
+        m_streamingPort = streamingPort;
+    }
+
+    cout << "Config file reloaded";
+    if (!changes.isEmpty())
+        cout << " [" << changes.join(", ") << "]";
+    cout << "." << endl;
+    invalidateStatus();
+    return true;
+}
+
 void SjcServer::sendMessage(const Dcp::Message &message)
 {
-    if (verbose())
+    if (debug())
         cout << message << endl;
     m_dcp->sendMessage(message);
 }
 
 void SjcServer::sendNotification(const QByteArray &data)
 {
-    foreach (const QByteArray &deviceName, m_clientMap.keys()) {
-        if (verbose())
-            cout << m_dcp->sendMessage(deviceName, data) << endl;
-        else
-            m_dcp->sendMessage(deviceName, data);
+    if (m_clientMap.isEmpty())
+        return;
+
+    // other clients receive every notification without delay
+    foreach (const QByteArray &deviceName, m_clientMap.keys())
+        if (!m_batchClients.contains(deviceName))
+            sendToClient(deviceName, data);
+    if (m_batchClients.isEmpty())
+        return;
+
+    // notifications are collected for m_notifyDelay milliseconds for batch
+    // clients; a newer state notification replaces a pending one with the
+    // same identifier, while events like framewritten are all kept
+    const QByteArray identifier = data.split(' ').value(1);
+    if (!isEventNotification(identifier)) {
+        for (int i = 0; i < m_pendingNotifications.size(); ++i) {
+            if (m_pendingNotifications[i].first == identifier) {
+                m_pendingNotifications.removeAt(i);
+                break;
+            }
+        }
+    }
+    m_pendingNotifications << qMakePair(identifier, data);
+
+    if (m_notifyDelay == 0)
+        flushNotifications();
+    else if (!m_notifyTimer->isActive())
+        m_notifyTimer->start(m_notifyDelay);
+}
+
+void SjcServer::sendCameraNotifications()
+{
+    if (m_clientMap.isEmpty())
+        return;
+
+    QByteArray arg;
+    if (m_recorder->isCameraOpen())
+        arg = m_recorder->isRunning() ? "capturing" : "opened";
+    else
+        arg = "closed";
+    sendNotification("set camerastate " + arg);
+
+    if (arg != "closed") {
+        bool ok;
+        QVariant value;
+        if (m_recorder->getAttribute("ExposureValue", &value)) {
+            arg = QByteArray::number(value.toUInt(&ok));
+            if (ok) sendNotification("set exposure " + arg);
+        }
+        if (m_recorder->getAttribute("FrameRate", &value)) {
+            arg = QByteArray::number(value.toFloat(&ok), 'f', 3);
+            if (ok) sendNotification("set framerate " + arg);
+        }
+        if (m_recorder->getAttribute("FrameStartTriggerMode", &value)) {
+            arg = value.toByteArray();
+            if (arg == "FixedRate" || arg == "SyncIn1"
+                    || arg == "SyncIn2") {
+                sendNotification("set triggermode " + arg.toLower());
+            }
+        }
+    }
+}
+
+void SjcServer::flushNotifications()
+{
+    if (m_pendingNotifications.isEmpty())
+        return;
+
+    // set batch <identifier> [<args>] ( ; <identifier> [<args>] )...
+    QByteArray batch = m_pendingNotifications.first().second;
+    if (m_pendingNotifications.size() > 1) {
+        batch = "set batch";
+        for (int i = 0; i < m_pendingNotifications.size(); ++i) {
+            batch += (i == 0) ? " " : " ; ";
+            batch += m_pendingNotifications[i].second.mid(4);
+        }
     }
+
+    foreach (const QByteArray &deviceName, m_batchClients)
+        sendToClient(deviceName, batch);
+    m_pendingNotifications.clear();
+}
+
+void SjcServer::sendToClient(const QByteArray &deviceName,
+                             const QByteArray &data)
+{
+    if (debug())
+        cout << m_dcp->sendMessage(deviceName, data) << endl;
+    else
+        m_dcp->sendMessage(deviceName, data);
 }
 
-void SjcServer::addClient(const QByteArray &deviceName)
+void SjcServer::addClient(const QByteArray &deviceName, bool batch)
 {
+    if (batch)
+        m_batchClients.insert(deviceName);
+    else
+        m_batchClients.remove(deviceName);
+
     if (!m_clientMap.contains(deviceName)) {
         QElapsedTimer timer;
         timer.start();
@@ -338,6 +1119,7 @@ void SjcServer::addClient(const QByteArray &deviceName)
 
 void SjcServer::removeClient(const QByteArray &deviceName)
 {
+    m_batchClients.remove(deviceName);
     if (m_clientMap.contains(deviceName)) {
         m_clientMap.remove(deviceName);
         cout << "Removed client '" << deviceName
@@ -353,75 +1135,288 @@ void SjcServer::updateClientMap()
         if (iter.value().hasExpired(m_clientTimeout)) {
             cout << "Removed client '" << iter.key()
                  << "' from the notification list (timeout)." << endl;
+            m_batchClients.remove(iter.key());
             iter.remove();
         }
     }
 }
 
-bool SjcServer::createFrameInfoLogFile()
+void SjcServer::printStatus()
 {
-    if (m_frameInfoLogFile)
-        return false;
-    QDateTime now = QDateTime::currentDateTimeUtc();
-    QString fileName = m_deviceName + "_frameinfo_"
-            + now.toString("yyyyMMdd-hhmmsszzz") + ".txt";
-    m_frameInfoLogFile = new QFile(
-            QDir(m_frameInfoDirPath).absoluteFilePath(fileName));
-    if (!m_frameInfoLogFile->open(QIODevice::WriteOnly | QIODevice::Text)) {
-        delete m_frameInfoLogFile;
-        m_frameInfoLogFile = 0;
-        return false;
+    if (!verbose() || !m_recorder->isRunning()) {
+        m_statusReporter.reset();
+        return;
     }
-    m_frameInfoLogFile->write(
-        "# id  count  status  timestamp  readoutTimestamp  readoutTimeMs\n");
-    return true;
+    if (debug())
+        cout << "\n";
+    cout << m_statusReporter.report() << endl;
 }
 
-void SjcServer::writeFrameInfoLog(const FrameInfo &info)
+void SjcServer::tuneBuffers()
 {
-    if (!m_frameInfoLogFile)
+    const int numBuffers = m_recorder->numBuffers() - m_buffersToRelease;
+    int target = m_bufferTuner.evaluate(numBuffers, m_recorder->bufferSize());
+
+    if (m_bufferTuner.lastDropped() > 0)
+        printInfo(QString("Camera dropped %1 frames [%2/%3 buffers in use].")
+                  .arg(m_bufferTuner.lastDropped())
+                  .arg(m_bufferTuner.lastHighWater()).arg(numBuffers));
+
+    if (!m_adaptiveBuffers || target == numBuffers)
         return;
-    QTextStream os(m_frameInfoLogFile);
-    os << info.id << "  " << info.count << "  " << info.status << "  "
-       << info.timestamp << "  " << info.readoutTimestamp << "  "
-       << info.readoutTimeMs << endl;
+
+    if (target > numBuffers) {
+        // cancel pending releases before allocating new buffers
+        int numNew = target - numBuffers;
+        int numKept = qMin(numNew, m_buffersToRelease);
+        m_buffersToRelease -= numKept;
+        if (numNew > numKept)
+            m_recorder->addFrames(numNew - numKept);
+    } else {
+        // buffers are released when they are returned by the pipeline
+        m_buffersToRelease += numBuffers - target;
+    }
+
+    printInfo(QString("Frame buffers changed: %1 -> %2 [high water %3, "
+                      "max consumer latency %4 ms].")
+              .arg(numBuffers).arg(target)
+              .arg(m_bufferTuner.lastHighWater())
+              .arg(m_bufferTuner.lastMaxLatency() / 1000));
 }
 
-void SjcServer::printInfo(const QString &infoString)
+void SjcServer::finishBurst()
 {
-    cout << infoString << endl;
+    m_burstRemaining = 0;
+    StoredFrameList frames = m_burstPool.takeAll();
+    cout << "Burst finished [" << frames.size() << " frames]." << endl;
+    m_burstWriting = true;
+    m_storedWriting = true;
+    QMetaObject::invokeMethod(m_imageWriter, "writeStoredFrames",
+                              Q_ARG(StoredFrameList, frames));
 }
 
-void SjcServer::printError(const QString &errorString)
+QByteArray SjcServer::calibrationState() const
 {
-    cout << "Error: " << errorString << endl;
+    QByteArray enabled = m_calibrationEnabled ? "true" : "false";
+    QByteArray darkFileName = m_darkFileName.isEmpty() ?
+                "-" : m_darkFileName.toLocal8Bit();
+    QByteArray flatFileName = m_flatFileName.isEmpty() ?
+                "-" : m_flatFileName.toLocal8Bit();
+    return enabled + " " + darkFileName + " " + flatFileName;
 }
 
-void SjcServer::dcpError(Dcp::Client::Error error)
+QByteArray SjcServer::defectState() const
 {
-    Q_UNUSED(error);
-    cout << "DCP Error: " << m_dcp->errorString() << "." << endl;
+    QByteArray fileName = m_defectFileName.isEmpty() ?
+                "-" : m_defectFileName.toLocal8Bit();
+    return FrameCalibrator::defectModeName(m_defectMode) + " " + fileName
+            + " " + QByteArray::number(m_numDefects);
 }
 
-void SjcServer::dcpStateChanged(Dcp::Client::State state)
+QByteArray SjcServer::statusReply()
 {
-    switch (state)
-    {
-    case Dcp::Client::HostLookupState:
-        cout << "Connecting to DCP server [" << m_dcp->serverName() << ":"
-             << m_dcp->serverPort() << "]..." << endl;
-        break;
-    case Dcp::Client::ConnectedState:
-        cout << "Connected to DCP server [" << m_dcp->deviceName()
-             << "@" << m_dcp->serverName() << ":" << m_dcp->serverPort()
-             << "]." << endl;
-        if (verbose())
-            cout << "Local IP address for DCP connection: "
-                 << m_dcp->localAddress().toString() << endl;
-        break;
-    case Dcp::Client::UnconnectedState:
-        cout << "Disconnected from DCP server." << endl;
-        break;
+    if (m_statusValid)
+        return m_status;
+
+    QList<QByteArray> fields;
+    const bool open = m_recorder->isCameraOpen();
+    if (open)
+        fields << (m_recorder->isRunning() ? "capturing" : "opened");
+    else
+        fields << "closed";
+    fields << m_dcp->localAddress().toString().toAscii()
+           << QByteArray::number(m_streamingPort);
+
+    if (open) {
+        CameraInfo info = m_recorder->cameraInfo();
+        fields << m_deviceName
+               << QByteArray::number(uint(info.pvCameraInfo.UniqueId))
+               << QByteArray::number(info.sensorWidth)
+               << QByteArray::number(info.sensorHeight)
+               << QByteArray::number(info.sensorBits);
+    } else {
+        fields << "-" << "-" << "-" << "-" << "-";
+    }
+
+    QVariant value, min, max;
+    QByteArray mode = "-";
+    if (open && m_recorder->getAttribute("FrameStartTriggerMode", &value)) {
+        mode = value.toByteArray();
+        if (mode == "FixedRate" || mode == "SyncIn1" || mode == "SyncIn2")
+            mode = mode.toLower();
+    }
+    fields << mode;
+
+    if (open && m_recorder->getAttribute("ExposureValue", &value) &&
+            value.canConvert(QVariant::UInt))
+        fields << QByteArray::number(value.toUInt());
+    else
+        fields << "-";
+    if (open && m_recorder->getAttributeRange("ExposureValue", &min, &max))
+        fields << QByteArray::number(min.toUInt())
+               << QByteArray::number(max.toUInt());
+    else
+        fields << "-" << "-";
+
+    if (open && m_recorder->getAttribute("FrameRate", &value) &&
+            value.canConvert(QVariant::Double))
+        fields << QByteArray::number(value.toFloat(), 'f', 3);
+    else
+        fields << "-";
+    if (open && m_recorder->getAttributeRange("FrameRate", &min, &max))
+        fields << QByteArray::number(min.toFloat(), 'f', 3)
+               << QByteArray::number(max.toFloat(), 'f', 3);
+    else
+        fields << "-" << "-";
+
+    fields << (m_markerEnabled ? "true" : "false")
+           << QByteArray::number(m_markerPos.x())
+           << QByteArray::number(m_markerPos.y());
+
+    m_status.clear();
+    foreach (const QByteArray &field, fields) {
+        if (!m_status.isEmpty())
+            m_status += ' ';
+        m_status += field;
+    }
+    m_statusValid = true;
+    return m_status;
+}
+
+void SjcServer::returnFrame(tPvFrame *frame)
+{
+    FrameTrace *trace = frameTrace(frame);
+    if (trace) {
+        trace->stamps[FrameTrace::BufferReturned] = monotonicUsecs();
+        if (trace->stamps[FrameTrace::Dispatched] != 0)
+            m_bufferTuner.frameReturned(
+                        trace->stamps[FrameTrace::BufferReturned] -
+                        trace->stamps[FrameTrace::Dispatched]);
+        bool tracing = m_pipelineStats.isTracing();
+        m_pipelineStats.addFrame(frame->FrameCount, *trace);
+        if (tracing && !m_pipelineStats.isTracing())
+            cout << "Pipeline trace written." << endl;
+        trace->clear();
+    }
+    serverMetrics.buffersInFlight.decrement();
+    --m_buffersInFlight;
+
+    // free buffers if the adaptive mode shrinks the pool
+    if (m_buffersToRelease > 0) {
+        --m_buffersToRelease;
+        m_recorder->releaseFrame(frame);
+    } else {
+        m_recorder->enqueueFrame(frame);
+    }
+}
+
+// The motion measurements are logged to a second file with the same time
+// stamp in its name.
+bool SjcServer::startFrameInfoLog()
+{
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QString suffix = now.toString("yyyyMMdd-hhmmsszzz") + ".dat";
+    QDir dir(m_frameInfoDirPath);
+    bool ok = false;
+    QMetaObject::invokeMethod(m_frameInfoLog, "startLogging",
+            Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok),
+            Q_ARG(QString, dir.absoluteFilePath(
+                      m_deviceName + "_frameinfo_" + suffix)));
+    if (ok)
+        QMetaObject::invokeMethod(m_motionTracker, "startLogging",
+                Q_ARG(QString, dir.absoluteFilePath(
+                          m_deviceName + "_motion_" + suffix)));
+    return ok;
+}
+
+void SjcServer::stopFrameInfoLog()
+{
+    QMetaObject::invokeMethod(m_frameInfoLog, "stopLogging");
+    QMetaObject::invokeMethod(m_motionTracker, "stopLogging");
+}
+
+void SjcServer::updateMarkerPos()
+{
+    QVariant markerPos = m_markerEnabled ? m_markerPos : QVariant();
+    QMetaObject::invokeMethod(m_imageWriter, "setMarkerPos",
+            Q_ARG(QVariant, markerPos));
+    QMetaObject::invokeMethod(m_motionTracker, "setMarkerPos",
+            Q_ARG(QVariant, markerPos));
+}
+
+QByteArray SjcServer::motionString(const MotionInfo &info) const
+{
+    return QByteArray::number(quint64(info.count)) + " "
+            + MotionTracker::statusName(info.status) + " "
+            + QByteArray::number(info.dx, 'f', 2) + " "
+            + QByteArray::number(info.dy, 'f', 2);
+}
+
+// Runs the exposure control on a frame before it is passed to the
+// calibrator. The exposure value and its range are only read from the
+// camera when the cached value was invalidated.
+// The new exposure value is set by the capture thread before the next frame,
+// the main thread uses the cached exposure value and range.
+void SjcServer::applyAutoExposure(const tPvFrame *frame)
+{
+    if (m_exposureValue == 0) {
+        m_exposureValue = m_recorder->exposureValue();
+        if (m_exposureValue == 0 || m_exposureMax == 0) {
+            m_autoExposureEnabled = false;
+            printError("Auto exposure disabled.");
+            sendNotification("set autoexposure false");
+            return;
+        }
+        m_autoExposure.setLimits(qMax(m_autoExposureMin, m_exposureMin),
+                                 qMin(m_autoExposureMax, m_exposureMax));
+        m_autoExposure.reset();
+    }
+
+    quint32 exposure;
+    if (!m_autoExposure.processFrame(frame, m_exposureValue, &exposure))
+        return;
+    m_recorder->setPendingExposure(exposure);
+    m_exposureValue = exposure;
+    invalidateStatus();
+    sendNotification("set exposure " + QByteArray::number(exposure));
+}
+
+void SjcServer::printInfo(const QString &infoString)
+{
+    cout << infoString << endl;
+}
+
+void SjcServer::printError(const QString &errorString)
+{
+    cout << "Error: " << errorString << endl;
+}
+
+void SjcServer::dcpError(Dcp::Client::Error error)
+{
+    Q_UNUSED(error);
+    cout << "DCP Error: " << m_dcp->errorString() << "." << endl;
+}
+
+void SjcServer::dcpStateChanged(Dcp::Client::State state)
+{
+    switch (state)
+    {
+    case Dcp::Client::HostLookupState:
+        cout << "Connecting to DCP server [" << m_dcp->serverName() << ":"
+             << m_dcp->serverPort() << "]..." << endl;
+        break;
+    case Dcp::Client::ConnectedState:
+        cout << "Connected to DCP server [" << m_dcp->deviceName()
+             << "@" << m_dcp->serverName() << ":" << m_dcp->serverPort()
+             << "]." << endl;
+        invalidateStatus();
+        if (verbose())
+            cout << "Local IP address for DCP connection: "
+                 << m_dcp->localAddress().toString() << endl;
+        break;
+    case Dcp::Client::UnconnectedState:
+        cout << "Disconnected from DCP server." << endl;
+        break;
     default:
         break;
     }
@@ -429,9 +1424,11 @@ void SjcServer::dcpStateChanged(Dcp::Client::State state)
 
 void SjcServer::dcpMessageReceived()
 {
+    ScopedLatencyTimer timer(&serverMetrics.dcpCommandUsecs,
+                             &serverMetrics.dcpCommandCount);
     Dcp::Message msg = m_dcp->readMessage();
 
-    if (verbose())
+    if (debug())
         cout << msg << endl;
 
     // ignore reply messages
@@ -448,824 +1445,1418 @@ void SjcServer::dcpMessageReceived()
         m_clientMap[msg.source()].restart();
 
     const Dcp::CommandParser::CmdType cmdType = m_command.cmdType();
-    const QByteArray identifier = m_command.identifier();
+    const QByteArray key = (cmdType == Dcp::CommandParser::SetCmd ? "set "
+                                                                  : "get ")
+                           + m_command.identifier();
+    QHash<QByteArray, DcpCommand>::const_iterator cmd =
+            m_dcpCommands.constFind(key);
+    if (cmd == m_dcpCommands.constEnd()) {
+        sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+        return;
+    }
+    if (!cmd->acceptsArguments(m_command.arguments())) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    // any set command may change the state reported by "get status"
     if (cmdType == Dcp::CommandParser::SetCmd)
+        invalidateStatus();
+
+    (this->*cmd->handler)(msg);
+}
+
+void SjcServer::addDcpCommand(const QByteArray &key, DcpHandler handler,
+                              const QByteArray &argSpec)
+{
+    DcpCommand cmd;
+    cmd.handler = handler;
+    cmd.argSpecs = argSpec.split(' ');
+    cmd.argSpecs.removeAll(QByteArray());
+    cmd.minArgs = 0;
+    while (cmd.minArgs < cmd.argSpecs.size() &&
+           !cmd.argSpecs[cmd.minArgs].endsWith('?'))
+        ++cmd.minArgs;
+    m_dcpCommands.insert(key, cmd);
+}
+
+// argument specifications: int, uint, float, bool (true, false, 1, 0),
+// any or a list of choices separated by "|"; a trailing "?" marks an
+// optional argument, optional arguments must follow the required ones
+bool SjcServer::DcpCommand::acceptsArguments(
+        const QList<QByteArray> &args) const
+{
+    if (args.size() < minArgs || args.size() > argSpecs.size())
+        return false;
+
+    for (int i = 0; i < args.size(); ++i)
     {
-        // set nop
-        //     returns: FIN
-        if (identifier == "nop")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            sendMessage(msg.replyMessage());
-            return;
-        }
+        QByteArray spec = argSpecs[i];
+        if (spec.endsWith('?'))
+            spec.chop(1);
+
+        bool ok = true;
+        if (spec == "any")
+            continue;
+        else if (spec == "int")
+            args[i].toLongLong(&ok);
+        else if (spec == "uint")
+            args[i].toUInt(&ok);
+        else if (spec == "float")
+            args[i].toDouble(&ok);
+        else if (spec == "bool")
+            ok = (args[i] == "true" || args[i] == "false" ||
+                  args[i] == "1" || args[i] == "0");
+        else
+            ok = spec.split('|').contains(args[i]);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
 
-        // set notify ( true | false )
-        //     returns: FIN
-        if (identifier == "notify")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+void SjcServer::registerDcpCommands()
+{
+    // the argument specifications are checked by acceptsArguments()
+    addDcpCommand("set nop", &SjcServer::dcpSetNop, "");
+    addDcpCommand("set notify", &SjcServer::dcpSetNotify, "true|false|batch");
+    addDcpCommand("set camera", &SjcServer::dcpSetCamera, "open|close");
+    addDcpCommand("set capturing", &SjcServer::dcpSetCapturing, "start|stop");
+    addDcpCommand("set triggermode", &SjcServer::dcpSetTriggermode,
+                  "fixedrate|syncin1|syncin2");
+    addDcpCommand("set exposure", &SjcServer::dcpSetExposure, "uint");
+    addDcpCommand("set framerate", &SjcServer::dcpSetFramerate, "float");
+    addDcpCommand("set writeframes", &SjcServer::dcpSetWriteframes,
+                  "int int?");
+    addDcpCommand("set pretrigger", &SjcServer::dcpSetPretrigger,
+                  "int float?");
+    addDcpCommand("set writepretrigger", &SjcServer::dcpSetWritepretrigger,
+                  "int int?");
+    addDcpCommand("set selectframes", &SjcServer::dcpSetSelectframes,
+                  "int int gradient|contrast?");
+    addDcpCommand("set coadd", &SjcServer::dcpSetCoadd, "int sum|average?");
+    addDcpCommand("set burst", &SjcServer::dcpSetBurst, "int");
+    addDcpCommand("set calibration", &SjcServer::dcpSetCalibration, "bool");
+    addDcpCommand("set darkfile", &SjcServer::dcpSetMasterFile, "any?");
+    addDcpCommand("set flatfile", &SjcServer::dcpSetMasterFile, "any?");
+    addDcpCommand("set builddark", &SjcServer::dcpSetBuildMaster, "int");
+    addDcpCommand("set buildflat", &SjcServer::dcpSetBuildMaster, "int");
+    addDcpCommand("set defectcorrection", &SjcServer::dcpSetDefectcorrection,
+                  "off|preview|on");
+    addDcpCommand("set defectfile", &SjcServer::dcpSetDefectfile, "any?");
+    addDcpCommand("set builddefects", &SjcServer::dcpSetBuilddefects,
+                  "int float?");
+    addDcpCommand("set pipelinetrace", &SjcServer::dcpSetPipelinetrace,
+                  "int any?");
+    addDcpCommand("set marker", &SjcServer::dcpSetMarker, "any any?");
+    addDcpCommand("set tracking", &SjcServer::dcpSetTracking,
+                  "off|centroid|correlation");
+    addDcpCommand("set trackingroi", &SjcServer::dcpSetTrackingroi,
+                  "uint uint uint uint");
+    addDcpCommand("set trackingthreshold", &SjcServer::dcpSetTrackingthreshold,
+                  "float");
+    addDcpCommand("set trackingreference",
+                  &SjcServer::dcpSetTrackingreference, "");
+    addDcpCommand("set autoexposure", &SjcServer::dcpSetAutoexposure, "bool");
+    addDcpCommand("set logframeinfo", &SjcServer::dcpSetLogframeinfo, "bool");
+    addDcpCommand("set reload", &SjcServer::dcpSetReload, "");
+    addDcpCommand("set verbose", &SjcServer::dcpSetVerbose,
+                  "true|false|debug|0|1|2");
+    addDcpCommand("set pvattr", &SjcServer::dcpSetPvattr, "any any?");
+
+    addDcpCommand("get notify", &SjcServer::dcpGetNotify, "");
+    addDcpCommand("get status", &SjcServer::dcpGetStatus, "");
+    addDcpCommand("get camerastate", &SjcServer::dcpGetCamerastate, "");
+    addDcpCommand("get triggermode", &SjcServer::dcpGetTriggermode, "");
+    addDcpCommand("get exposure", &SjcServer::dcpGetExposure, "");
+    addDcpCommand("get exposure_range", &SjcServer::dcpGetExposureRange, "");
+    addDcpCommand("get framerate", &SjcServer::dcpGetFramerate, "");
+    addDcpCommand("get framerate_range", &SjcServer::dcpGetFramerateRange, "");
+    addDcpCommand("get framestats", &SjcServer::dcpGetFramestats, "");
+    addDcpCommand("get network", &SjcServer::dcpGetNetwork, "");
+    addDcpCommand("get marker", &SjcServer::dcpGetMarker, "");
+    addDcpCommand("get pretrigger", &SjcServer::dcpGetPretrigger, "");
+    addDcpCommand("get selectframes", &SjcServer::dcpGetSelectframes, "");
+    addDcpCommand("get coadd", &SjcServer::dcpGetCoadd, "");
+    addDcpCommand("get burst", &SjcServer::dcpGetBurst, "");
+    addDcpCommand("get calibration", &SjcServer::dcpGetCalibration, "");
+    addDcpCommand("get defectcorrection", &SjcServer::dcpGetDefectcorrection,
+                  "");
+    addDcpCommand("get tracking", &SjcServer::dcpGetTracking, "");
+    addDcpCommand("get motion", &SjcServer::dcpGetMotion, "");
+    addDcpCommand("get autoexposure", &SjcServer::dcpGetAutoexposure, "");
+    addDcpCommand("get logframeinfo", &SjcServer::dcpGetLogframeinfo, "");
+    addDcpCommand("get pipelinestats", &SjcServer::dcpGetPipelinestats, "");
+    addDcpCommand("get clockmodel", &SjcServer::dcpGetClockmodel, "");
+    addDcpCommand("get threads", &SjcServer::dcpGetThreads, "");
+    addDcpCommand("get frameinfo", &SjcServer::dcpGetFrameinfo, "int int?");
+    addDcpCommand("get streaminghost", &SjcServer::dcpGetStreaminghost, "");
+    addDcpCommand("get camerainfo", &SjcServer::dcpGetCamerainfo, "");
+    addDcpCommand("get version", &SjcServer::dcpGetVersion, "");
+    addDcpCommand("get pvversion", &SjcServer::dcpGetPvversion, "");
+    addDcpCommand("get verbose", &SjcServer::dcpGetVerbose, "");
+    addDcpCommand("get clients", &SjcServer::dcpGetClients, "");
+    addDcpCommand("get connections", &SjcServer::dcpGetConnections, "");
+    addDcpCommand("get pvattr", &SjcServer::dcpGetPvattr, "any");
+
+    // the roi, maximagesize and binning commands are not implemented yet,
+    // see misc/dcp-commands.txt
+}
 
-            QByteArray arg = m_command.arguments()[0];
-            if (arg == "true") {
-                sendMessage(msg.ackMessage());
-                addClient(msg.source());
-                sendMessage(msg.replyMessage());
-            }
-            else if (arg == "false") {
-                sendMessage(msg.ackMessage());
-                removeClient(msg.source());
-                sendMessage(msg.replyMessage());
-            }
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            return;
-        }
+// set nop
+//     returns: FIN
+void SjcServer::dcpSetNop(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage());
+}
 
-        // set camera ( open | close )
-        //     errcodes: 1 -> cannot open/close camera
-        if (identifier == "camera")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set notify ( true | false | batch )
+//     returns: FIN
+//     note: batch clients receive coalesced notifications as a single
+//           "set batch" message; events like framewritten are not
+//           coalesced, other clients receive every notification at once
+void SjcServer::dcpSetNotify(const Dcp::Message &msg)
+{
+    QByteArray arg = m_command.arguments()[0];
+    sendMessage(msg.ackMessage());
+    if (arg == "false")
+        removeClient(msg.source());
+    else
+        addClient(msg.source(), arg == "batch");
+    sendMessage(msg.replyMessage());
+}
 
-            bool open;
-            QByteArray arg = m_command.arguments()[0];
-            if (arg == "open")
-                open = true;
-            else if (arg == "close")
-                open = false;
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set camera ( open | close )
+//     errcodes: 1 -> cannot open/close camera
+void SjcServer::dcpSetCamera(const Dcp::Message &msg)
+{
+    bool open;
+    QByteArray arg = m_command.arguments()[0];
+    if (arg == "open")
+        open = true;
+    else if (arg == "close")
+        open = false;
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
 
-            if (open && m_recorder->isCameraOpen()) {
-                sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            bool ok = open ? openCamera() : closeCamera();
-            sendMessage(msg.replyMessage(QByteArray(), ok ? 0 : 1));
-
-            // send notifications
-            if (!m_clientMap.isEmpty())
-            {
-                QByteArray arg;
-                if (m_recorder->isCameraOpen())
-                    arg = m_recorder->isRunning() ? "capturing" : "opened";
-                else
-                    arg = "closed";
-                sendNotification("set camerastate " + arg);
-
-                if (arg != "closed") {
-                    bool ok;
-                    QVariant value;
-                    if (m_recorder->getAttribute("ExposureValue", &value)) {
-                        arg = QByteArray::number(value.toUInt(&ok));
-                        if (ok) sendNotification("set exposure " + arg);
-                    }
-                    if (m_recorder->getAttribute("FrameRate", &value)) {
-                        arg = QByteArray::number(value.toFloat(&ok), 'f', 3);
-                        if (ok) sendNotification("set framerate " + arg);
-                    }
-                    if (m_recorder->getAttribute("FrameStartTriggerMode", &value)) {
-                        arg = value.toByteArray();
-                        if (arg == "FixedRate" || arg == "SyncIn1"
-                                || arg == "SyncIn2") {
-                            sendNotification("set triggermode " + arg.toLower());
-                        }
-                    }
-                }
-            }
-            return;
-        }
+    if (open && m_recorder->isCameraOpen()) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
 
-        // set capturing ( start | stop )
-        //     errcodes: 1 -> cannot start/stop capturing
-        if (identifier == "capturing")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+    bool ok = open ? openCamera() : closeCamera();
+    sendMessage(msg.replyMessage(QByteArray(), ok ? 0 : 1));
+    sendCameraNotifications();
+}
 
-            bool start;
-            QByteArray arg = m_command.arguments()[0];
-            if (arg == "start")
-                start = true;
-            else if (arg == "stop")
-                start = false;
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set capturing ( start | stop )
+//     errcodes: 1 -> cannot start/stop capturing
+void SjcServer::dcpSetCapturing(const Dcp::Message &msg)
+{
+    bool start;
+    QByteArray arg = m_command.arguments()[0];
+    if (arg == "start")
+        start = true;
+    else if (arg == "stop")
+        start = false;
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
 
-            // wrong mode, when trying to start capturing while the camera
-            // is not opened yet or the capture thread is already running
-            if (start && (!m_recorder->isCameraOpen() ||
-                           m_recorder->isRunning())) {
-                sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+    // wrong mode, when trying to start capturing while the camera
+    // is not opened yet or the capture thread is already running
+    if (start && (!m_recorder->isCameraOpen() ||
+                   m_recorder->isRunning())) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (start)
+        m_recorder->start();
+    else if (m_recorder->isRunning())
+        m_recorder->stop();
+
+    // Note: errorcode 1 cannot be returned without waiting for the
+    // Recorder::started() signal; for now we always return errcode 0.
+    sendMessage(msg.replyMessage());
+
+    // Notification messages will be sent from the recorderStarted()
+    // and recorderStopped() slots
+}
+
+// set triggermode ( fixedrate | syncin1 | syncin2 )
+//     returns: FIN
+//     errorcodes: 1 -> cannot set trigger mode
+void SjcServer::dcpSetTriggermode(const Dcp::Message &msg)
+{
+    QByteArray mode = m_command.arguments()[0];
+    if (mode == "fixedrate")
+        mode = "FixedRate";
+    else if (mode == "syncin1")
+        mode = "SyncIn1";
+    else if (mode == "syncin2")
+        mode = "SyncIn2";
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (m_recorder->setAttribute("FrameStartTriggerMode", mode))
+        sendMessage(msg.replyMessage());
+    else {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        QVariant value;
+        m_recorder->getAttribute("FrameStartTriggerMode", &value);
+        mode = value.toByteArray();
+    }
+    if (mode == "FixedRate" || mode == "SyncIn1" || mode == "SyncIn2")
+        sendNotification("set triggermode " + mode.toLower());
+}
+
+// set exposure <usecs>
+//     returns: FIN
+//     errorcodes: 1 -> cannot set exposure value
+//     note: disables the auto exposure control
+void SjcServer::dcpSetExposure(const Dcp::Message &msg)
+{
+    bool ok;
+    quint32 value = m_command.arguments()[0].toUInt(&ok);
+    if (!ok) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    m_exposureValue = 0;
+    if (m_autoExposureEnabled) {
+        m_autoExposureEnabled = false;
+        sendNotification("set autoexposure false");
+    }
 
-            if (start)
-                m_recorder->start();
-            else if (m_recorder->isRunning())
-                m_recorder->stop();
+    if (m_recorder->setAttribute("ExposureValue", value))
+        sendMessage(msg.replyMessage());
+    else {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        QVariant cameraValue;
+        m_recorder->getAttribute("ExposureValue", &cameraValue);
+        value = cameraValue.toUInt(&ok);
+        if (!ok)
+            return; // don't send notification if value isn't valid
+    }
+    sendNotification("set exposure " + QByteArray::number(value));
+}
+
+// set framerate <Hz>
+//     returns: FIN
+//     errorcodes: 1 -> cannot set framerate value
+void SjcServer::dcpSetFramerate(const Dcp::Message &msg)
+{
+    bool ok;
+    float value = m_command.arguments()[0].toFloat(&ok);
+    if (!ok || value < 0) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (m_recorder->setAttribute("FrameRate", value))
+        sendMessage(msg.replyMessage());
+    else {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        QVariant cameraValue;
+        m_recorder->getAttribute("FrameRate", &cameraValue);
+        value = cameraValue.toFloat(&ok);
+        if (!ok)
+            return; // don't send notification if value isn't valid
+    }
+    sendNotification("set framerate " + QByteArray::number(
+                         value, 'f', 3));
+}
 
-            // Note: errorcode 1 cannot be returned without waiting for the
-            // Recorder::started() signal; for now we always return errcode 0.
-            sendMessage(msg.replyMessage());
+// set writeframes <count> [<stepping>]
+//     returns: FIN
+//     note: new frames cannot be requested while stored frames are written
+void SjcServer::dcpSetWriteframes(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
 
-            // Notification messages will be sent from the recorderStarted()
-            // and recorderStopped() slots
+    bool ok;
+    int count = args[0].toInt(&ok);
+    if (!ok || count < 0) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    int stepping = 1;
+    if (args.size() == 2) {
+        stepping = args[1].toInt(&ok);
+        if (!ok || stepping < 1) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set triggermode ( fixedrate | syncin1 | syncin2 )
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set trigger mode
-        if (identifier == "triggermode")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+    if (count > 0 && m_storedWriting) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
 
-            QByteArray mode = m_command.arguments()[0];
-            if (mode == "fixedrate")
-                mode = "FixedRate";
-            else if (mode == "syncin1")
-                mode = "SyncIn1";
-            else if (mode == "syncin2")
-                mode = "SyncIn2";
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            if (m_recorder->setAttribute("FrameStartTriggerMode", mode))
-                sendMessage(msg.replyMessage());
-            else {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                QVariant value;
-                m_recorder->getAttribute("FrameStartTriggerMode", &value);
-                mode = value.toByteArray();
-            }
-            if (mode == "FixedRate" || mode == "SyncIn1" || mode == "SyncIn2")
-                sendNotification("set triggermode " + mode.toLower());
+    sendMessage(msg.ackMessage());
+    writeFrames(count, stepping);
+    sendMessage(msg.replyMessage());
+}
+
+// set pretrigger <frames> [<seconds>]
+//     returns: FIN
+//     note: <frames> = 0 disables the pre-trigger buffer
+void SjcServer::dcpSetPretrigger(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    bool ok;
+    int frames = args[0].toInt(&ok);
+    if (!ok || frames < 0) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    double seconds = 0;
+    if (args.size() == 2) {
+        seconds = args[1].toDouble(&ok);
+        if (!ok || seconds < 0) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set exposure <usecs>
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set exposure value
-        if (identifier == "exposure")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+    sendMessage(msg.ackMessage());
+    m_preTriggerFrames = frames;
+    m_preTriggerSeconds = seconds;
+    QMetaObject::invokeMethod(m_imageWriter, "setPreTrigger",
+            Q_ARG(int, m_preTriggerFrames),
+            Q_ARG(int, qRound(1000 * m_preTriggerSeconds)),
+            Q_ARG(bool, m_preTriggerCompressed));
+    sendMessage(msg.replyMessage());
+}
 
-            bool ok;
-            quint32 value = m_command.arguments()[0].toUInt(&ok);
-            if (!ok) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            if (m_recorder->setAttribute("ExposureValue", value))
-                sendMessage(msg.replyMessage());
-            else {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                QVariant cameraValue;
-                m_recorder->getAttribute("ExposureValue", &cameraValue);
-                value = cameraValue.toUInt(&ok);
-                if (!ok)
-                    return; // don't send notification if value isn't valid
-            }
-            sendNotification("set exposure " + QByteArray::number(value));
+// set writepretrigger <count> [<stepping>]
+//     returns: FIN
+//     note: writes the frames of the pre-trigger buffer followed by
+//           the next <count> frames; the buffered frames are written as
+//           they are, so the frame selection and co-adding must be off
+void SjcServer::dcpSetWritepretrigger(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    bool ok;
+    int count = args[0].toInt(&ok);
+    if (!ok || count < 0) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    int stepping = 1;
+    if (args.size() == 2) {
+        stepping = args[1].toInt(&ok);
+        if (!ok || stepping < 1) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set framerate <Hz>
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set framerate value
-        if (identifier == "framerate")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+    // stored frames of a previous flush must be written first
+    if (m_preTriggerFrames == 0 || m_storedWriting ||
+            m_selectKeep > 0 || m_coaddFrames > 1) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
 
-            bool ok;
-            float value = m_command.arguments()[0].toFloat(&ok);
-            if (!ok || value < 0) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            if (m_recorder->setAttribute("FrameRate", value))
-                sendMessage(msg.replyMessage());
-            else {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                QVariant cameraValue;
-                m_recorder->getAttribute("FrameRate", &cameraValue);
-                value = cameraValue.toFloat(&ok);
-                if (!ok)
-                    return; // don't send notification if value isn't valid
-            }
-            sendNotification("set framerate " + QByteArray::number(
-                                 value, 'f', 3));
+    sendMessage(msg.ackMessage());
+    m_storedWriting = true;
+    QMetaObject::invokeMethod(m_imageWriter, "writePreTriggerFrames",
+            Q_ARG(int, count), Q_ARG(int, stepping));
+    sendMessage(msg.replyMessage());
+}
+
+// set selectframes <keep> <window> [( gradient | contrast )]
+//     returns: FIN
+//     note: <keep> = 0 disables the frame selection
+void SjcServer::dcpSetSelectframes(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    bool ok1, ok2;
+    int keep = args[0].toInt(&ok1);
+    int window = args[1].toInt(&ok2);
+    if (!ok1 || !ok2 || keep < 0 || window < keep) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    // frame selection and co-adding cannot be used together
+    if (keep > 0 && m_coaddFrames > 1) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+
+    FrameSelector::Metric metric;
+    QByteArray metricName = (args.size() == 3) ? args[2]
+                                               : m_selectMetric;
+    if (!FrameSelector::metricFromName(metricName, &metric)) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    sendMessage(msg.ackMessage());
+    m_selectKeep = keep;
+    m_selectWindow = window;
+    m_selectMetric = metricName;
+    QMetaObject::invokeMethod(m_imageWriter, "setFrameSelection",
+            Q_ARG(int, keep), Q_ARG(int, window),
+            Q_ARG(int, int(metric)));
+    sendMessage(msg.replyMessage());
+}
+
+// set coadd <count> [( sum | average )]
+//     returns: FIN
+//     note: <count> <= 1 disables co-adding
+void SjcServer::dcpSetCoadd(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    // the 32-bit sum of 16-bit pixels overflows for more frames
+    bool ok;
+    int count = args[0].toInt(&ok);
+    if (!ok || count < 0 || count > 65536) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    bool average = m_coaddAverage;
+    if (args.size() == 2) {
+        if (args[1] == "sum")
+            average = false;
+        else if (args[1] == "average")
+            average = true;
+        else {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set roi <left> <top> <width> <height>
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set roi values
-        if (identifier == "roi")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+    if (count > 1 && m_selectKeep > 0) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+
+    sendMessage(msg.ackMessage());
+    m_coaddFrames = count;
+    m_coaddAverage = average;
+    QMetaObject::invokeMethod(m_imageWriter, "setCoadding",
+            Q_ARG(int, count), Q_ARG(bool, average));
+    sendMessage(msg.replyMessage());
+}
+
+// set burst <count>
+//     returns: FIN
+//     note: <count> = 0 stops a running burst
+void SjcServer::dcpSetBurst(const Dcp::Message &msg)
+{
+    bool ok;
+    int count = m_command.arguments()[0].toInt(&ok);
+    if (!ok || count < 0 || count > m_burstPool.capacity()) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    // a burst can only be started while capturing and after the stored
+    // frames of the previous burst or pre-trigger flush have been written
+    if (count > 0 && (!m_recorder->isRunning() ||
+                      m_burstRemaining > 0 || m_storedWriting)) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (count > 0)
+        m_burstRemaining = count;
+    else if (m_burstRemaining > 0)
+        finishBurst();
+    sendMessage(msg.replyMessage());
+}
+
+// set calibration ( true | false )
+//     returns: FIN
+void SjcServer::dcpSetCalibration(const Dcp::Message &msg)
+{
+    bool enable;
+    QByteArray arg = m_command.arguments()[0];
+    if (arg == "true" || arg == "1")
+        enable = true;
+    else if (arg == "false" || arg == "0")
+        enable = false;
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    QMetaObject::invokeMethod(m_frameCalibrator, "setEnabled",
+                              Q_ARG(bool, enable));
+    sendMessage(msg.replyMessage());
+}
+
+// set ( darkfile | flatfile ) [<filename>]
+//     returns: FIN
+//     errcodes: 1 = cannot read the file
+//     note: without filename the master frame is unloaded
+void SjcServer::dcpSetMasterFile(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+
+    int type = (m_command.identifier() == "darkfile") ? FrameCalibrator::Dark
+                                                      : FrameCalibrator::Flat;
+    QString fileName = m_command.hasArguments() ?
+                QString::fromLocal8Bit(m_command.arguments()[0]) :
+                QString();
+    bool ok = false;
+    QMetaObject::invokeMethod(m_frameCalibrator, "loadMaster",
+                              Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok),
+                              Q_ARG(int, type),
+                              Q_ARG(QString, fileName));
+    sendMessage(msg.replyMessage(QByteArray(), ok ? 0 : 1));
+}
+
+// set ( builddark | buildflat ) <count>
+//     returns: FIN
+//     note: the master frame is written to the calibration
+//           directory and loaded after <count> frames; <count> = 0
+//           cancels a running build
+void SjcServer::dcpSetBuildMaster(const Dcp::Message &msg)
+{
+    bool ok;
+    int count = m_command.arguments()[0].toInt(&ok);
+    if (!ok || count < 0 || count > 65536) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    if (count > 0 && !m_recorder->isRunning()) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    int type = (m_command.identifier() == "builddark") ?
+                FrameCalibrator::Dark : FrameCalibrator::Flat;
+    QMetaObject::invokeMethod(m_frameCalibrator, "buildMaster",
+                              Q_ARG(int, type), Q_ARG(int, count));
+    sendMessage(msg.replyMessage());
+}
+
+// set defectcorrection ( off | preview | on )
+//     returns: FIN
+//     note: preview only corrects the streamed images, on also corrects
+//           the frames before they are written
+void SjcServer::dcpSetDefectcorrection(const Dcp::Message &msg)
+{
+    int mode = FrameCalibrator::DefectsOff;
+    FrameCalibrator::defectModeFromName(m_command.arguments()[0], &mode);
+    sendMessage(msg.ackMessage());
+    QMetaObject::invokeMethod(m_frameCalibrator, "setDefectMode",
+                              Q_ARG(int, mode));
+    sendMessage(msg.replyMessage());
+}
+
+// set defectfile [<filename>]
+//     returns: FIN
+//     errcodes: 1 = cannot read the file
+//     note: without filename the defect map is unloaded
+void SjcServer::dcpSetDefectfile(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+
+    QString fileName = m_command.hasArguments() ?
+                QString::fromLocal8Bit(m_command.arguments()[0]) :
+                QString();
+    bool ok = false;
+    QMetaObject::invokeMethod(m_frameCalibrator, "loadDefectMap",
+                              Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok),
+                              Q_ARG(QString, fileName));
+    sendMessage(msg.replyMessage(QByteArray(), ok ? 0 : 1));
+}
+
+// set builddefects <count> [<threshold>]
+//     returns: FIN
+//     note: averages <count> dark frames and marks the pixels deviating
+//           more than <threshold> (default: [Calibration] DefectThreshold)
+//           standard deviations from the median; the map is written to
+//           the calibration directory and loaded
+void SjcServer::dcpSetBuilddefects(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+    bool ok1, ok2 = true;
+    int count = args[0].toInt(&ok1);
+    double threshold = (args.size() == 2) ? args[1].toDouble(&ok2)
+                                          : m_defectThreshold;
+    if (!ok1 || !ok2 || count < 0 || count > 65536 || threshold <= 0) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+
+    if (count > 0 && !m_recorder->isRunning()) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    QMetaObject::invokeMethod(m_frameCalibrator, "setDefectThreshold",
+                              Q_ARG(double, threshold));
+    QMetaObject::invokeMethod(m_frameCalibrator, "buildMaster",
+                              Q_ARG(int, FrameCalibrator::Defects),
+                              Q_ARG(int, count));
+    sendMessage(msg.replyMessage());
+}
+
+// set pipelinetrace <count> [<filename>]
+//     returns: FIN
+//     errcodes: 1 = cannot create trace file
+//     note: writes the traces of the next <count> returned frames
+//           as Chrome trace events, <count> = 0 finishes a running
+//           trace
+void SjcServer::dcpSetPipelinetrace(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    bool ok;
+    int count = args[0].toInt(&ok);
+    if (!ok || count < 0 || count > 100000) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (count == 0) {
+        m_pipelineStats.finishTrace();
+        sendMessage(msg.replyMessage());
+        return;
+    }
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QString fileName = (args.size() == 2) ?
+                QString::fromLocal8Bit(args[1]) :
+                m_deviceName + "_trace_"
+                    + now.toString("yyyyMMdd-hhmmsszzz") + ".json";
+    fileName = QDir(m_frameInfoDirPath).absoluteFilePath(fileName);
+    if (!m_pipelineStats.startTrace(fileName, count)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage());
+}
+
+// set marker ( true | false | center | (<xpos> <ypos>) )
+//     returns: FIN
+void SjcServer::dcpSetMarker(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    if (args.size() == 2) {
+        // set marker <xpos> <ypos>
+        bool ok1, ok2;
+        QPointF pos(args[0].toDouble(&ok1), args[1].toDouble(&ok2));
+        if (!ok1 || !ok2) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
-
-        // set binningx <pixels>
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set x-binning value
-        //     note: this affects roi and maximagesize
-        if (identifier == "binningx")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+        m_markerPos = pos;
+        m_markerEnabled = true;
+        m_markerCentering = false;
+    } else {
+        // set marker ( true | false | center )
+        if (args[0] == "true" || args[0] == "1") {
+            m_markerEnabled = true;
+        }
+        else if (args[0] == "false" || args[0] == "0") {
+            m_markerEnabled = false;
+        }
+        else if (args[0] == "center") {
+            m_markerEnabled = true;
+            if (m_recorder->isCameraOpen()) {
+                CameraInfo camInfo = m_recorder->cameraInfo();
+                m_markerPos.setX(0.5 * (camInfo.sensorWidth - 1));
+                m_markerPos.setY(0.5 * (camInfo.sensorHeight - 1));
+                m_markerCentering = false;
+            } else
+                m_markerCentering = true;
+        } else {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
+    sendMessage(msg.ackMessage());
+    updateMarkerPos();
+    sendMessage(msg.replyMessage());
+    QByteArray enabled = m_markerEnabled ? "true" : "false";
+    QByteArray x = QByteArray::number(m_markerPos.x());
+    QByteArray y = QByteArray::number(m_markerPos.y());
+    sendNotification("set marker " + enabled + " " + x + " " + y);
+}
 
-        // set binningy <pixels>
-        //     returns: FIN
-        //     errorcodes: 1 -> cannot set y-binning value
-        //     note: this affects roi and maximagesize
-        if (identifier == "binningy")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+// set tracking ( off | centroid | correlation )
+//     returns: FIN
+//     note: the results are sent as "set motion" notifications, to the
+//           clients of the tracking port and to the frame info log
+void SjcServer::dcpSetTracking(const Dcp::Message &msg)
+{
+    int mode = MotionTracker::Off;
+    MotionTracker::modeFromName(m_command.arguments()[0], &mode);
+    sendMessage(msg.ackMessage());
+    m_trackingMode = mode;
+    QMetaObject::invokeMethod(m_motionTracker, "setMode", Q_ARG(int, mode));
+    sendMessage(msg.replyMessage());
+    sendNotification("set tracking " + MotionTracker::modeName(mode));
+}
+
+// set trackingroi <x> <y> <width> <height>
+//     returns: FIN
+//     note: <width> = <height> = 0 selects the whole frame, otherwise the
+//           region must be non-empty and within the sensor
+void SjcServer::dcpSetTrackingroi(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    int values[4];
+    for (int i = 0; i < 4; ++i) {
+        bool ok;
+        values[i] = args[i].toInt(&ok);
+        if (!ok || values[i] < 0) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set binning <xbin> <ybin>
-        //     returns: FIN
-        //     errcodes: 1 -> cannot set x-binning value
-        //               2 -> cannot set y-binning value
-        //               3 -> cannot set any binning values
-        if (identifier == "binning")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+    QRect roi(values[0], values[1], values[2], values[3]);
+    if (!roi.isNull()) {
+        bool valid = !roi.isEmpty();
+        if (valid && m_recorder->isCameraOpen()) {
+            CameraInfo info = m_recorder->cameraInfo();
+            valid = QRect(0, 0, int(info.sensorWidth),
+                          int(info.sensorHeight)).contains(roi);
+        }
+        if (!valid) {
+            sendMessage(msg.ackMessage(Dcp::AckParameterError));
             return;
         }
+    }
 
-        // set writeframes <count> [<stepping>]
-        //     returns: FIN
-        if (identifier == "writeframes")
-        {
-            QList<QByteArray> args = m_command.arguments();
-            if (args.size() < 1 || args.size() > 2) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+    sendMessage(msg.ackMessage());
+    m_trackingRoi = roi;
+    QMetaObject::invokeMethod(m_motionTracker, "setRoi", Q_ARG(QRect, roi));
+    sendMessage(msg.replyMessage());
+}
 
-            bool ok;
-            int count = args[0].toInt(&ok);
-            if (!ok || count < 0) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set trackingthreshold <threshold>
+//     returns: FIN
+//     note: centroid threshold between the minimum (0) and the maximum (1)
+//           of the region
+void SjcServer::dcpSetTrackingthreshold(const Dcp::Message &msg)
+{
+    double threshold = m_command.arguments()[0].toDouble();
+    if (threshold < 0 || threshold > 1) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+    m_trackingThreshold = threshold;
+    QMetaObject::invokeMethod(m_motionTracker, "setThreshold",
+                              Q_ARG(double, threshold));
+    sendMessage(msg.replyMessage());
+}
 
-            int stepping = 1;
-            if (args.size() == 2) {
-                stepping = args[1].toInt(&ok);
-                if (!ok || stepping < 1) {
-                    sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                    return;
-                }
-            }
+// set trackingreference
+//     returns: FIN
+//     note: the next frame becomes the reference of the correlation mode
+void SjcServer::dcpSetTrackingreference(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QMetaObject::invokeMethod(m_motionTracker, "resetReference");
+    sendMessage(msg.replyMessage());
+}
 
-            sendMessage(msg.ackMessage());
-            QMetaObject::invokeMethod(m_imageWriter, "writeNextFrames",
-                    Q_ARG(int, count), Q_ARG(int, stepping));
-            sendMessage(msg.replyMessage());
-            return;
-        }
+// set autoexposure ( true | false )
+//     returns: FIN
+//     note: the exposure values chosen by the server are sent as
+//           "set exposure" notifications
+void SjcServer::dcpSetAutoexposure(const Dcp::Message &msg)
+{
+    QByteArray arg = m_command.arguments()[0];
+    bool enable = (arg == "true" || arg == "1");
+    sendMessage(msg.ackMessage());
+    m_autoExposureEnabled = enable;
+    m_exposureValue = 0;
+    sendMessage(msg.replyMessage());
+    sendNotification(QByteArray("set autoexposure ") +
+                     (enable ? "true" : "false"));
+}
 
-        // set marker ( true | false | center | (<xpos> <ypos>) )
-        //     returns: FIN
-        if (identifier == "marker")
-        {
-            QList<QByteArray> args = m_command.arguments();
-            if (args.size() < 1 || args.size() > 2) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set logframeinfo ( true | false )
+//     return: FIN
+void SjcServer::dcpSetLogframeinfo(const Dcp::Message &msg)
+{
+    bool enable;
+    QByteArray arg = m_command.arguments()[0];
+    if (arg == "true" || arg == "1")
+        enable = true;
+    else if (arg == "false" || arg == "0")
+        enable = false;
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
 
-            if (args.size() == 2) {
-                // set marker <xpos> <ypos>
-                bool ok1, ok2;
-                QPointF pos(args[0].toDouble(&ok1), args[1].toDouble(&ok2));
-                if (!ok1 || !ok2) {
-                    sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                    return;
-                }
-                m_markerPos = pos;
-                m_markerEnabled = true;
-                m_markerCentering = false;
-            } else {
-                // set marker ( true | false | center )
-                if (args[0] == "true" || args[0] == "1") {
-                    m_markerEnabled = true;
-                }
-                else if (args[0] == "false" || args[0] == "0") {
-                    m_markerEnabled = false;
-                }
-                else if (args[0] == "center") {
-                    m_markerEnabled = true;
-                    if (m_recorder->isCameraOpen()) {
-                        CameraInfo camInfo = m_recorder->cameraInfo();
-                        m_markerPos.setX(0.5 * (camInfo.sensorWidth - 1));
-                        m_markerPos.setY(0.5 * (camInfo.sensorHeight - 1));
-                        m_markerCentering = false;
-                    } else
-                        m_markerCentering = true;
-                } else {
-                    sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                    return;
-                }
-            }
-            sendMessage(msg.ackMessage());
-            QVariant markerPos = m_markerEnabled ? m_markerPos : QVariant();
-            QMetaObject::invokeMethod(m_imageWriter, "setMarkerPos",
-                    Q_ARG(QVariant, markerPos));
-            sendMessage(msg.replyMessage());
-            QByteArray enabled = m_markerEnabled ? "true" : "false";
-            QByteArray x = QByteArray::number(m_markerPos.x());
-            QByteArray y = QByteArray::number(m_markerPos.y());
-            sendNotification("set marker " + enabled + " " + x + " " + y);
+    if (enable == m_frameInfoLog->isLogging()) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    if (enable) {
+        if (!startFrameInfoLog()) {
+            sendMessage(msg.replyMessage(QByteArray(), 1));
             return;
         }
+    } else {
+        stopFrameInfoLog();
+    }
+    sendMessage(msg.replyMessage());
+}
 
-        // set logframeinfo ( true | false )
-        //     return: FIN
-        if (identifier == "logframeinfo")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set reload
+//     returns: FIN
+//     errcodes: 1 = cannot read the config file
+//     note: applies the changed [CamAttr], [Recording] and [Streaming]
+//           settings, like SIGHUP
+void SjcServer::dcpSetReload(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(QByteArray(), reloadConfig() ? 0 : 1));
+}
 
-            bool enable;
-            QByteArray arg = m_command.arguments()[0];
-            if (arg == "true" || arg == "1")
-                enable = true;
-            else if (arg == "false" || arg == "0")
-                enable = false;
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// set verbose ( true | false | debug )
+//     note: for debugging
+void SjcServer::dcpSetVerbose(const Dcp::Message &msg)
+{
+    int verbosity;
+    QByteArray arg = m_command.arguments()[0];
+    if (arg == "true" || arg == "1")
+        verbosity = 1;
+    else if (arg == "false" || arg == "0")
+        verbosity = 0;
+    else if (arg == "debug" || arg == "2")
+        verbosity = 2;
+    else {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
 
-            if (enable == (m_frameInfoLogFile != 0)) {
-                sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            if (enable) {
-                Q_ASSERT(m_frameInfoLogFile == 0);
-                if (!createFrameInfoLogFile()) {
-                    sendMessage(msg.replyMessage(QByteArray(), 1));
-                    return;
-                }
-            } else {
-                Q_ASSERT(m_frameInfoLogFile != 0);
-                delete m_frameInfoLogFile;
-                m_frameInfoLogFile = 0;
-            }
-            sendMessage(msg.replyMessage());
-            return;
-        }
+    m_verbosity = verbosity;
+    sendMessage(msg.replyMessage());
+}
 
+// set pvattr <name> [<value>]
+//     note: for debugging only!
+void SjcServer::dcpSetPvattr(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+    sendMessage(msg.ackMessage());
+
+    int errcode = 0;
+    QVariant value = (args.size() == 2 ? args[1] : QVariant());
+    if (!m_recorder->setAttribute(args[0], value))
+        errcode = 1;
+    m_exposureValue = 0;
+    sendMessage(msg.replyMessage(QByteArray(), errcode));
+}
 
-        // set verbose ( true | false )
-        //     note: for debugging
-        if (identifier == "verbose")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
+// get notify
+//     returns: ( true | false | batch )
+void SjcServer::dcpGetNotify(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+
+    if (m_batchClients.contains(msg.source()))
+        sendMessage(msg.replyMessage("batch"));
+    else if (m_clientMap.contains(msg.source()))
+        sendMessage(msg.replyMessage("true"));
+    else
+        sendMessage(msg.replyMessage("false"));
+}
 
-            bool verbose;
-            QByteArray arg = m_command.arguments()[0];
-            if (arg == "true" || arg == "1")
-                verbose = true;
-            else if (arg == "false" || arg == "0")
-                verbose = false;
-            else {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+// get status
+//     returns: <camerastate> <address> <port> <camera name>
+//              <unique id> <width> <height> <bitdepth> <triggermode>
+//              <exposure> <exp_min> <exp_max> <framerate> <fr_min>
+//              <fr_max> ( true | false ) <xpos> <ypos>
+//     note: camera values are "-" if the camera is closed or the
+//           value is not available
+void SjcServer::dcpGetStatus(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(statusReply()));
+}
 
-            m_verbose = verbose;
-            sendMessage(msg.replyMessage());
-            return;
-        }
+// get camerastate
+//     returns: ( closed | opened | capturing )
+void SjcServer::dcpGetCamerastate(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+
+    QByteArray state;
+    if (m_recorder->isCameraOpen())
+        state = m_recorder->isRunning() ? "capturing" : "opened";
+    else
+        state = "closed";
+    sendMessage(msg.replyMessage(state));
+}
 
-        // set pvattr <name> [<value>]
-        //     note: for debugging only!
-        if (identifier == "pvattr")
-        {
-            QList<QByteArray> args = m_command.arguments();
-            if (args.size() < 1 || args.size() > 2) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+// get triggermode
+//     returns: ( fixedrate | syncin1 | syncin2 )
+//     errorcodes: 1 -> cannot get trigger mode
+void SjcServer::dcpGetTriggermode(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
 
-            int errcode = 0;
-            QVariant value = (args.size() == 2 ? args[1] : QVariant());
-            if (!m_recorder->setAttribute(args[0], value))
-                errcode = 1;
-            sendMessage(msg.replyMessage(QByteArray(), errcode));
-            return;
-        }
+    QVariant value;
+    if (!m_recorder->getAttribute("FrameStartTriggerMode", &value)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
     }
-    else if (cmdType == Dcp::CommandParser::GetCmd)
-    {
-        // get notify
-        //     returns: ( true | false )
-        if (identifier == "notify")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+    QByteArray mode = value.toByteArray();
+    if (mode == "FixedRate" || mode == "SyncIn1" || mode == "SyncIn2")
+        mode = mode.toLower();
+    sendMessage(msg.replyMessage(mode));
+}
 
-            if (m_clientMap.contains(msg.source()))
-                sendMessage(msg.replyMessage("true"));
-            else
-                sendMessage(msg.replyMessage("false"));
-            return;
-        }
+// get exposure
+//     returns: <usecs>
+//     errorcodes: 1 -> cannot get exposure value
+void SjcServer::dcpGetExposure(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
 
-        // get camerastate
-        //     returns: ( closed | opened | capturing )
-        if (identifier == "camerastate")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            QByteArray state;
-            if (m_recorder->isCameraOpen())
-                state = m_recorder->isRunning() ? "capturing" : "opened";
-            else
-                state = "closed";
-            sendMessage(msg.replyMessage(state));
-            return;
-        }
+    QVariant value;
+    if (!m_recorder->getAttribute("ExposureValue", &value) ||
+            !value.canConvert(QVariant::UInt)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(QByteArray::number(value.toUInt())));
+}
 
-        //  get triggermode
-        //      returns: ( fixedrate | syncin1 | syncin2 )
-        //      errorcodes: 1 -> cannot get trigger mode
-        if (identifier == "triggermode")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+// get exposure_range
+//     returns: <min> <max>
+//     errorcodes: 1 -> cannot get range values
+void SjcServer::dcpGetExposureRange(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
 
-            QVariant value;
-            if (!m_recorder->getAttribute("FrameStartTriggerMode", &value)) {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                return;
-            }
-            QByteArray mode = value.toByteArray();
-            if (mode == "FixedRate" || mode == "SyncIn1" || mode == "SyncIn2")
-                mode = mode.toLower();
-            sendMessage(msg.replyMessage(mode));
-            return;
-        }
+    QVariant min, max;
+    if (!m_recorder->getAttributeRange("ExposureValue", &min, &max)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(
+            QByteArray::number(min.toUInt()) + " "
+            + QByteArray::number(max.toUInt())));
+}
 
-        // get exposure
-        //     returns: <usecs>
-        //     errorcodes: 1 -> cannot get exposure value
-        if (identifier == "exposure")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+// get framerate
+//     returns: <Hz>
+//     errorcodes: 1 -> cannot get framerate value
+void SjcServer::dcpGetFramerate(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
 
-            QVariant value;
-            if (!m_recorder->getAttribute("ExposureValue", &value) ||
-                    !value.canConvert(QVariant::UInt)) {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                return;
-            }
-            sendMessage(msg.replyMessage(QByteArray::number(value.toUInt())));
-            return;
-        }
+    QVariant value;
+    if (!m_recorder->getAttribute("FrameRate", &value) ||
+            !value.canConvert(QVariant::Double)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(
+                    QByteArray::number(value.toFloat(), 'f', 3)));
+}
 
-        // get exposure_range
-        //     returns: <min> <max>
-        //     errorcodes: 1 -> cannot get range values
-        if (identifier == "exposure_range")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
-            return;
-        }
+// get framerate_range
+//     returns: <min> <max>
+//     errorcodes: 1 -> cannot get range values
+void SjcServer::dcpGetFramerateRange(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
 
-        // get framerate
-        //     returns: <Hz>
-        //     errorcodes: 1 -> cannot get framerate value
-        if (identifier == "framerate")
-        {
-            // not implemented yet
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
+    QVariant min, max;
+    if (!m_recorder->getAttributeRange("FrameRate", &min, &max)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(
+            QByteArray::number(min.toFloat(), 'f', 3) + " "
+            + QByteArray::number(max.toFloat(), 'f', 3)));
+}
 
-            QVariant value;
-            if (!m_recorder->getAttribute("FrameRate", &value) ||
-                    !value.canConvert(QVariant::Double)) {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                return;
-            }
-            sendMessage(msg.replyMessage(
-                            QByteArray::number(value.toFloat(), 'f', 3)));
-            return;
-        }
+// get framestats
+//     returns: <fps> <completed> <dropped>
+//     errorcodes: 1 -> cannot get frame stats
+void SjcServer::dcpGetFramestats(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    float fps;
+    uint completed, dropped;
+    if (!m_recorder->getFrameStats(fps, completed, dropped)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(QByteArray::number(fps) + " "
+            + QByteArray::number(completed) + " "
+            + QByteArray::number(dropped)));
+}
 
-        // get framerate_range
-        //     returns: <min> <max>
-        //     errorcodes: 1 -> cannot get range values
-        if (identifier == "framerate_range")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
-            return;
-        }
+// get network
+//     returns: <packetsize> <bytespersecond> <received> <missed>
+//              <erroneous> <requested> <resent>
+//     errorcodes: 1 -> cannot get network stats
+//     note: packet counts are taken from the camera's Stat*
+//           attributes
+void SjcServer::dcpGetNetwork(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    NetworkStats stats;
+    if (!m_recorder->getNetworkStats(stats)) {
+        sendMessage(msg.replyMessage(QByteArray(), 1));
+        return;
+    }
+    sendMessage(msg.replyMessage(
+            QByteArray::number(stats.packetSize) + " "
+            + QByteArray::number(stats.bytesPerSecond) + " "
+            + QByteArray::number(stats.packetsReceived) + " "
+            + QByteArray::number(stats.packetsMissed) + " "
+            + QByteArray::number(stats.packetsErroneous) + " "
+            + QByteArray::number(stats.packetsRequested) + " "
+            + QByteArray::number(stats.packetsResent)));
+}
 
-        // get roi
-        //     returns: <left> <top> <width> <height>
-        //     errorcodes: 1 -> cannot get roi values
-        if (identifier == "roi")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
-            return;
-        }
+// get marker
+//     returns: ( true | false ) <xpos> <ypos>
+void SjcServer::dcpGetMarker(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray enabled = m_markerEnabled ? "true" : "false";
+    QByteArray xpos = QByteArray::number(m_markerPos.x());
+    QByteArray ypos = QByteArray::number(m_markerPos.y());
+    sendMessage(msg.replyMessage(enabled + " " + xpos + " " + ypos));
+}
 
-        // get maximagesize
-        //     returns: <width> <height>
-        //     errorcodes: 1 -> cannot get image size
-        if (identifier == "maximagesize")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
-            return;
-        }
+// get pretrigger
+//     returns: <frames> <seconds>
+void SjcServer::dcpGetPretrigger(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(
+                    QByteArray::number(m_preTriggerFrames) + " " +
+                    QByteArray::number(m_preTriggerSeconds)));
+}
 
-        // get binning
-        //     returns: <xbin> <ybin>
-        //     errcodes: 1 -> cannot get x-binning value
-        //               2 -> cannot get y-binning value
-        //               3 -> cannot get any binning values
-        if (identifier == "binning")
-        {
-            // not implemented yet
-            sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
-            return;
-        }
+// get selectframes
+//     returns: <keep> <window> ( gradient | contrast )
+void SjcServer::dcpGetSelectframes(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(
+                    QByteArray::number(m_selectKeep) + " " +
+                    QByteArray::number(m_selectWindow) + " " +
+                    m_selectMetric));
+}
 
-        // get framestats
-        //     returns: <fps> <completed> <dropped>
-        //     errorcodes: 1 -> cannot get frame stats
-        if (identifier == "framestats")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            float fps;
-            uint completed, dropped;
-            if (!m_recorder->getFrameStats(fps, completed, dropped)) {
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-                return;
-            }
-            sendMessage(msg.replyMessage(QByteArray::number(fps) + " "
-                    + QByteArray::number(completed) + " "
-                    + QByteArray::number(dropped)));
-            return;
-        }
+// get coadd
+//     returns: <count> ( sum | average )
+void SjcServer::dcpGetCoadd(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray mode = m_coaddAverage ? "average" : "sum";
+    sendMessage(msg.replyMessage(
+                    QByteArray::number(m_coaddFrames) + " " + mode));
+}
 
-        // get marker
-        //     returns: ( true | false ) <xpos> <ypos>
-        if (identifier == "marker")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            QByteArray enabled = m_markerEnabled ? "true" : "false";
-            QByteArray xpos = QByteArray::number(m_markerPos.x());
-            QByteArray ypos = QByteArray::number(m_markerPos.y());
-            sendMessage(msg.replyMessage(enabled + " " + xpos + " " + ypos));
-            return;
-        }
+// get burst
+//     returns: ( idle | capturing | writing ) <capacity>
+void SjcServer::dcpGetBurst(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray state = "idle";
+    if (m_burstRemaining > 0)
+        state = "capturing";
+    else if (m_burstWriting)
+        state = "writing";
+    sendMessage(msg.replyMessage(
+            state + " " + QByteArray::number(m_burstPool.capacity())));
+}
 
-        // get logframeinfo
-        //     returns: ( true | false )
-        if (identifier == "logframeinfo")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            QByteArray enabled = m_frameInfoLogFile ? "true" : "false";
-            sendMessage(msg.replyMessage(enabled));
-            return;
-        }
+// get calibration
+//     returns: ( true | false ) <darkfile> <flatfile>
+//     note: a missing master frame is returned as "-"
+void SjcServer::dcpGetCalibration(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(calibrationState()));
+}
 
-        // get streaminghost
-        //     returns: <address> <port>
-        if (identifier == "streaminghost")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            QByteArray address = m_dcp->localAddress().toString().toAscii();
-            QByteArray port = QByteArray::number(m_streamingPort);
-            sendMessage(msg.replyMessage(address + " " + port));
-            return;
-        }
+// get defectcorrection
+//     returns: ( off | preview | on ) <defectfile> <count>
+//     note: "-" is returned if no defect map is loaded
+void SjcServer::dcpGetDefectcorrection(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(defectState()));
+}
 
-        // get camerainfo
-        //     returns: <camera name> <unique id> <width> <height> <bitdepth>
-        if (identifier == "camerainfo")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            if (!m_recorder->isCameraOpen()) {
-                sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
-                return;
-            }
+// get tracking
+//     returns: ( off | centroid | correlation ) <x> <y> <width> <height>
+//              <threshold> <port>
+void SjcServer::dcpGetTracking(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(
+                    MotionTracker::modeName(m_trackingMode) + " " +
+                    QByteArray::number(m_trackingRoi.x()) + " " +
+                    QByteArray::number(m_trackingRoi.y()) + " " +
+                    QByteArray::number(m_trackingRoi.width()) + " " +
+                    QByteArray::number(m_trackingRoi.height()) + " " +
+                    QByteArray::number(m_trackingThreshold) + " " +
+                    QByteArray::number(m_trackingPort)));
+}
 
-            sendMessage(msg.ackMessage());
-            CameraInfo info = m_recorder->cameraInfo();
-            QByteArray reply = m_deviceName + " " +
-                    QByteArray::number(uint(info.pvCameraInfo.UniqueId)) + " " +
-                    QByteArray::number(info.sensorWidth) + " " +
-                    QByteArray::number(info.sensorHeight) + " " +
-                    QByteArray::number(info.sensorBits);
-            sendMessage(msg.replyMessage(reply));
-            return;
-        }
+// get motion
+//     returns: <count> ( valid | nosignal | outofrange | unsupported )
+//              <dx> <dy>
+//     note: the last measurement in pixels, relative to the marker
+//           (centroid) or to the reference frame (correlation)
+void SjcServer::dcpGetMotion(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(motionString(m_lastMotion)));
+}
 
-        // get version
-        //     returns: <server version>
-        if (identifier == "version")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            sendMessage(msg.replyMessage(SJCAM_VERSION_STRING));
-            return;
-        }
+// get autoexposure
+//     returns: ( true | false ) <level> <saturation>
+//     note: the percentile level and the fraction of saturated pixels of
+//           the last evaluated frame, relative to the full scale
+void SjcServer::dcpGetAutoexposure(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray enabled = m_autoExposureEnabled ? "true" : "false";
+    sendMessage(msg.replyMessage(
+            enabled + " "
+            + QByteArray::number(m_autoExposure.lastLevel(), 'f', 3) + " "
+            + QByteArray::number(m_autoExposure.lastSaturation(), 'g', 3)));
+}
 
-        // get pvversion
-        //     returns: <pvapi version>
-        if (identifier == "pvversion")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            sendMessage(msg.replyMessage(PvVersionString().toAscii()));
-            return;
-        }
+// get logframeinfo
+//     returns: ( true | false )
+void SjcServer::dcpGetLogframeinfo(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray enabled = m_frameInfoLog->isLogging() ? "true"
+                                                     : "false";
+    sendMessage(msg.replyMessage(enabled));
+}
 
-        // get verbose
-        //     returns: ( true | false )
-        //     note: for debugging
-        if (identifier == "verbose")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            sendMessage(msg.replyMessage(verbose() ? "true" : "false"));
-            return;
-        }
+// get pipelinestats
+//     returns: (<stage> <count> <p50> <p95> <p99> <max>){12}
+//     note: latencies in microseconds since the previous stage,
+//           the first stage "total" is the time from the end of
+//           the exposure until the buffer was returned
+void SjcServer::dcpGetPipelinestats(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(m_pipelineStats.summary()));
+}
 
-        // get clients
-        //     returns: <client list>
-        //     note: for debugging
-        if (identifier == "clients")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            QList<QByteArray> clientList = m_clientMap.keys();
-            QByteArray clients;
-            if (!clientList.isEmpty())
-                clients = clientList.takeFirst();
-            foreach (const QByteArray &client, clientList)
-                clients += " " + client;
-            sendMessage(msg.replyMessage(clients));
-            return;
-        }
+// get clockmodel
+//     returns: <samples> <rejected> <drift> <residual>
+//     note: drift of the camera clock in ppm, mean absolute residual of
+//           the fit in microseconds
+void SjcServer::dcpGetClockmodel(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    const ClockModel *clockModel = m_recorder->clockModel();
+    QByteArray data = QByteArray::number(clockModel->numSamples())
+            + " " + QByteArray::number(clockModel->numRejected())
+            + " " + QByteArray::number(clockModel->driftPpm(), 'f', 3)
+            + " " + QByteArray::number(clockModel->residualUsecs(), 'f', 1);
+    sendMessage(msg.replyMessage(data));
+}
 
-        // get connections
-        //     returns: <stream socket connections>
-        //     note: for debugging
-        if (identifier == "connections")
-        {
-            if (m_command.hasArguments()) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-            QString connections = m_streamConnectionList.join(" ");
-            sendMessage(msg.replyMessage(connections.toAscii()));
-            return;
-        }
+// get threads
+//     returns: (<thread> <cpuseconds>){5}
+//     note: CPU time used by the capture, main, calibrator,
+//           streamer and writer threads; the worker threads are
+//           shared by all cameras of the process
+void SjcServer::dcpGetThreads(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray data;
+    for (int i = 0; i < NumThreadTypes; ++i) {
+        qint64 usecs = threadCpuUsecs(ThreadType(i));
+        if (i > 0) data += " ";
+        data += threadTypeName(ThreadType(i)).toLower().toAscii()
+                + " " + QByteArray::number(qMax(usecs, qint64(0))
+                                           / 1e6, 'f', 3);
+    }
+    sendMessage(msg.replyMessage(data));
+}
 
-        // get pvattr <name>
-        //     note: for debugging only!
-        if (identifier == "pvattr")
-        {
-            if (m_command.numArguments() != 1) {
-                sendMessage(msg.ackMessage(Dcp::AckParameterError));
-                return;
-            }
-            sendMessage(msg.ackMessage());
-
-            QVariant value;
-            QList<QByteArray> args = m_command.arguments();
-            if (m_recorder->getAttribute(args[0], &value))
-                sendMessage(msg.replyMessage(value.toByteArray()));
-            else
-                sendMessage(msg.replyMessage(QByteArray(), 1));
-            return;
-        }
+// get frameinfo <since-id> [<maxcount>]
+//     returns: <n> (<id> <count> <status> <timestamp>
+//              <readoutTimestamp> <readoutTimeMs> <exposureUtcUsecs>){n}
+//     note: returns the buffered records with id > <since-id>,
+//           use -1 to get the oldest records
+void SjcServer::dcpGetFrameinfo(const Dcp::Message &msg)
+{
+    QList<QByteArray> args = m_command.arguments();
+
+    bool ok1, ok2 = true;
+    qint64 sinceId = args[0].toLongLong(&ok1);
+    int maxCount = (args.size() == 2) ? args[1].toInt(&ok2) : 100;
+    if (!ok1 || !ok2 || maxCount < 1 || maxCount > 1000) {
+        sendMessage(msg.ackMessage(Dcp::AckParameterError));
+        return;
+    }
+    sendMessage(msg.ackMessage());
+
+    QList<FrameInfo> records = m_frameInfoLog->records(sinceId,
+                                                       maxCount);
+    QByteArray data = QByteArray::number(records.size());
+    foreach (const FrameInfo &info, records) {
+        data += " " + QByteArray::number(quint64(info.id))
+              + " " + QByteArray::number(quint64(info.count))
+              + " " + QByteArray::number(info.status)
+              + " " + QByteArray::number(info.timestamp)
+              + " " + QByteArray::number(info.readoutTimestamp)
+              + " " + QByteArray::number(info.readoutTimeMs)
+              + " " + QByteArray::number(info.exposureUtcUsecs);
     }
+    sendMessage(msg.replyMessage(data));
+}
+
+// get streaminghost
+//     returns: <address> <port>
+void SjcServer::dcpGetStreaminghost(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray address = m_dcp->localAddress().toString().toAscii();
+    QByteArray port = QByteArray::number(m_streamingPort);
+    sendMessage(msg.replyMessage(address + " " + port));
+}
+
+// get camerainfo
+//     returns: <camera name> <unique id> <width> <height> <bitdepth>
+void SjcServer::dcpGetCamerainfo(const Dcp::Message &msg)
+{
+    if (!m_recorder->isCameraOpen()) {
+        sendMessage(msg.ackMessage(Dcp::AckWrongModeError));
+        return;
+    }
+
+    sendMessage(msg.ackMessage());
+    CameraInfo info = m_recorder->cameraInfo();
+    QByteArray reply = m_deviceName + " " +
+            QByteArray::number(uint(info.pvCameraInfo.UniqueId)) + " " +
+            QByteArray::number(info.sensorWidth) + " " +
+            QByteArray::number(info.sensorHeight) + " " +
+            QByteArray::number(info.sensorBits);
+    sendMessage(msg.replyMessage(reply));
+}
+
+// get version
+//     returns: <server version>
+void SjcServer::dcpGetVersion(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(SJCAM_VERSION_STRING));
+}
+
+// get pvversion
+//     returns: <pvapi version>
+void SjcServer::dcpGetPvversion(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    sendMessage(msg.replyMessage(PvVersionString().toAscii()));
+}
 
-    // if we get this far the message is not a valid command
-    sendMessage(msg.ackMessage(Dcp::AckUnknownCommandError));
+// get verbose
+//     returns: ( true | false | debug )
+//     note: for debugging
+void SjcServer::dcpGetVerbose(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QByteArray verbosity = debug() ? "debug" :
+                           verbose() ? "true" : "false";
+    sendMessage(msg.replyMessage(verbosity));
+}
+
+// get clients
+//     returns: <client list>
+//     note: for debugging
+void SjcServer::dcpGetClients(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QList<QByteArray> clientList = m_clientMap.keys();
+    QByteArray clients;
+    if (!clientList.isEmpty())
+        clients = clientList.takeFirst();
+    foreach (const QByteArray &client, clientList)
+        clients += " " + client;
+    sendMessage(msg.replyMessage(clients));
+}
+
+// get connections
+//     returns: <stream socket connections>
+//     note: for debugging
+void SjcServer::dcpGetConnections(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+    QString connections = m_streamConnectionList.join(" ");
+    sendMessage(msg.replyMessage(connections.toAscii()));
+}
+
+// get pvattr <name>
+//     note: for debugging only!
+void SjcServer::dcpGetPvattr(const Dcp::Message &msg)
+{
+    sendMessage(msg.ackMessage());
+
+    QVariant value;
+    QList<QByteArray> args = m_command.arguments();
+    if (m_recorder->getAttribute(args[0], &value))
+        sendMessage(msg.replyMessage(value.toByteArray()));
+    else
+        sendMessage(msg.replyMessage(QByteArray(), 1));
 }
 
 void SjcServer::recorderFrameFinished(FrameInfo info)
 {
-    if (verbose())
+    if (debug())
     {
         switch (info.status)
         {
@@ -1287,30 +2878,75 @@ void SjcServer::recorderFrameFinished(FrameInfo info)
         cout.flush();
     }
 
+    // detect frames dropped by the camera from gaps in the frame counter,
+    // which rolls over at 65535
+    if (info.status != ePvErrCancelled) {
+        int count = int(info.count & 0xffff);
+        if (m_lastFrameCount >= 0) {
+            int gap = (count - m_lastFrameCount - 1) & 0xffff;
+            if (gap > 0 && gap < 0x8000) {
+                m_bufferTuner.framesDropped(gap);
+                serverMetrics.framesDropped.add(gap);
+            }
+        }
+        m_lastFrameCount = count;
+    }
+
     tPvFrame *frame = m_recorder->readFinishedFrame();
+    stampFrame(frame, FrameTrace::Dispatched);
     if (frame) {
-        QMetaObject::invokeMethod(m_imageStreamer, "processFrame",
+        serverMetrics.buffersInFlight.increment();
+        m_bufferTuner.frameDispatched(++m_buffersInFlight);
+    }
+    if (frame && m_burstRemaining > 0) {
+        // copy the frame to the burst buffer and return it to the recorder
+        // immediately, bypassing the streamer and the writer
+        if (frame->Status == ePvErrSuccess &&
+                m_burstPool.append(frame, m_recorder->clockModel()->utcTime(
+                                       PvFrameTicks(frame))))
+            --m_burstRemaining;
+        returnFrame(frame);
+        if (m_burstRemaining == 0 || m_burstPool.isFull())
+            finishBurst();
+    }
+    else if (frame) {
+        if (m_autoExposureEnabled && frame->Status == ePvErrSuccess)
+            applyAutoExposure(frame);
+        QMetaObject::invokeMethod(m_frameCalibrator, "processFrame",
                                   Q_ARG(tPvFrame *, frame));
     }
-    else if (verbose()) {
+    else if (debug()) {
         cout << "0";
         cout.flush();
     }
 
-    if (m_frameInfoLogFile)
-        writeFrameInfoLog(info);
+    m_frameInfoLog->append(info);
 }
 
 
 void SjcServer::recorderStarted()
 {
     cout << "Capturing started." << endl;
+    m_bufferTuner.reset();
+    m_lastFrameCount = -1;
+    m_exposureValue = 0;
+    m_bufferTuneTimer->start(1000);
+    m_statusReporter.reset();
+    m_pipelineStats.clear();
+    m_frameInfoLog->clearRecords();
+    invalidateStatus();
     sendNotification("set camerastate capturing");
 }
 
 void SjcServer::recorderStopped()
 {
     cout << "Capturing stopped." << endl;
+    m_bufferTuneTimer->stop();
+    if (m_burstRemaining > 0)
+        finishBurst();
+    if (m_pipelineStats.isTracing() && m_pipelineStats.finishTrace())
+        cout << "Pipeline trace written." << endl;
+    invalidateStatus();
     QByteArray state = (m_recorder->isCameraOpen()) ? "opened" : "closed";
     sendNotification("set camerastate " + state);
 }
@@ -1320,13 +2956,6 @@ void SjcServer::streamerConnectionListChanged(const QStringList &connections)
     m_streamConnectionList = connections;
 }
 
-void SjcServer::streamerThreadStarted()
-{
-    if (verbose())
-        cout << "Streaming server started [" << m_streamingPort << "]."
-             << endl;
-}
-
 void SjcServer::streamerThreadFinished()
 {
     if (verbose())
@@ -1334,6 +2963,45 @@ void SjcServer::streamerThreadFinished()
     m_streamConnectionList.clear();
 }
 
+void SjcServer::calibratorCalibrationChanged(bool enabled,
+                                             const QString &darkFileName,
+                                             const QString &flatFileName)
+{
+    m_calibrationEnabled = enabled;
+    m_darkFileName = darkFileName;
+    m_flatFileName = flatFileName;
+    QMetaObject::invokeMethod(m_imageWriter, "setCalibration",
+                              Q_ARG(QString, darkFileName),
+                              Q_ARG(QString, flatFileName));
+    sendNotification("set calibration " + calibrationState());
+}
+
+void SjcServer::calibratorDefectModeChanged(int mode,
+                                            const QString &fileName,
+                                            int numDefects)
+{
+    m_defectMode = mode;
+    m_defectFileName = fileName;
+    m_numDefects = numDefects;
+    QMetaObject::invokeMethod(m_imageWriter, "setDefectFile",
+                              Q_ARG(QString, fileName));
+    sendNotification("set defectcorrection " + defectState());
+}
+
+void SjcServer::trackerMotionMeasured(const MotionInfo &info)
+{
+    // the motion is measured on every frame and published per frame on the
+    // tracking port; DCP clients are only notified once per second or when
+    // the tracking status changes
+    bool statusChanged = info.status != m_lastMotion.status;
+    m_lastMotion = info;
+    if (!statusChanged && m_motionNotifyTimer.isValid() &&
+            m_motionNotifyTimer.elapsed() < 1000)
+        return;
+    m_motionNotifyTimer.start();
+    sendNotification("set motion " + motionString(info));
+}
+
 void SjcServer::writerFrameWritten(int n, int total, const QByteArray &fileId)
 {
     sendNotification("set framewritten " + QByteArray::number(n) + " " +
@@ -1342,13 +3010,13 @@ void SjcServer::writerFrameWritten(int n, int total, const QByteArray &fileId)
 
 void SjcServer::writerFrameFinished(tPvFrame *frame)
 {
-    m_recorder->enqueueFrame(frame);
+    returnFrame(frame);
 }
 
-void SjcServer::writerThreadStarted()
+void SjcServer::writerStoredFramesWritten()
 {
-    if (verbose())
-        cout << "Writer thread started." << endl;
+    m_burstWriting = false;
+    m_storedWriting = false;
 }
 
 void SjcServer::writerThreadFinished()
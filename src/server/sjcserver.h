@@ -29,6 +29,13 @@
 
 #include "cmdlineopts.h"
 #include "recorder.h"
+#include "motiontracker.h"
+#include "framestore.h"
+#include "pipelinestats.h"
+#include "statusreporter.h"
+#include "buffertuner.h"
+#include "autoexposure.h"
+#include "threadcontrol.h"
 #include <sjcdata.h>
 #include <dcpclient/dcpclient.h>
 #include <QtCore/QObject>
@@ -38,44 +45,170 @@
 #include <QtCore/QVariant>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QPair>
 #include <QtCore/QStringList>
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QPointF>
+#include <QtCore/QRect>
 #include <PvApi.h>
 
+class Camera;
 class ImageStreamer;
 class ImageWriter;
+class FrameCalibrator;
+class FrameInfoLog;
+class ServerContext;
 class QThread;
 class QTimer;
-class QFile;
+class QSettings;
 
 class SjcServer : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit SjcServer(const CmdLineOpts &opts, QObject *parent = 0);
+    enum ThreadType {
+        CaptureThread, MainThread, CalibratorThread, StreamerThread,
+        WriterThread, NumThreadTypes
+    };
+
+    SjcServer(const CmdLineOpts &opts, const QString &configFileName,
+              ServerContext *context, QObject *parent = 0);
     ~SjcServer();
 
+    void shutdown();
+    void setStatusReportEnabled(bool enable);
+    bool setFrameSource(Camera *camera);
+
+    quint16 streamingPort() const { return m_streamingPort; }
+    const PipelineStats & pipelineStats() const { return m_pipelineStats; }
+    void clearPipelineStats() { m_pipelineStats.clear(); }
+    static QString threadTypeName(ThreadType type);
+    qint64 threadCpuUsecs(ThreadType type) const;
+
 public slots:
     bool openCamera();
     bool closeCamera();
     void startCapturing();
     void stopCapturing();
+    void writeFrames(int count, int stepping = 1);
     void connectToDcpServer();
+    bool reloadConfig();
 
 protected:
+    ThreadHandle threadHandle(ThreadType type) const;
+    void applyThreadSettings();
+
+    bool isConfigFileReadable();
     void loadConfigFile();
-    bool verbose() { return m_verbose; }
+    void readCamAttrSection(QSettings &settings);
+    void readStreamingSection(QSettings &settings);
+    void readRecordingSection(QSettings &settings);
+    void readTrackingSection(QSettings &settings);
+    void readAutoExposureSection(QSettings &settings);
+    bool verbose() { return m_verbosity >= 1; }
+    bool debug() { return m_verbosity >= 2; }
     void sendMessage(const Dcp::Message &message);
     void sendNotification(const QByteArray &data);
-    void addClient(const QByteArray &deviceName);
+    void sendCameraNotifications();
+    void sendToClient(const QByteArray &deviceName, const QByteArray &data);
+    void addClient(const QByteArray &deviceName, bool batch = false);
     void removeClient(const QByteArray &deviceName);
-    bool createFrameInfoLogFile();
-    void writeFrameInfoLog(const FrameInfo &info);
+    void finishBurst();
+    QByteArray calibrationState() const;
+    QByteArray defectState() const;
+    QByteArray statusReply();
+    void invalidateStatus() { m_statusValid = false; }
+    bool startFrameInfoLog();
+    void stopFrameInfoLog();
+    void updateMarkerPos();
+    QByteArray motionString(const MotionInfo &info) const;
+    void applyAutoExposure(const tPvFrame *frame);
+    void returnFrame(tPvFrame *frame);
+
+    typedef void (SjcServer::*DcpHandler)(const Dcp::Message &msg);
+    struct DcpCommand
+    {
+        DcpHandler handler;
+        QList<QByteArray> argSpecs;
+        int minArgs;
+        bool acceptsArguments(const QList<QByteArray> &args) const;
+    };
+    void registerDcpCommands();
+    void addDcpCommand(const QByteArray &key, DcpHandler handler,
+                       const QByteArray &argSpec);
+
+    void dcpSetNop(const Dcp::Message &msg);
+    void dcpSetNotify(const Dcp::Message &msg);
+    void dcpSetCamera(const Dcp::Message &msg);
+    void dcpSetCapturing(const Dcp::Message &msg);
+    void dcpSetTriggermode(const Dcp::Message &msg);
+    void dcpSetExposure(const Dcp::Message &msg);
+    void dcpSetFramerate(const Dcp::Message &msg);
+    void dcpSetWriteframes(const Dcp::Message &msg);
+    void dcpSetPretrigger(const Dcp::Message &msg);
+    void dcpSetWritepretrigger(const Dcp::Message &msg);
+    void dcpSetSelectframes(const Dcp::Message &msg);
+    void dcpSetCoadd(const Dcp::Message &msg);
+    void dcpSetBurst(const Dcp::Message &msg);
+    void dcpSetCalibration(const Dcp::Message &msg);
+    void dcpSetMasterFile(const Dcp::Message &msg);
+    void dcpSetBuildMaster(const Dcp::Message &msg);
+    void dcpSetDefectcorrection(const Dcp::Message &msg);
+    void dcpSetDefectfile(const Dcp::Message &msg);
+    void dcpSetBuilddefects(const Dcp::Message &msg);
+    void dcpSetPipelinetrace(const Dcp::Message &msg);
+    void dcpSetTracking(const Dcp::Message &msg);
+    void dcpSetTrackingroi(const Dcp::Message &msg);
+    void dcpSetTrackingthreshold(const Dcp::Message &msg);
+    void dcpSetTrackingreference(const Dcp::Message &msg);
+    void dcpSetAutoexposure(const Dcp::Message &msg);
+    void dcpSetMarker(const Dcp::Message &msg);
+    void dcpSetLogframeinfo(const Dcp::Message &msg);
+    void dcpSetReload(const Dcp::Message &msg);
+    void dcpSetVerbose(const Dcp::Message &msg);
+    void dcpSetPvattr(const Dcp::Message &msg);
+    void dcpGetNotify(const Dcp::Message &msg);
+    void dcpGetStatus(const Dcp::Message &msg);
+    void dcpGetCamerastate(const Dcp::Message &msg);
+    void dcpGetTriggermode(const Dcp::Message &msg);
+    void dcpGetExposure(const Dcp::Message &msg);
+    void dcpGetExposureRange(const Dcp::Message &msg);
+    void dcpGetFramerate(const Dcp::Message &msg);
+    void dcpGetFramerateRange(const Dcp::Message &msg);
+    void dcpGetFramestats(const Dcp::Message &msg);
+    void dcpGetNetwork(const Dcp::Message &msg);
+    void dcpGetMarker(const Dcp::Message &msg);
+    void dcpGetPretrigger(const Dcp::Message &msg);
+    void dcpGetSelectframes(const Dcp::Message &msg);
+    void dcpGetCoadd(const Dcp::Message &msg);
+    void dcpGetBurst(const Dcp::Message &msg);
+    void dcpGetCalibration(const Dcp::Message &msg);
+    void dcpGetDefectcorrection(const Dcp::Message &msg);
+    void dcpGetTracking(const Dcp::Message &msg);
+    void dcpGetMotion(const Dcp::Message &msg);
+    void dcpGetAutoexposure(const Dcp::Message &msg);
+    void dcpGetLogframeinfo(const Dcp::Message &msg);
+    void dcpGetPipelinestats(const Dcp::Message &msg);
+    void dcpGetClockmodel(const Dcp::Message &msg);
+    void dcpGetThreads(const Dcp::Message &msg);
+    void dcpGetFrameinfo(const Dcp::Message &msg);
+    void dcpGetStreaminghost(const Dcp::Message &msg);
+    void dcpGetCamerainfo(const Dcp::Message &msg);
+    void dcpGetVersion(const Dcp::Message &msg);
+    void dcpGetPvversion(const Dcp::Message &msg);
+    void dcpGetVerbose(const Dcp::Message &msg);
+    void dcpGetClients(const Dcp::Message &msg);
+    void dcpGetConnections(const Dcp::Message &msg);
+    void dcpGetPvattr(const Dcp::Message &msg);
 
 protected slots:
     void updateClientMap();
+    void flushNotifications();
+    void printStatus();
+    void tuneBuffers();
 
     void printInfo(const QString &infoString);
     void printError(const QString &errorString);
@@ -89,45 +222,120 @@ protected slots:
     void recorderStopped();
 
     void streamerConnectionListChanged(const QStringList &connections);
-    void streamerThreadStarted();
     void streamerThreadFinished();
 
+    void calibratorCalibrationChanged(bool enabled,
+                                      const QString &darkFileName,
+                                      const QString &flatFileName);
+    void calibratorDefectModeChanged(int mode, const QString &fileName,
+                                     int numDefects);
+
+    void trackerMotionMeasured(const MotionInfo &info);
+
     void writerFrameWritten(int n, int total, const QByteArray &fileId);
     void writerFrameFinished(tPvFrame *frame);
-    void writerThreadStarted();
+    void writerStoredFramesWritten();
     void writerThreadFinished();
 
 private:
     Q_DISABLE_COPY(SjcServer)
     QTextStream cout;
+    ServerContext * const m_context;
     Recorder * const m_recorder;
     ImageStreamer * const m_imageStreamer;
     QThread * const m_imageStreamerThread;
+    FrameCalibrator * const m_frameCalibrator;
+    QThread * const m_frameCalibratorThread;
+    MotionTracker * const m_motionTracker;
     ImageWriter * const m_imageWriter;
     QThread * const m_imageWriterThread;
+    FrameInfoLog * const m_frameInfoLog;
+    QThread * const m_frameInfoLogThread;
     Dcp::Client * const m_dcp;
     Dcp::CommandParser m_command;
+    QHash<QByteArray, DcpCommand> m_dcpCommands;
     QStringList m_streamConnectionList;
     QMap<QByteArray, QElapsedTimer> m_clientMap;
+    QSet<QByteArray> m_batchClients;
+    QList<QPair<QByteArray, QByteArray> > m_pendingNotifications;
     int m_clientTimeout;
     QTimer *m_updateClientMapTimer;
+    QTimer *m_notifyTimer;
+    int m_notifyDelay;
+    QTimer *m_statusTimer;
+    int m_statusInterval;
+    StatusReporter m_statusReporter;
     QString m_serverName;
     quint16 m_serverPort;
     QByteArray m_deviceName;
     QString m_outputFileNamePrefix;
     QString m_outputDirectory;
     QByteArray m_telescopeName;
+    int m_preTriggerFrames;
+    double m_preTriggerSeconds;
+    bool m_preTriggerCompressed;
+    int m_selectKeep;
+    int m_selectWindow;
+    QByteArray m_selectMetric;
+    int m_coaddFrames;
+    bool m_coaddAverage;
+    FramePool m_burstPool;
+    int m_burstMemory;
+    int m_burstRemaining;
+    bool m_burstWriting;
+    bool m_storedWriting;
+    bool m_calibrationEnabled;
+    QString m_calibrationDirectory;
+    QString m_darkFileName;
+    QString m_flatFileName;
+    int m_defectMode;
+    QString m_defectFileName;
+    double m_defectThreshold;
+    int m_numDefects;
+    int m_trackingMode;
+    QRect m_trackingRoi;
+    double m_trackingThreshold;
+    int m_trackingMaxShift;
+    quint16 m_trackingPort;
+    MotionInfo m_lastMotion;
+    QElapsedTimer m_motionNotifyTimer;
+    AutoExposure m_autoExposure;
+    bool m_autoExposureEnabled;
+    quint32 m_autoExposureMin;
+    quint32 m_autoExposureMax;
+    quint32 m_exposureValue;
+    quint32 m_exposureMin;
+    quint32 m_exposureMax;
     ulong m_cameraId;
+    QString m_replayPath;
+    double m_replaySpeed;
+    bool m_replayLoop;
     int m_numBuffers;
+    bool m_adaptiveBuffers;
+    BufferTuner m_bufferTuner;
+    QTimer *m_bufferTuneTimer;
+    int m_buffersToRelease;
+    int m_buffersInFlight;
+    quint32 m_maxPacketSize;
+    qint64 m_bandwidthBudget;
+    int m_bandwidthShares;
+    ThreadSettings m_threadSettings[NumThreadTypes];
+    int m_lastFrameCount;
     quint16 m_streamingPort;
+    QString m_metricsAddress;
+    quint16 m_metricsPort;
     QString m_configFileName;
     QList<NamedValue> m_camAttrList;
-    bool m_verbose;
+    int m_verbosity;
     bool m_markerEnabled;
     bool m_markerCentering;
     QPointF m_markerPos;
+    QByteArray m_status;
+    bool m_statusValid;
     QString m_frameInfoDirPath;
-    QFile *m_frameInfoLogFile;
+    bool m_frameInfoLogEnabled;
+    bool m_shutdown;
+    PipelineStats m_pipelineStats;
 };
 
 #endif // SJCAM_SJCSERVER_H
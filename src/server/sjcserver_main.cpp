@@ -25,10 +25,13 @@
  */
 
 #include "sjcserver.h"
+#include "servercontext.h"
 #include "cmdlineopts.h"
 #include "version.h"
 #include "pvutils.h"
 #include "recorder.h"
+#include "framestore.h"
+#include "defectmap.h"
 #include <QtCore/QtCore>
 #include <csignal>
 
@@ -46,6 +49,9 @@ int main(int argc, char **argv)
     qRegisterMetaType<tPvFrame *>("tPvFrame *");
     qRegisterMetaType<CameraInfo>("CameraInfo");
     qRegisterMetaType<FrameInfo>("FrameInfo");
+    qRegisterMetaType<MotionInfo>("MotionInfo");
+    qRegisterMetaType<StoredFrameList>("StoredFrameList");
+    qRegisterMetaType<DefectMap>("DefectMap");
 
     // use custom signal handler for SIGINT and SIGTERM to perform a clean
     // shutdown on CTRL+C or 'kill -15'
@@ -64,7 +70,8 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    SjcServer server(opts);
+    // PvApi and the worker threads are shared by all cameras
+    ServerContext context(opts.configFileNames.size());
 
     if (opts.list || opts.info)
     {
@@ -113,9 +120,27 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    QTimer::singleShot(0, &server, SLOT(connectToDcpServer()));
-    if (server.openCamera())
-        QTimer::singleShot(0, &server, SLOT(startCapturing()));
+    // create one server for each config file; the metrics are collected for
+    // the whole process, so only the first server prints status reports
+    QList<SjcServer *> servers;
+    if (opts.configFileNames.isEmpty())
+        servers.append(new SjcServer(opts, QString(), &context));
+    foreach (const QString &configFileName, opts.configFileNames)
+        servers.append(new SjcServer(opts, configFileName, &context));
+    for (int i = 1; i < servers.size(); ++i)
+        servers[i]->setStatusReportEnabled(false);
+
+    foreach (SjcServer *server, servers) {
+        QTimer::singleShot(0, server, SLOT(connectToDcpServer()));
+        if (server->openCamera())
+            QTimer::singleShot(0, server, SLOT(startCapturing()));
+    }
+
+    int result = app.exec();
 
-    return app.exec();
+    foreach (SjcServer *server, servers)
+        server->shutdown();
+    context.stopThreads();
+    qDeleteAll(servers);
+    return result;
 }
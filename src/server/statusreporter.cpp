@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "statusreporter.h"
+#include "pvutils.h"
+#include <QtCore/QtCore>
+
+StatusReporter::StatusReporter()
+{
+    reset();
+}
+
+void StatusReporter::reset()
+{
+    takeSnapshot(&m_last);
+    m_timer.start();
+}
+
+QString StatusReporter::report()
+{
+    Snapshot current;
+    takeSnapshot(&current);
+    const double secs = qMax(m_timer.restart(), qint64(1)) / 1000.0;
+
+    // frame counts by status, e.g. "Success 98, DataLost 2"
+    qint64 numFrames = 0;
+    QStringList statusCounts;
+    for (int i = 0; i <= ServerMetrics::NumFrameStatus; ++i) {
+        qint64 n = current.frames[i] - m_last.frames[i];
+        if (n == 0)
+            continue;
+        numFrames += n;
+        QString name = (i < ServerMetrics::NumFrameStatus) ?
+                    PvErrorCodeString(tPvErr(i)).mid(6) : QString("Other");
+        statusCounts << QString("%1 %2").arg(name).arg(n);
+    }
+    if (statusCounts.isEmpty())
+        statusCounts << "none";
+
+    const qint64 numBuffers = serverMetrics.buffers.value();
+    const qint64 inFlight = serverMetrics.buffersInFlight.value();
+    const double mb = 1024.0 * 1024.0;
+
+    QString result = QString("Status: %1 fps [%2], buffers %3/%4 in use, "
+                             "stream %5 clients %6 img/s %7 MB/s, "
+                             "writer %8 files/s %9 MB/s.")
+            .arg(numFrames / secs, 0, 'f', 2)
+            .arg(statusCounts.join(", "))
+            .arg(inFlight).arg(numBuffers)
+            .arg(serverMetrics.streamClients.value())
+            .arg((current.streamImages - m_last.streamImages) / secs, 0, 'f', 1)
+            .arg((current.streamBytes - m_last.streamBytes) / mb / secs,
+                 0, 'f', 2)
+            .arg((current.writerFiles - m_last.writerFiles) / secs, 0, 'f', 1)
+            .arg((current.writerBytes - m_last.writerBytes) / mb / secs,
+                 0, 'f', 2);
+
+    m_last = current;
+    return result;
+}
+
+void StatusReporter::takeSnapshot(Snapshot *snapshot) const
+{
+    for (int i = 0; i < ServerMetrics::NumFrameStatus; ++i)
+        snapshot->frames[i] = serverMetrics.framesByStatus[i].value();
+    snapshot->frames[ServerMetrics::NumFrameStatus] =
+            serverMetrics.framesOtherStatus.value();
+    snapshot->streamImages = serverMetrics.streamImagesSent.value();
+    snapshot->streamBytes = serverMetrics.streamBytesSent.value();
+    snapshot->writerFiles = serverMetrics.writerFiles.value();
+    snapshot->writerBytes = serverMetrics.writerBytes.value();
+}
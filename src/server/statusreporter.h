@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_STATUSREPORTER_H
+#define SJCAM_STATUSREPORTER_H
+
+#include "metrics.h"
+#include <QtCore/QString>
+#include <QtCore/QElapsedTimer>
+
+// Creates one-line summaries of the server metrics. Each call of report()
+// describes the interval since the previous call.
+class StatusReporter
+{
+public:
+    StatusReporter();
+
+    void reset();
+    QString report();
+
+private:
+    struct Snapshot {
+        qint64 frames[ServerMetrics::NumFrameStatus + 1];
+        qint64 streamImages;
+        qint64 streamBytes;
+        qint64 writerFiles;
+        qint64 writerBytes;
+    };
+
+    void takeSnapshot(Snapshot *snapshot) const;
+
+    Snapshot m_last;
+    QElapsedTimer m_timer;
+};
+
+#endif // SJCAM_STATUSREPORTER_H
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "syntheticcamera.h"
+#include "pvutils.h"
+#include "frameops.h"
+#include <QtCore/QtCore>
+#include <cmath>
+
+namespace {
+
+// number of different frames, the disk moves by a few pixels between them
+const int NumFrames = 4;
+const int ShiftX[NumFrames] = { 0, 3, 1, -2 };
+const int ShiftY[NumFrames] = { 0, -1, 2, 1 };
+
+} // namespace
+
+SyntheticCamera::SyntheticCamera(uint width, uint height, uint bitDepth)
+    : EmulatedCamera(0.0f, 10000.0f),
+      m_width(width),
+      m_height(height),
+      m_bitDepth(bitDepth),
+      m_capturing(false),
+      m_outputFormat(ePvFmtMono16),
+      m_frameBitDepth(0),
+      m_acquisitionUsecs(0),
+      m_startUsecs(0),
+      m_periodUsecs(0),
+      m_frameIndex(0),
+      m_completed(0),
+      m_dropped(0)
+{
+}
+
+SyntheticCamera::~SyntheticCamera()
+{
+    close();
+}
+
+bool SyntheticCamera::open(ulong cameraId)
+{
+    Q_UNUSED(cameraId);
+    clearError();
+    if (isOpen())
+        close();
+
+    if (m_width == 0 || m_height == 0 || m_bitDepth < 8 || m_bitDepth > 16) {
+        setError("Invalid size or bit depth of the synthetic frames.");
+        return false;
+    }
+
+    setInfo("Synthetic", "Synthetic", m_width, m_height, m_bitDepth);
+    m_open = true;
+    resetConfig();
+    return true;
+}
+
+void SyntheticCamera::close()
+{
+    if (!m_open)
+        return;
+    stopCapturing();
+    clearFrameQueue();
+    m_attributes.clear();
+    m_frames.clear();
+    clearInfo();
+    m_open = false;
+}
+
+bool SyntheticCamera::resetConfig()
+{
+    EmulatedCamera::resetConfig();
+    m_outputFormat = ePvFmtMono16;
+    m_frames.clear();
+    return true;
+}
+
+bool SyntheticCamera::startCapturing()
+{
+    if (!m_open) {
+        setError("Cannot start capturing.");
+        return false;
+    }
+    m_capturing = true;
+    return true;
+}
+
+bool SyntheticCamera::stopCapturing()
+{
+    m_capturing = false;
+    return true;
+}
+
+bool SyntheticCamera::enqueueFrame(tPvFrame *frame)
+{
+    if (!m_capturing) {
+        setError("Cannot enqueue frame.");
+        return false;
+    }
+    m_frameQueue.enqueue(frame);
+    m_enqueueUsecs.enqueue(monotonicUsecs());
+    return true;
+}
+
+bool SyntheticCamera::clearFrameQueue()
+{
+    while (!m_frameQueue.isEmpty())
+        m_frameQueue.dequeue()->Status = ePvErrCancelled;
+    m_enqueueUsecs.clear();
+    return true;
+}
+
+bool SyntheticCamera::startAcqusition()
+{
+    if (m_frames.isEmpty())
+        renderFrames();
+    m_acquisitionUsecs = monotonicUsecs();
+    m_frameIndex = 0;
+    m_completed = 0;
+    m_dropped = 0;
+    updateTiming(m_attributes.value("FrameRate").toFloat());
+    return true;
+}
+
+bool SyntheticCamera::stopAcquisition()
+{
+    return true;
+}
+
+bool SyntheticCamera::waitForFrameDone(tPvFrame *frame, ulong timeout,
+                                       bool *timedOut)
+{
+    if (timedOut)
+        *timedOut = false;
+    if (m_frameQueue.isEmpty() || m_frameQueue.head() != frame) {
+        setError("Failed to wait for frame, the frame is not queued.");
+        return false;
+    }
+
+    const qint64 now = monotonicUsecs();
+    qint64 due = now;
+    if (m_periodUsecs > 0) {
+        // the frames which were due before the buffer was queued are lost
+        due = m_startUsecs + qint64(m_frameIndex) * m_periodUsecs;
+        const qint64 queued = m_enqueueUsecs.head();
+        if (due < queued) {
+            const qint64 lost = (queued - due + m_periodUsecs - 1)
+                    / m_periodUsecs;
+            m_frameIndex += quint64(lost);
+            m_dropped += uint(lost);
+            due += lost * m_periodUsecs;
+        }
+
+        const qint64 waitUsecs = due - now;
+        if (waitUsecs > 1000 * qint64(timeout)) {
+            pvmsleep(uint(timeout));
+            setError("Failed to wait for frame, timeout.");
+            if (timedOut)
+                *timedOut = true;
+            return false;
+        }
+        if (waitUsecs >= 1000)
+            pvmsleep(uint(waitUsecs / 1000));
+    }
+    m_frameQueue.dequeue();
+    m_enqueueUsecs.dequeue();
+
+    // the pixel format may have been changed since the acquisition started
+    if (m_frames.isEmpty())
+        renderFrames();
+    const QByteArray &data = m_frames[int(m_frameIndex % NumFrames)];
+    const ulong size = ulong(data.size());
+    frame->FrameCount = ulong((m_frameIndex + 1) & 0xffff);
+    ++m_frameIndex;
+    if (size > frame->ImageBufferSize) {
+        frame->Status = ePvErrDataLost;
+        frame->ImageSize = 0;
+        return true;
+    }
+    qMemCopy(frame->ImageBuffer, data.constData(), size);
+    frame->ImageSize = size;
+    frame->Width = m_sensorWidth;
+    frame->Height = m_sensorHeight;
+    frame->RegionX = 0;
+    frame->RegionY = 0;
+    frame->Format = tPvImageFormat(m_outputFormat);
+    frame->BitDepth = m_frameBitDepth;
+
+    // the camera latches the time stamp at the start of the exposure
+    const quint32 exposure = m_attributes.value("ExposureValue").toUInt();
+    const quint64 ticks = quint64(qMax(due - exposure, qint64(0)));
+    frame->TimestampLo = ulong(ticks & 0xffffffff);
+    frame->TimestampHi = ulong(ticks >> 32);
+    if (frame->AncillaryBuffer && frame->AncillaryBufferSize >= 12) {
+        qMemSet(frame->AncillaryBuffer, 0, frame->AncillaryBufferSize);
+        quint32 *buf = reinterpret_cast<quint32 *>(frame->AncillaryBuffer);
+        buf[2] = qToBigEndian(exposure);
+        frame->AncillarySize = frame->AncillaryBufferSize;
+    }
+    frame->Status = ePvErrSuccess;
+    ++m_completed;
+    return true;
+}
+
+// Frame rate changes take effect with the next frame.
+void SyntheticCamera::updateTiming(float frameRate)
+{
+    m_periodUsecs = (frameRate > 0) ? qint64(1e6 / frameRate + 0.5) : 0;
+    m_startUsecs = monotonicUsecs() - qint64(m_frameIndex) * m_periodUsecs;
+}
+
+bool SyntheticCamera::applyAttribute(const QByteArray &name,
+                                     const QVariant &value)
+{
+    if (name == "PixelFormat") {
+        const QByteArray format = value.toByteArray();
+        ulong outputFormat;
+        if (format == "Mono8")
+            outputFormat = ePvFmtMono8;
+        else if (format == "Mono16")
+            outputFormat = ePvFmtMono16;
+        else if (format == "Mono12Packed")
+            outputFormat = ePvFmtMono12Packed;
+        else {
+            setError("Synthetic frames support only the pixel formats "
+                     "Mono8, Mono16 and Mono12Packed.");
+            return false;
+        }
+        if (outputFormat != m_outputFormat) {
+            m_outputFormat = outputFormat;
+            m_frames.clear();
+        }
+    }
+    else if (name == "FrameRate") {
+        if (value.toFloat() < 0) {
+            setError(QString("Invalid value for attribute %1.")
+                     .arg(QString(name)));
+            return false;
+        }
+        updateTiming(value.toFloat());
+    }
+    return true;
+}
+
+bool SyntheticCamera::getFrameStats(float &fps, uint &completed,
+                                    uint &dropped)
+{
+    const qint64 elapsed = monotonicUsecs() - m_acquisitionUsecs;
+    fps = (m_capturing && elapsed > 0) ? float(1e6 * m_completed / elapsed)
+                                       : 0;
+    completed = m_completed;
+    dropped = m_dropped;
+    return true;
+}
+
+QString SyntheticCamera::infoString() const
+{
+    QString result;
+    QTextStream ts(&result);
+    ts << "Synthetic camera infos:"
+       << "\n    Sensor ............ " << m_sensorWidth << "x"
+                                       << m_sensorHeight << "@"
+                                       << m_sensorBits
+       << "\n    PixelFormat ....... "
+                   << m_attributes.value("PixelFormat").toByteArray()
+       << "\n    FrameRate ......... "
+                   << m_attributes.value("FrameRate").toFloat();
+    return result;
+}
+
+// Renders a limb-darkened disk with 5% multiplicative noise on a dark
+// background, scaled to the bit depth of the sensor.
+void SyntheticCamera::renderFrames()
+{
+    const int width = int(m_sensorWidth);
+    const int height = int(m_sensorHeight);
+    const int count = width * height;
+    const int maxValue = (1 << m_sensorBits) - 1;
+    const double radius = 0.4 * qMin(width, height);
+    QVector<quint16> values(count);
+    quint32 seed = 12345;
+
+    int shift;
+    if (m_outputFormat == ePvFmtMono8)
+        shift = qMax(int(m_sensorBits) - 8, 0);
+    else if (m_outputFormat == ePvFmtMono12Packed)
+        shift = qMax(int(m_sensorBits) - 12, 0);
+    else
+        shift = 0;
+    m_frameBitDepth = m_sensorBits - uint(shift);
+
+    m_frames.resize(NumFrames);
+    for (int n = 0; n < NumFrames; ++n) {
+        const double cx = 0.5 * (width - 1) + ShiftX[n];
+        const double cy = 0.5 * (height - 1) + ShiftY[n];
+        for (int y = 0; y < height; ++y) {
+            quint16 *line = values.data() + y * width;
+            const double dy2 = (y - cy) * (y - cy);
+            for (int x = 0; x < width; ++x) {
+                const double r2 = ((x - cx) * (x - cx) + dy2)
+                        / (radius * radius);
+                double intensity = (r2 < 1) ? 0.3 + 0.6 * std::sqrt(1 - r2)
+                                            : 0.02;
+                seed = seed * 1664525u + 1013904223u;
+                intensity *= 0.95 + 0.1 * (seed >> 16) / 65536.0;
+                line[x] = quint16(qBound(0, int(intensity * maxValue),
+                                         maxValue) >> shift);
+            }
+        }
+
+        QByteArray &data = m_frames[n];
+        if (m_outputFormat == ePvFmtMono8) {
+            data.resize(count);
+            uchar *dest = reinterpret_cast<uchar *>(data.data());
+            for (int i = 0; i < count; ++i)
+                dest[i] = uchar(values[i]);
+        }
+        else if (m_outputFormat == ePvFmtMono12Packed) {
+            data.resize(mono12PackedSize(count));
+            uchar *dest = reinterpret_cast<uchar *>(data.data());
+            for (int i = 0; i + 1 < count; i += 2, dest += 3) {
+                const quint16 a = values[i], b = values[i + 1];
+                dest[0] = uchar(a >> 4);
+                dest[1] = uchar((a & 0x0f) | ((b & 0x0f) << 4));
+                dest[2] = uchar(b >> 4);
+            }
+            if (count % 2 != 0) {
+                dest[0] = uchar(values[count - 1] >> 4);
+                dest[1] = uchar(values[count - 1] & 0x0f);
+            }
+        }
+        else {
+            data.resize(2 * count);
+            qMemCopy(data.data(), values.constData(), 2 * count);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_SYNTHETICCAMERA_H
+#define SJCAM_SYNTHETICCAMERA_H
+
+#include "emulatedcamera.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QQueue>
+#include <QtCore/QVector>
+
+// Generates frames of a solar disk with noise in place of a camera, for
+// benchmarks of the pipeline without hardware. A few frames with slightly
+// shifted disks are rendered when the acquisition starts and are copied to
+// the buffers in turn. Like a free-running camera the frames are produced
+// at the FrameRate attribute, frames which are due while no buffer is
+// queued are lost and counted as dropped; a frame rate of 0 produces frames
+// as fast as buffers are queued. The PixelFormat attribute selects Mono8,
+// Mono16 or Mono12Packed output, the other attributes are only emulated.
+class SyntheticCamera : public EmulatedCamera
+{
+public:
+    SyntheticCamera(uint width, uint height, uint bitDepth);
+    ~SyntheticCamera();
+
+    bool open(ulong cameraId = 0);
+    void close();
+    bool resetConfig();
+
+    bool startCapturing();
+    bool stopCapturing();
+    bool isCapturing() const { return m_capturing; }
+    bool enqueueFrame(tPvFrame *frame);
+    bool clearFrameQueue();
+    bool startAcqusition();
+    bool stopAcquisition();
+    bool waitForFrameDone(tPvFrame *frame, ulong timeout, bool *timedOut);
+
+    bool getFrameStats(float &fps, uint &completed, uint &dropped);
+
+    QString infoString() const;
+
+protected:
+    bool applyAttribute(const QByteArray &name, const QVariant &value);
+    void renderFrames();
+    void updateTiming(float frameRate);
+
+private:
+    Q_DISABLE_COPY(SyntheticCamera)
+    const uint m_width;
+    const uint m_height;
+    const uint m_bitDepth;
+    bool m_capturing;
+    ulong m_outputFormat;
+    QVector<QByteArray> m_frames;
+    uint m_frameBitDepth;
+    QQueue<tPvFrame *> m_frameQueue;
+    QQueue<qint64> m_enqueueUsecs;
+
+    // timing of the current acquisition
+    qint64 m_acquisitionUsecs;
+    qint64 m_startUsecs;
+    qint64 m_periodUsecs;
+    quint64 m_frameIndex;
+    uint m_completed;
+    uint m_dropped;
+};
+
+#endif // SJCAM_SYNTHETICCAMERA_H
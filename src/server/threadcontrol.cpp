@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "threadcontrol.h"
+#include <QtCore/QStringList>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#endif
+
+bool schedPolicyFromName(const QByteArray &name, SchedPolicy *policy)
+{
+    Q_ASSERT(policy);
+    QByteArray lname = name.toLower();
+    if (lname == "other" || lname.isEmpty())
+        *policy = SchedOther;
+    else if (lname == "fifo")
+        *policy = SchedFifo;
+    else if (lname == "rr")
+        *policy = SchedRoundRobin;
+    else
+        return false;
+    return true;
+}
+
+QByteArray schedPolicyName(SchedPolicy policy)
+{
+    switch (policy) {
+    case SchedFifo: return "fifo";
+    case SchedRoundRobin: return "rr";
+    default: return "other";
+    }
+}
+
+bool parseCpuList(const QString &str, QList<int> *cpus)
+{
+    Q_ASSERT(cpus);
+    cpus->clear();
+    foreach (const QString &item, str.split(',', QString::SkipEmptyParts)) {
+        QStringList range = item.trimmed().split('-');
+        bool ok1, ok2 = true;
+        int first = range[0].toInt(&ok1);
+        int last = (range.size() == 2) ? range[1].toInt(&ok2) : first;
+        if (!ok1 || !ok2 || range.size() > 2 || first < 0 || last < first) {
+            cpus->clear();
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            if (!cpus->contains(cpu))
+                cpus->append(cpu);
+    }
+    return true;
+}
+
+#ifdef _WIN32
+ThreadHandle ThreadHandle::current()
+{
+    ThreadHandle handle;
+    handle.m_threadId = GetCurrentThreadId();
+    handle.m_valid = true;
+    return handle;
+}
+
+bool ThreadHandle::apply(const ThreadSettings &settings,
+                         QString *errorString) const
+{
+    HANDLE thread = m_valid ? OpenThread(THREAD_SET_INFORMATION |
+                                         THREAD_QUERY_INFORMATION, FALSE,
+                                         m_threadId) : 0;
+    if (!thread) {
+        *errorString = "Cannot access thread.";
+        return false;
+    }
+
+    QStringList errors;
+    if (!settings.cpus.isEmpty()) {
+        DWORD_PTR mask = 0;
+        foreach (int cpu, settings.cpus)
+            if (cpu < int(8 * sizeof(mask)))
+                mask |= DWORD_PTR(1) << cpu;
+        if (!SetThreadAffinityMask(thread, mask))
+            errors << "Cannot set CPU affinity.";
+    }
+
+    // there are no real-time policies, use the highest thread priority
+    int priority = (settings.policy == SchedOther) ?
+                THREAD_PRIORITY_NORMAL : THREAD_PRIORITY_TIME_CRITICAL;
+    if (!SetThreadPriority(thread, priority))
+        errors << "Cannot set thread priority.";
+
+    CloseHandle(thread);
+    *errorString = errors.join(" ");
+    return errors.isEmpty();
+}
+
+qint64 ThreadHandle::cpuUsecs() const
+{
+    HANDLE thread = m_valid ? OpenThread(THREAD_QUERY_INFORMATION, FALSE,
+                                         m_threadId) : 0;
+    if (!thread)
+        return -1;
+    FILETIME creation, exit, kernel, user;
+    BOOL ok = GetThreadTimes(thread, &creation, &exit, &kernel, &user);
+    CloseHandle(thread);
+    if (!ok)
+        return -1;
+    quint64 k = (quint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    quint64 u = (quint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return qint64((k + u) / 10);  // 100 ns units
+}
+#else
+ThreadHandle ThreadHandle::current()
+{
+    ThreadHandle handle;
+    handle.m_thread = pthread_self();
+    handle.m_valid = true;
+    return handle;
+}
+
+bool ThreadHandle::apply(const ThreadSettings &settings,
+                         QString *errorString) const
+{
+    if (!m_valid) {
+        *errorString = "Cannot access thread.";
+        return false;
+    }
+
+    QStringList errors;
+    if (!settings.cpus.isEmpty()) {
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        foreach (int cpu, settings.cpus)
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &cpuSet);
+        int err = pthread_setaffinity_np(m_thread, sizeof(cpuSet), &cpuSet);
+        if (err != 0)
+            errors << QString("Cannot set CPU affinity: %1.")
+                      .arg(strerror(err));
+#else
+        errors << "CPU affinity is not supported on this platform.";
+#endif
+    }
+
+    int policy = SCHED_OTHER;
+    if (settings.policy == SchedFifo)
+        policy = SCHED_FIFO;
+    else if (settings.policy == SchedRoundRobin)
+        policy = SCHED_RR;
+    sched_param param;
+    param.sched_priority = 0;
+    if (policy != SCHED_OTHER)
+        param.sched_priority = qBound(sched_get_priority_min(policy),
+                                      settings.priority,
+                                      sched_get_priority_max(policy));
+    int err = pthread_setschedparam(m_thread, policy, &param);
+    if (err != 0)
+        errors << QString("Cannot set %1 scheduling: %2.")
+                  .arg(QString(schedPolicyName(settings.policy)))
+                  .arg(strerror(err));
+
+    *errorString = errors.join(" ");
+    return errors.isEmpty();
+}
+
+qint64 ThreadHandle::cpuUsecs() const
+{
+    clockid_t clockId;
+    timespec t;
+    if (!m_valid || pthread_getcpuclockid(m_thread, &clockId) != 0 ||
+            clock_gettime(clockId, &t) != 0)
+        return -1;
+    return qint64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+#endif
+
+WorkerThread::WorkerThread(QObject *parent)
+    : QThread(parent)
+{
+}
+
+// Returns the handle of the running thread, waiting for it if the thread
+// was just started.
+ThreadHandle WorkerThread::handle() const
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_handle.isValid() && isRunning())
+        m_handleSet.wait(&m_mutex, 100);
+    return m_handle;
+}
+
+void WorkerThread::run()
+{
+    m_mutex.lock();
+    m_handle = ThreadHandle::current();
+    m_handleSet.wakeAll();
+    m_mutex.unlock();
+
+    exec();
+
+    m_mutex.lock();
+    m_handle = ThreadHandle();
+    m_mutex.unlock();
+}
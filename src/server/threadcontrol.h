@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012 Kolja Glogowski
+ * Kiepenheuer-Institut fuer Sonnenphysik
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SJCAM_THREADCONTROL_H
+#define SJCAM_THREADCONTROL_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+enum SchedPolicy { SchedOther, SchedFifo, SchedRoundRobin };
+
+bool schedPolicyFromName(const QByteArray &name, SchedPolicy *policy);
+QByteArray schedPolicyName(SchedPolicy policy);
+
+// Parses CPU lists like "0,2-3"; an empty string results in an empty list.
+bool parseCpuList(const QString &str, QList<int> *cpus);
+
+// CPU affinity and scheduling of a thread; an empty CPU list and SchedOther
+// leave the defaults of the operating system unchanged.
+struct ThreadSettings
+{
+    ThreadSettings() : policy(SchedOther), priority(0) {}
+    bool isDefault() const { return cpus.isEmpty() && policy == SchedOther; }
+
+    QList<int> cpus;
+    SchedPolicy policy;
+    int priority;
+};
+
+inline bool operator==(const ThreadSettings &a, const ThreadSettings &b)
+{
+    return a.cpus == b.cpus && a.policy == b.policy &&
+           a.priority == b.priority;
+}
+
+inline bool operator!=(const ThreadSettings &a, const ThreadSettings &b)
+{
+    return !(a == b);
+}
+
+// Identifies a running thread, so that its settings and its CPU time can
+// be accessed from other threads. The handle becomes invalid when the thread
+// terminates.
+class ThreadHandle
+{
+public:
+    ThreadHandle() : m_valid(false) {}
+    static ThreadHandle current();
+
+    bool isValid() const { return m_valid; }
+    bool apply(const ThreadSettings &settings, QString *errorString) const;
+    qint64 cpuUsecs() const;
+
+private:
+#ifdef _WIN32
+    ulong m_threadId;
+#else
+    pthread_t m_thread;
+#endif
+    bool m_valid;
+};
+
+// Event loop thread which publishes its handle.
+class WorkerThread : public QThread
+{
+public:
+    explicit WorkerThread(QObject *parent = 0);
+    ThreadHandle handle() const;
+
+protected:
+    void run();
+
+private:
+    Q_DISABLE_COPY(WorkerThread)
+    mutable QMutex m_mutex;
+    mutable QWaitCondition m_handleSet;
+    ThreadHandle m_handle;
+};
+
+#endif // SJCAM_THREADCONTROL_H